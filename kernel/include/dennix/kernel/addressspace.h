@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,8 +23,12 @@
 #include <dennix/mman.h>
 #include <dennix/kernel/kthread.h>
 #include <dennix/kernel/memorysegment.h>
+#include <dennix/kernel/vnode.h>
 
 #define PROT_WRITE_COMBINING (1 << 17)
+#define PROT_COPY_ON_WRITE (1 << 18)
+// The frame belongs to a page cache and is not owned by the address space.
+#define PROT_CACHE_FRAME (1 << 20)
 
 class AddressSpace : public ConstructorMayFail {
 public:
@@ -36,8 +40,11 @@ public:
     void activate();
     AddressSpace* fork();
     paddr_t getPhysicalAddress(vaddr_t virtualAddress);
+    int handlePageFault(vaddr_t address, bool write);
     vaddr_t mapAt(vaddr_t virtualAddress, paddr_t physicalAddress,
             int protection);
+    vaddr_t mapFile(vaddr_t virtualAddress, size_t size, int protection,
+            bool shared, const Reference<Vnode>& vnode, off_t offset);
     vaddr_t mapFromOtherAddressSpace(AddressSpace* sourceSpace,
             vaddr_t sourceVirtualAddress, size_t size, int protection);
     vaddr_t mapMemory(size_t size, int protection);
@@ -45,12 +52,19 @@ public:
     vaddr_t mapPhysical(paddr_t physicalAddress, size_t size, int protection);
     vaddr_t mapUnaligned(paddr_t physicalAddress, size_t size, int protection,
             vaddr_t& mapping, size_t& mapSize);
+    int syncMemory(vaddr_t virtualAddress, size_t size);
     void unmapMemory(vaddr_t virtualAddress, size_t size);
     void unmapPhysical(vaddr_t firstVirtualAddress, size_t size);
 private:
+    struct FileMapping;
+
+    FileMapping* getFileMapping(vaddr_t virtualAddress);
+    uintptr_t getPageTableEntry(vaddr_t virtualAddress);
     bool isActive();
+    bool mapPageTables(vaddr_t virtualAddress, size_t size);
     vaddr_t mapMemoryInternal(vaddr_t virtualAddress, size_t size,
             int protection);
+    FileMapping* removeFileMappings(vaddr_t virtualAddress, size_t size);
     void unmap(vaddr_t virtualAddress);
 public:
     MemorySegment::List segments;
@@ -59,6 +73,7 @@ private:
     AddressSpace* next;
     kthread_mutex_t mutex;
     vaddr_t mappingArea;
+    FileMapping* fileMappings;
 #ifdef __i386__
     paddr_t pageDir;
 #elif defined(__x86_64__)
@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -29,7 +29,8 @@ void initialize(uint8_t bus, uint8_t device, uint8_t function);
 
 class AhciDevice : public BlockCacheDevice {
 public:
-    AhciDevice(vaddr_t portRegisters, paddr_t portMemPhys, vaddr_t portMemVirt);
+    AhciDevice(vaddr_t portRegisters, paddr_t portMemPhys, vaddr_t portMemVirt,
+            uint32_t capabilities);
     ~AhciDevice() = default;
     NOT_COPYABLE(AhciDevice);
     NOT_MOVABLE(AhciDevice);
@@ -38,27 +39,46 @@ public:
     off_t lseek(off_t offset, int whence) override;
     void onIrq(const InterruptContext* context, uint32_t interruptStatus);
     short poll() override;
-    int sync(int flags) override;
 protected:
+    bool finishWrites() override;
     bool readUncached(void* buffer, size_t size, off_t offset, int flags)
             override;
+    bool readUncachedPages(void* const* buffers, size_t size, off_t offset,
+            int flags) override;
+    int syncUncached(int flags) override;
     bool writeUncached(const void* buffer, size_t size, off_t offset, int flags)
             override;
+    bool writeUncachedPages(const void* const* buffers, size_t size,
+            off_t offset, int flags) override;
 private:
-    bool finishDmaTransfer();
+    unsigned int allocateSlot(bool queued);
     uint32_t readRegister(size_t offset);
-    bool sendDmaCommand(uint8_t command, paddr_t physicalAddress, size_t size,
-            bool write, uint64_t lba, uint16_t blockCount);
+    void releaseFinishedWrites();
+    void restartPort();
+    unsigned int sendCommand(uint8_t command, const paddr_t* physicalAddresses,
+            size_t size, bool write, uint64_t lba, uint16_t blockCount);
+    bool waitForCommands(uint32_t slots);
     void writeRegister(size_t offset, uint32_t value);
 private:
     vaddr_t portRegisters;
     paddr_t portMemPhys;
     vaddr_t portMemVirt;
+    vaddr_t commandTables;
+    uint32_t capabilities;
     uint32_t error;
     uint64_t sectors;
     uint64_t sectorSize;
-    bool awaitingInterrupt;
-    bool dmaInProgress;
+    kthread_cond_t commandCond;
+    // Bit masks of command slots. These are protected by disabling
+    // interrupts.
+    uint32_t activeSlots; // Commands that are being processed by the device.
+    uint32_t failedSlots; // Commands that have failed.
+    uint32_t pendingWrites; // Writes that are waited for by finishWrites.
+    uint32_t slotMask; // Command slots supported by the controller.
+    uint32_t usedSlots; // Slots that have not been released yet.
+    bool ncq;
+    bool nonQueuedCommand;
+    bool writeFailed;
 };
 
 #endif
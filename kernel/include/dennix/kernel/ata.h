@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -52,6 +52,7 @@ private:
     paddr_t dmaRegion;
     vaddr_t dmaMapped;
     IrqHandler irqHandler;
+    kthread_cond_t interruptCond;
     bool awaitingInterrupt;
     bool dmaInProgress;
     bool error;
@@ -67,10 +68,10 @@ public:
 
     off_t lseek(off_t offset, int whence) override;
     short poll() override;
-    int sync(int flags) override;
 protected:
     bool readUncached(void* buffer, size_t size, off_t offset, int flags)
             override;
+    int syncUncached(int flags) override;
     bool writeUncached(const void* buffer, size_t size, off_t offset, int flags)
             override;
 private:
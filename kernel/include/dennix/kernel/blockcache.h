@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,6 +23,7 @@
 #include <dennix/kernel/cache.h>
 #include <dennix/kernel/hashtable.h>
 #include <dennix/kernel/list.h>
+#include <dennix/kernel/slab.h>
 #include <dennix/kernel/vnode.h>
 #include <dennix/kernel/worker.h>
 
@@ -33,19 +34,36 @@ protected:
     NOT_MOVABLE(BlockCacheDevice);
 public:
     virtual ~BlockCacheDevice() = default;
+    bool flush();
     void freeUnusedBlocks();
     bool isSeekable() override;
     ssize_t pread(void* buffer, size_t size, off_t offset, int flags) override;
     ssize_t pwrite(const void* buffer, size_t size, off_t offset, int flags)
             override;
+    void readahead(off_t offset, size_t size) override;
     paddr_t reclaimCache() override;
+    int sync(int flags) override;
 protected:
+    // Waits until all writes started by writeUncached have finished.
+    virtual bool finishWrites();
     virtual bool readUncached(void* buffer, size_t size, off_t offset,
             int flags) = 0;
+    // Reads consecutive pages from the device into the given page-aligned
+    // buffers. Devices should override this to read all pages at once.
+    virtual bool readUncachedPages(void* const* buffers, size_t size,
+            off_t offset, int flags);
+    virtual int syncUncached(int flags) = 0;
+    // Writes may still be in progress when this function returns. The buffer
+    // must not be modified until finishWrites has been called.
     virtual bool writeUncached(const void* buffer, size_t size, off_t offset,
             int flags) = 0;
+    // Writes consecutive data from the given buffers. The first buffer may
+    // start in the middle of a page, all buffers extend to the end of their
+    // page.
+    virtual bool writeUncachedPages(const void* const* buffers, size_t size,
+            off_t offset, int flags);
 private:
-    struct Block {
+    struct Block : public CachedObject<Block> {
         Block(vaddr_t address, uint64_t blockNumber);
         ~Block() = default;
         NOT_COPYABLE(Block);
@@ -53,12 +71,20 @@ private:
 
         vaddr_t address;
         uint64_t blockNumber;
+        // The part of the block that needs to be written back to the device.
+        // The block is clean if dirtyEnd is 0.
+        size_t dirtyBegin;
+        size_t dirtyEnd;
         Block* nextInHashTable;
         Block* prevAccessed;
         Block* nextAccessed;
+        Block* prevDirty;
+        Block* nextDirty;
         Block* nextFree;
 
         uint64_t hashKey() { return blockNumber; }
+
+        static ObjectCache objectCache;
     };
     HashTable<Block, uint64_t> blocks;
     Block* blockBuffer[10000];
@@ -68,9 +94,20 @@ private:
     // Blocks ordered from least recently to most recently used.
     LinkedListWithEnd<Block, &Block::prevAccessed, &Block::nextAccessed>
             accessedBlocks;
+    // Dirty blocks ordered by block number.
+    LinkedList<Block, &Block::prevDirty, &Block::nextDirty> dirtyBlocks;
+    size_t dirtyCount;
     WorkerJob workerJob;
 private:
+    bool flushUnlocked();
+    void freeBlock(Block* block);
+    bool loadBlocks(uint64_t blockNumber, size_t count, int flags);
+    void markDirty(Block* block, size_t begin, size_t end);
     void useBlock(Block* block);
+public:
+    BlockCacheDevice* nextDevice;
+
+    static void startFlusher();
 };
 
 #endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -30,6 +30,11 @@ public:
 protected:
     paddr_t allocateCache();
     void returnCache(paddr_t address);
+    // Turns a frame that was allocated as normal memory into cache memory.
+    void convertToCache();
+    // Turns cache memory back into normal memory. This fails if there is no
+    // memory available.
+    bool convertFromCache();
 public:
     CacheController* nextCache;
 };
@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2020 Dennis Wölfing
+/* Copyright (c) 2018, 2020, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -27,10 +27,13 @@ public:
     Clock();
     void add(const Clock* clock);
     int getTime(struct timespec* result);
+    // Like getTime but with nanosecond resolution when the TSC is used.
+    int getPreciseTime(struct timespec* result);
     int nanosleep(int flags, const struct timespec* requested,
             struct timespec* remaining);
     int setTime(struct timespec* newValue);
     void tick(unsigned long nanoseconds);
+    struct timespec toMonotonic(struct timespec time);
 public:
     static Clock* get(clockid_t clockid);
     static void onTick(bool user, unsigned long nanoseconds);
@@ -38,6 +41,7 @@ private:
     struct timespec value;
 };
 
+struct timespec timespecMinus(struct timespec ts1, struct timespec ts2);
 struct timespec timespecPlus(struct timespec ts1, struct timespec ts2);
 bool timespecLess(struct timespec ts1, struct timespec ts2);
 
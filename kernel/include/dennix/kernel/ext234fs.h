@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,6 +23,8 @@
 #include <dennix/kernel/endian.h>
 #include <dennix/kernel/filesystem.h>
 #include <dennix/kernel/hashtable.h>
+#include <dennix/kernel/list.h>
+#include <dennix/kernel/slab.h>
 
 struct SuperBlock {
     little_uint32_t s_inodes_count;
@@ -201,26 +203,114 @@ struct DirectoryEntry {
     char name[];
 };
 
+struct ExtentHeader {
+    little_uint16_t eh_magic;
+    little_uint16_t eh_entries;
+    little_uint16_t eh_max;
+    little_uint16_t eh_depth;
+    little_uint32_t eh_generation;
+};
+
+struct ExtentIndex {
+    little_uint32_t ei_block;
+    little_uint32_t ei_leaf_lo;
+    little_uint16_t ei_leaf_hi;
+    little_uint16_t ei_unused;
+};
+
+struct Extent {
+    little_uint32_t ee_block;
+    little_uint16_t ee_len;
+    little_uint16_t ee_start_hi;
+    little_uint32_t ee_start_lo;
+};
+
+// A node of an extent tree that was visited while looking up a block.
+struct ExtentPath {
+    // The block containing the node or 0 for the root node in the inode.
+    uint64_t block;
+    ExtentHeader* header;
+    // For index nodes this is the index that was followed. For leaf nodes it
+    // is the number of extents that start at or before the block.
+    size_t index;
+};
+
+// Blocks that were allocated in advance for a file that is being appended to.
+// They are marked as used but do not belong to the file until it grows.
+struct BlockReservation {
+    uint64_t start;
+    uint64_t count;
+};
+
+struct DxRootInfo {
+    little_uint32_t reserved_zero;
+    little_uint8_t hash_version;
+    little_uint8_t info_length;
+    little_uint8_t indirect_levels;
+    little_uint8_t unused_flags;
+};
+
+// The hash of the first entry of each node is replaced by the count and limit.
+struct DxCountLimit {
+    little_uint16_t limit;
+    little_uint16_t count;
+};
+
+struct DxEntry {
+    little_uint32_t hash;
+    little_uint32_t block;
+};
+
+// A node of a directory index that was visited while looking up a hash.
+struct DxFrame {
+    uint64_t block;
+    char* data;
+    DxEntry* entries;
+    size_t at;
+};
+
+#define EXTENT_MAGIC 0xF30A
+#define EXTENT_MAX_DEPTH 5
+// Extents longer than this are unwritten extents.
+#define EXTENT_MAX_LENGTH 32768
+
+#define INODE_INDEX_FL 0x1000
+#define INODE_EXTENTS_FL 0x80000
+
+#define COMPAT_DIR_INDEX 0x20
+
 #define INCOMPAT_FILETYPE 0x2
+#define INCOMPAT_EXTENTS 0x40
 #define INCOMPAT_64BIT 0x80
+#define INCOMPAT_FLEX_BG 0x200
 
 #define RO_COMPAT_SPARSE_SUPER 0x1
 #define RO_COMPAT_LARGE_FILE 0x2
 #define RO_COMPAT_EXTRA_ISIZE 0x40
 
-#define SUPPORTED_INCOMPAT_FEATURES (INCOMPAT_FILETYPE | INCOMPAT_64BIT)
+#define SUPPORTED_INCOMPAT_FEATURES (INCOMPAT_FILETYPE | INCOMPAT_EXTENTS | \
+        INCOMPAT_64BIT | INCOMPAT_FLEX_BG)
 #define SUPPORTED_RO_FEATURES \
         (RO_COMPAT_SPARSE_SUPER | RO_COMPAT_LARGE_FILE | RO_COMPAT_EXTRA_ISIZE)
 
 #define STATE_CLEAN 0x1
 
+#define FLAGS_UNSIGNED_HASH 0x2
+
+#define DX_HASH_LEGACY 0
+#define DX_HASH_HALF_MD4 1
+#define DX_HASH_TEA 2
+#define DX_HASH_UNSIGNED_OFFSET 3
+// The root and one level of interior nodes.
+#define DX_MAX_LEVELS 2
+
 class Ext234Vnode;
 
-class Ext234Fs : public FileSystem {
+class Ext234Fs : public FileSystem, public ConstructorMayFail {
 public:
     Ext234Fs(const Reference<Vnode>& device, const SuperBlock* superBlock,
             const Reference<Vnode>& mountPoint, bool readonly);
-    ~Ext234Fs() = default;
+    ~Ext234Fs();
     NOT_COPYABLE(Ext234Fs);
     NOT_MOVABLE(Ext234Fs);
 
@@ -228,7 +318,9 @@ public:
     bool deallocateInode(ino_t ino, bool dir);
     void dropVnodeReference(ino_t ino);
     void finishDropVnodeReference();
+    uint64_t getBlockCount(uint64_t fileSize);
     uint64_t getBlockGroup(ino_t ino);
+    uint8_t getDefaultHashVersion();
     struct timespec getInodeATime(const Inode* inode);
     struct timespec getInodeCTime(const Inode* inode);
     struct timespec getInodeMTime(const Inode* inode);
@@ -236,11 +328,19 @@ public:
     Reference<Vnode> getRootDir() override;
     Reference<Ext234Vnode> getVnode(ino_t ino);
     Reference<Ext234Vnode> getVnodeIfOpen(ino_t ino);
+    bool hasCompatFeature(uint32_t feature);
     bool hasIncompatFeature(uint32_t feature);
+    uint32_t hashName(const char* name, size_t length, uint8_t hashVersion);
+    void initializeExtentTree(Inode* inode);
     bool onUnmount() override;
+    void readahead(const Inode* inode, off_t offset, size_t size);
     bool readInodeData(const Inode* inode, off_t offset, void* buffer,
             size_t size);
-    bool resizeInode(ino_t ino, Inode* inode, off_t newSize);
+    void releaseDelayedBlocks(uint64_t count);
+    void releaseReservation(BlockReservation* reservation);
+    bool reserveDelayedBlocks(uint64_t count);
+    bool resizeInode(ino_t ino, Inode* inode, off_t newSize,
+            BlockReservation* reservation = nullptr);
     void setTime(struct timespec* ts, little_uint32_t* time,
             little_uint32_t* extraTime);
     int sync(int flags);
@@ -248,24 +348,74 @@ public:
     bool writeInodeData(const Inode* inode, off_t offset, const void* buffer,
             size_t size);
 private:
+    struct Bitmap {
+        uint64_t block;
+        // The cached bitmap or nullptr if it has not been read yet.
+        unsigned char* data;
+        // The bytes that need to be written back. The bitmap is clean if
+        // dirtyEnd is 0.
+        size_t dirtyBegin;
+        size_t dirtyEnd;
+    };
+
+    // The group descriptors and bitmaps are kept in memory. Allocations only
+    // modify these copies and writeBackGroups writes the modified parts back
+    // to the device in one go.
+    struct BlockGroup {
+        BlockGroupDescriptor descriptor;
+        Bitmap blockBitmap;
+        Bitmap inodeBitmap;
+        bool dirty;
+        BlockGroup* nextDirty;
+    };
+
+    void addInodeBlocks(Inode* inode, int64_t blocks);
     uint64_t allocateBlock(uint64_t blockGroup);
-    uint64_t allocateBlockInGroup(uint64_t blockGroup,
-            BlockGroupDescriptor* bg, uint32_t freeBlocks);
+    uint64_t allocateBlocks(uint64_t blockGroup, uint64_t goal,
+            uint64_t& count);
+    uint64_t allocateBlocksInGroup(uint64_t blockGroup, uint32_t freeBlocks,
+            uint64_t goal, uint64_t& count);
+    uint64_t allocateFileBlocks(uint64_t blockGroup, uint64_t goal,
+            uint64_t& count, uint64_t fileBlocks,
+            BlockReservation* reservation);
     ino_t allocateInode(uint64_t blockGroup, bool dir);
-    ino_t allocateInodeInGroup(uint64_t blockGroup,
-            BlockGroupDescriptor* bg, uint32_t freeInodes, bool dir);
+    ino_t allocateInodeInGroup(uint64_t blockGroup, uint32_t freeInodes,
+            bool dir);
     bool deallocateBlock(uint64_t blockNumber);
+    bool deallocateBlocks(uint64_t blockNumber, uint64_t count);
     bool decreaseInodeBlockCount(Inode* inode, uint64_t oldBlockCount,
             uint64_t newBlockCount);
-    uint64_t getBlockCount(uint64_t fileSize);
-    uint64_t getInodeBlockAddress(const Inode* inode, uint64_t block);
+    int findExtentPath(ExtentHeader* root, uint64_t block, ExtentPath* path,
+            char* buffer);
+    unsigned char* getBitmap(Bitmap& bitmap);
+    uint64_t getExtentBlockAddress(const Inode* inode, uint64_t block,
+            uint64_t* contiguous);
+    uint64_t getFreeBlockCount();
+    uint64_t getInodeBlockAddress(const Inode* inode, uint64_t block,
+            uint64_t* contiguous);
+    bool growExtentTree(ino_t ino, Inode* inode);
     bool hasReadOnlyFeature(uint32_t feature);
+    bool increaseExtentBlockCount(ino_t ino, Inode* inode,
+            uint64_t oldBlockCount, uint64_t newBlockCount,
+            BlockReservation* reservation);
     bool increaseInodeBlockCount(ino_t ino, Inode* inode,
-            uint64_t oldBlockCount, uint64_t newBlockCount);
+            uint64_t oldBlockCount, uint64_t newBlockCount,
+            BlockReservation* reservation);
+    bool insertExtent(ino_t ino, Inode* inode, uint64_t block, uint64_t start,
+            uint64_t length);
+    void markGroupDirty(BlockGroup* group, Bitmap* bitmap, size_t begin,
+            size_t end);
     bool read(void* buffer, size_t size, off_t offset);
-    bool readBlockGroupDesc(uint64_t blockGroup, BlockGroupDescriptor* bg);
     bool readInode(uint64_t ino, Inode* inode, uint64_t& inodeAddress);
+    bool splitExtentPath(ino_t ino, Inode* inode, ExtentPath* path, int depth,
+            uint64_t block);
+    bool truncateExtentNode(Inode* inode, ExtentHeader* header,
+            uint64_t blockCount);
+    bool truncateExtents(Inode* inode, uint64_t blockCount);
     bool write(const void* buffer, size_t size, off_t offset);
+    bool writeBackBitmap(Bitmap& bitmap);
+    bool writeBackGroups();
+    bool writeExtentNode(const ExtentPath& path);
     bool writeSuperBlock();
 public:
     uint64_t blockSize;
@@ -276,8 +426,18 @@ public:
     kthread_mutex_t renameMutex;
 private:
     kthread_mutex_t blocksMutex;
+    size_t cachedBitmaps;
+    // Free blocks that are set aside for delayed writes. This is protected by
+    // blocksMutex.
+    uint64_t delayedBlocks;
     Reference<Vnode> device;
+    SinglyLinkedList<BlockGroup, &BlockGroup::nextDirty> dirtyGroups;
     uint64_t groupCount;
+    BlockGroup* groups;
+    // Protects dirtyGroups and cachedBitmaps. Block bitmaps and the block
+    // counts in the descriptors are protected by blocksMutex, inode bitmaps
+    // and inode counts by inodesMutex.
+    kthread_mutex_t groupsMutex;
     size_t gdtSize;
     kthread_mutex_t inodesMutex;
     size_t openVnodes;
@@ -287,7 +447,7 @@ private:
     kthread_mutex_t vnodesMutex;
 };
 
-class Ext234Vnode : public Vnode {
+class Ext234Vnode : public Vnode, public CachedObject<Ext234Vnode> {
 public:
     Ext234Vnode(Ext234Fs* fs, ino_t ino, const Inode* inode,
             uint64_t inodeAddress);
@@ -295,8 +455,10 @@ public:
     NOT_COPYABLE(Ext234Vnode);
     NOT_MOVABLE(Ext234Vnode);
 
+    int checkWriteBackError() override;
     int chmod(mode_t mode) override;
     int chown(uid_t uid, gid_t gid) override;
+    int fallocate(off_t offset, off_t length) override;
     int ftruncate(off_t length) override;
     Reference<Vnode> getChildNode(const char* name) override;
     Reference<Vnode> getChildNode(const char* path, size_t length) override;
@@ -308,14 +470,19 @@ public:
     off_t lseek(off_t offset, int whence) override;
     int mkdir(const char* name, mode_t mode) override;
     int mount(FileSystem* filesystem) override;
+    void onClose(int flags) override;
     void onLink() override;
     bool onUnlink(bool force) override;
     Reference<Vnode> open(const char* name, int flags, mode_t mode) override;
     long pathconf(int name) override;
     short poll() override;
     ssize_t pread(void* buffer, size_t size, off_t offset, int flags) override;
+    ssize_t preadUncached(void* buffer, size_t size, off_t offset) override;
     ssize_t pwrite(const void* buffer, size_t size, off_t offset, int flags)
             override;
+    ssize_t pwriteUncached(const void* buffer, size_t size, off_t offset)
+            override;
+    void readahead(off_t offset, size_t size) override;
     ssize_t readlink(char* buffer, size_t size) override;
     void removeReference() const override;
     int rename(const Reference<Vnode>& oldDirectory, const char* oldName,
@@ -331,23 +498,60 @@ protected:
 private:
     bool addChildNode(const char* name, size_t nameLength, ino_t ino,
             unsigned char dt);
+    int addEntryToBlock(char* block, const char* name, size_t nameLength,
+            ino_t ino, unsigned char dt);
+    bool addIndexedChildNode(const char* name, size_t nameLength, ino_t ino,
+            unsigned char dt);
+    bool addIndexLevel(DxFrame& root);
+    uint64_t appendDirectoryBlock();
+    bool delayWrite(const void* buffer, size_t size, off_t offset);
     uint64_t findDirectoryEntry(const char* name, size_t nameLength,
             DirectoryEntry* de);
+    size_t findEntryInBlock(const char* block, const char* name,
+            size_t nameLength);
+    uint64_t findIndexedEntry(const char* name, size_t nameLength,
+            DirectoryEntry* de);
     Reference<Vnode> getChildNodeUnlocked(const char* path, size_t length);
     bool isAncestor(const Reference<Vnode>& vnode);
     int linkUnlocked(const char* name, size_t nameLength,
             const Reference<Vnode>& vnode);
+    bool makeIndexedDirectory(char* block);
+    bool nextIndexLeaf(DxFrame* frames, size_t levels, uint32_t hash);
+    ssize_t pwriteUnlocked(const void* buffer, size_t size, off_t offset);
+    bool probeIndex(const char* name, size_t nameLength, DxFrame* frames,
+            size_t& levels, char* buffer, uint32_t& hash);
+    int resize(off_t length);
+    bool splitIndexLeaf(DxFrame& frame, const char* leaf,
+            uint8_t hashVersion);
+    bool splitIndexNode(DxFrame& root, DxFrame& node);
     int unlinkUnlocked(const char* name, int flags);
     bool updateParent(const Reference<Ext234Vnode>& parent);
+    bool writeDelayedData();
     void writeTimestamps();
 public:
+    Ext234Vnode* nextDelayed;
     Ext234Vnode* nextInHashTable;
+    static ObjectCache objectCache;
+
+    static void writeBackDelayedData(Ext234Fs* fs);
 private:
+    // Data written past the end of the file on disk is kept in memory and
+    // blocks are only allocated for it when it is written back.
+    uint64_t delayedBlocks;
+    size_t delayedCapacity;
+    char* delayedData;
+    size_t delayedSize;
     Ext234Fs* filesystem;
     Inode inode;
     uint64_t inodeAddress;
     bool inodeModified;
     FileSystem* mounted;
+    // Whether the vnode is in the list of vnodes with delayed data.
+    bool onDelayedList;
+    BlockReservation reservation;
+    // Error that occurred when delayed data was written back in the
+    // background. It is reported by the next close or sync.
+    int writeBackError;
 };
 
 #endif
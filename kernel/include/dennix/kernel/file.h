@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -29,6 +29,7 @@ public:
     NOT_COPYABLE(FileVnode);
     NOT_MOVABLE(FileVnode);
 
+    int fallocate(off_t offset, off_t length) override;
     int ftruncate(off_t length) override;
     bool isSeekable() override;
     off_t lseek(off_t offset, int whence) override;
@@ -36,6 +37,10 @@ public:
     ssize_t pread(void* buffer, size_t size, off_t offset, int flags) override;
     ssize_t pwrite(const void* buffer, size_t size, off_t offset, int flags)
             override;
+    ssize_t pwriteUncached(const void* buffer, size_t size, off_t offset)
+            override;
+private:
+    ssize_t pwriteUnlocked(const void* buffer, size_t size, off_t offset);
 public:
     char* data;
 };
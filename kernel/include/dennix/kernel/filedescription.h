@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2020, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2020, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -20,9 +20,11 @@
 #ifndef KERNEL_FILEDESCRIPTION_H
 #define KERNEL_FILEDESCRIPTION_H
 
+#include <dennix/kernel/slab.h>
 #include <dennix/kernel/vnode.h>
 
-class FileDescription : public ReferenceCounted {
+class FileDescription : public ReferenceCounted,
+        public CachedObject<FileDescription> {
 public:
     FileDescription(const Reference<Vnode>& vnode, int flags);
     ~FileDescription();
@@ -42,14 +44,24 @@ public:
     int tcgetattr(struct termios* result);
     int tcsetattr(int flags, const struct termios* termio);
     ssize_t write(const void* buffer, size_t size);
+private:
+    void readahead(size_t size);
 public:
     Reference<Vnode> vnode;
+    static ObjectCache objectCache;
 private:
     kthread_mutex_t mutex;
     void* dents;
     size_t dentsSize;
     off_t offset;
     int fileFlags;
+    // End of the data that has been read ahead.
+    off_t readaheadEnd;
+    // Offset of the next read if the file is being read sequentially.
+    off_t sequentialOffset;
+    // Size of the readahead window. This is 0 when the file is not being read
+    // sequentially.
+    size_t readaheadSize;
 };
 
 #endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -20,10 +20,16 @@
 #ifndef KERNEL_HPET_H
 #define KERNEL_HPET_H
 
+#include <time.h>
 #include <dennix/kernel/kernel.h>
 
 namespace Hpet {
 void initialize(paddr_t baseAddress);
+// Sets when the next timer interrupt should occur. A null deadline means that
+// the timer is not needed soon. This does nothing when the HPET is not used.
+void setDeadline(const struct timespec* deadline);
+// Advances the clocks by the time that passed since the last update.
+void updateClocks(bool user);
 }
 
 #endif
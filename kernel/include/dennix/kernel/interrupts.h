@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019, 2020, 2021 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2020, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -97,6 +97,10 @@ void enable();
 void initApic();
 void initIoApic(paddr_t baseAddress, int interruptBase);
 void initPic();
+// Disables interrupts and returns whether they were enabled before.
+bool saveAndDisable();
+// Reenables interrupts if they were enabled before saveAndDisable was called.
+void restore(bool enabled);
 }
 
 #endif
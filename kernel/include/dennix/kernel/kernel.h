@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -72,6 +72,15 @@ public:
 
 #define FAIL_CONSTRUCTOR do { __constructionFailed = true; return; } while (0)
 
+// Objects of classes deriving from CachedObject<T> are allocated from the
+// ObjectCache T::objectCache instead of the heap. (See slab.h)
+template <typename T>
+class CachedObject {
+public:
+    void* operator new(size_t /*size*/) { return T::objectCache.allocate(); }
+    void operator delete(void* object) { T::objectCache.free(object); }
+};
+
 NORETURN void panic(const char* file, unsigned int line, const char* func,
         const char* format, ...) PRINTF_LIKE(4, 5);
 
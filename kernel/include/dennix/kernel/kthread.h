@@ -1,4 +1,4 @@
-/* Copyright (c) 2017, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2017, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -24,26 +24,34 @@
 #include <dennix/kernel/kernel.h>
 #include <dennix/kernel/list.h>
 
-typedef bool kthread_mutex_t;
-#define KTHREAD_MUTEX_INITIALIZER false
+class Thread;
 
-struct kthread_cond_waiter {
-    kthread_cond_waiter* prev;
-    kthread_cond_waiter* next;
+struct kthread_waiter {
+    kthread_waiter* prev;
+    kthread_waiter* next;
+    Thread* thread;
     bool blocked;
 };
 
+typedef LinkedListWithEnd<kthread_waiter, &kthread_waiter::prev,
+        &kthread_waiter::next> kthread_wait_queue;
+
+typedef struct {
+    bool locked;
+    kthread_wait_queue waiters;
+} kthread_mutex_t;
+#define KTHREAD_MUTEX_INITIALIZER { false }
+
 typedef struct {
-    kthread_mutex_t mutex;
-    LinkedListWithEnd<kthread_cond_waiter, &kthread_cond_waiter::prev,
-            &kthread_cond_waiter::next> waiters;
+    kthread_wait_queue waiters;
 } kthread_cond_t;
-#define KTHREAD_COND_INITIALIZER { KTHREAD_MUTEX_INITIALIZER }
+#define KTHREAD_COND_INITIALIZER {}
 
 int kthread_cond_broadcast(kthread_cond_t* cond);
 int kthread_cond_sigclockwait(kthread_cond_t* cond, kthread_mutex_t* mutex,
         clockid_t clock, const struct timespec* endTime);
 int kthread_cond_signal(kthread_cond_t* cond);
+int kthread_cond_wait(kthread_cond_t* cond, kthread_mutex_t* mutex);
 int kthread_cond_sigwait(kthread_cond_t* cond, kthread_mutex_t* mutex);
 int kthread_mutex_lock(kthread_mutex_t* mutex);
 int kthread_mutex_trylock(kthread_mutex_t* mutex);
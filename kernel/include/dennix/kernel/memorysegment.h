@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2019, 2020, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2019, 2020, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,6 +23,8 @@
 #include <dennix/kernel/list.h>
 
 #define SEG_NOUNMAP (1 << 16)
+// Frames for the segment are allocated on the first access.
+#define SEG_LAZY (1 << 19)
 
 class MemorySegment {
 public:
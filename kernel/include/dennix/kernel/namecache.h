@@ -0,0 +1,45 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/include/dennix/kernel/namecache.h
+ * Cache for directory lookups.
+ */
+
+#ifndef KERNEL_NAMECACHE_H
+#define KERNEL_NAMECACHE_H
+
+#include <dennix/kernel/filesystem.h>
+
+// The name cache remembers which vnode a name in a directory refers to and
+// which names do not exist. Directories that use the cache must call remove
+// whenever they link or unlink a name. Entries hold references to both the
+// directory and the vnode, so they keep them alive until they are evicted.
+namespace NameCache {
+// Adds the result of a lookup unless the cache was invalidated after
+// getGeneration returned the given generation. A null vnode is cached as a
+// negative entry.
+void add(Vnode* directory, const char* name, size_t length,
+        const Reference<Vnode>& vnode, unsigned long generation);
+unsigned long getGeneration();
+// Returns true if the name was found in the cache. For negative entries the
+// result is null and errno is set to ENOENT.
+bool lookup(const Vnode* directory, const char* name, size_t length,
+        Reference<Vnode>& result);
+void remove(const Vnode* directory, const char* name, size_t length);
+void removeDirectory(const Vnode* directory);
+void removeFileSystem(FileSystem* filesystem);
+}
+
+#endif
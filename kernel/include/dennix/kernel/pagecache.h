@@ -0,0 +1,104 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/include/dennix/kernel/pagecache.h
+ * Page cache for file data.
+ */
+
+#ifndef KERNEL_PAGECACHE_H
+#define KERNEL_PAGECACHE_H
+
+#include <sys/types.h>
+#include <dennix/kernel/kthread.h>
+#include <dennix/kernel/list.h>
+#include <dennix/kernel/slab.h>
+
+class Vnode;
+
+// The page cache holds the pages of a file indexed by their file offset. Pages
+// are loaded with Vnode::preadUncached. While the file is mapped its pages are
+// pinned, otherwise they are reclaimed in LRU order like any other cache.
+// Writes to the file must be forwarded to the cache by the vnode so that the
+// cached data stays up to date.
+class PageCache {
+public:
+    PageCache(Vnode* vnode);
+    ~PageCache();
+    NOT_COPYABLE(PageCache);
+    NOT_MOVABLE(PageCache);
+
+    void addMapping(bool sharedWritable);
+    paddr_t getPage(off_t offset, bool dirty);
+    ssize_t read(void* buffer, size_t size, off_t offset);
+    void removeMapping(bool sharedWritable);
+    int sync();
+    void truncate(off_t length);
+    void write(const void* buffer, size_t size, off_t offset);
+public:
+    struct PageKey {
+        PageCache* cache;
+        uint64_t index;
+
+        bool operator==(const PageKey& other) const {
+            return cache == other.cache && index == other.index;
+        }
+
+        size_t operator%(size_t capacity) const {
+            return ((uintptr_t) cache / 32 * 31 + index) % capacity;
+        }
+    };
+
+    struct Page : public CachedObject<Page> {
+        Page(PageCache* cache, uint64_t index, vaddr_t address,
+                paddr_t physicalAddress);
+        ~Page() = default;
+        NOT_COPYABLE(Page);
+        NOT_MOVABLE(Page);
+
+        PageCache* cache;
+        uint64_t index;
+        vaddr_t address;
+        paddr_t physicalAddress;
+        bool dirty;
+        // Pinned pages are in use and cannot be reclaimed.
+        size_t pinCount;
+        Page* nextInHashTable;
+        Page* prevAccessed;
+        Page* nextAccessed;
+        Page* prevInCache;
+        Page* nextInCache;
+        Page* nextFree;
+
+        PageKey hashKey() { return PageKey{cache, index}; }
+
+        static ObjectCache objectCache;
+    };
+private:
+    Page* loadPage(uint64_t index);
+private:
+    friend class PageCacheController;
+    Vnode* vnode;
+    LinkedList<Page, &Page::prevInCache, &Page::nextInCache> pages;
+    // The number of mappings of the file. Sync also counts as a mapping so
+    // that no pages are reclaimed while it runs.
+    size_t mappings;
+    size_t sharedWritableMappings;
+    // Incremented whenever the file is modified.
+    unsigned long generation;
+    // Serializes loading of pages and sync.
+    kthread_mutex_t mutex;
+};
+
+#endif
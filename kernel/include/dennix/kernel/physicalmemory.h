@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019, 2021 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -22,12 +22,21 @@
 
 #include <dennix/kernel/multiboot2.h>
 
+// The largest supported allocation is 2^MAX_ORDER page frames.
+#define MAX_ORDER 10
+
 namespace PhysicalMemory {
+void addFrameReference(paddr_t physicalAddress);
 void initialize(const multiboot_info* multiboot);
+bool isFrameShared(paddr_t physicalAddress);
 paddr_t popPageFrame();
 paddr_t popPageFrame32();
+paddr_t popPageFrames(unsigned int order);
+paddr_t popPageFrames32(unsigned int order);
 paddr_t popReserved();
 void pushPageFrame(paddr_t physicalAddress);
+void pushPageFrames(paddr_t physicalAddress, unsigned int order);
+void releaseFrame(paddr_t physicalAddress, bool reserved);
 bool reserveFrames(size_t frames);
 void unreserveFrames(size_t frames);
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -73,6 +73,7 @@ public:
     Clock childrenSystemCpuClock;
     Clock childrenUserCpuClock;
     Clock cpuClock;
+    int niceness;
     pid_t pid;
     Clock systemCpuClock;
     siginfo_t terminationStatus;
@@ -99,8 +100,11 @@ private:
     bool terminated;
     WorkerJob terminationJob;
     kthread_mutex_t threadsMutex;
+    // Signaled when a thread of the process terminates.
+    kthread_cond_t threadsCond;
 
     kthread_mutex_t childrenMutex;
+    kthread_cond_t childrenCond;
     Process* prevChild;
     Process* nextChild;
     using ChildrenList = LinkedList<Process, &Process::prevChild,
@@ -0,0 +1,73 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/include/dennix/kernel/slab.h
+ * Slab allocator for fixed-size objects.
+ */
+
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <dennix/kernel/cache.h>
+#include <dennix/kernel/kthread.h>
+#include <dennix/kernel/list.h>
+#include <dennix/kernel/worker.h>
+
+#define MAX_EMPTY_SLABS 4
+
+// An object cache allocates objects of a single size from slabs. A slab is a
+// page that is divided into objects of that size. Allocating and freeing an
+// object only takes a few list operations. A few empty slabs are kept around
+// for later allocations. These are counted as cache memory and are given back
+// to the PMM when memory is needed.
+class ObjectCache : public CacheController {
+public:
+    ObjectCache(size_t objectSize);
+    NOT_COPYABLE(ObjectCache);
+    NOT_MOVABLE(ObjectCache);
+
+    void* allocate();
+    void free(void* object);
+    paddr_t reclaimCache() override;
+private:
+    struct Slab {
+        Slab* prev;
+        Slab* next;
+        void* freeList;
+        size_t usedObjects;
+    };
+
+    Slab* allocateSlab();
+    void freeSlab(Slab* slab);
+    static void unmapReclaimedSlabs(void* cache);
+private:
+    kthread_mutex_t mutex;
+    size_t objectSize;
+    size_t objectsPerSlab;
+    // Slabs that have both used and free objects.
+    LinkedList<Slab, &Slab::prev, &Slab::next> partialSlabs;
+    LinkedList<Slab, &Slab::prev, &Slab::next> emptySlabs;
+    size_t numEmptySlabs;
+    // Slabs that have been reclaimed but that are still mapped.
+    vaddr_t reclaimedSlabs[MAX_EMPTY_SLABS];
+    size_t numReclaimedSlabs;
+    WorkerJob workerJob;
+};
+
+#ifdef SLAB_BENCHMARK
+void benchmarkObjectCaches();
+#endif
+
+#endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -52,6 +52,7 @@ int devctl(int fd, int command, void* restrict data, size_t size,
 int dup3(int fd1, int fd2, int flags);
 int execve(const char* path, char* const argv[], char* const envp[]);
 NORETURN void exit_thread(const struct exit_thread* data);
+int fallocate(int fd, off_t offset, off_t length);
 int fchdir(int);
 int fchdirat(int fd, const char* path);
 int fchmod(int fd, mode_t mode);
@@ -65,12 +66,14 @@ int fstat(int fd, struct stat* result);
 int fstatat(int fd, const char* restrict path, struct stat* restrict result,
         int flags);
 int ftruncate(int fd, off_t length);
+int futex(int* address, int op, int value, const struct timespec* timeout);
 int futimens(int fd, const struct timespec ts[2]);
 ssize_t getdents(int fd, void* buffer, size_t size, int flags);
 int getentropy(void* buffer, size_t size);
 pid_t getpid();
 pid_t getppid();
 pid_t getpgid(pid_t pid);
+int getpriority(int which, id_t who);
 int getrusagens(int who, struct rusagens* usage);
 int isatty(int fd);
 int kill(pid_t pid, int signal);
@@ -79,10 +82,12 @@ int linkat(int oldFd, const char* oldPath, int newFd, const char* newPath,
 int listen(int fd, int backlog);
 off_t lseek(int fd, off_t offset, int whence);
 void meminfo(struct meminfo*);
+void meminfo2(struct meminfo*, size_t size);
 int mkdirat(int fd, const char* path, mode_t mode);
 void* mmap(__mmapRequest* request);
 int mount(const char* filename, const char* mountPath, const char* filesystem,
         int flags);
+int msync(void* addr, size_t size, int flags);
 int munmap(void* addr, size_t size);
 int openat(int fd, const char* path, int flags, mode_t mode);
 int pipe2(int fd[2], int flags);
@@ -94,6 +99,7 @@ ssize_t readlinkat(int fd, const char* restrict path, char* restrict buffer,
 int renameat(int oldFd, const char* oldPath, int newFd, const char* newPath);
 pid_t regfork(int flags, regfork_t* registers);
 int setpgid(pid_t pid, pid_t pgid);
+int setpriority(int which, id_t who, int value);
 pid_t setsid();
 int sigaction(int signal, const struct sigaction* restrict action,
         struct sigaction* restrict old);
@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -26,21 +26,26 @@
 #include <dennix/kernel/kernel.h>
 #include <dennix/kernel/kthread.h>
 #include <dennix/kernel/list.h>
+#include <dennix/kernel/slab.h>
 
 class Process;
+struct RunQueue;
 
-struct PendingSignal {
+struct PendingSignal : public CachedObject<PendingSignal> {
     siginfo_t siginfo;
     PendingSignal* next;
+
+    static ObjectCache objectCache;
 };
 
-class Thread {
+class Thread : public CachedObject<Thread> {
 public:
     Thread(Process* process);
     ~Thread();
     NOT_MOVABLE(Thread);
     NOT_COPYABLE(Thread);
 
+    void* getBounceBuffer();
     InterruptContext* handleSignal(InterruptContext* context);
     void raiseSignal(siginfo_t siginfo);
     int sigtimedwait(const sigset_t* set, siginfo_t* info,
@@ -49,8 +54,10 @@ public:
     void updateContext(vaddr_t newKernelStack, InterruptContext* newContext,
             const __fpu_t* newFpuEnv);
     void updatePendingSignals();
+    void wakeUp();
 private:
     void checkSigalarm(bool scheduling);
+    void newTimeslice();
     void raiseSignalUnlocked(siginfo_t siginfo);
 public:
     Clock cpuClock;
@@ -62,24 +69,41 @@ public:
     pid_t tid;
     uintptr_t tlsBase;
 private:
+    bool blocked;
+    vaddr_t bounceBuffer;
     bool contextChanged;
     int errorNumber;
+    bool interactive;
     InterruptContext* interruptContext;
     vaddr_t kernelStack;
     Thread* next;
     PendingSignal* pendingSignals;
     Thread* prev;
+    int priority;
+    RunQueue* runQueue;
     kthread_mutex_t signalMutex;
     kthread_cond_t signalCond;
+    struct timespec timesliceEnd;
+    struct timespec wakeupTime;
 public:
     using ThreadList = LinkedList<Thread, &Thread::prev, &Thread::next>;
+    using RunList = LinkedListWithEnd<Thread, &Thread::prev, &Thread::next>;
 
     static void addThread(Thread* thread);
+    static void block(const struct timespec* wakeupTime = nullptr);
     static Thread* current() { return _current; }
+    NORETURN static void idle();
     static Thread* idleThread;
     static void initializeIdleThread();
+    static ObjectCache objectCache;
     static void removeThread(Thread* thread);
-    static InterruptContext* schedule(InterruptContext* context);
+    static InterruptContext* schedule(InterruptContext* context,
+            bool preempted = false);
+    static void startKernelThread(void (*func)(void));
+private:
+    static void addSleepingThread(Thread* thread);
+    static void dequeue(Thread* thread);
+    static void enqueue(Thread* thread, RunQueue* queue);
 private:
     static Thread* _current;
 };
@@ -0,0 +1,48 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/include/dennix/kernel/tsc.h
+ * Time Stamp Counter.
+ */
+
+#ifndef KERNEL_TSC_H
+#define KERNEL_TSC_H
+
+#include <dennix/kernel/kernel.h>
+
+namespace Tsc {
+// Physical address of the time page, or 0 if the TSC is not used.
+extern paddr_t timePage;
+
+// Returns the nanoseconds that passed since the clocks were last updated.
+uint64_t getElapsed();
+// Starts using the TSC for timekeeping. The frequency is measured by the
+// HPET.
+void initialize(uint64_t frequency);
+bool isSupported();
+// Advances the clocks by the time that passed since the last update. Returns
+// false if the TSC is not used.
+bool updateClocks(bool user);
+// Copies the current clock values into the time page.
+void updateTimePage();
+
+inline uint64_t read() {
+    uint32_t low, high;
+    asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return (uint64_t) high << 32 | low;
+}
+}
+
+#endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -26,7 +26,13 @@
 #include <dennix/kernel/kthread.h>
 #include <dennix/kernel/refcount.h>
 
+// User buffers are copied through the per-thread bounce buffer of this size so
+// that the vnode does not need to be locked while accessing user memory. A page
+// fault on a mapped file needs to lock the vnode of that file.
+#define BOUNCE_BUFFER_SIZE (64 * 1024)
+
 class FileSystem;
+class PageCache;
 
 class Vnode : public ReferenceCounted {
 public:
@@ -34,17 +40,22 @@ public:
             socklen_t* length, int fileFlags);
     virtual int bind(const struct sockaddr* address, socklen_t length,
             int flags);
+    // Reports errors that occurred when writing back data of the file in the
+    // background. This is called whenever a file descriptor is closed.
+    virtual int checkWriteBackError();
     virtual int chmod(mode_t mode);
     virtual int chown(uid_t uid, gid_t gid);
     virtual int connect(const struct sockaddr* address, socklen_t length,
             int flags);
     virtual int devctl(int command, void* restrict data, size_t size,
             int* restrict info);
+    virtual int fallocate(off_t offset, off_t length);
     virtual int ftruncate(off_t length);
     virtual Reference<Vnode> getChildNode(const char* path);
     virtual Reference<Vnode> getChildNode(const char* path, size_t length);
     virtual size_t getDirectoryEntries(void** buffer, int flags);
     virtual char* getLinkTarget();
+    virtual PageCache* getPageCache();
     virtual int isatty();
     virtual bool isSeekable();
     virtual int link(const char* name, const Reference<Vnode>& vnode);
@@ -52,15 +63,21 @@ public:
     virtual off_t lseek(off_t offset, int whence);
     virtual int mkdir(const char* name, mode_t mode);
     virtual int mount(FileSystem* filesystem);
+    // Called when an open file description for the vnode is closed.
+    virtual void onClose(int flags);
     virtual void onLink();
     virtual bool onUnlink(bool force);
     virtual Reference<Vnode> open(const char* name, int flags, mode_t mode);
     virtual long pathconf(int name);
     virtual short poll();
     virtual ssize_t pread(void* buffer, size_t size, off_t offset, int flags);
+    virtual ssize_t preadUncached(void* buffer, size_t size, off_t offset);
     virtual ssize_t pwrite(const void* buffer, size_t size, off_t offset,
                 int flags);
+    virtual ssize_t pwriteUncached(const void* buffer, size_t size,
+            off_t offset);
     virtual ssize_t read(void* buffer, size_t size, int flags);
+    virtual void readahead(off_t offset, size_t size);
     virtual ssize_t readlink(char* buffer, size_t size);
     virtual int rename(const Reference<Vnode>& oldDirectory,
             const char* oldName, const char* newName);
@@ -88,8 +105,20 @@ protected:
 public:
     kthread_mutex_t mutex;
     struct stat stats;
+    // Held for the whole duration of writes and size changes so that a write
+    // that is split into several chunks cannot be interleaved with others.
+    // This mutex must be locked before the vnode mutex.
+    kthread_mutex_t writeMutex;
+protected:
+    // The page cache is created when the file is mapped for the first time.
+    PageCache* pageCache;
 };
 
+// Threads waiting in poll() are woken up by notifyPoll whenever the result of
+// Vnode::poll might have changed for any vnode.
+unsigned long getPollGeneration();
+void notifyPoll();
+int waitForPoll(unsigned long generation, const struct timespec* endTime);
 Reference<Vnode> resolvePath(const Reference<Vnode>& vnode, const char* path,
         bool followFinalSymlink = true);
 Reference<Vnode> resolvePathExceptLastComponent(const Reference<Vnode>& vnode,
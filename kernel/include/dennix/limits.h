@@ -1,4 +1,4 @@
-/* Copyright (c) 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,6 +23,7 @@
 #define FILESIZEBITS 64
 #define _GETENTROPY_MAX 256
 #define _NSIG_MAX 65
+#define NZERO 20
 #define PAGESIZE 0x1000
 #define PAGE_SIZE PAGESIZE
 #define PIPE_BUF 4096
@@ -1,4 +1,4 @@
-/* Copyright (c) 2020, 2021 Dennis Wölfing
+/* Copyright (c) 2020, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -20,11 +20,18 @@
 #ifndef _DENNIX_MEMINFO_H
 #define _DENNIX_MEMINFO_H
 
+#define MEMINFO_ORDERS 11
+
 struct meminfo {
     __SIZE_TYPE__ mem_total;
     __SIZE_TYPE__ mem_free;
     __SIZE_TYPE__ mem_available;
     __SIZE_TYPE__ __reserved;
+    /* The following fields are only filled in by SYSCALL_MEMINFO2 if the
+       size passed to it includes them. SYSCALL_MEMINFO fills in only the
+       fields above. */
+    /* The number of free blocks of 2^i contiguous pages. */
+    __SIZE_TYPE__ mem_free_blocks[MEMINFO_ORDERS];
 };
 
 #endif
@@ -29,9 +29,15 @@
 
 #define MAP_PRIVATE (1 << 0)
 #define MAP_ANONYMOUS (1 << 1)
+#define MAP_POPULATE (1 << 2)
+#define MAP_SHARED (1 << 3)
 
 #define MAP_FAILED ((void*) 0)
 
+#define MS_ASYNC (1 << 0)
+#define MS_SYNC (1 << 1)
+#define MS_INVALIDATE (1 << 2)
+
 #if defined(__is_dennix_kernel) || defined(__is_dennix_libc)
 /* The mmap() function has to many parameters to be passed in registers */
 #  include <stddef.h>
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -84,7 +84,13 @@
 #define SYSCALL_FCHOWN 61
 #define SYSCALL_SETSID 62
 #define SYSCALL_GETPPID 63
+#define SYSCALL_GETPRIORITY 64
+#define SYSCALL_SETPRIORITY 65
+#define SYSCALL_MSYNC 66
+#define SYSCALL_FUTEX 67
+#define SYSCALL_FALLOCATE 68
+#define SYSCALL_MEMINFO2 69
 
-#define NUM_SYSCALLS 64
+#define NUM_SYSCALLS 70
 
 #endif
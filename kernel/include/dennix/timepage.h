@@ -0,0 +1,44 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/include/dennix/timepage.h
+ * Clock parameters shared with userspace.
+ */
+
+#ifndef _DENNIX_TIMEPAGE_H
+#define _DENNIX_TIMEPAGE_H
+
+#include <dennix/timespec.h>
+
+// The kernel maps this page read-only into every process and passes its
+// address to the program entry point. When tscEnabled is set, the current time
+// is the time stored in the page plus the time since the TSC had the value
+// tscBase. The kernel makes the sequence number odd while it updates the
+// page.
+struct __timepage {
+    __UINT32_TYPE__ sequence;
+    int tscEnabled;
+    __UINT64_TYPE__ tscBase;
+    // Nanoseconds per TSC tick, scaled by 2^32.
+    __UINT64_TYPE__ tscMultiplier;
+    // Fraction of a nanosecond that had passed at tscBase, scaled by 2^32.
+    __UINT64_TYPE__ tscFraction;
+    // Larger differences than this could overflow and need a system call.
+    __UINT64_TYPE__ tscMaxDelta;
+    struct timespec monotonic;
+    struct timespec realtime;
+};
+
+#endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,13 +17,34 @@
  * Address space class.
  */
 
+#include <assert.h>
+#include <signal.h>
 #include <string.h>
 #include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/pagecache.h>
 #include <dennix/kernel/physicalmemory.h>
 
 #define PAGE_PRESENT (1 << 0)
 #define PAGE_WRITABLE (1 << 1)
 #define PAGE_USER (1 << 2)
+#define PAGE_COPY_ON_WRITE (1 << 9)
+#define PAGE_CACHE_FRAME (1 << 10)
+#ifdef __x86_64__
+#  define PAGE_FLAGS 0xFFF0000000000FFF
+#else
+#  define PAGE_FLAGS PAGE_MISALIGN
+#endif
+
+struct AddressSpace::FileMapping {
+    vaddr_t address;
+    size_t size;
+    off_t offset;
+    Reference<Vnode> vnode;
+    PageCache* cache;
+    bool shared;
+    bool sharedWritable;
+    FileMapping* next;
+};
 
 static AddressSpace _kernelSpace;
 AddressSpace* const kernelSpace = &_kernelSpace;
@@ -35,45 +56,259 @@ bool AddressSpace::isActive() {
 }
 
 static kthread_mutex_t forkMutex = KTHREAD_MUTEX_INITIALIZER;
+// Prevents shared frames from being released while they are being copied.
+static kthread_mutex_t copyOnWriteMutex = KTHREAD_MUTEX_INITIALIZER;
+
+static int getSegmentFlags(MemorySegment::List& segments,
+        vaddr_t address) {
+    for (const auto& segment : segments) {
+        if (address >= segment.address &&
+                address - segment.address < segment.size) {
+            return segment.flags;
+        }
+    }
+    return 0;
+}
 
 AddressSpace* AddressSpace::fork() {
     AutoLock lock(&forkMutex);
 
     AddressSpace* result = new AddressSpace();
     if (!result) return nullptr;
+
+    AutoLock spaceLock(&mutex);
     for (const auto& segment : segments) {
-        if (!(segment.flags & SEG_NOUNMAP)) {
-            // Copy the segment
-            size_t size = segment.size;
-            if (!result->mapMemory(segment.address, size, segment.flags)) {
-                delete result;
-                return nullptr;
+        if (segment.flags & SEG_NOUNMAP) continue;
+
+        // Instead of copying the segment we share its frames with the new
+        // address space and copy writable pages when they are written to.
+        // A frame is reserved for each of these copies and for each page
+        // that has not been allocated yet so that handling the page fault
+        // cannot fail.
+        size_t pages = segment.size / PAGESIZE;
+        bool writable = segment.flags & PROT_WRITE;
+        bool lazy = segment.flags & SEG_LAZY;
+        size_t reserved = 0;
+        for (size_t i = 0; i < pages; i++) {
+            uintptr_t entry = getPageTableEntry(segment.address +
+                    i * PAGESIZE);
+            if (!(entry & PAGE_PRESENT)) {
+                if (lazy) reserved++;
+            } else if (entry & PAGE_CACHE_FRAME) {
+                // Pages of private file mappings are copied when written to.
+                if (entry & PAGE_COPY_ON_WRITE) reserved++;
+            } else if (writable) {
+                reserved++;
             }
+        }
+        if (!PhysicalMemory::reserveFrames(reserved)) {
+            delete result;
+            return nullptr;
+        }
+
+        if (!result->mapPageTables(segment.address, segment.size) ||
+                !MemorySegment::addSegment(result->segments, segment.address,
+                segment.size, segment.flags)) {
+            PhysicalMemory::unreserveFrames(reserved);
+            delete result;
+            return nullptr;
+        }
 
-            vaddr_t source = kernelSpace->mapFromOtherAddressSpace(this,
-                    segment.address, size, PROT_READ);
-            if (!source) {
-                delete result;
-                return nullptr;
+        int protection = segment.flags;
+        if (writable) protection |= PROT_COPY_ON_WRITE;
+
+        for (size_t i = 0; i < pages; i++) {
+            vaddr_t address = segment.address + i * PAGESIZE;
+            uintptr_t entry = getPageTableEntry(address);
+            if (!(entry & PAGE_PRESENT)) continue;
+            paddr_t physicalAddress = entry & ~PAGE_FLAGS;
+
+            // These cannot fail because the page tables already exist.
+            if (entry & PAGE_CACHE_FRAME) {
+                // The frame is owned by the page cache, so the page is
+                // mapped into the new address space the same way.
+                int cacheProtection = segment.flags | PROT_CACHE_FRAME;
+                if (entry & PAGE_COPY_ON_WRITE) {
+                    cacheProtection |= PROT_COPY_ON_WRITE;
+                }
+                result->mapAt(address, physicalAddress, cacheProtection);
+                continue;
             }
 
-            vaddr_t dest = kernelSpace->mapFromOtherAddressSpace(result,
-                    segment.address, size, PROT_WRITE);
-            if (!dest) {
-                kernelSpace->unmapPhysical(source, size);
-                delete result;
-                return nullptr;
+            result->mapAt(address, physicalAddress, protection);
+            PhysicalMemory::addFrameReference(physicalAddress);
+
+            if (writable) {
+                mapAt(address, physicalAddress, protection);
             }
+        }
+    }
 
-            memcpy((void*) dest, (const void*) source, size);
-            kernelSpace->unmapPhysical(source, size);
-            kernelSpace->unmapPhysical(dest, size);
+    for (FileMapping* mapping = fileMappings; mapping;
+            mapping = mapping->next) {
+        FileMapping* copy = new FileMapping(*mapping);
+        if (!copy) {
+            delete result;
+            return nullptr;
         }
+        copy->next = result->fileMappings;
+        result->fileMappings = copy;
+        copy->cache->addMapping(copy->sharedWritable);
     }
 
     return result;
 }
 
+AddressSpace::FileMapping* AddressSpace::getFileMapping(
+        vaddr_t virtualAddress) {
+    for (FileMapping* mapping = fileMappings; mapping;
+            mapping = mapping->next) {
+        if (virtualAddress >= mapping->address &&
+                virtualAddress - mapping->address < mapping->size) {
+            return mapping;
+        }
+    }
+    return nullptr;
+}
+
+// Returns 0 if the fault was resolved, otherwise the signal to raise.
+int AddressSpace::handlePageFault(vaddr_t address, bool write) {
+    if (this == kernelSpace) return SIGSEGV;
+    address &= ~PAGE_MISALIGN;
+
+    AutoLock lock(&mutex);
+    assert(isActive());
+
+    int protection = getSegmentFlags(segments, address);
+    if (!(protection & _PROT_FLAGS) || (write && !(protection & PROT_WRITE))) {
+        return SIGSEGV;
+    }
+
+    uintptr_t entry = getPageTableEntry(address);
+    FileMapping* mapping = nullptr;
+    if (!(entry & PAGE_PRESENT)) {
+        mapping = getFileMapping(address);
+    }
+
+    if (mapping) {
+        off_t offset = mapping->offset + (address - mapping->address);
+        bool writable = protection & PROT_WRITE;
+        paddr_t physicalAddress = mapping->cache->getPage(offset,
+                mapping->sharedWritable);
+        // This fails for pages after the end of the file or when the page
+        // could not be read.
+        if (!physicalAddress) return SIGBUS;
+
+        protection |= PROT_CACHE_FRAME;
+        if (!mapping->shared && writable) {
+            // Private mappings get their own copy of the page when they
+            // write to it.
+            protection |= PROT_COPY_ON_WRITE;
+        }
+        mapAt(address, physicalAddress, protection);
+        if (!write || mapping->shared) return 0;
+
+        entry = getPageTableEntry(address);
+        protection &= ~(PROT_CACHE_FRAME | PROT_COPY_ON_WRITE);
+    }
+
+    if (!(entry & PAGE_PRESENT)) {
+        if (!(protection & SEG_LAZY)) return SIGSEGV;
+
+        // Allocate the frame that was reserved when the segment was mapped.
+        paddr_t physicalAddress = PhysicalMemory::popReserved();
+        kernelSpace->mapAt(mappingArea, physicalAddress, PROT_WRITE);
+        memset((void*) mappingArea, 0, PAGESIZE);
+        kernelSpace->unmap(mappingArea);
+        mapAt(address, physicalAddress, protection);
+        return 0;
+    }
+
+    if (!write || !(entry & PAGE_COPY_ON_WRITE)) return SIGSEGV;
+    paddr_t physicalAddress = entry & ~PAGE_FLAGS;
+    bool cached = entry & PAGE_CACHE_FRAME;
+
+    AutoLock copyLock(&copyOnWriteMutex);
+    if (!cached && !PhysicalMemory::isFrameShared(physicalAddress)) {
+        // All other address spaces have already stopped using this frame.
+        mapAt(address, physicalAddress, protection);
+        return 0;
+    }
+
+    // The frame for the copy was reserved when the frame was shared.
+    paddr_t copy = PhysicalMemory::popReserved();
+    kernelSpace->mapAt(mappingArea, copy, PROT_WRITE);
+    memcpy((void*) mappingArea, (const void*) address, PAGESIZE);
+    kernelSpace->unmap(mappingArea);
+
+    mapAt(address, copy, protection);
+    // Frames of the page cache are not owned by the address space.
+    if (!cached) {
+        PhysicalMemory::releaseFrame(physicalAddress, false);
+    }
+    return 0;
+}
+
+vaddr_t AddressSpace::mapFile(vaddr_t virtualAddress, size_t size,
+        int protection, bool shared, const Reference<Vnode>& vnode,
+        off_t offset) {
+    PageCache* cache = vnode->getPageCache();
+    if (!cache) return 0;
+
+    FileMapping* mapping = new FileMapping();
+    if (!mapping) return 0;
+    mapping->size = size;
+    mapping->offset = offset;
+    mapping->vnode = vnode;
+    mapping->cache = cache;
+    mapping->shared = shared;
+    mapping->sharedWritable = shared && (protection & PROT_WRITE);
+
+    // Writable private mappings need a frame for each page that is copied.
+    size_t reserved = 0;
+    if (!shared && (protection & PROT_WRITE)) {
+        protection |= SEG_LAZY;
+        reserved = size / PAGESIZE;
+    }
+
+    AutoLock lock(&mutex);
+    // If no address is given the file is mapped at any free address.
+    if (virtualAddress) {
+        if (!MemorySegment::addSegment(segments, virtualAddress, size,
+                protection)) {
+            delete mapping;
+            return 0;
+        }
+    } else {
+        virtualAddress = MemorySegment::findAndAddNewSegment(segments, size,
+                protection);
+        if (!virtualAddress) {
+            delete mapping;
+            return 0;
+        }
+    }
+
+    if (!PhysicalMemory::reserveFrames(reserved)) {
+        MemorySegment::removeSegment(segments, virtualAddress, size);
+        delete mapping;
+        return 0;
+    }
+
+    // Pages are loaded from the page cache when they are accessed.
+    if (!mapPageTables(virtualAddress, size)) {
+        PhysicalMemory::unreserveFrames(reserved);
+        MemorySegment::removeSegment(segments, virtualAddress, size);
+        delete mapping;
+        return 0;
+    }
+
+    mapping->address = virtualAddress;
+    mapping->next = fileMappings;
+    fileMappings = mapping;
+    cache->addMapping(mapping->sharedWritable);
+    return virtualAddress;
+}
+
 vaddr_t AddressSpace::mapFromOtherAddressSpace(AddressSpace* sourceSpace,
         vaddr_t sourceVirtualAddress, size_t size, int protection) {
     kthread_mutex_lock(&mutex);
@@ -111,6 +346,17 @@ vaddr_t AddressSpace::mapMemoryInternal(vaddr_t virtualAddress, size_t size,
         return 0;
     }
 
+    if (protection & SEG_LAZY) {
+        // Frames are allocated when the pages are accessed for the first
+        // time. Creating the page tables now ensures that this cannot fail.
+        if (!mapPageTables(virtualAddress, size)) {
+            PhysicalMemory::unreserveFrames(pages);
+            MemorySegment::removeSegment(segments, virtualAddress, size);
+            return 0;
+        }
+        return virtualAddress;
+    }
+
     for (size_t i = 0; i < pages; i++) {
         paddr_t physicalAddress = PhysicalMemory::popReserved();
         if (unlikely(!mapAt(virtualAddress + i * PAGESIZE, physicalAddress,
@@ -137,6 +383,17 @@ vaddr_t AddressSpace::mapMemoryInternal(vaddr_t virtualAddress, size_t size,
     return virtualAddress;
 }
 
+bool AddressSpace::mapPageTables(vaddr_t virtualAddress, size_t size) {
+    // A page table covers at least 2 MiB on all architectures. Mapping a
+    // null page creates the page table without mapping anything.
+    vaddr_t address = virtualAddress;
+    while (address - virtualAddress < size) {
+        if (!mapAt(address, 0, 0)) return false;
+        address = ALIGNUP(address + 1, 0x200000);
+    }
+    return true;
+}
+
 vaddr_t AddressSpace::mapMemory(size_t size, int protection) {
     AutoLock lock(&mutex);
     vaddr_t virtualAddress = MemorySegment::findAndAddNewSegment(segments,
@@ -187,25 +444,144 @@ vaddr_t AddressSpace::mapUnaligned(paddr_t physicalAddress, size_t size,
     return mapping + offset;
 }
 
+AddressSpace::FileMapping* AddressSpace::removeFileMappings(
+        vaddr_t virtualAddress, size_t size) {
+    vaddr_t endAddress = virtualAddress + size;
+    FileMapping* removed = nullptr;
+
+    FileMapping** link = &fileMappings;
+    while (*link) {
+        FileMapping* mapping = *link;
+        vaddr_t mappingEnd = mapping->address + mapping->size;
+        if (mappingEnd <= virtualAddress || mapping->address >= endAddress) {
+            link = &mapping->next;
+            continue;
+        }
+
+        if (mapping->address >= virtualAddress && mappingEnd <= endAddress) {
+            *link = mapping->next;
+            mapping->next = removed;
+            removed = mapping;
+            continue;
+        }
+
+        if (mapping->address < virtualAddress && mappingEnd > endAddress) {
+            // Split the mapping.
+            FileMapping* tail = new FileMapping(*mapping);
+            if (tail) {
+                tail->address = endAddress;
+                tail->size = mappingEnd - endAddress;
+                tail->offset += endAddress - mapping->address;
+                mapping->next = tail;
+                tail->cache->addMapping(tail->sharedWritable);
+            }
+            // Otherwise we are so low on memory that the pages after the
+            // unmapped range can no longer be loaded from the file.
+            mapping->size = virtualAddress - mapping->address;
+        } else if (mapping->address < virtualAddress) {
+            mapping->size = virtualAddress - mapping->address;
+        } else {
+            mapping->offset += endAddress - mapping->address;
+            mapping->size = mappingEnd - endAddress;
+            mapping->address = endAddress;
+        }
+        link = &mapping->next;
+    }
+
+    return removed;
+}
+
+int AddressSpace::syncMemory(vaddr_t virtualAddress, size_t size) {
+    vaddr_t endAddress = virtualAddress + size;
+    int result = 0;
+
+    while (virtualAddress < endAddress) {
+        // Find the next shared mapping in the range. The vnode reference
+        // keeps the page cache alive while the mutex is unlocked.
+        kthread_mutex_lock(&mutex);
+        FileMapping* next = nullptr;
+        for (FileMapping* mapping = fileMappings; mapping;
+                mapping = mapping->next) {
+            if (mapping->shared && mapping->address < endAddress &&
+                    mapping->address + mapping->size > virtualAddress &&
+                    (!next || mapping->address < next->address)) {
+                next = mapping;
+            }
+        }
+
+        if (!next) {
+            kthread_mutex_unlock(&mutex);
+            break;
+        }
+        Reference<Vnode> vnode = next->vnode;
+        PageCache* cache = next->cache;
+        virtualAddress = next->address + next->size;
+        kthread_mutex_unlock(&mutex);
+
+        if (cache->sync() < 0) {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
 void AddressSpace::unmap(vaddr_t virtualAddress) {
     mapAt(virtualAddress, 0, 0);
 }
 
 void AddressSpace::unmapMemory(vaddr_t virtualAddress, size_t size) {
-    AutoLock lock(&mutex);
+    kthread_mutex_lock(&mutex);
 
+    size_t unusedReservations = 0;
     for (size_t i = 0; i < size; i += PAGESIZE) {
-        paddr_t physicalAddress = getPhysicalAddress(virtualAddress + i);
+        uintptr_t entry = getPageTableEntry(virtualAddress + i);
+        if (!(entry & PAGE_PRESENT)) {
+            // Lazily allocated pages that were never accessed only have a
+            // reserved frame.
+            if (getSegmentFlags(segments, virtualAddress + i) & SEG_LAZY) {
+                unusedReservations++;
+            }
+            continue;
+        }
         unmap(virtualAddress + i);
 
+        if (entry & PAGE_CACHE_FRAME) {
+            // The frame belongs to the page cache. Private mappings still
+            // have a frame reserved for copying the page.
+            if (entry & PAGE_COPY_ON_WRITE) {
+                unusedReservations++;
+            }
+            continue;
+        }
+
         // Unlock the mutex because PhysicalMemory::pushPageFrame may need to
         // map pages.
         kthread_mutex_unlock(&mutex);
-        PhysicalMemory::pushPageFrame(physicalAddress);
+        paddr_t physicalAddress = entry & ~PAGE_FLAGS;
+        if (this == kernelSpace) {
+            PhysicalMemory::pushPageFrame(physicalAddress);
+        } else {
+            AutoLock copyLock(&copyOnWriteMutex);
+            PhysicalMemory::releaseFrame(physicalAddress,
+                    entry & PAGE_COPY_ON_WRITE);
+        }
         kthread_mutex_lock(&mutex);
     }
 
+    PhysicalMemory::unreserveFrames(unusedReservations);
     MemorySegment::removeSegment(segments, virtualAddress, size);
+    FileMapping* removed = removeFileMappings(virtualAddress, size);
+    kthread_mutex_unlock(&mutex);
+
+    // Removing the last shared mapping writes the file back, so this must
+    // happen without holding the mutex.
+    while (removed) {
+        FileMapping* next = removed->next;
+        removed->cache->removeMapping(removed->sharedWritable);
+        delete removed;
+        removed = next;
+    }
 }
 
 void AddressSpace::unmapPhysical(vaddr_t virtualAddress, size_t size) {
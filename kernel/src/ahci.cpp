@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -19,7 +19,6 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <dennix/poll.h>
@@ -50,11 +49,14 @@
 #define REGISTER_PxSIG 0x24 // Port Signature
 #define REGISTER_PxSSTS 0x28 // Port Serial ATA Status
 #define REGISTER_PxSERR 0x30 // Port Serial ATA Error
+#define REGISTER_PxSACT 0x34 // Port Serial ATA Active
 #define REGISTER_PxCI 0x38 // Port Command Issue
 
 #define GHC_IE (1 << 1) // Interrupt Enable
 #define GHC_AE (1U << 31) // AHCI Enable
 
+#define CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) // Number of Command Slots
+#define CAP_SNCQ (1 << 30) // Supports Native Command Queuing
 #define CAP_S64A (1U << 31) // Supports 64-bit addressing
 
 #define CAP2_BOH (1 << 0) // BIOS/OS Handoff
@@ -84,9 +86,62 @@
 
 #define COMMAND_READ_DMA_EXT 0x25
 #define COMMAND_WRITE_DMA_EXT 0x35
+#define COMMAND_READ_FPDMA_QUEUED 0x60
+#define COMMAND_WRITE_FPDMA_QUEUED 0x61
 #define COMMAND_FLUSH_CACHE 0xE7
 #define COMMAND_IDENTIFY_DEVICE 0xEC
 
+// Number of PRDT entries in each command table. Each entry describes a page.
+// With this number of entries a command table is exactly 1 KiB large.
+#define MAX_PRDT_ENTRIES 56
+
+struct CommandHeader {
+    uint16_t flags;
+    uint16_t prdtl;
+    uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+};
+
+struct CommandFis {
+    uint8_t type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t featuresLow;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t featuresHigh;
+    uint16_t count;
+    uint8_t icc;
+    uint8_t control;
+    uint32_t auxiliary;
+};
+
+struct PrdtEntry {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t byteCount;
+};
+
+struct CommandTable {
+    CommandFis cfis;
+    char padding[44];
+    char acmd[16];
+    char reserved[48];
+    PrdtEntry entries[MAX_PRDT_ENTRIES];
+};
+
+// Command tables need to be aligned to 128 bytes.
+static_assert(sizeof(CommandTable) % 128 == 0, "invalid command table size");
+#define COMMAND_TABLES_SIZE (32 * sizeof(CommandTable))
+
 static size_t numAhciDevices = 0;
 static void onAhciIrq(void* user, const InterruptContext* context);
 
@@ -209,7 +264,8 @@ AhciController::AhciController(vaddr_t hbaMapped, unsigned int irq)
                 if (sig == PxSIG_ATA) {
                     // An ATA device was detected. Try to initialize it.
                     ports[i] = xnew AhciDevice(hbaMapped + portOffset,
-                            portMemPhys, portMemVirt);
+                            portMemPhys, portMemVirt,
+                            readRegister(REGISTER_CAP));
                 }
             }
         }
@@ -264,33 +320,75 @@ void AhciController::writeRegister(size_t offset, uint32_t value) {
 }
 
 AhciDevice::AhciDevice(vaddr_t portRegisters, paddr_t portMemPhys,
-        vaddr_t portMemVirt) : BlockCacheDevice(0644, DevFS::dev) {
+        vaddr_t portMemVirt, uint32_t capabilities)
+        : BlockCacheDevice(0644, DevFS::dev) {
     this->portRegisters = portRegisters;
     this->portMemPhys = portMemPhys;
     this->portMemVirt = portMemVirt;
+    this->capabilities = capabilities;
 
-    awaitingInterrupt = false;
-    dmaInProgress = false;
+    commandTables = 0;
+    commandCond = KTHREAD_COND_INITIALIZER;
     error = 0;
+    activeSlots = 0;
+    failedSlots = 0;
+    usedSlots = 0;
+    pendingWrites = 0;
+    size_t numSlots = CAP_NCS(capabilities);
+    slotMask = numSlots == 32 ? 0xFFFFFFFF : (1U << numSlots) - 1;
+    ncq = false;
+    nonQueuedCommand = false;
+    writeFailed = false;
 }
 
-bool AhciDevice::finishDmaTransfer() {
-    if (!dmaInProgress) return true;
+// Waits until a command can be sent and reserves a command slot for it.
+unsigned int AhciDevice::allocateSlot(bool queued) {
+    Interrupts::disable();
+    while (true) {
+        releaseFinishedWrites();
+
+        // Queued and non-queued commands cannot be mixed, so non-queued
+        // commands need exclusive access to the port.
+        uint32_t freeSlots = slotMask & ~usedSlots;
+        bool allowed = queued ? !nonQueuedCommand : usedSlots == 0;
+        if (freeSlots && allowed) {
+            unsigned int slot = __builtin_ctz(freeSlots);
+            usedSlots |= 1U << slot;
+            if (!queued) nonQueuedCommand = true;
+            Interrupts::enable();
+            return slot;
+        }
 
-    while (awaitingInterrupt) {
-        sched_yield();
+        kthread_cond_wait(&commandCond, nullptr);
     }
+}
 
-    dmaInProgress = false;
-    if (error) {
-        Log::printf("AHCI error 0x%X\n", error);
-        error = 0;
+bool AhciDevice::finishWrites() {
+    Interrupts::disable();
+    while (pendingWrites & activeSlots) {
+        kthread_cond_wait(&commandCond, nullptr);
+    }
+    releaseFinishedWrites();
+    bool failed = writeFailed;
+    writeFailed = false;
+    uint32_t errorStatus = error;
+    Interrupts::enable();
+
+    if (failed) {
+        Log::printf("AHCI error 0x%X\n", errorStatus);
+        errno = EIO;
         return false;
     }
     return true;
 }
 
 bool AhciDevice::identify() {
+    // Allocate the command tables for all command slots.
+    commandTables = kernelSpace->mapMemory(COMMAND_TABLES_SIZE,
+            PROT_READ | PROT_WRITE);
+    if (!commandTables) return false;
+    memset((void*) commandTables, 0, COMMAND_TABLES_SIZE);
+
     // Start the DMA engine.
     uint32_t cmd = readRegister(REGISTER_PxCMD);
     cmd |= PxCMD_ST;
@@ -306,8 +404,9 @@ bool AhciDevice::identify() {
     paddr_t phys = kernelSpace->getPhysicalAddress(virt);
 
     // Ask the device to identify itself.
-    if (!sendDmaCommand(COMMAND_IDENTIFY_DEVICE, phys, 512, false, 0, 0) ||
-            !finishDmaTransfer()) {
+    unsigned int slot = sendCommand(COMMAND_IDENTIFY_DEVICE, &phys, 512,
+            false, 0, 0);
+    if (!waitForCommands(1U << slot)) {
         kernelSpace->unmapMemory(virt, PAGESIZE);
         return false;
     }
@@ -335,6 +434,15 @@ bool AhciDevice::identify() {
             stats.st_blksize = 2 * (data[117] | (data[118] << 16));
         }
     }
+
+    if (capabilities & CAP_SNCQ && data[76] & (1 << 8)) {
+        // The device supports native command queuing.
+        ncq = true;
+        size_t queueDepth = (data[75] & 0x1F) + 1;
+        if (queueDepth < 32) {
+            slotMask &= (1U << queueDepth) - 1;
+        }
+    }
     kernelSpace->unmapMemory(virt, PAGESIZE);
 
     if (__builtin_mul_overflow(sectors, stats.st_blksize, &stats.st_size)) {
@@ -375,13 +483,20 @@ off_t AhciDevice::lseek(off_t offset, int whence) {
 void AhciDevice::onIrq(const InterruptContext* /*context*/,
         uint32_t interruptStatus) {
     if (interruptStatus & PORT_INTERRUPT_ERROR) {
+        // We cannot tell which of the outstanding commands has failed, so
+        // all of them are considered as failed.
         error = interruptStatus & PORT_INTERRUPT_ERROR;
+        failedSlots |= activeSlots;
+        activeSlots = 0;
+        restartPort();
+    } else {
+        // Queued commands are complete once their bit in PxSACT has been
+        // cleared. For other commands only PxCI is relevant.
+        activeSlots &= readRegister(REGISTER_PxCI) |
+                readRegister(REGISTER_PxSACT);
     }
 
-    uint32_t commandIssue = readRegister(REGISTER_PxCI);
-    if (!commandIssue) {
-        awaitingInterrupt = false;
-    }
+    kthread_cond_broadcast(&commandCond);
 }
 
 short AhciDevice::poll() {
@@ -402,133 +517,246 @@ bool AhciDevice::readUncached(void* buffer, size_t size, off_t offset,
     vaddr_t aligned = virt & ~PAGE_MISALIGN;
     paddr_t phys = kernelSpace->getPhysicalAddress(aligned);
     phys += virt - aligned;
-    if (!sendDmaCommand(COMMAND_READ_DMA_EXT, phys, size, false,
-            lba, sectors)) {
+    unsigned int slot = sendCommand(COMMAND_READ_DMA_EXT, &phys, size, false,
+            lba, sectors);
+    if (!waitForCommands(1U << slot)) {
+        errno = EIO;
         return false;
     }
-    if (!finishDmaTransfer()) return false;
 
     return true;
 }
 
-int AhciDevice::sync(int /*flags*/) {
-    if (!sendDmaCommand(COMMAND_FLUSH_CACHE, 0, 0, false, 0, 0) ||
-            !finishDmaTransfer()) {
-        errno = EIO;
-        return -1;
-    }
-    return 0;
-}
-
-bool AhciDevice::writeUncached(const void* buffer, size_t size, off_t offset,
-        int /*flags*/) {
+bool AhciDevice::readUncachedPages(void* const* buffers, size_t size,
+        off_t offset, int /*flags*/) {
     assert(offset % stats.st_blksize == 0);
     assert(size % stats.st_blksize == 0);
-    assert(size <= PAGESIZE);
     assert(offset < stats.st_size);
 
-    size_t sectors = size / stats.st_blksize;
-    uint64_t lba = offset / stats.st_blksize;
+    // All commands are sent before waiting for any of them so that the
+    // device can process them concurrently.
+    uint32_t slots = 0;
+    while (size > 0) {
+        paddr_t phys[MAX_PRDT_ENTRIES];
+        size_t readSize = 0;
+        size_t pages = 0;
+        while (pages < MAX_PRDT_ENTRIES && readSize < size) {
+            phys[pages] = kernelSpace->getPhysicalAddress(
+                    (vaddr_t) buffers[pages]);
+            pages++;
+            readSize += PAGESIZE;
+        }
+        if (readSize > size) readSize = size;
+
+        size_t sectors = readSize / stats.st_blksize;
+        uint64_t lba = offset / stats.st_blksize;
+        slots |= 1U << sendCommand(COMMAND_READ_DMA_EXT, phys, readSize, false,
+                lba, sectors);
+
+        if (!ncq) {
+            // Without NCQ only one command can be active at a time.
+            if (!waitForCommands(slots)) {
+                errno = EIO;
+                return false;
+            }
+            slots = 0;
+        }
 
-    vaddr_t virt = (vaddr_t) buffer;
-    vaddr_t aligned = virt & ~PAGE_MISALIGN;
-    paddr_t phys = kernelSpace->getPhysicalAddress(aligned);
-    phys += virt - aligned;
-    if (!sendDmaCommand(COMMAND_WRITE_DMA_EXT, phys, size, true, lba,
-            sectors)) {
+        buffers += pages;
+        offset += readSize;
+        size -= readSize;
+    }
+
+    if (!waitForCommands(slots)) {
         errno = EIO;
         return false;
     }
-
     return true;
 }
 
-struct CommandHeader {
-    uint16_t flags;
-    uint16_t prdtl;
-    uint32_t prdbc;
-    uint32_t ctba;
-    uint32_t ctbau;
-    uint32_t reserved[4];
-};
-
-struct CommandFis {
-    uint8_t type;
-    uint8_t flags;
-    uint8_t command;
-    uint8_t featuresLow;
-    uint8_t lba0;
-    uint8_t lba1;
-    uint8_t lba2;
-    uint8_t device;
-    uint8_t lba3;
-    uint8_t lba4;
-    uint8_t lba5;
-    uint8_t featuresHigh;
-    uint16_t count;
-    uint8_t icc;
-    uint8_t control;
-    uint32_t auxiliary;
-};
+// This function is called with interrupts disabled.
+void AhciDevice::releaseFinishedWrites() {
+    uint32_t finishedWrites = pendingWrites & ~activeSlots;
+    if (!finishedWrites) return;
 
-struct PrdtEntry {
-    uint32_t dba;
-    uint32_t dbau;
-    uint32_t reserved;
-    uint32_t byteCount;
-};
+    if (failedSlots & finishedWrites) {
+        writeFailed = true;
+    }
+    failedSlots &= ~finishedWrites;
+    pendingWrites &= ~finishedWrites;
+    usedSlots &= ~finishedWrites;
+    if (usedSlots == 0) {
+        nonQueuedCommand = false;
+    }
+}
 
-struct CommandTable {
-    CommandFis cfis;
-    char padding[44];
-    char acmd[16];
-    char reserved[48];
-    PrdtEntry entry;
-};
+// This function is called from the interrupt handler after an error. Stopping
+// the port aborts all outstanding commands.
+void AhciDevice::restartPort() {
+    uint32_t cmd = readRegister(REGISTER_PxCMD);
+    writeRegister(REGISTER_PxCMD, cmd & ~PxCMD_ST);
+    while (readRegister(REGISTER_PxCMD) & PxCMD_CR) {
+        // Wait until the command list is no longer running.
+    }
 
-bool AhciDevice::sendDmaCommand(uint8_t command, paddr_t physicalAddress,
-        size_t size, bool write, uint64_t lba, uint16_t blockCount) {
-    if (!finishDmaTransfer()) return false;
+    writeRegister(REGISTER_PxSERR, readRegister(REGISTER_PxSERR));
+    writeRegister(REGISTER_PxIS, readRegister(REGISTER_PxIS));
+    writeRegister(REGISTER_PxCMD, cmd | PxCMD_ST);
+}
 
-    CommandHeader* header = (CommandHeader*) portMemVirt;
-    CommandTable* table = (CommandTable*) (portMemVirt + 0x500);
+// Each physical address describes a buffer that extends to the end of its
+// page or to the end of the transfer. Returns the slot used for the command.
+unsigned int AhciDevice::sendCommand(uint8_t command,
+        const paddr_t* physicalAddresses, size_t size, bool write, uint64_t lba,
+        uint16_t blockCount) {
+    bool queued = ncq && (command == COMMAND_READ_DMA_EXT ||
+            command == COMMAND_WRITE_DMA_EXT);
+    unsigned int slot = allocateSlot(queued);
+
+    CommandHeader* header = (CommandHeader*) portMemVirt + slot;
+    vaddr_t tableVirt = commandTables + slot * sizeof(CommandTable);
+    CommandTable* table = (CommandTable*) tableVirt;
+    paddr_t tablePhys = kernelSpace->getPhysicalAddress(tableVirt &
+            ~PAGE_MISALIGN) + (tableVirt & PAGE_MISALIGN);
 
     CommandFis* cfis = &table->cfis;
     cfis->type = FIS_TYPE_REG_H2D;
     cfis->flags = 0x80;
-    cfis->command = command;
     cfis->lba0 = lba & 0xFF;
     cfis->lba1 = (lba >> 8) & 0xFF;
     cfis->lba2 = (lba >> 16) & 0xFF;
     cfis->lba3 = (lba >> 24) & 0xFF;
     cfis->lba4 = (lba >> 32) & 0xFF;
     cfis->lba5 = (lba >> 40) & 0xFF;
-    cfis->count = blockCount;
     cfis->device = 0x40;
 
-    if (size > 0) {
-        PrdtEntry* prdt = &table->entry;
+    if (queued) {
+        // For queued commands the block count is passed in the features
+        // register and the count register contains the tag.
+        cfis->command = write ? COMMAND_WRITE_FPDMA_QUEUED :
+                COMMAND_READ_FPDMA_QUEUED;
+        cfis->featuresLow = blockCount & 0xFF;
+        cfis->featuresHigh = blockCount >> 8;
+        cfis->count = slot << 3;
+    } else {
+        cfis->command = command;
+        cfis->featuresLow = 0;
+        cfis->featuresHigh = 0;
+        cfis->count = blockCount;
+    }
+
+    size_t entries = 0;
+    while (size > 0) {
+        assert(entries < MAX_PRDT_ENTRIES);
+        paddr_t physicalAddress = physicalAddresses[entries];
+        size_t entrySize = PAGESIZE - (physicalAddress & PAGE_MISALIGN);
+        if (entrySize > size) entrySize = size;
+
+        PrdtEntry* prdt = &table->entries[entries++];
         prdt->dba = physicalAddress & 0xFFFFFFFF;
         prdt->dbau = (uint64_t) physicalAddress >> 32;
         prdt->reserved = 0;
-        prdt->byteCount = size - 1;
+        prdt->byteCount = entrySize - 1;
+        size -= entrySize;
     }
 
     header->flags = 5;
     if (write) {
         header->flags |= (1 << 6);
     }
-    header->prdtl = size ? 1 : 0;
+    header->prdtl = entries;
     header->prdbc = 0;
-    uint64_t tablePhys = portMemPhys + 0x500;
     header->ctba = tablePhys & 0xFFFFFFFF;
-    header->ctbau = tablePhys >> 32;
+    header->ctbau = (uint64_t) tablePhys >> 32;
+
+    Interrupts::disable();
+    activeSlots |= 1U << slot;
+    if (queued) {
+        writeRegister(REGISTER_PxSACT, 1U << slot);
+    }
+    writeRegister(REGISTER_PxCI, 1U << slot);
+    Interrupts::enable();
+
+    return slot;
+}
+
+int AhciDevice::syncUncached(int /*flags*/) {
+    if (!finishWrites()) return -1;
+
+    unsigned int slot = sendCommand(COMMAND_FLUSH_CACHE, nullptr, 0, false, 0,
+            0);
+    if (!waitForCommands(1U << slot)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Waits until the commands in the given slots have finished and releases the
+// slots.
+bool AhciDevice::waitForCommands(uint32_t slots) {
+    Interrupts::disable();
+    while (activeSlots & slots) {
+        kthread_cond_wait(&commandCond, nullptr);
+    }
 
-    awaitingInterrupt = true;
-    dmaInProgress = true;
-    error = false;
+    bool failed = failedSlots & slots;
+    failedSlots &= ~slots;
+    usedSlots &= ~slots;
+    if (usedSlots == 0) {
+        nonQueuedCommand = false;
+    }
+    uint32_t errorStatus = error;
+    kthread_cond_broadcast(&commandCond);
+    Interrupts::enable();
+
+    if (failed) {
+        Log::printf("AHCI error 0x%X\n", errorStatus);
+        return false;
+    }
+    return true;
+}
+
+bool AhciDevice::writeUncached(const void* buffer, size_t size, off_t offset,
+        int flags) {
+    return writeUncachedPages(&buffer, size, offset, flags);
+}
+
+bool AhciDevice::writeUncachedPages(const void* const* buffers, size_t size,
+        off_t offset, int /*flags*/) {
+    assert(offset % stats.st_blksize == 0);
+    assert(size % stats.st_blksize == 0);
+    assert(offset < stats.st_size);
+
+    // The writes are not waited for here. They are completed by finishWrites.
+    while (size > 0) {
+        paddr_t phys[MAX_PRDT_ENTRIES];
+        size_t writeSize = 0;
+        size_t pages = 0;
+        while (pages < MAX_PRDT_ENTRIES && writeSize < size) {
+            vaddr_t virt = (vaddr_t) buffers[pages];
+            vaddr_t aligned = virt & ~PAGE_MISALIGN;
+            phys[pages] = kernelSpace->getPhysicalAddress(aligned) +
+                    (virt - aligned);
+            pages++;
+            writeSize += PAGESIZE - (virt - aligned);
+        }
+        if (writeSize > size) writeSize = size;
+
+        size_t sectors = writeSize / stats.st_blksize;
+        uint64_t lba = offset / stats.st_blksize;
+        unsigned int slot = sendCommand(COMMAND_WRITE_DMA_EXT, phys, writeSize,
+                true, lba, sectors);
+
+        Interrupts::disable();
+        pendingWrites |= 1U << slot;
+        Interrupts::enable();
+
+        buffers += pages;
+        offset += writeSize;
+        size -= writeSize;
+    }
 
-    writeRegister(REGISTER_PxCI, 1);
     return true;
 }
 
@@ -1,4 +1,4 @@
-/* Copyright (c) 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -29,6 +29,8 @@
 #define PAGE_WRITABLE (1 << 1)
 #define PAGE_USER (1 << 2)
 #define PAGE_WRITE_COMBINING (1 << 7)
+#define PAGE_COPY_ON_WRITE (1 << 9)
+#define PAGE_CACHE_FRAME (1 << 10)
 
 extern "C" {
 extern symbol_t bootstrapBegin;
@@ -64,6 +66,11 @@ static inline void addressToIndex(
 static inline int protectionToFlags(int protection) {
     int flags = PAGE_PRESENT;
     if (protection & PROT_WRITE) flags |= PAGE_WRITABLE;
+    if (protection & PROT_COPY_ON_WRITE) {
+        // The page becomes writable when it is written to for the first time.
+        flags = (flags & ~PAGE_WRITABLE) | PAGE_COPY_ON_WRITE;
+    }
+    if (protection & PROT_CACHE_FRAME) flags |= PAGE_CACHE_FRAME;
     if (protection & PROT_WRITE_COMBINING && AddressSpace::patSupported) {
         flags |= PAGE_WRITE_COMBINING;
     }
@@ -71,6 +78,8 @@ static inline int protectionToFlags(int protection) {
 }
 
 AddressSpace::AddressSpace() {
+    fileMappings = nullptr;
+
     if (this == kernelSpace) {
         pageDir = (paddr_t) &kernelPageDirectory;
         mappingArea = (vaddr_t) _kernelMappingArea;
@@ -194,6 +203,10 @@ void AddressSpace::activate() {
 }
 
 paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
+    return getPageTableEntry(virtualAddress) & ~PAGE_MISALIGN;
+}
+
+uintptr_t AddressSpace::getPageTableEntry(vaddr_t virtualAddress) {
     if (this == kernelSpace && virtualAddress < 0xC0000000) return 0;
 
     size_t pdIndex;
@@ -205,7 +218,7 @@ paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
         if (!pageDirectory[pdIndex]) return 0;
         uintptr_t* pageTable =
                 (uintptr_t*) (RECURSIVE_MAPPING + PAGESIZE * pdIndex);
-        return pageTable[ptIndex] & ~PAGE_MISALIGN;
+        return pageTable[ptIndex];
     } else {
         uintptr_t* pageDirectory = (uintptr_t*) kernelSpace->mapAt(mappingArea,
                 pageDir, PROT_READ);
@@ -215,7 +228,7 @@ paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
 
         uintptr_t* pageTable = (uintptr_t*) kernelSpace->mapAt(mappingArea,
                 pdEntry & ~PAGE_MISALIGN, PROT_READ);
-        paddr_t result = pageTable[ptIndex] & ~PAGE_MISALIGN;
+        uintptr_t result = pageTable[ptIndex];
         kernelSpace->unmap(mappingArea);
         return result;
     }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -24,6 +24,7 @@
 #include <dennix/kernel/list.h>
 #include <dennix/kernel/panic.h>
 #include <dennix/kernel/portio.h>
+#include <dennix/kernel/process.h>
 #include <dennix/kernel/registers.h>
 #include <dennix/kernel/signal.h>
 #include <dennix/kernel/thread.h>
@@ -192,6 +193,18 @@ void Interrupts::enable() {
     asm volatile ("sti");
 }
 
+bool Interrupts::saveAndDisable() {
+    uintptr_t flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags & 0x200;
+}
+
+void Interrupts::restore(bool enabled) {
+    if (enabled) {
+        asm volatile ("sti");
+    }
+}
+
 static const char* exceptionName(unsigned int exception) {
     switch (exception) {
     case EX_DIVIDE_BY_ZERO: return "Divide-by-zero Exception";
@@ -219,7 +232,38 @@ static const char* exceptionName(unsigned int exception) {
     }
 }
 
+static int handlePageFault(const InterruptContext* context) {
+    vaddr_t address;
+    asm ("mov %%cr2, %0" : "=r"(address));
+    // Bit 1 of the error code is set when the fault was caused by a write.
+    bool write = context->error & 2;
+
+    Thread* thread = Thread::current();
+    if (!thread || !thread->process->addressSpace) return SIGSEGV;
+
+    // Loading a page of a mapped file might need to wait for I/O, so we
+    // need to allow interrupts if they were enabled before the fault.
+#ifdef __i386__
+    bool interrupts = context->eflags & 0x200;
+#else
+    bool interrupts = context->rflags & 0x200;
+#endif
+    if (interrupts) {
+        Interrupts::enable();
+    }
+    int signal = thread->process->addressSpace->handlePageFault(address,
+            write);
+    Interrupts::disable();
+    return signal;
+}
+
 static bool handleUserspaceException(const InterruptContext* context) {
+    int pageFaultSignal = 0;
+    if (context->interrupt == EX_PAGE_FAULT) {
+        pageFaultSignal = handlePageFault(context);
+        if (!pageFaultSignal) return true;
+    }
+
     siginfo_t siginfo = {};
     switch (context->interrupt) {
     case EX_DIVIDE_BY_ZERO:
@@ -247,8 +291,8 @@ static bool handleUserspaceException(const InterruptContext* context) {
         siginfo.si_addr = (void*) context->INSTRUCTION_POINTER;
         break;
     case EX_PAGE_FAULT:
-        siginfo.si_signo = SIGSEGV;
-        siginfo.si_code = SEGV_MAPERR;
+        siginfo.si_signo = pageFaultSignal;
+        siginfo.si_code = pageFaultSignal == SIGBUS ? BUS_ADRERR : SEGV_MAPERR;
         asm ("mov %%cr2, %0" : "=r"(siginfo.si_addr));
         break;
     case EX_X87_FLOATING_POINT_EXCEPTION:
@@ -270,6 +314,10 @@ extern "C" InterruptContext* handleInterrupt(InterruptContext* context) {
     if (context->interrupt <= 31 && context->cs != 0x8) {
         if (!handleUserspaceException(context)) goto handleKernelException;
     } else if (context->interrupt <= 31) { // CPU Exception
+        // The kernel may cause page faults when writing to user memory.
+        if (context->interrupt == EX_PAGE_FAULT && !handlePageFault(context)) {
+            return newContext;
+        }
 handleKernelException:
         PANIC(context, "Unexpected %s", exceptionName(context->interrupt));
     } else if (context->interrupt == 0xFF) {
@@ -283,7 +331,11 @@ handleKernelException:
 
         if (irq == Interrupts::timerIrq) {
             console->display->update();
-            newContext = Thread::schedule(context);
+            newContext = Thread::schedule(context, true);
+        } else if (Thread::current() == Thread::idleThread) {
+            // Run threads that were woken up by the interrupt immediately
+            // instead of waiting for the next timer interrupt.
+            newContext = Thread::schedule(context, true);
         }
 
         // Send End of Interrupt
@@ -299,6 +351,10 @@ handleKernelException:
         }
     } else if (context->interrupt == 0x31) {
         newContext = Thread::schedule(context);
+        if (Thread::current() == Thread::idleThread) {
+            // The timer might not fire for a while when the system is idle.
+            console->display->update();
+        }
     } else if (context->interrupt == 0x32) {
         newContext = Signal::sigreturn(context);
     }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -35,6 +35,8 @@
 #define PAGE_WRITABLE (1 << 1)
 #define PAGE_USER (1 << 2)
 #define PAGE_WRITE_COMBINING (1 << 7)
+#define PAGE_COPY_ON_WRITE (1 << 9)
+#define PAGE_CACHE_FRAME (1 << 10)
 #define PAGE_NO_EXECUTE (1UL << 63)
 #define PAGE_FLAGS 0xFFF0000000000FFF
 
@@ -87,6 +89,11 @@ static PageIndex addressToIndex(vaddr_t virtualAddress) {
 static inline uintptr_t protectionToFlags(int protection) {
     uintptr_t flags = PAGE_PRESENT;
     if (protection & PROT_WRITE) flags |= PAGE_WRITABLE;
+    if (protection & PROT_COPY_ON_WRITE) {
+        // The page becomes writable when it is written to for the first time.
+        flags = (flags & ~PAGE_WRITABLE) | PAGE_COPY_ON_WRITE;
+    }
+    if (protection & PROT_CACHE_FRAME) flags |= PAGE_CACHE_FRAME;
     if (!(protection & PROT_EXEC)) flags |= PAGE_NO_EXECUTE;
     if (protection & PROT_WRITE_COMBINING && AddressSpace::patSupported) {
         flags |= PAGE_WRITE_COMBINING;
@@ -95,6 +102,8 @@ static inline uintptr_t protectionToFlags(int protection) {
 }
 
 AddressSpace::AddressSpace() {
+    fileMappings = nullptr;
+
     if (this == kernelSpace) {
         pml4 = (paddr_t) &kernelPml4;
         mappingArea = (vaddr_t) _kernelMappingArea;
@@ -236,6 +245,10 @@ void AddressSpace::activate() {
 }
 
 paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
+    return getPageTableEntry(virtualAddress) & ~PAGE_FLAGS;
+}
+
+uintptr_t AddressSpace::getPageTableEntry(vaddr_t virtualAddress) {
     if (this == kernelSpace && virtualAddress < 0xFFFF800000000000) return 0;
     PageIndex index = addressToIndex(virtualAddress);
 
@@ -249,7 +262,7 @@ paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
         if (!pageDir[index.pdIndex]) return 0;
         uintptr_t* pageTable = (uintptr_t*) RECURSIVE_PAGETABLE(index.pml4Index,
                 index.pdptIndex, index.pdIndex);
-        return pageTable[index.ptIndex] & ~PAGE_FLAGS;
+        return pageTable[index.ptIndex];
     } else {
         uintptr_t* pml4Mapping = (uintptr_t*) kernelSpace->mapAt(mappingArea,
                 pml4, PROT_READ);
@@ -271,7 +284,7 @@ paddr_t AddressSpace::getPhysicalAddress(vaddr_t virtualAddress) {
 
         uintptr_t* pageTable = (uintptr_t*) kernelSpace->mapAt(mappingArea,
                 pdEntry & ~PAGE_FLAGS, PROT_READ);
-        paddr_t result = pageTable[index.ptIndex] & ~PAGE_FLAGS;
+        uintptr_t result = pageTable[index.ptIndex];
         kernelSpace->unmap(mappingArea);
         return result;
     }
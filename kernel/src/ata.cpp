@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -19,7 +19,6 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <dennix/seek.h>
@@ -177,6 +176,7 @@ AtaChannel::AtaChannel(uint16_t iobase, uint16_t ctrlbase,
 
     awaitingInterrupt = false;
     dmaInProgress = false;
+    interruptCond = KTHREAD_COND_INITIALIZER;
     error = false;
     irqHandler.func = onAtaIrq;
     irqHandler.user = this;
@@ -186,9 +186,11 @@ AtaChannel::AtaChannel(uint16_t iobase, uint16_t ctrlbase,
 bool AtaChannel::finishDmaTransfer() {
     if (!dmaInProgress) return true;
 
+    Interrupts::disable();
     while (awaitingInterrupt) {
-        sched_yield();
+        kthread_cond_wait(&interruptCond, nullptr);
     }
+    Interrupts::enable();
 
     outb(busmasterBase + REGISTER_BUSMASTER_COMMAND, 0);
     dmaInProgress = false;
@@ -290,6 +292,7 @@ void AtaChannel::onIrq(const InterruptContext* /*context*/) {
         error = true;
     }
     awaitingInterrupt = false;
+    kthread_cond_broadcast(&interruptCond);
 }
 
 bool AtaChannel::readSectors(char* buffer, size_t sectorCount, uint64_t lba,
@@ -458,7 +461,7 @@ bool AtaDevice::writeUncached(const void* buffer, size_t size, off_t offset,
     return true;
 }
 
-int AtaDevice::sync(int /*flags*/) {
+int AtaDevice::syncUncached(int /*flags*/) {
     if (!channel->flushCache(secondary)) {
         errno = EIO;
         return -1;
@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,10 +17,29 @@
  * Cached block device.
  */
 
+#include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <dennix/kernel/addressspace.h>
 #include <dennix/kernel/blockcache.h>
+#include <dennix/kernel/clock.h>
+#include <dennix/kernel/ext234fs.h>
 #include <dennix/kernel/interrupts.h>
+#include <dennix/kernel/thread.h>
+
+// Writes are flushed immediately once this many blocks are dirty.
+#define MAX_DIRTY_BLOCKS 1024
+// Interval in seconds in which the flusher thread writes back dirty blocks.
+#define FLUSH_INTERVAL 5
+// Maximum number of blocks that are transferred with a single request.
+#define MAX_TRANSFER_BLOCKS 32
+
+static kthread_mutex_t flusherMutex = KTHREAD_MUTEX_INITIALIZER;
+static kthread_cond_t flusherCond = KTHREAD_COND_INITIALIZER;
+static SinglyLinkedList<BlockCacheDevice, &BlockCacheDevice::nextDevice>
+        devices;
+
+ObjectCache BlockCacheDevice::Block::objectCache(sizeof(Block));
 
 static void worker(void* device) {
     BlockCacheDevice* dev = (BlockCacheDevice*) device;
@@ -31,14 +50,174 @@ BlockCacheDevice::BlockCacheDevice(mode_t mode, dev_t dev)
         : Vnode(mode | S_IFBLK, dev),
         blocks(sizeof(blockBuffer) / sizeof(blockBuffer[0]), blockBuffer) {
     cacheMutex = KTHREAD_MUTEX_INITIALIZER;
+    dirtyCount = 0;
     workerJob.func = worker;
     workerJob.context = this;
+
+    AutoLock lock(&flusherMutex);
+    devices.addFront(*this);
+}
+
+bool BlockCacheDevice::flush() {
+    AutoLock lock(&mutex);
+    return flushUnlocked();
+}
+
+bool BlockCacheDevice::finishWrites() {
+    return true;
+}
+
+bool BlockCacheDevice::flushUnlocked() {
+    AutoLock lock(&cacheMutex);
+
+    // Dirty blocks are written in ascending order and runs of adjacent dirty
+    // blocks are written with a single request. The device might still be
+    // processing the writes when writeUncachedPages returns, so the blocks
+    // are only marked as clean once all writes have finished.
+    auto iter = dirtyBlocks.begin();
+    while (iter != dirtyBlocks.end()) {
+        Block* first = &*iter;
+        const void* buffers[MAX_TRANSFER_BLOCKS];
+        size_t count = 0;
+        size_t size = 0;
+
+        Block* previous = nullptr;
+        while (iter != dirtyBlocks.end() && count < MAX_TRANSFER_BLOCKS) {
+            Block* block = &*iter;
+            if (previous && (block->blockNumber != previous->blockNumber + 1 ||
+                    previous->dirtyEnd != PAGESIZE || block->dirtyBegin != 0)) {
+                break;
+            }
+
+            buffers[count++] = (char*) block->address + block->dirtyBegin;
+            size += block->dirtyEnd - block->dirtyBegin;
+            previous = block;
+            ++iter;
+        }
+
+        off_t offset = first->blockNumber * PAGESIZE + first->dirtyBegin;
+        if (!writeUncachedPages(buffers, size, offset, 0)) {
+            finishWrites();
+            errno = EIO;
+            return false;
+        }
+    }
+
+    if (!finishWrites()) {
+        errno = EIO;
+        return false;
+    }
+
+    while (!dirtyBlocks.empty()) {
+        Block* block = &dirtyBlocks.front();
+        dirtyBlocks.remove(*block);
+        block->dirtyBegin = 0;
+        block->dirtyEnd = 0;
+    }
+    dirtyCount = 0;
+
+    return true;
 }
 
 bool BlockCacheDevice::isSeekable() {
     return true;
 }
 
+void BlockCacheDevice::freeBlock(Block* block) {
+    paddr_t physicalAddress = kernelSpace->getPhysicalAddress(block->address);
+    kernelSpace->unmapPhysical(block->address, PAGESIZE);
+    returnCache(physicalAddress);
+    delete block;
+}
+
+// This function is called with the mutex and the cacheMutex locked. The
+// cacheMutex is temporarily unlocked while memory is allocated.
+bool BlockCacheDevice::loadBlocks(uint64_t blockNumber, size_t count,
+        int flags) {
+    assert(count <= MAX_TRANSFER_BLOCKS);
+    kthread_mutex_unlock(&cacheMutex);
+
+    Block* newBlocks[MAX_TRANSFER_BLOCKS];
+    size_t allocated = 0;
+    while (allocated < count) {
+        paddr_t physicalAddress = allocateCache();
+        if (!physicalAddress) break;
+        vaddr_t address = kernelSpace->mapPhysical(physicalAddress, PAGESIZE,
+                PROT_READ | PROT_WRITE);
+        if (!address) {
+            returnCache(physicalAddress);
+            break;
+        }
+        Block* block = new Block(address, blockNumber + allocated);
+        if (!block) {
+            kernelSpace->unmapPhysical(address, PAGESIZE);
+            returnCache(physicalAddress);
+            break;
+        }
+        newBlocks[allocated++] = block;
+    }
+
+    if (allocated == 0) {
+        errno = ENOMEM;
+        kthread_mutex_lock(&cacheMutex);
+        return false;
+    }
+
+    void* buffers[MAX_TRANSFER_BLOCKS];
+    for (size_t i = 0; i < allocated; i++) {
+        buffers[i] = (void*) newBlocks[i]->address;
+    }
+
+    off_t offset = blockNumber * PAGESIZE;
+    size_t readSize = allocated * PAGESIZE;
+    if (unlikely((off_t) readSize > stats.st_size - offset)) {
+        // The device ends before the end of the last page.
+        readSize = stats.st_size - offset;
+    }
+
+    // Blocks are only ever added while the mutex is locked, so none of these
+    // blocks can have been loaded in the meantime.
+    kthread_mutex_lock(&cacheMutex);
+    if (!readUncachedPages(buffers, readSize, offset, flags)) {
+        kthread_mutex_unlock(&cacheMutex);
+        for (size_t i = 0; i < allocated; i++) {
+            freeBlock(newBlocks[i]);
+        }
+        kthread_mutex_lock(&cacheMutex);
+        return false;
+    }
+
+    for (size_t i = 0; i < allocated; i++) {
+        blocks.add(newBlocks[i]);
+        accessedBlocks.addBack(*newBlocks[i]);
+    }
+    return true;
+}
+
+void BlockCacheDevice::markDirty(Block* block, size_t begin, size_t end) {
+    if (block->dirtyEnd != 0) {
+        if (begin < block->dirtyBegin) block->dirtyBegin = begin;
+        if (end > block->dirtyEnd) block->dirtyEnd = end;
+        return;
+    }
+
+    block->dirtyBegin = begin;
+    block->dirtyEnd = end;
+    dirtyCount++;
+
+    auto iter = dirtyBlocks.end();
+    for (auto i = dirtyBlocks.begin(); i != dirtyBlocks.end(); ++i) {
+        if (i->blockNumber > block->blockNumber) break;
+        iter = i;
+    }
+
+    if (iter == dirtyBlocks.end()) {
+        dirtyBlocks.addFront(*block);
+    } else {
+        dirtyBlocks.addAfter(iter, *block);
+    }
+}
+
 void BlockCacheDevice::useBlock(Block* block) {
     accessedBlocks.remove(*block);
     accessedBlocks.addBack(*block);
@@ -60,64 +239,32 @@ ssize_t BlockCacheDevice::pread(void* buffer, size_t size, off_t offset,
     }
 
     kthread_mutex_lock(&cacheMutex);
-    Block* allocatedBlock = nullptr;
     ssize_t bytesRead = 0;
     char* buf = (char*) buffer;
+    uint64_t lastBlock = (offset + size - 1) / PAGESIZE;
 
     while (size > 0) {
         uint64_t blockNumber = offset / PAGESIZE;
-        off_t blockOffset = blockNumber * PAGESIZE;
 
         Block* block = blocks.get(blockNumber);
         if (!block) {
-            if (!allocatedBlock) {
-                kthread_mutex_unlock(&cacheMutex);
-
-                paddr_t physicalAddress = allocateCache();
-                if (!physicalAddress) {
-                    if (bytesRead) return bytesRead;
-                    errno = ENOMEM;
-                    return -1;
-                }
-                vaddr_t address = kernelSpace->mapPhysical(physicalAddress,
-                        PAGESIZE, PROT_READ | PROT_WRITE);
-                if (!address) {
-                    returnCache(physicalAddress);
-                    if (bytesRead) return bytesRead;
-                    errno = ENOMEM;
-                    return -1;
-                }
-                allocatedBlock = new Block(address, blockNumber);
-                if (!allocatedBlock) {
-                    kernelSpace->unmapPhysical(address, PAGESIZE);
-                    returnCache(physicalAddress);
-                    if (bytesRead) return bytesRead;
-                    return -1;
-                }
+            // Read all consecutive missing blocks of the request at once.
+            size_t count = 1;
+            while (count < MAX_TRANSFER_BLOCKS &&
+                    blockNumber + count <= lastBlock &&
+                    !blocks.get(blockNumber + count)) {
+                count++;
+            }
 
-                kthread_mutex_lock(&cacheMutex);
+            if (!loadBlocks(blockNumber, count, flags)) {
+                if (!bytesRead) bytesRead = -1;
+                break;
             }
 
+            // The block might have been reclaimed while the cacheMutex was
+            // unlocked.
             block = blocks.get(blockNumber);
-
-            if (!block) {
-                size_t readSize = PAGESIZE;
-                if (unlikely(blockOffset + PAGESIZE > stats.st_size)) {
-                    // The device ends before the end of the page.
-                    readSize = stats.st_size - blockOffset;
-                }
-
-                if (!readUncached((void*) allocatedBlock->address, readSize,
-                        blockOffset, flags)) {
-                    if (!bytesRead) bytesRead = -1;
-                    break;
-                }
-
-                block = allocatedBlock;
-                allocatedBlock = nullptr;
-                blocks.add(block);
-                accessedBlocks.addBack(*block);
-            }
+            if (!block) continue;
         }
 
         useBlock(block);
@@ -133,16 +280,49 @@ ssize_t BlockCacheDevice::pread(void* buffer, size_t size, off_t offset,
     }
 
     kthread_mutex_unlock(&cacheMutex);
+    return bytesRead;
+}
 
-    if (allocatedBlock) {
-        paddr_t physicalAddress = kernelSpace->getPhysicalAddress(
-                allocatedBlock->address);
-        kernelSpace->unmapPhysical(allocatedBlock->address, PAGESIZE);
-        returnCache(physicalAddress);
-        delete allocatedBlock;
+void BlockCacheDevice::readahead(off_t offset, size_t size) {
+    if (size == 0 || offset < 0) return;
+
+    AutoLock lock(&mutex);
+    if (offset >= stats.st_size) return;
+    if ((off_t) size > stats.st_size - offset) {
+        size = stats.st_size - offset;
     }
 
-    return bytesRead;
+    AutoLock cacheLock(&cacheMutex);
+    uint64_t blockNumber = offset / PAGESIZE;
+    uint64_t lastBlock = (offset + size - 1) / PAGESIZE;
+
+    while (blockNumber <= lastBlock) {
+        if (blocks.get(blockNumber)) {
+            blockNumber++;
+            continue;
+        }
+
+        size_t count = 1;
+        while (count < MAX_TRANSFER_BLOCKS &&
+                blockNumber + count <= lastBlock &&
+                !blocks.get(blockNumber + count)) {
+            count++;
+        }
+
+        if (!loadBlocks(blockNumber, count, 0)) return;
+        blockNumber += count;
+    }
+}
+
+bool BlockCacheDevice::readUncachedPages(void* const* buffers, size_t size,
+        off_t offset, int flags) {
+    for (size_t i = 0; size > 0; i++) {
+        size_t readSize = size < PAGESIZE ? size : PAGESIZE;
+        if (!readUncached(buffers[i], readSize, offset, flags)) return false;
+        offset += readSize;
+        size -= readSize;
+    }
+    return true;
 }
 
 ssize_t BlockCacheDevice::pwrite(const void* buffer, size_t size, off_t offset,
@@ -224,25 +404,22 @@ ssize_t BlockCacheDevice::pwrite(const void* buffer, size_t size, off_t offset,
                 block = allocatedBlock;
                 allocatedBlock = nullptr;
                 blocks.add(block);
+                accessedBlocks.addBack(*block);
             }
         }
 
         useBlock(block);
 
-        size_t writeSize = PAGESIZE - (offset & PAGE_MISALIGN);
+        size_t blockBegin = offset & PAGE_MISALIGN;
+        size_t writeSize = PAGESIZE - blockBegin;
         if (writeSize > size) writeSize = size;
 
-        memcpy((char*) block->address + (offset & PAGE_MISALIGN),
-                buf + bytesWritten, writeSize);
+        memcpy((char*) block->address + blockBegin, buf + bytesWritten,
+                writeSize);
 
-        off_t writeOffset = offset & ~(stats.st_blksize - 1);
-        size_t writeLength = ALIGNUP(writeSize, stats.st_blksize);
-
-        if (!writeUncached((char*) block->address + (writeOffset &
-                PAGE_MISALIGN), writeLength, writeOffset, flags)) {
-            if (bytesWritten == 0) return -1;
-            return bytesWritten;
-        }
+        // The block is written back later by the flusher thread.
+        markDirty(block, blockBegin & ~(stats.st_blksize - 1),
+                ALIGNUP(blockBegin + writeSize, stats.st_blksize));
 
         offset += writeSize;
         bytesWritten += writeSize;
@@ -252,11 +429,12 @@ ssize_t BlockCacheDevice::pwrite(const void* buffer, size_t size, off_t offset,
     kthread_mutex_unlock(&cacheMutex);
 
     if (allocatedBlock) {
-        paddr_t physicalAddress = kernelSpace->getPhysicalAddress(
-                allocatedBlock->address);
-        kernelSpace->unmapPhysical(allocatedBlock->address, PAGESIZE);
-        returnCache(physicalAddress);
-        delete allocatedBlock;
+        freeBlock(allocatedBlock);
+    }
+
+    if (bytesWritten > 0 && (flags & O_SYNC ||
+            dirtyCount > MAX_DIRTY_BLOCKS)) {
+        if (!flushUnlocked() && flags & O_SYNC) return -1;
     }
 
     return bytesWritten;
@@ -279,8 +457,23 @@ void BlockCacheDevice::freeUnusedBlocks() {
 paddr_t BlockCacheDevice::reclaimCache() {
     AutoLock lock(&cacheMutex);
 
-    if (accessedBlocks.empty()) return 0;
-    Block* block = &accessedBlocks.front();
+    // Dirty blocks cannot be reclaimed before they have been written back.
+    Block* block = nullptr;
+    for (Block& b : accessedBlocks) {
+        if (b.dirtyEnd == 0) {
+            block = &b;
+            break;
+        }
+    }
+
+    if (!block) {
+        // We cannot do the I/O here because the PMM is locked, so let the
+        // flusher thread write back the blocks.
+        if (!dirtyBlocks.empty()) {
+            kthread_cond_signal(&flusherCond);
+        }
+        return 0;
+    }
     accessedBlocks.remove(*block);
 
     blocks.remove(block->blockNumber);
@@ -299,9 +492,56 @@ paddr_t BlockCacheDevice::reclaimCache() {
     return physicalAddress;
 }
 
+bool BlockCacheDevice::writeUncachedPages(const void* const* buffers,
+        size_t size, off_t offset, int flags) {
+    for (size_t i = 0; size > 0; i++) {
+        size_t writeSize = PAGESIZE - ((vaddr_t) buffers[i] & PAGE_MISALIGN);
+        if (writeSize > size) writeSize = size;
+        if (!writeUncached(buffers[i], writeSize, offset, flags)) return false;
+        offset += writeSize;
+        size -= writeSize;
+    }
+    return true;
+}
+
+int BlockCacheDevice::sync(int flags) {
+    if (!flush()) return -1;
+    return syncUncached(flags);
+}
+
+static NORETURN void flusher() {
+    while (true) {
+        kthread_mutex_lock(&flusherMutex);
+        struct timespec endTime;
+        Clock::get(CLOCK_MONOTONIC)->getTime(&endTime);
+        endTime = timespecPlus(endTime, { FLUSH_INTERVAL, 0 });
+        kthread_cond_sigclockwait(&flusherCond, &flusherMutex,
+                CLOCK_MONOTONIC, &endTime);
+        kthread_mutex_unlock(&flusherMutex);
+
+        // Writing back delayed data of ext234 files dirties blocks, so this
+        // needs to happen before the devices are flushed.
+        Ext234Vnode::writeBackDelayedData(nullptr);
+
+        // Devices are never removed from the list, so it is safe to iterate
+        // it without holding the mutex.
+        for (BlockCacheDevice& device : devices) {
+            device.flush();
+        }
+    }
+}
+
+void BlockCacheDevice::startFlusher() {
+    Thread::startKernelThread(flusher);
+}
+
 BlockCacheDevice::Block::Block(vaddr_t address, uint64_t blockNumber) {
     this->address = address;
     this->blockNumber = blockNumber;
+    dirtyBegin = 0;
+    dirtyEnd = 0;
     prevAccessed = nullptr;
     nextAccessed = nullptr;
+    prevDirty = nullptr;
+    nextDirty = nullptr;
 }
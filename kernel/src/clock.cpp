@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2020 Dennis Wölfing
+/* Copyright (c) 2018, 2020, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,10 +18,10 @@
  */
 
 #include <errno.h>
-#include <sched.h>
 #include <dennix/kernel/clock.h>
 #include <dennix/kernel/process.h>
 #include <dennix/kernel/signal.h>
+#include <dennix/kernel/tsc.h>
 
 static Clock monotonicClock;
 static Clock realtimeClock;
@@ -38,7 +38,7 @@ struct timespec timespecPlus(struct timespec ts1, struct timespec ts2) {
     return result;
 }
 
-static struct timespec timespecMinus(struct timespec ts1, struct timespec ts2) {
+struct timespec timespecMinus(struct timespec ts1, struct timespec ts2) {
     struct timespec result;
     result.tv_sec = ts1.tv_sec - ts2.tv_sec;
     result.tv_nsec = ts1.tv_nsec - ts2.tv_nsec;
@@ -82,8 +82,38 @@ int Clock::getTime(struct timespec* result) {
     return 0;
 }
 
+int Clock::getPreciseTime(struct timespec* result) {
+    if (this != &monotonicClock && this != &realtimeClock) {
+        return getTime(result);
+    }
+
+    // Add the time since the clocks were last updated, so that the result is
+    // the same as clock_gettime would return from the time page.
+    bool interrupts = Interrupts::saveAndDisable();
+    uint64_t elapsed = Tsc::getElapsed();
+    *result = value;
+    Interrupts::restore(interrupts);
+
+    while (elapsed >= 1000000000) {
+        result->tv_sec++;
+        elapsed -= 1000000000;
+    }
+    result->tv_nsec += elapsed;
+    if (result->tv_nsec >= 1000000000L) {
+        result->tv_sec++;
+        result->tv_nsec -= 1000000000L;
+    }
+    return 0;
+}
+
 int Clock::nanosleep(int flags, const struct timespec* requested,
         struct timespec* remaining) {
+    // CPU time clocks only advance while the thread is running, so a blocked
+    // thread would never wake up.
+    if (this != &monotonicClock && this != &realtimeClock) {
+        return errno = EINVAL;
+    }
+
     if (requested->tv_nsec < 0 || requested->tv_nsec >= 1000000000L) {
         return errno = EINVAL;
     }
@@ -95,9 +125,12 @@ int Clock::nanosleep(int flags, const struct timespec* requested,
         abstime = timespecPlus(value, *requested);
     }
 
+    Interrupts::disable();
     while (timespecLess(value, abstime) && !Signal::isPending()) {
-        sched_yield();
+        struct timespec wakeupTime = toMonotonic(abstime);
+        Thread::block(&wakeupTime);
     }
+    Interrupts::enable();
 
     struct timespec diff = timespecMinus(abstime, value);
     if (diff.tv_sec > 0 || (diff.tv_sec == 0 && diff.tv_nsec > 0)) {
@@ -110,6 +143,7 @@ int Clock::nanosleep(int flags, const struct timespec* requested,
 
 int Clock::setTime(struct timespec* newValue) {
     value = *newValue;
+    Tsc::updateTimePage();
     return 0;
 }
 
@@ -122,6 +156,11 @@ void Clock::tick(unsigned long nanoseconds) {
     }
 }
 
+struct timespec Clock::toMonotonic(struct timespec time) {
+    if (this == &monotonicClock) return time;
+    return timespecPlus(monotonicClock.value, timespecMinus(time, value));
+}
+
 void Clock::onTick(bool user, unsigned long nanoseconds) {
     monotonicClock.tick(nanoseconds);
     realtimeClock.tick(nanoseconds);
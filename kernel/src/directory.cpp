@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -27,6 +27,7 @@
 #include <dennix/kernel/directory.h>
 #include <dennix/kernel/file.h>
 #include <dennix/kernel/filesystem.h>
+#include <dennix/kernel/namecache.h>
 #include <dennix/kernel/symlink.h>
 
 static kthread_mutex_t renameMutex = KTHREAD_MUTEX_INITIALIZER;
@@ -82,6 +83,7 @@ int DirectoryVnode::linkUnlocked(const char* name, size_t length,
     // is uninitialized so we cannot call operator=.
     new (&childNodes[childCount]) Reference<Vnode>(vnode);
     childCount++;
+    NameCache::remove(this, name, length);
 
     vnode->onLink();
     if (S_ISDIR(vnode->stats.st_mode)) {
@@ -97,8 +99,19 @@ Reference<Vnode> DirectoryVnode::getChildNode(const char* name) {
 }
 
 Reference<Vnode> DirectoryVnode::getChildNode(const char* name, size_t length) {
-    AutoLock lock(&mutex);
-    return getChildNodeUnlocked(name, length);
+    Reference<Vnode> vnode;
+    if (NameCache::lookup(this, name, length, vnode)) return vnode;
+    unsigned long generation = NameCache::getGeneration();
+
+    {
+        AutoLock lock(&mutex);
+        vnode = getChildNodeUnlocked(name, length);
+    }
+
+    if (vnode || errno == ENOENT) {
+        NameCache::add(this, name, length, vnode, generation);
+    }
+    return vnode;
 }
 
 Reference<Vnode> DirectoryVnode::getChildNodeUnlocked(const char* name,
@@ -217,6 +230,7 @@ int DirectoryVnode::mount(FileSystem* filesystem) {
     }
 
     mounted = filesystem;
+    NameCache::removeDirectory(this);
     return 0;
 }
 
@@ -408,6 +422,10 @@ int DirectoryVnode::unlinkUnlocked(const char* name, int flags) {
                 fileNames[i] = fileNames[childCount - 1];
             }
             childNodes[--childCount].~Reference();
+            NameCache::remove(this, name, nameLength);
+            if (S_ISDIR(vnodeStat.st_mode)) {
+                NameCache::removeDirectory((Vnode*) vnode);
+            }
 
             // Resize the list. Reallocation failure is not an error because we
             // are just making the list smaller.
@@ -439,6 +457,7 @@ int DirectoryVnode::unmount() {
         return -1;
     }
 
+    NameCache::removeFileSystem(mounted);
     if (!mounted->onUnmount()) return -1;
 
     delete mounted;
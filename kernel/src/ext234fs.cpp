@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -27,12 +27,90 @@
 
 // This implements mostly ext2 with a hint of ext4. Any filesystem formatted for
 // ext2 or ext3 should be supported unless special options were used during
-// filesystem creation.
-// TODO: We need to implement extent trees in order to properly use all ext4
-// 64bit features.
+// filesystem creation. On filesystems with the extents feature new files are
+// mapped using extent trees.
 
 #define ffs(x) __builtin_ffs(x)
 #define min(x, y) ((x) < (y) ? (x) : (y))
+// Clean bitmaps are dropped from memory once more than this many are cached.
+#define MAX_CACHED_BITMAPS 64
+// Limits for the number of blocks that are reserved for a growing file.
+#define MIN_RESERVATION 8
+#define MAX_RESERVATION 1024
+// Maximum amount of data in bytes for which delayed writes may set aside
+// blocks.
+#define MAX_DELAYED_DATA (16 * 1024 * 1024)
+
+// Extent trees map ranges of logical blocks to contiguous ranges of blocks on
+// the device. The root node is stored in i_block of the inode and all other
+// nodes occupy a whole block. Leaf nodes contain extents, all other nodes
+// contain indexes that point to nodes of the next level. Entries in each node
+// are sorted by their first logical block.
+
+static inline Extent* getExtents(ExtentHeader* header) {
+    return (Extent*) (header + 1);
+}
+
+static inline ExtentIndex* getIndexes(ExtentHeader* header) {
+    return (ExtentIndex*) (header + 1);
+}
+
+static inline uint64_t getExtentLength(const Extent* extent) {
+    uint16_t length = extent->ee_len;
+    return length > EXTENT_MAX_LENGTH ? length - EXTENT_MAX_LENGTH : length;
+}
+
+static inline uint64_t getExtentStart(const Extent* extent) {
+    return extent->ee_start_lo | (uint64_t) extent->ee_start_hi << 32;
+}
+
+static inline uint64_t getIndexLeaf(const ExtentIndex* index) {
+    return index->ei_leaf_lo | (uint64_t) index->ei_leaf_hi << 32;
+}
+
+static inline bool isUnwritten(const Extent* extent) {
+    return extent->ee_len > EXTENT_MAX_LENGTH;
+}
+
+static inline void setExtentStart(Extent* extent, uint64_t start) {
+    extent->ee_start_lo = start & 0xFFFFFFFF;
+    extent->ee_start_hi = start >> 32;
+}
+
+static inline void setIndexLeaf(ExtentIndex* index, uint64_t leaf) {
+    index->ei_leaf_lo = leaf & 0xFFFFFFFF;
+    index->ei_leaf_hi = leaf >> 32;
+    index->ei_unused = 0;
+}
+
+// Returns the number of entries that start at or before the given block.
+template <typename T>
+static size_t countEntriesBefore(const T* entries, size_t count,
+        little_uint32_t T::*first, uint64_t block) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (entries[mid].*first <= block) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static size_t findClearBit(const unsigned char* bitmap, size_t begin,
+        size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (i % 8 == 0 && bitmap[i / 8] == 0xFF) {
+            i += 7;
+            continue;
+        }
+        if (!(bitmap[i / 8] & (1U << (i % 8)))) return i;
+    }
+    return end;
+}
 
 FileSystem* Ext234::initialize(const Reference<Vnode>& device,
         const Reference<Vnode>& mountPoint, const char* mountPath, int flags) {
@@ -49,6 +127,14 @@ FileSystem* Ext234::initialize(const Reference<Vnode>& device,
         return nullptr;
     }
 
+    uint16_t descriptorSize = superBlock.s_desc_size;
+    if (superBlock.s_feature_incompat & INCOMPAT_64BIT &&
+            (descriptorSize < 32 || descriptorSize > 1024 ||
+            descriptorSize & (descriptorSize - 1))) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
     bool readonly = flags & MOUNT_READONLY;
     if (!readonly && superBlock.s_feature_ro_compat & ~SUPPORTED_RO_FEATURES) {
         errno = EROFS;
@@ -100,162 +186,228 @@ Ext234Fs::Ext234Fs(const Reference<Vnode>& device, const SuperBlock* superBlock,
     }
 
     blocksMutex = KTHREAD_MUTEX_INITIALIZER;
+    cachedBitmaps = 0;
+    delayedBlocks = 0;
     dev = device->stat().st_rdev;
+    groupsMutex = KTHREAD_MUTEX_INITIALIZER;
     inodesMutex = KTHREAD_MUTEX_INITIALIZER;
     openVnodes = 0;
     renameMutex = KTHREAD_MUTEX_INITIALIZER;
     vnodesMutex = KTHREAD_MUTEX_INITIALIZER;
+
+    groups = new BlockGroup[groupCount]();
+    if (!groups) FAIL_CONSTRUCTOR;
+
+    char* buffer = new char[blockSize];
+    if (!buffer) FAIL_CONSTRUCTOR;
+
+    uint64_t gdtAddress = ALIGNUP(2048, blockSize);
+    size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
+    size_t descriptorsPerBlock = blockSize / gdtSize;
+    for (uint64_t i = 0; i < groupCount; i += descriptorsPerBlock) {
+        size_t count = min(descriptorsPerBlock, groupCount - i);
+        if (!read(buffer, count * gdtSize, gdtAddress + i * gdtSize)) {
+            delete[] buffer;
+            FAIL_CONSTRUCTOR;
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            BlockGroup* group = &groups[i + j];
+            BlockGroupDescriptor* bg = &group->descriptor;
+            memcpy(bg, buffer + j * gdtSize, descriptorSize);
+
+            group->blockBitmap.block = bg->bg_block_bitmap;
+            group->inodeBitmap.block = bg->bg_inode_bitmap;
+            if (gdtSize > 32) {
+                group->blockBitmap.block |=
+                        (uint64_t) bg->bg_block_bitmap_hi << 32;
+                group->inodeBitmap.block |=
+                        (uint64_t) bg->bg_inode_bitmap_hi << 32;
+            }
+        }
+    }
+
+    delete[] buffer;
+}
+
+Ext234Fs::~Ext234Fs() {
+    if (!groups) return;
+
+    for (uint64_t i = 0; i < groupCount; i++) {
+        delete[] groups[i].blockBitmap.data;
+        delete[] groups[i].inodeBitmap.data;
+    }
+    delete[] groups;
+}
+
+void Ext234Fs::addInodeBlocks(Inode* inode, int64_t blocks) {
+    inode->i_blocks = inode->i_blocks + blocks * (int64_t) (blockSize / 512);
 }
 
 uint64_t Ext234Fs::allocateBlock(uint64_t blockGroup) {
-    AutoLock lock(&blocksMutex);
+    uint64_t count = 1;
+    return allocateBlocks(blockGroup, 0, count);
+}
 
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return 0;
+// Allocates up to count contiguous blocks, preferably starting at the goal
+// block. On success count is set to the number of allocated blocks.
+uint64_t Ext234Fs::allocateBlocks(uint64_t blockGroup, uint64_t goal,
+        uint64_t& count) {
+    AutoLock lock(&blocksMutex);
 
-    uint32_t freeBlocks = bg.bg_free_blocks_count;
-    if (gdtSize > 32) {
-        freeBlocks |= bg.bg_free_blocks_count_hi << 16;
+    // Blocks that were set aside for delayed writes must stay available.
+    uint64_t freeBlocksTotal = getFreeBlockCount();
+    if (freeBlocksTotal <= delayedBlocks) {
+        errno = ENOSPC;
+        return 0;
     }
+    count = min(count, freeBlocksTotal - delayedBlocks);
 
-    if (freeBlocks > 0) {
-        return allocateBlockInGroup(blockGroup, &bg, freeBlocks);
+    if (goal) {
+        uint64_t goalGroup = (goal - (blockSize == 1024)) /
+                superBlock.s_blocks_per_group;
+        if (goalGroup < groupCount) {
+            blockGroup = goalGroup;
+        } else {
+            goal = 0;
+        }
     }
 
-    for (blockGroup = 0; blockGroup < groupCount; blockGroup++) {
-        if (!readBlockGroupDesc(blockGroup, &bg)) return 0;
+    // Search the following groups if the preferred group is full so that
+    // the blocks stay close to the inode.
+    for (uint64_t i = 0; i < groupCount; i++) {
+        uint64_t group = (blockGroup + i) % groupCount;
+        const BlockGroupDescriptor* bg = &groups[group].descriptor;
 
-        freeBlocks = bg.bg_free_blocks_count;
+        uint32_t freeBlocks = bg->bg_free_blocks_count;
         if (gdtSize > 32) {
-            freeBlocks |= bg.bg_free_blocks_count_hi << 16;
+            freeBlocks |= bg->bg_free_blocks_count_hi << 16;
         }
 
         if (freeBlocks > 0) {
-            return allocateBlockInGroup(blockGroup, &bg, freeBlocks);
+            return allocateBlocksInGroup(group, freeBlocks, i == 0 ? goal : 0,
+                    count);
         }
     }
     errno = ENOSPC;
     return 0;
 }
 
-uint64_t Ext234Fs::allocateBlockInGroup(uint64_t blockGroup,
-        BlockGroupDescriptor* bg, uint32_t freeBlocks) {
-    uint64_t bitmap = bg->bg_block_bitmap;
-    if (gdtSize > 32) {
-        bitmap |= (uint64_t) bg->bg_block_bitmap_hi << 32;
+uint64_t Ext234Fs::allocateBlocksInGroup(uint64_t blockGroup,
+        uint32_t freeBlocks, uint64_t goal, uint64_t& count) {
+    BlockGroup* group = &groups[blockGroup];
+    unsigned char* bitmap = getBitmap(group->blockBitmap);
+    if (!bitmap) return 0;
+
+    uint64_t groupStart = blockGroup * superBlock.s_blocks_per_group +
+            (blockSize == 1024);
+    size_t blocksInGroup = superBlock.s_blocks_per_group;
+    size_t start = 0;
+    if (goal >= groupStart && goal - groupStart < blocksInGroup) {
+        start = goal - groupStart;
     }
-    uint64_t bitmapAddress = bitmap * blockSize;
 
-    char* block = new char[blockSize];
-    if (!block) return 0;
-    if (!read(block, blockSize, bitmapAddress)) {
-        delete[] block;
-        return 0;
+    size_t first = findClearBit(bitmap, start, blocksInGroup);
+    if (first == blocksInGroup) {
+        first = findClearBit(bitmap, 0, start);
+        if (first == start) {
+            errno = ENOSPC;
+            return 0;
+        }
     }
 
-    unsigned int* p = (unsigned int*) block;
-    for (size_t i = 0; i < blockSize / sizeof(unsigned int); i++) {
-        if (p[i] != UINT_MAX) {
-            int x = ffs(~p[i]) - 1;
-            uint64_t blockNumber = blockGroup * superBlock.s_blocks_per_group +
-                    (blockSize == 1024);
-            blockNumber += i * sizeof(unsigned int) * 8 + x;
-            p[i] |= 1U << x;
-            if (!write(block, blockSize, bitmapAddress)) {
-                delete[] block;
-                return 0;
-            }
-            delete[] block;
+    size_t length = 0;
+    while (length < count && length < freeBlocks &&
+            first + length < blocksInGroup) {
+        size_t bit = first + length;
+        if (bitmap[bit / 8] & (1U << (bit % 8))) break;
+        bitmap[bit / 8] |= 1U << (bit % 8);
+        length++;
+    }
 
-            freeBlocks--;
-            bg->bg_free_blocks_count = freeBlocks & 0xFFFF;
-            bg->bg_free_blocks_count_hi = freeBlocks >> 16;
+    freeBlocks -= length;
+    BlockGroupDescriptor* bg = &group->descriptor;
+    bg->bg_free_blocks_count = freeBlocks & 0xFFFF;
+    bg->bg_free_blocks_count_hi = freeBlocks >> 16;
+    markGroupDirty(group, &group->blockBitmap, first, first + length);
 
-            size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
-            if (!write(bg, descriptorSize, ALIGNUP(2048, blockSize) +
-                    blockGroup * gdtSize)) {
-                return 0;
-            }
+    uint64_t freeBlocksTotal = superBlock.s_free_blocks_count;
+    if (hasIncompatFeature(INCOMPAT_64BIT)) {
+        freeBlocksTotal |= (uint64_t) superBlock.s_free_blocks_count_hi << 32;
+    }
+    freeBlocksTotal -= length;
+    superBlock.s_free_blocks_count = freeBlocksTotal & 0xFFFFFFFF;
+    superBlock.s_free_blocks_count_hi = freeBlocksTotal >> 32;
 
-            uint64_t freeBlocksTotal = superBlock.s_free_blocks_count;
-            if (hasIncompatFeature(INCOMPAT_64BIT)) {
-                freeBlocksTotal |=
-                        (uint64_t) superBlock.s_free_blocks_count_hi << 32;
-            }
-            freeBlocksTotal--;
-            superBlock.s_free_blocks_count = freeBlocksTotal & 0xFFFFFFFF;
-            superBlock.s_free_blocks_count_hi = freeBlocksTotal >> 32;
+    count = length;
+    return groupStart + first;
+}
 
-            return blockNumber;
-        }
+// Allocates up to count blocks for a file that grows to fileBlocks blocks.
+// Blocks are taken from the reservation of the file if it has one. Otherwise
+// a run about as large as the file is allocated and the blocks that are not
+// needed yet are reserved. This way files that are appended to in small
+// pieces stay contiguous even when other files grow at the same time.
+uint64_t Ext234Fs::allocateFileBlocks(uint64_t blockGroup, uint64_t goal,
+        uint64_t& count, uint64_t fileBlocks, BlockReservation* reservation) {
+    if (!reservation) return allocateBlocks(blockGroup, goal, count);
+
+    if (reservation->count == 0) {
+        uint64_t size = fileBlocks;
+        if (size < MIN_RESERVATION) size = MIN_RESERVATION;
+        if (size > MAX_RESERVATION) size = MAX_RESERVATION;
+        if (size < count) size = count;
+
+        uint64_t start = allocateBlocks(blockGroup, goal, size);
+        if (!start) return 0;
+        reservation->start = start;
+        reservation->count = size;
     }
 
-    delete[] block;
-    errno = ENOSPC;
-    return 0;
+    count = min(count, reservation->count);
+    uint64_t start = reservation->start;
+    reservation->start += count;
+    reservation->count -= count;
+    return start;
 }
 
 ino_t Ext234Fs::allocateInode(uint64_t blockGroup, bool dir) {
     AutoLock lock(&inodesMutex);
 
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return 0;
-
-    uint32_t freeInodes = bg.bg_free_inodes_count;
-    if (gdtSize > 32) {
-        freeInodes |= bg.bg_free_inodes_count_hi << 16;
-    }
+    for (uint64_t i = 0; i < groupCount; i++) {
+        uint64_t group = (blockGroup + i) % groupCount;
+        const BlockGroupDescriptor* bg = &groups[group].descriptor;
 
-    if (freeInodes > 0) {
-        return allocateInodeInGroup(blockGroup, &bg, freeInodes, dir);
-    }
-
-    for (blockGroup = 0; blockGroup < groupCount; blockGroup++) {
-        if (!readBlockGroupDesc(blockGroup, &bg)) return 0;
-
-        freeInodes = bg.bg_free_inodes_count;
+        uint32_t freeInodes = bg->bg_free_inodes_count;
         if (gdtSize > 32) {
-            freeInodes |= bg.bg_free_inodes_count_hi << 16;
+            freeInodes |= bg->bg_free_inodes_count_hi << 16;
         }
 
         if (freeInodes > 0) {
-            return allocateInodeInGroup(blockGroup, &bg, freeInodes, dir);
+            return allocateInodeInGroup(group, freeInodes, dir);
         }
     }
     errno = ENOSPC;
     return 0;
 }
 
-ino_t Ext234Fs::allocateInodeInGroup(uint64_t blockGroup,
-        BlockGroupDescriptor* bg, uint32_t freeInodes, bool dir) {
-    uint64_t bitmap = bg->bg_inode_bitmap;
-    if (gdtSize > 32) {
-        bitmap |= (uint64_t) bg->bg_inode_bitmap_hi << 32;
-    }
-    uint64_t bitmapAddress = bitmap * blockSize;
-
-    char* block = new char[blockSize];
-    if (!block) return 0;
-    if (!read(block, blockSize, bitmapAddress)) {
-        delete[] block;
-        return 0;
-    }
+ino_t Ext234Fs::allocateInodeInGroup(uint64_t blockGroup, uint32_t freeInodes,
+        bool dir) {
+    BlockGroup* group = &groups[blockGroup];
+    unsigned char* bitmap = getBitmap(group->inodeBitmap);
+    if (!bitmap) return 0;
 
-    unsigned int* p = (unsigned int*) block;
+    unsigned int* p = (unsigned int*) bitmap;
     for (size_t i = 0; i < blockSize / sizeof(unsigned int); i++) {
         if (p[i] != UINT_MAX) {
             int x = ffs(~p[i]) - 1;
+            size_t bit = i * sizeof(unsigned int) * 8 + x;
             uint64_t inodeNumber = blockGroup * superBlock.s_inodes_per_group +
-                    1;
-            inodeNumber += i * sizeof(unsigned int) * 8 + x;
+                    1 + bit;
             p[i] |= 1U << x;
-            if (!write(block, blockSize, bitmapAddress)) {
-                delete[] block;
-                return 0;
-            }
-            delete[] block;
 
             freeInodes--;
+            BlockGroupDescriptor* bg = &group->descriptor;
             bg->bg_free_inodes_count = freeInodes & 0xFFFF;
             bg->bg_free_inodes_count_hi = freeInodes >> 16;
 
@@ -268,12 +420,7 @@ ino_t Ext234Fs::allocateInodeInGroup(uint64_t blockGroup,
                 bg->bg_used_dirs_count = usedDirs & 0xFFFF;
                 bg->bg_used_dirs_count_hi = usedDirs >> 16;
             }
-
-            size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
-            if (!write(bg, descriptorSize, ALIGNUP(2048, blockSize) +
-                    blockGroup * gdtSize)) {
-                return 0;
-            }
+            markGroupDirty(group, &group->inodeBitmap, bit, bit + 1);
 
             superBlock.s_free_inodes_count = superBlock.s_free_inodes_count - 1;
 
@@ -281,7 +428,6 @@ ino_t Ext234Fs::allocateInodeInGroup(uint64_t blockGroup,
         }
     }
 
-    delete[] block;
     errno = ENOSPC;
     return 0;
 }
@@ -291,122 +437,124 @@ ino_t Ext234Fs::createInode(uint64_t blockGroup, mode_t mode) {
     if (!ino) return 0;
     Inode inode = {};
     inode.i_mode = mode;
+    if (!S_ISLNK(mode)) {
+        // Fast symlinks store their target in i_block.
+        initializeExtentTree(&inode);
+    }
     blockGroup = getBlockGroup(ino);
 
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return false;
-    uint64_t inodeTable = bg.bg_inode_table;
+    const BlockGroupDescriptor* bg = &groups[blockGroup].descriptor;
+    uint64_t inodeTable = bg->bg_inode_table;
     if (gdtSize > 32) {
-        inodeTable |= (uint64_t) bg.bg_inode_table_hi << 32;
+        inodeTable |= (uint64_t) bg->bg_inode_table_hi << 32;
     }
 
     uint64_t localIndex = (ino - 1) % superBlock.s_inodes_per_group;
     uint64_t inodeAddress = inodeTable * blockSize + (localIndex * inodeSize);
     if (!writeInode(&inode, inodeAddress)) return 0;
+    writeBackGroups();
     return ino;
 }
 
 bool Ext234Fs::deallocateBlock(uint64_t blockNumber) {
+    return deallocateBlocks(blockNumber, 1);
+}
+
+bool Ext234Fs::deallocateBlocks(uint64_t blockNumber, uint64_t count) {
     AutoLock lock(&blocksMutex);
 
     if (blockSize == 1024) {
         blockNumber--;
     }
-    uint64_t blockGroup = blockNumber / superBlock.s_blocks_per_group;
 
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return false;
+    while (count > 0) {
+        uint64_t blockGroup = blockNumber / superBlock.s_blocks_per_group;
+        uint64_t localIndex = blockNumber % superBlock.s_blocks_per_group;
+        uint64_t blocks = min(count,
+                superBlock.s_blocks_per_group - localIndex);
 
-    uint32_t freeBlocks = bg.bg_free_blocks_count;
-    if (gdtSize > 32) {
-        freeBlocks |= bg.bg_free_blocks_count_hi << 16;
-    }
-
-    uint64_t bitmap = bg.bg_block_bitmap;
-    if (gdtSize > 32) {
-        bitmap |= (uint64_t) bg.bg_block_bitmap_hi << 32;
-    }
-    uint64_t bitmapAddress = bitmap * blockSize;
+        BlockGroup* group = &groups[blockGroup];
+        unsigned char* bitmap = getBitmap(group->blockBitmap);
+        if (!bitmap) return false;
 
-    uint64_t localIndex = blockNumber % superBlock.s_blocks_per_group;
-    size_t index = localIndex / 8;
-    unsigned char entry;
-    if (!read(&entry, 1, bitmapAddress + index)) return false;
-    entry &= ~(1U << (localIndex % 8));
-    if (!write(&entry, 1, bitmapAddress + index)) return false;
-    freeBlocks++;
-    bg.bg_free_blocks_count = freeBlocks & 0xFFFF;
-    bg.bg_free_blocks_count_hi = freeBlocks >> 16;
+        for (uint64_t i = localIndex; i < localIndex + blocks; i++) {
+            bitmap[i / 8] &= ~(1U << (i % 8));
+        }
 
-    size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
-    if (!write(&bg, descriptorSize, ALIGNUP(2048, blockSize) +
-            blockGroup * gdtSize)) {
-        return false;
-    }
+        BlockGroupDescriptor* bg = &group->descriptor;
+        uint32_t freeBlocks = bg->bg_free_blocks_count;
+        if (gdtSize > 32) {
+            freeBlocks |= bg->bg_free_blocks_count_hi << 16;
+        }
+        freeBlocks += blocks;
+        bg->bg_free_blocks_count = freeBlocks & 0xFFFF;
+        bg->bg_free_blocks_count_hi = freeBlocks >> 16;
+        markGroupDirty(group, &group->blockBitmap, localIndex,
+                localIndex + blocks);
+
+        uint64_t freeBlocksTotal = superBlock.s_free_blocks_count;
+        if (hasIncompatFeature(INCOMPAT_64BIT)) {
+            freeBlocksTotal |=
+                    (uint64_t) superBlock.s_free_blocks_count_hi << 32;
+        }
+        freeBlocksTotal += blocks;
+        superBlock.s_free_blocks_count = freeBlocksTotal & 0xFFFFFFFF;
+        superBlock.s_free_blocks_count_hi = freeBlocksTotal >> 32;
 
-    uint64_t freeBlocksTotal = superBlock.s_free_blocks_count;
-    if (hasIncompatFeature(INCOMPAT_64BIT)) {
-        freeBlocksTotal |= (uint64_t) superBlock.s_free_blocks_count_hi << 32;
+        blockNumber += blocks;
+        count -= blocks;
     }
-    freeBlocksTotal++;
-    superBlock.s_free_blocks_count = freeBlocksTotal & 0xFFFFFFFF;
-    superBlock.s_free_blocks_count_hi = freeBlocksTotal >> 32;
 
     return true;
 }
 
 bool Ext234Fs::deallocateInode(ino_t ino, bool dir) {
-    AutoLock lock(&inodesMutex);
+    kthread_mutex_lock(&inodesMutex);
 
     uint64_t blockGroup = getBlockGroup(ino);
-
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return false;
-
-    uint32_t freeInodes = bg.bg_free_inodes_count;
-    if (gdtSize > 32) {
-        freeInodes |= bg.bg_free_inodes_count_hi << 16;
+    BlockGroup* group = &groups[blockGroup];
+    unsigned char* bitmap = getBitmap(group->inodeBitmap);
+    if (!bitmap) {
+        kthread_mutex_unlock(&inodesMutex);
+        return false;
     }
 
-    uint64_t bitmap = bg.bg_inode_bitmap;
+    uint64_t localIndex = (ino - 1) % superBlock.s_inodes_per_group;
+    bitmap[localIndex / 8] &= ~(1U << (localIndex % 8));
+
+    BlockGroupDescriptor* bg = &group->descriptor;
+    uint32_t freeInodes = bg->bg_free_inodes_count;
     if (gdtSize > 32) {
-        bitmap |= (uint64_t) bg.bg_inode_bitmap_hi << 32;
+        freeInodes |= bg->bg_free_inodes_count_hi << 16;
     }
-    uint64_t bitmapAddress = bitmap * blockSize;
-
-    uint64_t localIndex = (ino - 1) % superBlock.s_inodes_per_group;
-    size_t index = localIndex / 8;
-    unsigned char entry;
-    if (!read(&entry, 1, bitmapAddress + index)) return false;
-    entry &= ~(1U << (localIndex % 8));
-    if (!write(&entry, 1, bitmapAddress + index)) return false;
     freeInodes++;
-    bg.bg_free_inodes_count = freeInodes & 0xFFFF;
-    bg.bg_free_inodes_count_hi = freeInodes >> 16;
+    bg->bg_free_inodes_count = freeInodes & 0xFFFF;
+    bg->bg_free_inodes_count_hi = freeInodes >> 16;
 
     if (dir) {
-        uint32_t usedDirs = bg.bg_used_dirs_count;
+        uint32_t usedDirs = bg->bg_used_dirs_count;
         if (gdtSize > 32) {
-            usedDirs |= (uint32_t) bg.bg_used_dirs_count_hi << 16;
+            usedDirs |= (uint32_t) bg->bg_used_dirs_count_hi << 16;
         }
         usedDirs--;
-        bg.bg_used_dirs_count = usedDirs & 0xFFFF;
-        bg.bg_used_dirs_count_hi = usedDirs >> 16;
-    }
-
-    size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
-    if (!write(&bg, descriptorSize, ALIGNUP(2048, blockSize) +
-            blockGroup * gdtSize)) {
-        return false;
+        bg->bg_used_dirs_count = usedDirs & 0xFFFF;
+        bg->bg_used_dirs_count_hi = usedDirs >> 16;
     }
+    markGroupDirty(group, &group->inodeBitmap, localIndex, localIndex + 1);
 
     superBlock.s_free_inodes_count = superBlock.s_free_inodes_count + 1;
+    kthread_mutex_unlock(&inodesMutex);
 
+    writeBackGroups();
     return true;
 }
 
 bool Ext234Fs::decreaseInodeBlockCount(Inode* inode,
         uint64_t oldBlockCount, uint64_t newBlockCount) {
+    if (inode->i_flags & INODE_EXTENTS_FL) {
+        return truncateExtents(inode, newBlockCount);
+    }
+
     size_t indirectBlockPointers = blockSize / 4;
     size_t doublyIndirectPointers = indirectBlockPointers *
             indirectBlockPointers;
@@ -503,6 +651,70 @@ void Ext234Fs::finishDropVnodeReference() {
     kthread_mutex_unlock(&vnodesMutex);
 }
 
+// Finds the path from the root to the leaf that should contain the given
+// block. The nodes below the root are read into the buffer, which must have
+// room for EXTENT_MAX_DEPTH blocks. Returns the depth of the tree.
+int Ext234Fs::findExtentPath(ExtentHeader* root, uint64_t block,
+        ExtentPath* path, char* buffer) {
+    int depth = root->eh_depth;
+    if (depth > EXTENT_MAX_DEPTH) {
+        errno = EIO;
+        return -1;
+    }
+
+    ExtentHeader* header = root;
+    uint64_t nodeBlock = 0;
+    for (int level = 0; ; level++) {
+        if (header->eh_magic != EXTENT_MAGIC ||
+                header->eh_entries > header->eh_max ||
+                header->eh_depth != depth - level) {
+            errno = EIO;
+            return -1;
+        }
+
+        path[level].block = nodeBlock;
+        path[level].header = header;
+        size_t entries = header->eh_entries;
+
+        if (level == depth) {
+            path[level].index = countEntriesBefore(getExtents(header),
+                    entries, &Extent::ee_block, block);
+            return depth;
+        }
+
+        if (entries == 0) {
+            errno = EIO;
+            return -1;
+        }
+
+        // Blocks before the first index belong to the first subtree.
+        size_t index = countEntriesBefore(getIndexes(header), entries,
+                &ExtentIndex::ei_block, block);
+        path[level].index = index > 0 ? index - 1 : 0;
+
+        nodeBlock = getIndexLeaf(&getIndexes(header)[path[level].index]);
+        header = (ExtentHeader*) (buffer + level * blockSize);
+        if (!read(header, blockSize, nodeBlock * blockSize)) return -1;
+    }
+}
+
+// Returns the cached bitmap and reads it from the device if necessary.
+unsigned char* Ext234Fs::getBitmap(Bitmap& bitmap) {
+    if (bitmap.data) return bitmap.data;
+
+    unsigned char* data = new unsigned char[blockSize];
+    if (!data) return nullptr;
+    if (!read(data, blockSize, bitmap.block * blockSize)) {
+        delete[] data;
+        return nullptr;
+    }
+
+    bitmap.data = data;
+    AutoLock lock(&groupsMutex);
+    cachedBitmaps++;
+    return data;
+}
+
 uint64_t Ext234Fs::getBlockCount(uint64_t fileSize) {
     size_t indirectBlockPointers = blockSize / 4;
     uint64_t dataBlocks = ALIGNUP(fileSize, blockSize) / blockSize;
@@ -520,7 +732,88 @@ uint64_t Ext234Fs::getBlockGroup(ino_t ino) {
     return (ino - 1) / superBlock.s_inodes_per_group;
 }
 
-uint64_t Ext234Fs::getInodeBlockAddress(const Inode* inode, uint64_t block) {
+// Returns the device address of the block or 0 if the block is not allocated.
+// The number of following blocks with the same property is returned in
+// contiguous.
+uint64_t Ext234Fs::getExtentBlockAddress(const Inode* inode, uint64_t block,
+        uint64_t* contiguous) {
+    const ExtentHeader* header = (const ExtentHeader*) inode->i_block;
+    char* buffer = nullptr;
+    uint64_t result = 0;
+    if (contiguous) *contiguous = 1;
+
+    for (size_t level = 0; header->eh_depth > 0; level++) {
+        if (header->eh_magic != EXTENT_MAGIC ||
+                header->eh_entries > header->eh_max ||
+                level >= EXTENT_MAX_DEPTH) {
+            delete[] buffer;
+            errno = EIO;
+            return -1;
+        }
+
+        const ExtentIndex* indexes = (const ExtentIndex*) (header + 1);
+        size_t index = countEntriesBefore(indexes, header->eh_entries,
+                &ExtentIndex::ei_block, block);
+        if (index == 0) {
+            delete[] buffer;
+            return 0;
+        }
+
+        if (!buffer) {
+            buffer = new char[blockSize];
+            if (!buffer) return -1;
+        }
+        if (!read(buffer, blockSize,
+                getIndexLeaf(&indexes[index - 1]) * blockSize)) {
+            delete[] buffer;
+            return -1;
+        }
+        header = (const ExtentHeader*) buffer;
+    }
+
+    if (header->eh_magic != EXTENT_MAGIC ||
+            header->eh_entries > header->eh_max) {
+        delete[] buffer;
+        errno = EIO;
+        return -1;
+    }
+
+    const Extent* extents = (const Extent*) (header + 1);
+    size_t entries = header->eh_entries;
+    size_t index = countEntriesBefore(extents, entries, &Extent::ee_block,
+            block);
+
+    const Extent* extent = index > 0 ? &extents[index - 1] : nullptr;
+    if (extent && block - extent->ee_block < getExtentLength(extent)) {
+        uint64_t offset = block - extent->ee_block;
+        if (contiguous) *contiguous = getExtentLength(extent) - offset;
+        // Unwritten extents are read as zeros just like holes.
+        if (!isUnwritten(extent)) {
+            result = (getExtentStart(extent) + offset) * blockSize;
+        }
+    } else if (index < entries && contiguous) {
+        *contiguous = extents[index].ee_block - block;
+    }
+
+    delete[] buffer;
+    return result;
+}
+
+uint64_t Ext234Fs::getFreeBlockCount() {
+    uint64_t freeBlocks = superBlock.s_free_blocks_count;
+    if (hasIncompatFeature(INCOMPAT_64BIT)) {
+        freeBlocks |= (uint64_t) superBlock.s_free_blocks_count_hi << 32;
+    }
+    return freeBlocks;
+}
+
+uint64_t Ext234Fs::getInodeBlockAddress(const Inode* inode, uint64_t block,
+        uint64_t* contiguous) {
+    if (inode->i_flags & INODE_EXTENTS_FL) {
+        return getExtentBlockAddress(inode, block, contiguous);
+    }
+    if (contiguous) *contiguous = 1;
+
     size_t indirectBlockPointers = blockSize / 4;
     size_t doublyIndirectPointers = indirectBlockPointers *
             indirectBlockPointers;
@@ -654,6 +947,53 @@ Reference<Ext234Vnode> Ext234Fs::getVnodeIfOpen(ino_t ino) {
     return vnode;
 }
 
+bool Ext234Fs::growExtentTree(ino_t ino, Inode* inode) {
+    // The content of the root node is moved into a new block and the root
+    // then only contains a single index pointing to that block.
+    ExtentHeader* root = (ExtentHeader*) inode->i_block;
+    if (root->eh_depth >= EXTENT_MAX_DEPTH) {
+        errno = EFBIG;
+        return false;
+    }
+
+    uint64_t newBlock = allocateBlock(getBlockGroup(ino));
+    if (!newBlock) return false;
+
+    char* node = new char[blockSize];
+    if (!node) {
+        deallocateBlock(newBlock);
+        return false;
+    }
+    memset(node, 0, blockSize);
+    ExtentHeader* header = (ExtentHeader*) node;
+    header->eh_magic = EXTENT_MAGIC;
+    header->eh_entries = root->eh_entries;
+    header->eh_max = (blockSize - sizeof(ExtentHeader)) / sizeof(Extent);
+    header->eh_depth = root->eh_depth;
+    memcpy(header + 1, root + 1, root->eh_entries * sizeof(Extent));
+
+    if (!write(node, blockSize, newBlock * blockSize)) {
+        delete[] node;
+        deallocateBlock(newBlock);
+        return false;
+    }
+    delete[] node;
+    addInodeBlocks(inode, 1);
+
+    // Extents and indexes both start with their first logical block.
+    uint32_t firstBlock = getExtents(root)[0].ee_block;
+    root->eh_entries = 1;
+    root->eh_depth = root->eh_depth + 1;
+    getIndexes(root)[0].ei_block = firstBlock;
+    setIndexLeaf(&getIndexes(root)[0], newBlock);
+    return true;
+}
+
+bool Ext234Fs::hasCompatFeature(uint32_t feature) {
+    if (superBlock.s_rev_level == 0) return false;
+    return (superBlock.s_feature_compat & feature) == feature;
+}
+
 bool Ext234Fs::hasIncompatFeature(uint32_t feature) {
     if (superBlock.s_rev_level == 0) return false;
     return (superBlock.s_feature_incompat & feature) == feature;
@@ -664,8 +1004,59 @@ bool Ext234Fs::hasReadOnlyFeature(uint32_t feature) {
     return (superBlock.s_feature_ro_compat & feature) == feature;
 }
 
+bool Ext234Fs::increaseExtentBlockCount(ino_t ino, Inode* inode,
+        uint64_t oldBlockCount, uint64_t newBlockCount,
+        BlockReservation* reservation) {
+    if (newBlockCount > 1ULL << 32) {
+        errno = EFBIG;
+        return false;
+    }
+
+    // Try to continue where the last extent ends so that it can be extended.
+    uint64_t goal = 0;
+    if (oldBlockCount > 0) {
+        uint64_t address = getExtentBlockAddress(inode, oldBlockCount - 1,
+                nullptr);
+        if (address == (uint64_t) -1) return false;
+        if (address) goal = address / blockSize + 1;
+    }
+
+    uint64_t currentBlockCount = oldBlockCount;
+    while (currentBlockCount < newBlockCount) {
+        uint64_t count = min(newBlockCount - currentBlockCount,
+                EXTENT_MAX_LENGTH);
+        uint64_t start = allocateFileBlocks(getBlockGroup(ino), goal, count,
+                newBlockCount, reservation);
+        if (!start) goto fail;
+
+        if (!insertExtent(ino, inode, currentBlockCount, start, count)) {
+            deallocateBlocks(start, count);
+            goto fail;
+        }
+        addInodeBlocks(inode, count);
+
+        currentBlockCount += count;
+        goal = start + count;
+    }
+
+    return true;
+
+fail:
+    if (currentBlockCount != oldBlockCount) {
+        truncateExtents(inode, oldBlockCount);
+    }
+
+    return false;
+}
+
 bool Ext234Fs::increaseInodeBlockCount(ino_t ino, Inode* inode,
-        uint64_t oldBlockCount, uint64_t newBlockCount) {
+        uint64_t oldBlockCount, uint64_t newBlockCount,
+        BlockReservation* reservation) {
+    if (inode->i_flags & INODE_EXTENTS_FL) {
+        return increaseExtentBlockCount(ino, inode, oldBlockCount,
+                newBlockCount, reservation);
+    }
+
     size_t indirectBlockPointers = blockSize / 4;
     size_t doublyIndirectPointers = indirectBlockPointers *
             indirectBlockPointers;
@@ -673,9 +1064,12 @@ bool Ext234Fs::increaseInodeBlockCount(ino_t ino, Inode* inode,
     uint64_t blockGroup = getBlockGroup(ino);
 
     uint64_t currentBlockCount = oldBlockCount;
+    little_uint32_t blockNumber = 0;
     while (currentBlockCount < newBlockCount) {
         uint64_t block = currentBlockCount;
-        little_uint32_t blockNumber = allocateBlock(blockGroup);
+        uint64_t count = 1;
+        blockNumber = allocateFileBlocks(blockGroup, 0, count, newBlockCount,
+                reservation);
         if (!blockNumber) goto fail;
 
         little_uint32_t blockNum;
@@ -786,6 +1180,10 @@ indirect:
     return true;
 
 fail:
+    if (blockNumber) {
+        // The block has not been added to the block map yet.
+        deallocateBlock(blockNumber);
+    }
     if (currentBlockCount != oldBlockCount) {
         decreaseInodeBlockCount(inode, currentBlockCount, oldBlockCount);
     }
@@ -793,7 +1191,106 @@ fail:
     return false;
 }
 
+void Ext234Fs::initializeExtentTree(Inode* inode) {
+    if (!hasIncompatFeature(INCOMPAT_EXTENTS)) return;
+
+    inode->i_flags = inode->i_flags | INODE_EXTENTS_FL;
+    ExtentHeader* header = (ExtentHeader*) inode->i_block;
+    header->eh_magic = EXTENT_MAGIC;
+    header->eh_entries = 0;
+    header->eh_max = (sizeof(inode->i_block) - sizeof(ExtentHeader)) /
+            sizeof(Extent);
+    header->eh_depth = 0;
+    header->eh_generation = 0;
+}
+
+bool Ext234Fs::insertExtent(ino_t ino, Inode* inode, uint64_t block,
+        uint64_t start, uint64_t length) {
+    ExtentHeader* root = (ExtentHeader*) inode->i_block;
+    ExtentPath path[EXTENT_MAX_DEPTH + 1];
+    char* buffer = new char[EXTENT_MAX_DEPTH * blockSize];
+    if (!buffer) return false;
+
+    while (true) {
+        int depth = findExtentPath(root, block, path, buffer);
+        if (depth < 0) break;
+
+        ExtentHeader* leaf = path[depth].header;
+        Extent* extents = getExtents(leaf);
+        size_t index = path[depth].index;
+
+        // Extend the previous extent if the new blocks directly follow it.
+        if (index > 0) {
+            Extent* previous = &extents[index - 1];
+            uint64_t previousLength = previous->ee_len;
+            if (!isUnwritten(previous) &&
+                    previous->ee_block + previousLength == block &&
+                    getExtentStart(previous) + previousLength == start &&
+                    previousLength + length <= EXTENT_MAX_LENGTH) {
+                previous->ee_len = previousLength + length;
+                bool result = writeExtentNode(path[depth]);
+                delete[] buffer;
+                return result;
+            }
+        }
+
+        if (leaf->eh_entries == leaf->eh_max) {
+            if (!splitExtentPath(ino, inode, path, depth, block)) break;
+            continue;
+        }
+
+        memmove(&extents[index + 1], &extents[index],
+                (leaf->eh_entries - index) * sizeof(Extent));
+        extents[index].ee_block = block;
+        extents[index].ee_len = length;
+        setExtentStart(&extents[index], start);
+        leaf->eh_entries = leaf->eh_entries + 1;
+        bool result = writeExtentNode(path[depth]);
+
+        // The indexes leading to the leaf must not start after the extent.
+        for (int level = depth - 1; result && level >= 0; level--) {
+            ExtentIndex* entry = &getIndexes(path[level].header)[
+                    path[level].index];
+            if (entry->ei_block <= block) break;
+            entry->ei_block = block;
+            result = writeExtentNode(path[level]);
+        }
+
+        delete[] buffer;
+        return result;
+    }
+
+    delete[] buffer;
+    return false;
+}
+
+// Marks the descriptor of the group and the bits [begin, end) of the bitmap as
+// needing to be written back.
+void Ext234Fs::markGroupDirty(BlockGroup* group, Bitmap* bitmap, size_t begin,
+        size_t end) {
+    if (begin < end) {
+        size_t firstByte = begin / 8;
+        size_t lastByte = (end - 1) / 8 + 1;
+        if (bitmap->dirtyEnd == 0) {
+            bitmap->dirtyBegin = firstByte;
+            bitmap->dirtyEnd = lastByte;
+        } else {
+            bitmap->dirtyBegin = min(bitmap->dirtyBegin, firstByte);
+            if (lastByte > bitmap->dirtyEnd) bitmap->dirtyEnd = lastByte;
+        }
+    }
+
+    AutoLock lock(&groupsMutex);
+    if (!group->dirty) {
+        group->dirty = true;
+        dirtyGroups.addFront(*group);
+    }
+}
+
 bool Ext234Fs::onUnmount() {
+    // Vnodes with delayed writes are kept open until the data is written.
+    Ext234Vnode::writeBackDelayedData(this);
+
     AutoLock lock(&vnodesMutex);
 
     if (openVnodes) {
@@ -806,6 +1303,7 @@ bool Ext234Fs::onUnmount() {
         Clock::get(CLOCK_REALTIME)->getTime(&now);
         superBlock.s_wtime = now.tv_sec;
         superBlock.s_state = superBlock.s_state | STATE_CLEAN;
+        writeBackGroups();
         writeSuperBlock();
     }
 
@@ -817,24 +1315,42 @@ bool Ext234Fs::read(void* buffer, size_t size, off_t offset) {
     return device->pread(buffer, size, offset, 0) == (ssize_t) size;
 }
 
-bool Ext234Fs::readBlockGroupDesc(uint64_t blockGroup,
-        BlockGroupDescriptor* bg) {
-    uint64_t bgdt = ALIGNUP(2048, blockSize);
-    uint64_t descriptorOffset = bgdt + blockGroup * gdtSize;
+void Ext234Fs::readahead(const Inode* inode, off_t offset, size_t size) {
+    uint64_t block = offset / blockSize;
+    uint64_t endBlock = ALIGNUP(offset + size, blockSize) / blockSize;
+
+    // Blocks that are contiguous on the device are read ahead together.
+    uint64_t runAddress = 0;
+    uint64_t runSize = 0;
+    while (block < endBlock) {
+        uint64_t contiguous;
+        uint64_t address = getInodeBlockAddress(inode, block, &contiguous);
+        if (address == (uint64_t) -1) break;
+        uint64_t blocks = min(contiguous, endBlock - block);
+        block += blocks;
+        if (address == 0) continue;
+
+        if (runSize && address == runAddress + runSize) {
+            runSize += blocks * blockSize;
+            continue;
+        }
 
-    size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
-    return read(bg, descriptorSize, descriptorOffset);
+        if (runSize) device->readahead(runAddress, runSize);
+        runAddress = address;
+        runSize = blocks * blockSize;
+    }
+
+    if (runSize) device->readahead(runAddress, runSize);
 }
 
 bool Ext234Fs::readInode(uint64_t ino, Inode* inode, uint64_t& inodeAddress) {
     uint64_t blockGroup = getBlockGroup(ino);
     uint64_t localIndex = (ino - 1) % superBlock.s_inodes_per_group;
 
-    BlockGroupDescriptor bg;
-    if (!readBlockGroupDesc(blockGroup, &bg)) return false;
-    uint64_t inodeTable = bg.bg_inode_table;
+    const BlockGroupDescriptor* bg = &groups[blockGroup].descriptor;
+    uint64_t inodeTable = bg->bg_inode_table;
     if (gdtSize > 32) {
-        inodeTable |= (uint64_t) bg.bg_inode_table_hi << 32;
+        inodeTable |= (uint64_t) bg->bg_inode_table_hi << 32;
     }
 
     size_t size = min(inodeSize, sizeof(Inode));
@@ -849,12 +1365,16 @@ bool Ext234Fs::readInodeData(const Inode* inode, off_t offset, void* buffer,
     while (size > 0) {
         uint64_t block = offset / blockSize;
         uint64_t misalign = offset % blockSize;
-        size_t readSize = blockSize - misalign;
-        if (readSize > size) readSize = size;
 
-        uint64_t address = getInodeBlockAddress(inode, block);
-        if (address == (uint64_t) -1 ||
-                !read(buf, readSize, address + misalign)) {
+        // Blocks that are contiguous on the device are read at once.
+        uint64_t contiguous;
+        uint64_t address = getInodeBlockAddress(inode, block, &contiguous);
+        if (address == (uint64_t) -1) return false;
+        size_t readSize = min(contiguous * blockSize - misalign, size);
+
+        if (address == 0) {
+            memset(buf, 0, readSize);
+        } else if (!read(buf, readSize, address + misalign)) {
             return false;
         }
 
@@ -866,28 +1386,76 @@ bool Ext234Fs::readInodeData(const Inode* inode, off_t offset, void* buffer,
     return true;
 }
 
-bool Ext234Fs::resizeInode(ino_t ino, Inode* inode, off_t newSize) {
+void Ext234Fs::releaseDelayedBlocks(uint64_t count) {
+    AutoLock lock(&blocksMutex);
+    assert(count <= delayedBlocks);
+    delayedBlocks -= count;
+}
+
+void Ext234Fs::releaseReservation(BlockReservation* reservation) {
+    if (reservation->count == 0) return;
+
+    deallocateBlocks(reservation->start, reservation->count);
+    reservation->start = 0;
+    reservation->count = 0;
+    writeBackGroups();
+}
+
+// Sets aside free blocks for data that is written to the device later. These
+// blocks are not allocated but other allocations cannot use them.
+bool Ext234Fs::reserveDelayedBlocks(uint64_t count) {
+    AutoLock lock(&blocksMutex);
+    uint64_t newCount;
+    if (__builtin_add_overflow(delayedBlocks, count, &newCount) ||
+            newCount > getFreeBlockCount() ||
+            newCount > MAX_DELAYED_DATA / blockSize) {
+        return false;
+    }
+    delayedBlocks = newCount;
+    return true;
+}
+
+// Blocks are allocated from the reservation if one is given. Shrinking the
+// file releases the reservation.
+bool Ext234Fs::resizeInode(ino_t ino, Inode* inode, off_t newSize,
+        BlockReservation* reservation) {
     uint64_t oldSize = getInodeSize(inode);
     uint64_t oldBlockCount = ALIGNUP(oldSize, blockSize) / blockSize;
     uint64_t newBlockCount = ALIGNUP(newSize, blockSize) / blockSize;
 
     if (oldBlockCount > newBlockCount) {
+        if (reservation) {
+            releaseReservation(reservation);
+        }
         if (!decreaseInodeBlockCount(inode, oldBlockCount, newBlockCount)) {
             return false;
         }
     } else if (oldBlockCount < newBlockCount) {
         if (!increaseInodeBlockCount(ino, inode, oldBlockCount,
-                newBlockCount)) {
-            return false;
+                newBlockCount, reservation)) {
+            // When the disk is almost full the reservation might have taken
+            // the blocks that are needed for the block map.
+            if (!reservation || reservation->count == 0) return false;
+            releaseReservation(reservation);
+            if (!increaseInodeBlockCount(ino, inode, oldBlockCount,
+                    newBlockCount, nullptr)) {
+                return false;
+            }
         }
     }
 
-    inode->i_blocks = getBlockCount(newSize) * (blockSize / 512);
+    if (!(inode->i_flags & INODE_EXTENTS_FL)) {
+        // For extent trees i_blocks is updated when blocks are allocated.
+        inode->i_blocks = getBlockCount(newSize) * (blockSize / 512);
+    }
     inode->i_size = newSize;
     if (hasReadOnlyFeature(RO_COMPAT_LARGE_FILE)) {
         inode->i_size_high = newSize >> 32;
     }
 
+    // All allocations of the resize are written back together. This cannot
+    // fail the resize because the groups stay dirty if the writeback fails.
+    writeBackGroups();
     return true;
 }
 
@@ -920,22 +1488,234 @@ void Ext234Fs::setTime(struct timespec* ts, little_uint32_t* time,
     }
 }
 
+// Makes room in the leaf of the path by splitting the lowest node that has a
+// free entry in its parent. If all nodes are full the tree grows by a level.
+bool Ext234Fs::splitExtentPath(ino_t ino, Inode* inode, ExtentPath* path,
+        int depth, uint64_t block) {
+    int level = depth;
+    while (level >= 0 &&
+            path[level].header->eh_entries == path[level].header->eh_max) {
+        level--;
+    }
+    if (level < 0) return growExtentTree(ino, inode);
+
+    ExtentPath& parent = path[level];
+    ExtentPath& child = path[level + 1];
+    size_t entries = child.header->eh_entries;
+
+    // When appending at the end of the tree the full node is kept intact and
+    // the new entries go into a new node.
+    size_t split = entries / 2;
+    if (level + 1 == depth && child.index == entries) {
+        split = entries;
+    } else if (level + 1 < depth && child.index == entries - 1) {
+        split = entries - 1;
+    }
+
+    uint64_t newBlock = allocateBlock(getBlockGroup(ino));
+    if (!newBlock) return false;
+
+    char* node = new char[blockSize];
+    if (!node) {
+        deallocateBlock(newBlock);
+        return false;
+    }
+    memset(node, 0, blockSize);
+    ExtentHeader* header = (ExtentHeader*) node;
+    header->eh_magic = EXTENT_MAGIC;
+    header->eh_entries = entries - split;
+    header->eh_max = (blockSize - sizeof(ExtentHeader)) / sizeof(Extent);
+    header->eh_depth = child.header->eh_depth;
+    memcpy(getExtents(header), &getExtents(child.header)[split],
+            (entries - split) * sizeof(Extent));
+    uint32_t firstBlock = split < entries ?
+            (uint32_t) getExtents(header)[0].ee_block : (uint32_t) block;
+
+    if (!write(node, blockSize, newBlock * blockSize)) {
+        delete[] node;
+        deallocateBlock(newBlock);
+        return false;
+    }
+    delete[] node;
+    addInodeBlocks(inode, 1);
+
+    child.header->eh_entries = split;
+    if (!writeExtentNode(child)) return false;
+
+    ExtentIndex* indexes = getIndexes(parent.header);
+    size_t parentEntries = parent.header->eh_entries;
+    memmove(&indexes[parent.index + 2], &indexes[parent.index + 1],
+            (parentEntries - parent.index - 1) * sizeof(ExtentIndex));
+    indexes[parent.index + 1].ei_block = firstBlock;
+    setIndexLeaf(&indexes[parent.index + 1], newBlock);
+    parent.header->eh_entries = parentEntries + 1;
+    return writeExtentNode(parent);
+}
+
 int Ext234Fs::sync(int flags) {
     if (!readonly) {
         struct timespec now;
         Clock::get(CLOCK_REALTIME)->getTime(&now);
         superBlock.s_wtime = now.tv_sec;
-        if (!writeSuperBlock()) return -1;
+        if (!writeBackGroups() || !writeSuperBlock()) return -1;
     }
 
     return device->sync(flags);
 }
 
+// Removes all blocks starting at blockCount from the subtree of the node.
+bool Ext234Fs::truncateExtentNode(Inode* inode, ExtentHeader* header,
+        uint64_t blockCount) {
+    size_t entries = header->eh_entries;
+
+    if (header->eh_depth == 0) {
+        Extent* extents = getExtents(header);
+        while (entries > 0) {
+            Extent* extent = &extents[entries - 1];
+            uint64_t length = getExtentLength(extent);
+            if (extent->ee_block + length <= blockCount) break;
+
+            uint64_t keep = 0;
+            if (extent->ee_block < blockCount) {
+                keep = blockCount - extent->ee_block;
+            }
+            if (!deallocateBlocks(getExtentStart(extent) + keep,
+                    length - keep)) {
+                header->eh_entries = entries;
+                return false;
+            }
+            addInodeBlocks(inode, -(int64_t) (length - keep));
+
+            if (keep) {
+                extent->ee_len = isUnwritten(extent) ?
+                        keep + EXTENT_MAX_LENGTH : keep;
+                break;
+            }
+            entries--;
+        }
+
+        header->eh_entries = entries;
+        return true;
+    }
+
+    char* buffer = new char[blockSize];
+    if (!buffer) return false;
+    ExtentHeader* child = (ExtentHeader*) buffer;
+
+    ExtentIndex* indexes = getIndexes(header);
+    bool result = true;
+    while (result && entries > 0) {
+        ExtentIndex* index = &indexes[entries - 1];
+        // Subtrees before this one only contain blocks before blockCount.
+        bool last = index->ei_block < blockCount;
+
+        uint64_t nodeBlock = getIndexLeaf(index);
+        if (!read(child, blockSize, nodeBlock * blockSize)) {
+            result = false;
+            break;
+        }
+        if (child->eh_magic != EXTENT_MAGIC ||
+                child->eh_entries > child->eh_max ||
+                child->eh_depth != header->eh_depth - 1) {
+            errno = EIO;
+            result = false;
+            break;
+        }
+
+        result = truncateExtentNode(inode, child, blockCount);
+        if (child->eh_entries == 0) {
+            if (!deallocateBlock(nodeBlock)) {
+                result = false;
+                break;
+            }
+            addInodeBlocks(inode, -1);
+            entries--;
+        } else if (!write(child, blockSize, nodeBlock * blockSize)) {
+            result = false;
+        }
+
+        if (last) break;
+    }
+
+    header->eh_entries = entries;
+    delete[] buffer;
+    return result;
+}
+
+bool Ext234Fs::truncateExtents(Inode* inode, uint64_t blockCount) {
+    ExtentHeader* root = (ExtentHeader*) inode->i_block;
+    if (root->eh_magic != EXTENT_MAGIC || root->eh_depth > EXTENT_MAX_DEPTH) {
+        errno = EIO;
+        return false;
+    }
+
+    bool result = truncateExtentNode(inode, root, blockCount);
+    if (root->eh_entries == 0) {
+        root->eh_depth = 0;
+    }
+    return result;
+}
+
 bool Ext234Fs::write(const void* buffer, size_t size, off_t offset) {
     assert(!readonly);
     return device->pwrite(buffer, size, offset, 0) == (ssize_t) size;
 }
 
+bool Ext234Fs::writeBackBitmap(Bitmap& bitmap) {
+    if (bitmap.dirtyEnd == 0) return true;
+
+    if (!write(bitmap.data + bitmap.dirtyBegin,
+            bitmap.dirtyEnd - bitmap.dirtyBegin,
+            bitmap.block * blockSize + bitmap.dirtyBegin)) {
+        return false;
+    }
+    bitmap.dirtyBegin = 0;
+    bitmap.dirtyEnd = 0;
+    return true;
+}
+
+// Writes the modified bitmaps and group descriptors to the device.
+bool Ext234Fs::writeBackGroups() {
+    AutoLock lock1(&blocksMutex);
+    AutoLock lock2(&inodesMutex);
+    AutoLock lock3(&groupsMutex);
+
+    uint64_t gdtAddress = ALIGNUP(2048, blockSize);
+    size_t descriptorSize = min(gdtSize, sizeof(BlockGroupDescriptor));
+    while (!dirtyGroups.empty()) {
+        BlockGroup* group = &dirtyGroups.front();
+        uint64_t blockGroup = group - groups;
+        if (!writeBackBitmap(group->blockBitmap) ||
+                !writeBackBitmap(group->inodeBitmap) ||
+                !write(&group->descriptor, descriptorSize,
+                gdtAddress + blockGroup * gdtSize)) {
+            return false;
+        }
+        dirtyGroups.removeFront();
+        group->dirty = false;
+    }
+
+    // All bitmaps are clean now, so they can simply be dropped if too many of
+    // them have accumulated. They will be read again from the block cache.
+    if (cachedBitmaps > MAX_CACHED_BITMAPS) {
+        for (uint64_t i = 0; i < groupCount; i++) {
+            delete[] groups[i].blockBitmap.data;
+            groups[i].blockBitmap.data = nullptr;
+            delete[] groups[i].inodeBitmap.data;
+            groups[i].inodeBitmap.data = nullptr;
+        }
+        cachedBitmaps = 0;
+    }
+
+    return true;
+}
+
+bool Ext234Fs::writeExtentNode(const ExtentPath& path) {
+    // The root node is written together with the inode.
+    if (path.block == 0) return true;
+    return write(path.header, blockSize, path.block * blockSize);
+}
+
 bool Ext234Fs::writeInode(const Inode* inode, uint64_t inodeAddress) {
     size_t size = min(inodeSize, sizeof(Inode));
     return write(inode, size, inodeAddress);
@@ -948,14 +1728,19 @@ bool Ext234Fs::writeInodeData(const Inode* inode, off_t offset,
     while (size > 0) {
         uint64_t block = offset / blockSize;
         uint64_t misalign = offset % blockSize;
-        size_t writeSize = blockSize - misalign;
-        if (writeSize > size) writeSize = size;
 
-        uint64_t address = getInodeBlockAddress(inode, block);
-        if (address == (uint64_t) -1 ||
-                !write(buf, writeSize, address + misalign)) {
+        uint64_t contiguous;
+        uint64_t address = getInodeBlockAddress(inode, block, &contiguous);
+        if (address == (uint64_t) -1) return false;
+        size_t writeSize = min(contiguous * blockSize - misalign, size);
+
+        if (address == 0) {
+            // Holes and unwritten extents are never created by this driver
+            // and cannot be written to.
+            errno = EIO;
             return false;
         }
+        if (!write(buf, writeSize, address + misalign)) return false;
 
         size -= writeSize;
         offset += writeSize;
@@ -0,0 +1,669 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/ext234htree.cpp
+ * Hashed directory indexes for ext3 and ext4.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dennix/kernel/ext234fs.h>
+
+// A directory with an index stores a tree of hashes in some of its blocks.
+// Block 0 contains the "." and ".." entries followed by the root of the tree.
+// Interior nodes consist of a single unused directory entry spanning the
+// whole block so that they look empty to code that does not know about the
+// index. The leaves are ordinary directory blocks that contain the names of a
+// range of hashes. The lowest bit of a hash in the index is set if names with
+// the same hash are also stored in the previous leaf.
+
+#define DX_ROOT_INFO_OFFSET 24
+#define DX_NODE_ENTRIES_OFFSET 8
+
+static inline size_t getCount(const DxEntry* entries) {
+    return ((const DxCountLimit*) entries)->count;
+}
+
+static inline size_t getLimit(const DxEntry* entries) {
+    return ((const DxCountLimit*) entries)->limit;
+}
+
+static inline void setCount(DxEntry* entries, size_t count) {
+    ((DxCountLimit*) entries)->count = count;
+}
+
+static inline void setLimit(DxEntry* entries, size_t limit) {
+    ((DxCountLimit*) entries)->limit = limit;
+}
+
+static inline uint32_t rotateLeft(uint32_t value, unsigned int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static uint32_t legacyHash(const char* name, size_t length, bool isUnsigned) {
+    uint32_t hash0 = 0x12A3FE2D;
+    uint32_t hash1 = 0x37ABE8F9;
+    for (size_t i = 0; i < length; i++) {
+        int c = isUnsigned ? (int) (unsigned char) name[i] :
+                (int) (signed char) name[i];
+        uint32_t hash = hash1 + (hash0 ^ (uint32_t) (c * 7152373));
+        if (hash & 0x80000000) {
+            hash -= 0x7FFFFFFF;
+        }
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// Converts up to num * 4 bytes of the name into words padded with the length.
+static void nameToWords(const char* name, size_t length, uint32_t* words,
+        size_t num, bool isUnsigned) {
+    uint32_t pad = (uint32_t) length | (uint32_t) length << 8;
+    pad |= pad << 16;
+
+    uint32_t value = pad;
+    if (length > num * 4) {
+        length = num * 4;
+    }
+    for (size_t i = 0; i < length; i++) {
+        int c = isUnsigned ? (int) (unsigned char) name[i] :
+                (int) (signed char) name[i];
+        value = (uint32_t) c + (value << 8);
+        if (i % 4 == 3) {
+            *words++ = value;
+            value = pad;
+            num--;
+        }
+    }
+    if (num > 0) {
+        *words++ = value;
+        num--;
+    }
+    while (num > 0) {
+        *words++ = pad;
+        num--;
+    }
+}
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define ROUND(f, a, b, c, d, x, s) ((a) = rotateLeft((a) + f(b, c, d) + (x), s))
+#define K2 013240474631U
+#define K3 015666365641U
+
+static void halfMd4Transform(uint32_t buffer[4], const uint32_t in[8]) {
+    uint32_t a = buffer[0];
+    uint32_t b = buffer[1];
+    uint32_t c = buffer[2];
+    uint32_t d = buffer[3];
+
+    ROUND(F, a, b, c, d, in[0], 3);
+    ROUND(F, d, a, b, c, in[1], 7);
+    ROUND(F, c, d, a, b, in[2], 11);
+    ROUND(F, b, c, d, a, in[3], 19);
+    ROUND(F, a, b, c, d, in[4], 3);
+    ROUND(F, d, a, b, c, in[5], 7);
+    ROUND(F, c, d, a, b, in[6], 11);
+    ROUND(F, b, c, d, a, in[7], 19);
+
+    ROUND(G, a, b, c, d, in[1] + K2, 3);
+    ROUND(G, d, a, b, c, in[3] + K2, 5);
+    ROUND(G, c, d, a, b, in[5] + K2, 9);
+    ROUND(G, b, c, d, a, in[7] + K2, 13);
+    ROUND(G, a, b, c, d, in[0] + K2, 3);
+    ROUND(G, d, a, b, c, in[2] + K2, 5);
+    ROUND(G, c, d, a, b, in[4] + K2, 9);
+    ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+    ROUND(H, a, b, c, d, in[3] + K3, 3);
+    ROUND(H, d, a, b, c, in[7] + K3, 9);
+    ROUND(H, c, d, a, b, in[2] + K3, 11);
+    ROUND(H, b, c, d, a, in[6] + K3, 15);
+    ROUND(H, a, b, c, d, in[1] + K3, 3);
+    ROUND(H, d, a, b, c, in[5] + K3, 9);
+    ROUND(H, c, d, a, b, in[0] + K3, 11);
+    ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+    buffer[0] += a;
+    buffer[1] += b;
+    buffer[2] += c;
+    buffer[3] += d;
+}
+
+static void teaTransform(uint32_t buffer[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buffer[0];
+    uint32_t b1 = buffer[1];
+    for (size_t i = 0; i < 16; i++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buffer[0] += b0;
+    buffer[1] += b1;
+}
+
+struct DxMapEntry {
+    uint32_t hash;
+    uint16_t offset;
+    uint16_t size;
+};
+
+static int compareMapEntries(const void* a, const void* b) {
+    const DxMapEntry* entry1 = (const DxMapEntry*) a;
+    const DxMapEntry* entry2 = (const DxMapEntry*) b;
+    if (entry1->hash != entry2->hash) {
+        return entry1->hash < entry2->hash ? -1 : 1;
+    }
+    return entry1->offset < entry2->offset ? -1 : 1;
+}
+
+// Copies the given entries into an otherwise empty block.
+static void copyEntries(char* destination, const char* source,
+        const DxMapEntry* map, size_t count, size_t blockSize) {
+    size_t offset = 0;
+    DirectoryEntry* entry = (DirectoryEntry*) destination;
+    for (size_t i = 0; i < count; i++) {
+        entry = (DirectoryEntry*) (destination + offset);
+        memcpy(entry, source + map[i].offset, map[i].size);
+        entry->rec_len = map[i].size;
+        offset += map[i].size;
+    }
+    entry->rec_len = entry->rec_len + blockSize - offset;
+}
+
+static void insertIndexEntry(DxFrame& frame, uint32_t hash, uint32_t block) {
+    size_t count = getCount(frame.entries);
+    DxEntry* entry = &frame.entries[frame.at + 1];
+    memmove(entry + 1, entry, (count - frame.at - 1) * sizeof(DxEntry));
+    entry->hash = hash;
+    entry->block = block;
+    setCount(frame.entries, count + 1);
+}
+
+static void initializeIndexNode(char* data, size_t blockSize) {
+    memset(data, 0, blockSize);
+    DirectoryEntry* entry = (DirectoryEntry*) data;
+    entry->inode = 0;
+    entry->rec_len = blockSize;
+    DxEntry* entries = (DxEntry*) (data + DX_NODE_ENTRIES_OFFSET);
+    setLimit(entries, (blockSize - DX_NODE_ENTRIES_OFFSET) / sizeof(DxEntry));
+}
+
+uint8_t Ext234Fs::getDefaultHashVersion() {
+    uint8_t hashVersion = superBlock.s_def_hash_version;
+    if (hashVersion > DX_HASH_TEA) return DX_HASH_HALF_MD4;
+    return hashVersion;
+}
+
+uint32_t Ext234Fs::hashName(const char* name, size_t length,
+        uint8_t hashVersion) {
+    uint32_t buffer[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    for (size_t i = 0; i < 4; i++) {
+        if (superBlock.s_hash_seed[i] != 0) {
+            for (size_t j = 0; j < 4; j++) {
+                buffer[j] = superBlock.s_hash_seed[j];
+            }
+            break;
+        }
+    }
+
+    // File systems created on machines where char is unsigned use hashes that
+    // treat the name as unsigned.
+    bool isUnsigned = superBlock.s_flags & FLAGS_UNSIGNED_HASH;
+    if (hashVersion >= DX_HASH_UNSIGNED_OFFSET) {
+        hashVersion -= DX_HASH_UNSIGNED_OFFSET;
+        isUnsigned = true;
+    }
+
+    uint32_t hash;
+    uint32_t in[8];
+    if (hashVersion == DX_HASH_LEGACY) {
+        hash = legacyHash(name, length, isUnsigned);
+    } else if (hashVersion == DX_HASH_HALF_MD4) {
+        do {
+            nameToWords(name, length, in, 8, isUnsigned);
+            halfMd4Transform(buffer, in);
+            name += 32;
+            length = length > 32 ? length - 32 : 0;
+        } while (length > 0);
+        hash = buffer[1];
+    } else {
+        do {
+            nameToWords(name, length, in, 4, isUnsigned);
+            teaTransform(buffer, in);
+            name += 16;
+            length = length > 16 ? length - 16 : 0;
+        } while (length > 0);
+        hash = buffer[0];
+    }
+
+    hash &= ~1;
+    if (hash == 0xFFFFFFFE) {
+        hash = 0xFFFFFFFC;
+    }
+    return hash;
+}
+
+bool Ext234Vnode::addIndexedChildNode(const char* name, size_t nameLength,
+        ino_t ino, unsigned char dt) {
+    size_t blockSize = filesystem->blockSize;
+    char* buffer = new char[(DX_MAX_LEVELS + 1) * blockSize];
+    if (!buffer) return false;
+    char* leaf = buffer + DX_MAX_LEVELS * blockSize;
+
+    DxFrame frames[DX_MAX_LEVELS];
+    bool result = false;
+    while (true) {
+        size_t levels;
+        uint32_t hash;
+        if (!probeIndex(name, nameLength, frames, levels, buffer, hash)) break;
+
+        DxFrame& frame = frames[levels];
+        uint64_t leafBlock = frame.entries[frame.at].block;
+        if (!filesystem->readInodeData(&inode, leafBlock * blockSize, leaf,
+                blockSize)) {
+            break;
+        }
+
+        int added = addEntryToBlock(leaf, name, nameLength, ino, dt);
+        if (added != 0) {
+            result = added > 0 && filesystem->writeInodeData(&inode,
+                    leafBlock * blockSize, leaf, blockSize);
+            break;
+        }
+
+        // The leaf is full. Split it or make room in the index for splitting
+        // it and then try again.
+        if (getCount(frame.entries) < getLimit(frame.entries)) {
+            const DxRootInfo* info = (const DxRootInfo*) (buffer +
+                    DX_ROOT_INFO_OFFSET);
+            if (!splitIndexLeaf(frame, leaf, info->hash_version)) break;
+        } else if (levels == 0) {
+            if (!addIndexLevel(frames[0])) break;
+        } else if (getCount(frames[0].entries) < getLimit(frames[0].entries)) {
+            if (!splitIndexNode(frames[0], frame)) break;
+        } else {
+            errno = ENOSPC;
+            break;
+        }
+    }
+
+    delete[] buffer;
+    return result;
+}
+
+// Moves the entries of the root into a new interior node.
+bool Ext234Vnode::addIndexLevel(DxFrame& root) {
+    size_t blockSize = filesystem->blockSize;
+    char* data = new char[blockSize];
+    if (!data) return false;
+
+    uint64_t newBlock = appendDirectoryBlock();
+    if (newBlock == (uint64_t) -1) {
+        delete[] data;
+        return false;
+    }
+
+    initializeIndexNode(data, blockSize);
+    DxEntry* entries = (DxEntry*) (data + DX_NODE_ENTRIES_OFFSET);
+    size_t count = getCount(root.entries);
+    entries[0].block = root.entries[0].block;
+    memcpy(&entries[1], &root.entries[1], (count - 1) * sizeof(DxEntry));
+    setCount(entries, count);
+
+    bool result = filesystem->writeInodeData(&inode, newBlock * blockSize,
+            data, blockSize);
+    delete[] data;
+    if (!result) return false;
+
+    DxRootInfo* info = (DxRootInfo*) (root.data + DX_ROOT_INFO_OFFSET);
+    info->indirect_levels = 1;
+    setCount(root.entries, 1);
+    root.entries[0].block = newBlock;
+    return filesystem->writeInodeData(&inode, 0, root.data, blockSize);
+}
+
+uint64_t Ext234Vnode::findIndexedEntry(const char* name, size_t nameLength,
+        DirectoryEntry* de) {
+    size_t blockSize = filesystem->blockSize;
+    char* buffer = new char[(DX_MAX_LEVELS + 1) * blockSize];
+    if (!buffer) return -1;
+    char* leaf = buffer + DX_MAX_LEVELS * blockSize;
+
+    DxFrame frames[DX_MAX_LEVELS];
+    size_t levels;
+    uint32_t hash;
+    uint64_t result = -1;
+    if (!probeIndex(name, nameLength, frames, levels, buffer, hash)) {
+        delete[] buffer;
+        return -1;
+    }
+
+    do {
+        uint64_t leafBlock = frames[levels].entries[frames[levels].at].block;
+        if (!filesystem->readInodeData(&inode, leafBlock * blockSize, leaf,
+                blockSize)) {
+            break;
+        }
+
+        size_t offset = findEntryInBlock(leaf, name, nameLength);
+        if (offset == (size_t) -1) {
+            errno = EIO;
+            break;
+        }
+
+        if (offset < blockSize) {
+            *de = *(DirectoryEntry*) (leaf + offset);
+            result = leafBlock * blockSize + offset;
+            break;
+        }
+    } while (nextIndexLeaf(frames, levels, hash));
+
+    delete[] buffer;
+    return result;
+}
+
+// Converts a directory consisting of a single full block into an indexed
+// directory. The entries are moved into a new block that becomes the only leaf.
+bool Ext234Vnode::makeIndexedDirectory(char* block) {
+    size_t blockSize = filesystem->blockSize;
+    DirectoryEntry* dot = (DirectoryEntry*) block;
+    if (dot->rec_len < 12 || dot->rec_len > blockSize - 12 ||
+            dot->name_len != 1 || dot->name[0] != '.') {
+        return false;
+    }
+    DirectoryEntry* dotdot = (DirectoryEntry*) (block + dot->rec_len);
+    if (dotdot->rec_len < 12 || dotdot->name_len != 2 ||
+            memcmp(dotdot->name, "..", 2) != 0) {
+        return false;
+    }
+
+    DxMapEntry* map = new DxMapEntry[blockSize / 12];
+    if (!map) return false;
+    size_t count = 0;
+    size_t offset = dot->rec_len + dotdot->rec_len;
+    while (offset < blockSize) {
+        DirectoryEntry* entry = (DirectoryEntry*) (block + offset);
+        if (entry->rec_len < 8) {
+            delete[] map;
+            return false;
+        }
+        if (entry->inode != 0) {
+            map[count].offset = offset;
+            map[count].size = ALIGNUP(sizeof(DirectoryEntry) +
+                    entry->name_len, 4);
+            count++;
+        }
+        offset += entry->rec_len;
+    }
+
+    char* leaf = new char[blockSize];
+    if (!leaf) {
+        delete[] map;
+        return false;
+    }
+    memset(leaf, 0, blockSize);
+    DirectoryEntry* entry = (DirectoryEntry*) leaf;
+    entry->rec_len = blockSize;
+    if (count > 0) {
+        copyEntries(leaf, block, map, count, blockSize);
+    }
+    delete[] map;
+
+    uint64_t leafBlock = appendDirectoryBlock();
+    if (leafBlock == (uint64_t) -1 || !filesystem->writeInodeData(&inode,
+            leafBlock * blockSize, leaf, blockSize)) {
+        delete[] leaf;
+        return false;
+    }
+    delete[] leaf;
+
+    memmove(block + 12, dotdot, 12);
+    dot->rec_len = 12;
+    dotdot = (DirectoryEntry*) (block + 12);
+    dotdot->rec_len = blockSize - 12;
+    memset(block + DX_ROOT_INFO_OFFSET, 0, blockSize - DX_ROOT_INFO_OFFSET);
+
+    DxRootInfo* info = (DxRootInfo*) (block + DX_ROOT_INFO_OFFSET);
+    info->hash_version = filesystem->getDefaultHashVersion();
+    info->info_length = sizeof(DxRootInfo);
+    DxEntry* entries = (DxEntry*) (block + DX_ROOT_INFO_OFFSET +
+            sizeof(DxRootInfo));
+    setLimit(entries, (blockSize - DX_ROOT_INFO_OFFSET - sizeof(DxRootInfo)) /
+            sizeof(DxEntry));
+    setCount(entries, 1);
+    entries[0].block = leafBlock;
+
+    if (!filesystem->writeInodeData(&inode, 0, block, blockSize)) {
+        return false;
+    }
+    inode.i_flags = inode.i_flags | INODE_INDEX_FL;
+    inodeModified = true;
+    return true;
+}
+
+// Advances to the next leaf if it might contain names with the given hash.
+bool Ext234Vnode::nextIndexLeaf(DxFrame* frames, size_t levels,
+        uint32_t hash) {
+    size_t level = levels;
+    while (frames[level].at + 1 >= getCount(frames[level].entries)) {
+        if (level == 0) return false;
+        level--;
+    }
+
+    frames[level].at++;
+    uint32_t nextHash = frames[level].entries[frames[level].at].hash;
+    if ((nextHash & ~1) != hash) return false;
+
+    size_t blockSize = filesystem->blockSize;
+    while (level < levels) {
+        uint64_t block = frames[level].entries[frames[level].at].block;
+        level++;
+        DxFrame& frame = frames[level];
+        if (!filesystem->readInodeData(&inode, block * blockSize, frame.data,
+                blockSize)) {
+            return false;
+        }
+        frame.block = block;
+        frame.entries = (DxEntry*) (frame.data + DX_NODE_ENTRIES_OFFSET);
+        frame.at = 0;
+        if (getCount(frame.entries) == 0) {
+            errno = EIO;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Looks up the path to the leaf that contains the hash of the name. The nodes
+// are read into consecutive blocks of the buffer.
+bool Ext234Vnode::probeIndex(const char* name, size_t nameLength,
+        DxFrame* frames, size_t& levels, char* buffer, uint32_t& hash) {
+    size_t blockSize = filesystem->blockSize;
+    if (!filesystem->readInodeData(&inode, 0, buffer, blockSize)) {
+        return false;
+    }
+
+    const DxRootInfo* info = (const DxRootInfo*) (buffer +
+            DX_ROOT_INFO_OFFSET);
+    if (info->reserved_zero != 0 || info->info_length != sizeof(DxRootInfo) ||
+            info->indirect_levels >= DX_MAX_LEVELS ||
+            (info->hash_version > DX_HASH_TEA &&
+            info->hash_version - DX_HASH_UNSIGNED_OFFSET > DX_HASH_TEA)) {
+        errno = EIO;
+        return false;
+    }
+
+    hash = filesystem->hashName(name, nameLength, info->hash_version);
+    levels = info->indirect_levels;
+
+    uint64_t block = 0;
+    char* data = buffer;
+    DxEntry* entries = (DxEntry*) (buffer + DX_ROOT_INFO_OFFSET +
+            sizeof(DxRootInfo));
+    size_t limit = (blockSize - DX_ROOT_INFO_OFFSET - sizeof(DxRootInfo)) /
+            sizeof(DxEntry);
+
+    for (size_t level = 0; ; level++) {
+        size_t count = getCount(entries);
+        if (getLimit(entries) != limit || count == 0 || count > limit) {
+            errno = EIO;
+            return false;
+        }
+
+        // Find the last entry with a hash that is not greater than the hash.
+        // The first entry implicitly has the lowest hash.
+        size_t low = 1;
+        size_t high = count;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (entries[mid].hash > hash) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+
+        frames[level].block = block;
+        frames[level].data = data;
+        frames[level].entries = entries;
+        frames[level].at = low - 1;
+        if (level == levels) return true;
+
+        block = entries[low - 1].block;
+        data = buffer + (level + 1) * blockSize;
+        if (!filesystem->readInodeData(&inode, block * blockSize, data,
+                blockSize)) {
+            return false;
+        }
+        entries = (DxEntry*) (data + DX_NODE_ENTRIES_OFFSET);
+        limit = (blockSize - DX_NODE_ENTRIES_OFFSET) / sizeof(DxEntry);
+    }
+}
+
+// Moves the entries with the higher hashes of a full leaf into a new leaf.
+bool Ext234Vnode::splitIndexLeaf(DxFrame& frame, const char* leaf,
+        uint8_t hashVersion) {
+    size_t blockSize = filesystem->blockSize;
+    DxMapEntry* map = new DxMapEntry[blockSize / 12];
+    if (!map) return false;
+
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < blockSize) {
+        const DirectoryEntry* entry = (const DirectoryEntry*) (leaf + offset);
+        if (entry->rec_len < 8) {
+            delete[] map;
+            errno = EIO;
+            return false;
+        }
+        if (entry->inode != 0) {
+            map[count].hash = filesystem->hashName(entry->name,
+                    entry->name_len, hashVersion);
+            map[count].offset = offset;
+            map[count].size = ALIGNUP(sizeof(DirectoryEntry) +
+                    entry->name_len, 4);
+            count++;
+        }
+        offset += entry->rec_len;
+    }
+
+    if (count < 2) {
+        delete[] map;
+        errno = EIO;
+        return false;
+    }
+
+    qsort(map, count, sizeof(DxMapEntry), compareMapEntries);
+
+    // Move entries from the end until the new leaf is about half full.
+    size_t split = count;
+    size_t movedSize = 0;
+    while (split > 1 && (split == count ||
+            movedSize + map[split - 1].size <= blockSize / 2)) {
+        split--;
+        movedSize += map[split].size;
+    }
+    uint32_t splitHash = map[split].hash;
+    bool continued = map[split - 1].hash == splitHash;
+
+    char* data = new char[2 * blockSize];
+    if (!data) {
+        delete[] map;
+        return false;
+    }
+    memset(data, 0, 2 * blockSize);
+    copyEntries(data, leaf, map, split, blockSize);
+    copyEntries(data + blockSize, leaf, map + split, count - split,
+            blockSize);
+    delete[] map;
+
+    uint64_t leafBlock = frame.entries[frame.at].block;
+    uint64_t newBlock = appendDirectoryBlock();
+    if (newBlock == (uint64_t) -1 || !filesystem->writeInodeData(&inode,
+            newBlock * blockSize, data + blockSize, blockSize) ||
+            !filesystem->writeInodeData(&inode, leafBlock * blockSize, data,
+            blockSize)) {
+        delete[] data;
+        return false;
+    }
+    delete[] data;
+
+    insertIndexEntry(frame, splitHash | continued, newBlock);
+    return filesystem->writeInodeData(&inode, frame.block * blockSize,
+            frame.data, blockSize);
+}
+
+// Moves the upper half of a full interior node into a new node.
+bool Ext234Vnode::splitIndexNode(DxFrame& root, DxFrame& node) {
+    size_t blockSize = filesystem->blockSize;
+    char* data = new char[blockSize];
+    if (!data) return false;
+
+    uint64_t newBlock = appendDirectoryBlock();
+    if (newBlock == (uint64_t) -1) {
+        delete[] data;
+        return false;
+    }
+
+    size_t count = getCount(node.entries);
+    size_t split = count / 2;
+    uint32_t splitHash = node.entries[split].hash;
+
+    initializeIndexNode(data, blockSize);
+    DxEntry* entries = (DxEntry*) (data + DX_NODE_ENTRIES_OFFSET);
+    entries[0].block = node.entries[split].block;
+    memcpy(&entries[1], &node.entries[split + 1],
+            (count - split - 1) * sizeof(DxEntry));
+    setCount(entries, count - split);
+
+    bool result = filesystem->writeInodeData(&inode, newBlock * blockSize,
+            data, blockSize);
+    delete[] data;
+    if (!result) return false;
+
+    setCount(node.entries, split);
+    if (!filesystem->writeInodeData(&inode, node.block * blockSize,
+            node.data, blockSize)) {
+        return false;
+    }
+
+    insertIndexEntry(root, splitHash, newBlock);
+    return filesystem->writeInodeData(&inode, 0, root.data, blockSize);
+}
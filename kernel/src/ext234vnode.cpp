@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -27,7 +27,25 @@
 #include <dennix/fcntl.h>
 #include <dennix/poll.h>
 #include <dennix/seek.h>
+#include <dennix/kernel/clock.h>
 #include <dennix/kernel/ext234fs.h>
+#include <dennix/kernel/namecache.h>
+#include <dennix/kernel/pagecache.h>
+#include <dennix/kernel/thread.h>
+
+// Maximum amount of delayed data in bytes that is kept in memory for a single
+// file. MAX_DELAYED_DATA in ext234fs.cpp instead limits the blocks that are set
+// aside for the delayed data of all files of a filesystem.
+#define MAX_DELAYED_SIZE (1024 * 1024)
+
+// Protects delayedVnodes. Each vnode in the list holds a reference to itself.
+static kthread_mutex_t delayedMutex = KTHREAD_MUTEX_INITIALIZER;
+static SinglyLinkedList<Ext234Vnode, &Ext234Vnode::nextDelayed> delayedVnodes;
+// Serializes write backs so that all data has been written when
+// writeBackDelayedData returns.
+static kthread_mutex_t writeBackMutex = KTHREAD_MUTEX_INITIALIZER;
+
+ObjectCache Ext234Vnode::objectCache(sizeof(Ext234Vnode));
 
 static unsigned char typeToDT(uint8_t type) {
     return type == 1 ? DT_REG :
@@ -52,9 +70,17 @@ static uint8_t dtToType(unsigned char dt) {
 Ext234Vnode::Ext234Vnode(Ext234Fs* fs, ino_t ino, const Inode* inode,
         uint64_t inodeAddress) : Vnode(inode->i_mode, fs->dev), inode(*inode),
         inodeAddress(inodeAddress) {
+    delayedBlocks = 0;
+    delayedCapacity = 0;
+    delayedData = nullptr;
+    delayedSize = 0;
     filesystem = fs;
     inodeModified = false;
     mounted = nullptr;
+    onDelayedList = false;
+    reservation.start = 0;
+    reservation.count = 0;
+    writeBackError = 0;
 
     stats.st_ino = ino;
     stats.st_nlink = inode->i_links_count;
@@ -69,6 +95,12 @@ Ext234Vnode::Ext234Vnode(Ext234Fs* fs, ino_t ino, const Inode* inode,
 }
 
 Ext234Vnode::~Ext234Vnode() {
+    // The list of vnodes with delayed data keeps the vnode alive until the
+    // data has been written.
+    assert(delayedSize == 0);
+    free(delayedData);
+    filesystem->releaseReservation(&reservation);
+
     if (S_ISDIR(stats.st_mode) && stats.st_nlink == 1) {
         // Decrease count for the . entry.
         stats.st_nlink = 0;
@@ -95,88 +127,51 @@ Ext234Vnode::~Ext234Vnode() {
 
 bool Ext234Vnode::addChildNode(const char* name, size_t nameLength, ino_t ino,
         unsigned char dt) {
-    size_t neededSize = ALIGNUP(sizeof(DirectoryEntry) + nameLength, 4);
+    if (inode.i_flags & INODE_INDEX_FL) {
+        return addIndexedChildNode(name, nameLength, ino, dt);
+    }
+
+    char* block = new char[filesystem->blockSize];
+    if (!block) return false;
 
     uint64_t blockNum = 0;
     while (blockNum * filesystem->blockSize < (uint64_t) stats.st_size) {
-        char* block = new char[filesystem->blockSize];
-        if (!block) return false;
         if (!filesystem->readInodeData(&inode, blockNum * filesystem->blockSize,
                 block, filesystem->blockSize)) {
             delete[] block;
             return false;
         }
 
-        size_t offset = 0;
-        while (offset < filesystem->blockSize) {
-            DirectoryEntry* entry = (DirectoryEntry*) (block + offset);
-
-            if (entry->rec_len < 8) {
-                delete[] block;
-                errno = EIO;
-                return false;
-            }
-
-            if (entry->inode != 0) {
-                size_t length = ALIGNUP(sizeof(DirectoryEntry) +
-                        entry->name_len, 4);
-                if (entry->rec_len >= length + neededSize) {
-                    size_t remainingLength = entry->rec_len - length;
-                    entry->rec_len = length;
-                    entry = (DirectoryEntry*) (block + offset + length);
-                    entry->inode = 0;
-                    entry->rec_len = remainingLength;
-                }
-            }
-
-            if (entry->inode == 0 && entry->rec_len >= neededSize) {
-                entry->inode = ino;
-                entry->name_len = nameLength;
-                if (filesystem->hasIncompatFeature(INCOMPAT_FILETYPE)) {
-                    entry->file_type = dtToType(dt);
-                } else {
-                    entry->file_type = 0;
-                }
-                memcpy(entry->name, name, nameLength);
-
-                bool result = filesystem->writeInodeData(&inode,
-                        blockNum * filesystem->blockSize, block,
-                        filesystem->blockSize);
-                delete[] block;
-                return result;
-            }
-
-            offset += entry->rec_len;
+        int added = addEntryToBlock(block, name, nameLength, ino, dt);
+        if (added != 0) {
+            bool result = added > 0 && filesystem->writeInodeData(&inode,
+                    blockNum * filesystem->blockSize, block,
+                    filesystem->blockSize);
+            delete[] block;
+            return result;
         }
 
-        delete[] block;
         blockNum++;
     }
 
-    // No free space for the new entry was found.
-    if (!filesystem->resizeInode(stats.st_ino, &inode,
-            stats.st_size + filesystem->blockSize)) {
-        return false;
+    // No free space for the new entry was found. Directories that outgrow
+    // their first block get an index if the file system supports it.
+    if (blockNum == 1 && filesystem->hasCompatFeature(COMPAT_DIR_INDEX) &&
+            makeIndexedDirectory(block)) {
+        delete[] block;
+        return addIndexedChildNode(name, nameLength, ino, dt);
     }
-    stats.st_size += filesystem->blockSize;
 
-    char* block = new char[filesystem->blockSize];
-    if (!block) return false;
-    memset(block, 0, filesystem->blockSize);
-    DirectoryEntry* entry = (DirectoryEntry*) block;
-    entry->inode = ino;
-    entry->rec_len = neededSize;
-    entry->name_len = nameLength;
-    if (filesystem->hasIncompatFeature(INCOMPAT_FILETYPE)) {
-        entry->file_type = dtToType(dt);
-    } else {
-        entry->file_type = 0;
+    blockNum = appendDirectoryBlock();
+    if (blockNum == (uint64_t) -1) {
+        delete[] block;
+        return false;
     }
-    memcpy(entry->name, name, nameLength);
 
-    entry = (DirectoryEntry*) &block[neededSize];
+    DirectoryEntry* entry = (DirectoryEntry*) block;
     entry->inode = 0;
-    entry->rec_len = filesystem->blockSize - neededSize;
+    entry->rec_len = filesystem->blockSize;
+    addEntryToBlock(block, name, nameLength, ino, dt);
 
     if (!filesystem->writeInodeData(&inode, blockNum * filesystem->blockSize,
             block, filesystem->blockSize)) {
@@ -187,6 +182,73 @@ bool Ext234Vnode::addChildNode(const char* name, size_t nameLength, ino_t ino,
     return true;
 }
 
+// Returns 1 if the entry was added to the block, 0 if there was not enough
+// space and -1 if the block is corrupt.
+int Ext234Vnode::addEntryToBlock(char* block, const char* name,
+        size_t nameLength, ino_t ino, unsigned char dt) {
+    size_t neededSize = ALIGNUP(sizeof(DirectoryEntry) + nameLength, 4);
+
+    size_t offset = 0;
+    while (offset < filesystem->blockSize) {
+        DirectoryEntry* entry = (DirectoryEntry*) (block + offset);
+
+        if (entry->rec_len < 8) {
+            errno = EIO;
+            return -1;
+        }
+
+        if (entry->inode != 0) {
+            size_t length = ALIGNUP(sizeof(DirectoryEntry) + entry->name_len,
+                    4);
+            if (entry->rec_len >= length + neededSize) {
+                size_t remainingLength = entry->rec_len - length;
+                entry->rec_len = length;
+                entry = (DirectoryEntry*) (block + offset + length);
+                entry->inode = 0;
+                entry->rec_len = remainingLength;
+            }
+        }
+
+        if (entry->inode == 0 && entry->rec_len >= neededSize) {
+            entry->inode = ino;
+            entry->name_len = nameLength;
+            if (filesystem->hasIncompatFeature(INCOMPAT_FILETYPE)) {
+                entry->file_type = dtToType(dt);
+            } else {
+                entry->file_type = 0;
+            }
+            memcpy(entry->name, name, nameLength);
+            return 1;
+        }
+
+        offset += entry->rec_len;
+    }
+
+    return 0;
+}
+
+// Returns the number of the new block or -1 on failure.
+uint64_t Ext234Vnode::appendDirectoryBlock() {
+    uint64_t blockNum = stats.st_size / filesystem->blockSize;
+    if (!filesystem->resizeInode(stats.st_ino, &inode,
+            stats.st_size + filesystem->blockSize)) {
+        return -1;
+    }
+    stats.st_size += filesystem->blockSize;
+    inodeModified = true;
+    return blockNum;
+}
+
+int Ext234Vnode::checkWriteBackError() {
+    AutoLock lock(&mutex);
+    if (writeBackError) {
+        errno = writeBackError;
+        writeBackError = 0;
+        return -1;
+    }
+    return 0;
+}
+
 int Ext234Vnode::chmod(mode_t mode) {
     AutoLock lock(&mutex);
     if (filesystem->readonly) {
@@ -223,8 +285,70 @@ int Ext234Vnode::chown(uid_t uid, gid_t gid) {
     return 0;
 }
 
+// Keeps data that is written past the end of the file on disk in memory so
+// that blocks can be allocated for all of it at once. Returns false if the
+// data cannot be delayed and needs to be written immediately.
+bool Ext234Vnode::delayWrite(const void* buffer, size_t size, off_t offset) {
+    off_t diskSize = stats.st_size - delayedSize;
+    assert(offset >= diskSize);
+    if (offset - diskSize > MAX_DELAYED_SIZE) return false;
+    size_t begin = offset - diskSize;
+    if (size > MAX_DELAYED_SIZE - begin) return false;
+    size_t end = begin + size;
+
+    if (end > delayedSize) {
+        if (end > delayedCapacity) {
+            size_t newCapacity = delayedCapacity ? delayedCapacity : 4096;
+            while (newCapacity < end) {
+                newCapacity *= 2;
+            }
+            if (newCapacity > MAX_DELAYED_SIZE) {
+                newCapacity = MAX_DELAYED_SIZE;
+            }
+            char* newData = (char*) realloc(delayedData, newCapacity);
+            if (!newData) return false;
+            delayedData = newData;
+            delayedCapacity = newCapacity;
+        }
+
+        // Set aside enough blocks for the data and for the block map so that
+        // writing back the data cannot fail because the disk is full.
+        uint64_t blocks = filesystem->getBlockCount(diskSize + end) -
+                filesystem->getBlockCount(diskSize) + EXTENT_MAX_DEPTH;
+        if (blocks > delayedBlocks) {
+            if (!filesystem->reserveDelayedBlocks(blocks - delayedBlocks)) {
+                return false;
+            }
+            delayedBlocks = blocks;
+        }
+
+        if (!onDelayedList) {
+            addReference();
+            onDelayedList = true;
+            AutoLock lock(&delayedMutex);
+            delayedVnodes.addFront(*this);
+        }
+
+        if (begin > delayedSize) {
+            memset(delayedData + delayedSize, 0, begin - delayedSize);
+        }
+        delayedSize = end;
+        stats.st_size = diskSize + end;
+    }
+
+    memcpy(delayedData + begin, buffer, size);
+    return true;
+}
+
 uint64_t Ext234Vnode::findDirectoryEntry(const char* name, size_t nameLength,
         DirectoryEntry* de) {
+    bool isDotOrDotDot = name[0] == '.' && (nameLength == 1 ||
+            (nameLength == 2 && name[1] == '.'));
+    if ((inode.i_flags & INODE_INDEX_FL) && !isDotOrDotDot &&
+            filesystem->hasCompatFeature(COMPAT_DIR_INDEX)) {
+        return findIndexedEntry(name, nameLength, de);
+    }
+
     off_t bytesRead = 0;
     uint64_t blockNum = 0;
     char* block = new char[filesystem->blockSize];
@@ -237,29 +361,17 @@ uint64_t Ext234Vnode::findDirectoryEntry(const char* name, size_t nameLength,
             return -1;
         }
 
-        size_t offset = 0;
-        while (offset < filesystem->blockSize) {
-            DirectoryEntry* entry = (DirectoryEntry*) (block + offset);
-
-            if (entry->rec_len < 8) {
-                delete[] block;
-                errno = EIO;
-                return -1;
-            }
-
-            if (entry->inode == 0) {
-                offset += entry->rec_len;
-                continue;
-            }
-
-            if (entry->name_len == nameLength && memcmp(name, entry->name,
-                    nameLength) == 0) {
-                *de = *entry;
-                delete[] block;
-                return blockNum * filesystem->blockSize + offset;
-            }
+        size_t offset = findEntryInBlock(block, name, nameLength);
+        if (offset == (size_t) -1) {
+            delete[] block;
+            errno = EIO;
+            return -1;
+        }
 
-            offset += entry->rec_len;
+        if (offset < filesystem->blockSize) {
+            *de = *(DirectoryEntry*) (block + offset);
+            delete[] block;
+            return blockNum * filesystem->blockSize + offset;
         }
 
         bytesRead += filesystem->blockSize;
@@ -270,40 +382,69 @@ uint64_t Ext234Vnode::findDirectoryEntry(const char* name, size_t nameLength,
     return -1;
 }
 
-int Ext234Vnode::ftruncate(off_t length) {
+// Returns the offset of the entry, the block size if the name was not found or
+// -1 if the block is corrupt.
+size_t Ext234Vnode::findEntryInBlock(const char* block, const char* name,
+        size_t nameLength) {
+    size_t offset = 0;
+    while (offset < filesystem->blockSize) {
+        const DirectoryEntry* entry = (const DirectoryEntry*) (block + offset);
+        if (entry->rec_len < 8) return -1;
+
+        if (entry->inode != 0 && entry->name_len == nameLength &&
+                memcmp(name, entry->name, nameLength) == 0) {
+            return offset;
+        }
+
+        offset += entry->rec_len;
+    }
+
+    return filesystem->blockSize;
+}
+
+int Ext234Vnode::fallocate(off_t offset, off_t length) {
+    AutoLock writeLock(&writeMutex);
     AutoLock lock(&mutex);
     if (filesystem->readonly) {
         errno = EROFS;
         return -1;
     }
 
-    if (!S_ISREG(stats.st_mode) || length < 0) {
-        errno = EINVAL;
+    if (!S_ISREG(stats.st_mode)) {
+        errno = ENODEV;
         return -1;
     }
 
-    off_t oldSize = stats.st_size;
-    if (!filesystem->resizeInode(stats.st_ino, &inode, length)) {
+    off_t newSize;
+    if (__builtin_add_overflow(offset, length, &newSize)) {
+        errno = EFBIG;
         return -1;
     }
-    stats.st_size = length;
 
-    while (length > oldSize) {
-        char* buffer = new char[filesystem->blockSize];
-        if (!buffer) return -1;
-        memset(buffer, 0, filesystem->blockSize);
-        size_t diff = length - oldSize;
-        if (diff > filesystem->blockSize) diff = filesystem->blockSize;
-        if (!filesystem->writeInodeData(&inode, oldSize, buffer, diff)) {
-            delete[] buffer;
-            return -1;
-        }
-        delete[] buffer;
-        oldSize += diff;
+    // Delayed data does not have any blocks yet.
+    if (!writeDelayedData()) return -1;
+
+    // This driver never creates holes, so all blocks before the end of the
+    // file are already allocated. Growing the file allocates the new blocks
+    // in as few contiguous runs as possible.
+    if (newSize <= stats.st_size) return 0;
+    return resize(newSize);
+}
+
+int Ext234Vnode::ftruncate(off_t length) {
+    AutoLock writeLock(&writeMutex);
+    AutoLock lock(&mutex);
+    if (filesystem->readonly) {
+        errno = EROFS;
+        return -1;
     }
 
-    updateTimestamps(false, true, true);
-    return 0;
+    if (!S_ISREG(stats.st_mode) || length < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return resize(length);
 }
 
 Reference<Vnode> Ext234Vnode::getChildNode(const char* name) {
@@ -311,8 +452,19 @@ Reference<Vnode> Ext234Vnode::getChildNode(const char* name) {
 }
 
 Reference<Vnode> Ext234Vnode::getChildNode(const char* path, size_t length) {
-    AutoLock lock(&mutex);
-    return getChildNodeUnlocked(path, length);
+    Reference<Vnode> vnode;
+    if (NameCache::lookup(this, path, length, vnode)) return vnode;
+    unsigned long generation = NameCache::getGeneration();
+
+    {
+        AutoLock lock(&mutex);
+        vnode = getChildNodeUnlocked(path, length);
+    }
+
+    if (vnode || errno == ENOENT) {
+        NameCache::add(this, path, length, vnode, generation);
+    }
+    return vnode;
 }
 
 Reference<Vnode> Ext234Vnode::getChildNodeUnlocked(const char* path,
@@ -531,6 +683,7 @@ int Ext234Vnode::linkUnlocked(const char* name, size_t nameLength,
     if (!addChildNode(name, nameLength, st.st_ino, IFTODT(st.st_mode))) {
         return -1;
     }
+    NameCache::remove(this, name, nameLength);
     updateTimestamps(false, true, true);
     vnode->onLink();
     return 0;
@@ -603,9 +756,25 @@ int Ext234Vnode::mount(FileSystem* filesystem) {
     }
 
     mounted = filesystem;
+    NameCache::removeDirectory(this);
     return 0;
 }
 
+void Ext234Vnode::onClose(int /*flags*/) {
+    // The blocks that were reserved for appending to the file are given back
+    // when any description of the file is closed. The access mode cannot be
+    // used to decide this because the reservation does not belong to a
+    // particular file description. Delayed data is written at the same time so
+    // that it is allocated from the reservation. If that fails, the data and
+    // the reservation are kept for the next attempt.
+    AutoLock lock(&mutex);
+    if (!writeDelayedData()) {
+        writeBackError = errno;
+        return;
+    }
+    filesystem->releaseReservation(&reservation);
+}
+
 void Ext234Vnode::onLink() {
     updateTimestamps(false, true, false);
     stats.st_nlink++;
@@ -721,8 +890,7 @@ short Ext234Vnode::poll() {
 
 ssize_t Ext234Vnode::pread(void* buffer, size_t size, off_t offset,
         int /*flags*/) {
-    AutoLock lock(&mutex);
-
+    // The file type cannot change, so we do not need to lock the mutex here.
     if (S_ISDIR(stats.st_mode)) {
         errno = EISDIR;
         return -1;
@@ -735,24 +903,48 @@ ssize_t Ext234Vnode::pread(void* buffer, size_t size, off_t offset,
         errno = EINVAL;
         return -1;
     }
-    if (offset > stats.st_size) return 0;
+
+    // File data is read through the page cache so that data that is read
+    // repeatedly does not need to be looked up in the block map every time.
+    PageCache* cache = getPageCache();
+    if (!cache) return -1;
+    ssize_t result = cache->read(buffer, size, offset);
+    if (result < 0) return -1;
+
+    AutoLock lock(&mutex);
+    updateTimestamps(true, false, false);
+    return result;
+}
+
+ssize_t Ext234Vnode::preadUncached(void* buffer, size_t size, off_t offset) {
+    AutoLock lock(&mutex);
+    if (offset >= stats.st_size) return 0;
 
     if ((off_t) size > stats.st_size ||
             stats.st_size - (off_t) size < offset) {
         size = stats.st_size - offset;
     }
 
-    if (!filesystem->readInodeData(&inode, offset, buffer, size)) {
-        return -1;
+    // Delayed data past the end of the file on disk is copied from memory.
+    off_t diskSize = stats.st_size - delayedSize;
+    size_t diskPart = 0;
+    if (offset < diskSize) {
+        diskPart = (off_t) size < diskSize - offset ? size : diskSize - offset;
+        if (!filesystem->readInodeData(&inode, offset, buffer, diskPart)) {
+            return -1;
+        }
     }
 
-    updateTimestamps(true, false, false);
+    if (diskPart < size) {
+        memcpy((char*) buffer + diskPart,
+                delayedData + (offset + diskPart - diskSize), size - diskPart);
+    }
     return size;
 }
 
 ssize_t Ext234Vnode::pwrite(const void* buffer, size_t size, off_t offset,
         int flags) {
-    AutoLock lock(&mutex);
+    // The file type cannot change, so we do not need to lock the mutex here.
     if (filesystem->readonly) {
         errno = EROFS;
         return -1;
@@ -768,9 +960,55 @@ ssize_t Ext234Vnode::pwrite(const void* buffer, size_t size, off_t offset,
 
     if (size == 0) return 0;
 
+    char* bounceBuffer = (char*) Thread::current()->getBounceBuffer();
+    if (!bounceBuffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // The end of the file is determined only once for appending writes.
+    // Holding the write mutex ensures that it does not change until all
+    // chunks have been written.
+    AutoLock writeLock(&writeMutex);
     if (flags & O_APPEND) {
+        AutoLock lock(&mutex);
         offset = stats.st_size;
     }
+
+    const char* buf = (const char*) buffer;
+    size_t written = 0;
+    while (written < size) {
+        size_t writeSize = size - written;
+        if (writeSize > BOUNCE_BUFFER_SIZE) writeSize = BOUNCE_BUFFER_SIZE;
+        memcpy(bounceBuffer, buf + written, writeSize);
+
+        AutoLock lock(&mutex);
+        if (pwriteUnlocked(bounceBuffer, writeSize, offset) < 0) {
+            return written ? (ssize_t) written : -1;
+        }
+        if (pageCache) {
+            pageCache->write(bounceBuffer, writeSize, offset);
+        }
+
+        offset += writeSize;
+        written += writeSize;
+    }
+
+    return written;
+}
+
+ssize_t Ext234Vnode::pwriteUncached(const void* buffer, size_t size,
+        off_t offset) {
+    AutoLock lock(&mutex);
+    // The page cache is written back when its data needs to reach the device,
+    // so delayed data cannot stay in memory.
+    ssize_t result = pwriteUnlocked(buffer, size, offset);
+    if (result >= 0 && !writeDelayedData()) return -1;
+    return result;
+}
+
+ssize_t Ext234Vnode::pwriteUnlocked(const void* buffer, size_t size,
+        off_t offset) {
     assert(offset >= 0);
 
     off_t newSize;
@@ -779,19 +1017,53 @@ ssize_t Ext234Vnode::pwrite(const void* buffer, size_t size, off_t offset,
         return -1;
     }
 
-    if (newSize > stats.st_size) {
-        if (!filesystem->resizeInode(stats.st_ino, &inode, newSize)) {
+    // Data that is written past the end of the file on disk is delayed so
+    // that many small appending writes do not allocate blocks one by one.
+    const char* buf = (const char*) buffer;
+    off_t diskSize = stats.st_size - delayedSize;
+    size_t diskPart = 0;
+    if (offset < diskSize) {
+        diskPart = (off_t) size < diskSize - offset ? size : diskSize - offset;
+        if (!filesystem->writeInodeData(&inode, offset, buf, diskPart)) {
             return -1;
         }
-        stats.st_size = newSize;
     }
 
-    if (!filesystem->writeInodeData(&inode, offset, buffer, size)) return -1;
+    if (diskPart < size && !delayWrite(buf + diskPart, size - diskPart,
+            offset + diskPart)) {
+        if (!writeDelayedData()) return -1;
+
+        if (newSize > stats.st_size) {
+            if (!filesystem->resizeInode(stats.st_ino, &inode, newSize,
+                    &reservation)) {
+                return -1;
+            }
+            stats.st_size = newSize;
+        }
+
+        if (!filesystem->writeInodeData(&inode, offset + diskPart,
+                buf + diskPart, size - diskPart)) {
+            return -1;
+        }
+    }
 
     updateTimestamps(false, true, true);
     return size;
 }
 
+void Ext234Vnode::readahead(off_t offset, size_t size) {
+    if (!S_ISREG(stats.st_mode) || offset < 0) return;
+
+    AutoLock lock(&mutex);
+    off_t diskSize = stats.st_size - delayedSize;
+    if (offset >= diskSize) return;
+    if ((off_t) size > diskSize - offset) {
+        size = diskSize - offset;
+    }
+
+    filesystem->readahead(&inode, offset, size);
+}
+
 ssize_t Ext234Vnode::readlink(char* buffer, size_t size) {
     if (!S_ISLNK(stats.st_mode)) {
         errno = EINVAL;
@@ -924,6 +1196,53 @@ int Ext234Vnode::rename(const Reference<Vnode>& oldDirectory,
     return 0;
 }
 
+// Changes the size of the file and fills any new part with zeros.
+int Ext234Vnode::resize(off_t length) {
+    // Delayed data after the new end of the file is discarded instead of
+    // written, so that files can still be shrunk when writing it fails.
+    off_t diskSize = stats.st_size - delayedSize;
+    if (delayedSize > 0 && length < stats.st_size) {
+        delayedSize = length > diskSize ? length - diskSize : 0;
+        stats.st_size = diskSize + delayedSize;
+        if (delayedSize == 0) {
+            filesystem->releaseDelayedBlocks(delayedBlocks);
+            delayedBlocks = 0;
+        }
+    }
+
+    // Reservations are only made for appending writes. The file gets exactly
+    // the blocks it needs, starting at the blocks that were reserved.
+    if (!writeDelayedData()) return -1;
+    filesystem->releaseReservation(&reservation);
+
+    off_t oldSize = stats.st_size;
+    if (!filesystem->resizeInode(stats.st_ino, &inode, length)) return -1;
+    stats.st_size = length;
+
+    if (pageCache) {
+        pageCache->truncate(length < oldSize ? length : oldSize);
+    }
+
+    if (length > oldSize) {
+        char* buffer = new char[filesystem->blockSize];
+        if (!buffer) return -1;
+        memset(buffer, 0, filesystem->blockSize);
+        while (length > oldSize) {
+            size_t diff = length - oldSize;
+            if (diff > filesystem->blockSize) diff = filesystem->blockSize;
+            if (!filesystem->writeInodeData(&inode, oldSize, buffer, diff)) {
+                delete[] buffer;
+                return -1;
+            }
+            oldSize += diff;
+        }
+        delete[] buffer;
+    }
+
+    updateTimestamps(false, true, true);
+    return 0;
+}
+
 Reference<Vnode> Ext234Vnode::resolve() {
     AutoLock lock(&mutex);
 
@@ -956,6 +1275,7 @@ int Ext234Vnode::symlink(const char* linkTarget, const char* name) {
         symlink->inode.i_size = length;
         memcpy(symlink->inode.i_block, linkTarget, length);
     } else {
+        filesystem->initializeExtentTree(&symlink->inode);
         if (!filesystem->resizeInode(ino, &symlink->inode, length) ||
                 !filesystem->writeInodeData(&symlink->inode, 0, linkTarget,
                 length)) {
@@ -967,7 +1287,19 @@ int Ext234Vnode::symlink(const char* linkTarget, const char* name) {
 }
 
 int Ext234Vnode::sync(int flags) {
+    // Writing back the page cache needs to lock the vnode.
+    if (pageCache && pageCache->sync() < 0) return -1;
+
     AutoLock lock(&mutex);
+    if (!writeDelayedData()) {
+        writeBackError = 0;
+        return -1;
+    }
+    if (writeBackError) {
+        errno = writeBackError;
+        writeBackError = 0;
+        return -1;
+    }
 
     if (inodeModified) {
         if (!filesystem->writeInode(&inode, inodeAddress)) return -1;
@@ -1030,6 +1362,10 @@ int Ext234Vnode::unlinkUnlocked(const char* name, int flags) {
             sizeof(DirectoryEntry))) {
         return -1;
     }
+    NameCache::remove(this, name, nameLength);
+    if (S_ISDIR(mode)) {
+        NameCache::removeDirectory((Vnode*) vnode);
+    }
 
     updateTimestamps(false, true, true);
     return 0;
@@ -1043,6 +1379,7 @@ int Ext234Vnode::unmount() {
         return -1;
     }
 
+    NameCache::removeFileSystem(mounted);
     if (!mounted->onUnmount()) return -1;
 
     delete mounted;
@@ -1079,6 +1416,75 @@ int Ext234Vnode::utimens(struct timespec atime, struct timespec mtime) {
     return 0;
 }
 
+// Writes back the delayed data of all vnodes of the given filesystem or of
+// all filesystems if fs is null.
+void Ext234Vnode::writeBackDelayedData(Ext234Fs* fs) {
+    AutoLock lock(&writeBackMutex);
+
+    SinglyLinkedList<Ext234Vnode, &Ext234Vnode::nextDelayed> list;
+    kthread_mutex_lock(&delayedMutex);
+    list.swap(delayedVnodes);
+    kthread_mutex_unlock(&delayedMutex);
+
+    while (!list.empty()) {
+        Ext234Vnode* vnode = &list.front();
+        list.removeFront();
+
+        if (fs && vnode->filesystem != fs) {
+            AutoLock listLock(&delayedMutex);
+            delayedVnodes.addFront(*vnode);
+            continue;
+        }
+
+        kthread_mutex_lock(&vnode->mutex);
+        if (!vnode->writeDelayedData()) {
+            // The vnode stays in the list so that writing is retried later.
+            vnode->writeBackError = errno;
+            kthread_mutex_unlock(&vnode->mutex);
+            AutoLock listLock(&delayedMutex);
+            delayedVnodes.addFront(*vnode);
+            continue;
+        }
+        vnode->onDelayedList = false;
+        kthread_mutex_unlock(&vnode->mutex);
+        // This might delete the vnode, so its mutex must not be held.
+        vnode->removeReference();
+    }
+}
+
+// Allocates blocks for the delayed data and writes it to the device. If this
+// fails the delayed data is kept so that writing it can be retried later.
+bool Ext234Vnode::writeDelayedData() {
+    if (delayedSize == 0) return true;
+
+    // The blocks set aside for the delayed data are given back so that they
+    // can be allocated for it.
+    off_t diskSize = stats.st_size - delayedSize;
+    filesystem->releaseDelayedBlocks(delayedBlocks);
+
+    bool resized = filesystem->resizeInode(stats.st_ino, &inode,
+            stats.st_size, &reservation);
+    if (resized) {
+        inodeModified = true;
+    }
+    if (!resized || !filesystem->writeInodeData(&inode, diskSize, delayedData,
+            delayedSize)) {
+        // Once the inode has been resized the blocks are allocated and only
+        // the data needs to be written again.
+        if (resized || !filesystem->reserveDelayedBlocks(delayedBlocks)) {
+            delayedBlocks = 0;
+        }
+        return false;
+    }
+
+    free(delayedData);
+    delayedBlocks = 0;
+    delayedCapacity = 0;
+    delayedData = nullptr;
+    delayedSize = 0;
+    return true;
+}
+
 void Ext234Vnode::writeTimestamps() {
     little_uint32_t* atimeExtra = nullptr;
     little_uint32_t* ctimeExtra = nullptr;
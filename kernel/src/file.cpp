@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -26,6 +26,8 @@
 #include <dennix/seek.h>
 #include <dennix/stat.h>
 #include <dennix/kernel/file.h>
+#include <dennix/kernel/pagecache.h>
+#include <dennix/kernel/thread.h>
 
 FileVnode::FileVnode(const void* data, size_t size, mode_t mode, dev_t dev)
         : Vnode(S_IFREG | mode, dev) {
@@ -39,6 +41,35 @@ FileVnode::~FileVnode() {
     free(data);
 }
 
+int FileVnode::fallocate(off_t offset, off_t length) {
+    off_t newSize;
+    if (__builtin_add_overflow(offset, length, &newSize) ||
+            (sizeof(off_t) > sizeof(size_t) && newSize > (off_t) SIZE_MAX)) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    AutoLock writeLock(&writeMutex);
+    AutoLock lock(&mutex);
+    if (newSize <= stats.st_size) return 0;
+
+    void* newData = realloc(data, (size_t) newSize);
+    if (!newData) {
+        errno = ENOSPC;
+        return -1;
+    }
+    data = (char*) newData;
+    memset(data + stats.st_size, '\0', newSize - stats.st_size);
+
+    if (pageCache) {
+        pageCache->truncate(stats.st_size);
+    }
+
+    stats.st_size = newSize;
+    updateTimestamps(false, true, true);
+    return 0;
+}
+
 int FileVnode::ftruncate(off_t length) {
     if (length < 0) {
         errno = EINVAL;
@@ -49,6 +80,7 @@ int FileVnode::ftruncate(off_t length) {
         return -1;
     }
 
+    AutoLock writeLock(&writeMutex);
     AutoLock lock(&mutex);
     void* newData = realloc(data, (size_t) length);
     if (!newData) {
@@ -61,6 +93,10 @@ int FileVnode::ftruncate(off_t length) {
         memset(data + stats.st_size, '\0', length - stats.st_size);
     }
 
+    if (pageCache) {
+        pageCache->truncate(length < stats.st_size ? length : stats.st_size);
+    }
+
     stats.st_size = length;
     updateTimestamps(false, true, true);
     return 0;
@@ -104,29 +140,89 @@ ssize_t FileVnode::pread(void* buffer, size_t size, off_t offset,
     }
     if (size == 0) return 0;
 
-    AutoLock lock(&mutex);
+    char* bounceBuffer = (char*) Thread::current()->getBounceBuffer();
+    if (!bounceBuffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+
     char* buf = (char*) buffer;
+    size_t bytesRead = 0;
+    while (bytesRead < size) {
+        kthread_mutex_lock(&mutex);
+        off_t position;
+        if (__builtin_add_overflow(offset, bytesRead, &position) ||
+                position >= stats.st_size) {
+            kthread_mutex_unlock(&mutex);
+            break;
+        }
 
-    for (size_t i = 0; i < size; i++) {
-        off_t j;
-        if (__builtin_add_overflow(offset, i, &j) || j >= stats.st_size) {
-            return i;
+        size_t readSize = size - bytesRead;
+        if (readSize > BOUNCE_BUFFER_SIZE) readSize = BOUNCE_BUFFER_SIZE;
+        if ((off_t) readSize > stats.st_size - position) {
+            readSize = stats.st_size - position;
         }
-        buf[i] = data[j];
+        memcpy(bounceBuffer, data + position, readSize);
+        kthread_mutex_unlock(&mutex);
+
+        memcpy(buf + bytesRead, bounceBuffer, readSize);
+        bytesRead += readSize;
     }
 
+    AutoLock lock(&mutex);
     updateTimestamps(true, false, false);
-    return size;
+    return bytesRead;
 }
 
 ssize_t FileVnode::pwrite(const void* buffer, size_t size, off_t offset,
         int flags) {
     if (size == 0) return 0;
 
-    AutoLock lock(&mutex);
+    char* bounceBuffer = (char*) Thread::current()->getBounceBuffer();
+    if (!bounceBuffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // The end of the file is determined only once for appending writes.
+    // Holding the write mutex ensures that it does not change until all
+    // chunks have been written.
+    AutoLock writeLock(&writeMutex);
     if (flags & O_APPEND) {
+        AutoLock lock(&mutex);
         offset = stats.st_size;
     }
+
+    const char* buf = (const char*) buffer;
+    size_t written = 0;
+    while (written < size) {
+        size_t writeSize = size - written;
+        if (writeSize > BOUNCE_BUFFER_SIZE) writeSize = BOUNCE_BUFFER_SIZE;
+        memcpy(bounceBuffer, buf + written, writeSize);
+
+        AutoLock lock(&mutex);
+        if (pwriteUnlocked(bounceBuffer, writeSize, offset) < 0) {
+            return written ? (ssize_t) written : -1;
+        }
+        if (pageCache) {
+            pageCache->write(bounceBuffer, writeSize, offset);
+        }
+
+        offset += writeSize;
+        written += writeSize;
+    }
+
+    return written;
+}
+
+ssize_t FileVnode::pwriteUncached(const void* buffer, size_t size,
+        off_t offset) {
+    AutoLock lock(&mutex);
+    return pwriteUnlocked(buffer, size, offset);
+}
+
+ssize_t FileVnode::pwriteUnlocked(const void* buffer, size_t size,
+        off_t offset) {
     assert(offset >= 0);
 
     off_t newSize;
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -30,6 +30,11 @@
 
 #define FILE_STATUS_FLAGS (O_APPEND | O_NONBLOCK | O_SYNC)
 
+#define MIN_READAHEAD (4 * PAGESIZE)
+#define MAX_READAHEAD (32 * PAGESIZE)
+
+ObjectCache FileDescription::objectCache(sizeof(FileDescription));
+
 FileDescription::FileDescription(const Reference<Vnode>& vnode, int flags)
         : vnode(vnode) {
     mutex = KTHREAD_MUTEX_INITIALIZER;
@@ -37,9 +42,13 @@ FileDescription::FileDescription(const Reference<Vnode>& vnode, int flags)
     fileFlags = flags & (O_ACCMODE | FILE_STATUS_FLAGS);
     dents = nullptr;
     dentsSize = 0;
+    readaheadEnd = 0;
+    readaheadSize = 0;
+    sequentialOffset = 0;
 }
 
 FileDescription::~FileDescription() {
+    vnode->onClose(fileFlags);
     free(dents);
 }
 
@@ -179,6 +188,7 @@ Reference<FileDescription> FileDescription::openat(const char* path, int flags,
 ssize_t FileDescription::read(void* buffer, size_t size) {
     if (vnode->isSeekable()) {
         AutoLock lock(&mutex);
+        readahead(size);
         ssize_t result = vnode->pread(buffer, size, offset, fileFlags);
 
         if (result != -1) {
@@ -189,6 +199,44 @@ ssize_t FileDescription::read(void* buffer, size_t size) {
     return vnode->read(buffer, size, fileFlags);
 }
 
+// This function is called with the mutex locked.
+void FileDescription::readahead(size_t size) {
+    off_t end;
+    if (size == 0 || __builtin_add_overflow(offset, size, &end)) return;
+
+    if (offset != sequentialOffset) {
+        // This does not look like sequential access. We start reading ahead
+        // once the next read continues where this one ends.
+        sequentialOffset = end;
+        readaheadEnd = offset;
+        readaheadSize = 0;
+        return;
+    }
+    sequentialOffset = end;
+
+    // Read more data once half of the window has been consumed.
+    if (readaheadSize && end <= readaheadEnd - (off_t) (readaheadSize / 2)) {
+        return;
+    }
+
+    // The window grows as long as the file is read sequentially.
+    if (readaheadSize == 0) {
+        readaheadSize = MIN_READAHEAD;
+    } else if (readaheadSize < MAX_READAHEAD) {
+        readaheadSize *= 2;
+    }
+
+    off_t start = readaheadEnd > offset ? readaheadEnd : offset;
+    if (__builtin_add_overflow(end, readaheadSize, &readaheadEnd)) {
+        readaheadEnd = end;
+    }
+
+    // Avoid filling the whole cache when the read itself is very large.
+    size_t length = readaheadEnd - start;
+    if (length > 2 * MAX_READAHEAD) length = 2 * MAX_READAHEAD;
+    vnode->readahead(start, length);
+}
+
 int FileDescription::tcgetattr(struct termios* result) {
     return vnode->tcgetattr(result);
 }
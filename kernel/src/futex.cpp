@@ -0,0 +1,151 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/futex.cpp
+ * Futexes.
+ */
+
+#include <errno.h>
+#include <dennix/futex.h>
+#include <dennix/kernel/process.h>
+#include <dennix/kernel/signal.h>
+#include <dennix/kernel/syscall.h>
+#include <dennix/kernel/thread.h>
+
+#define FUTEX_BUCKETS 64
+
+// A futex is a user address that threads can wait on until another thread
+// wakes them. Futexes are identified by the address space and the address, so
+// they are private to a process. Waiters are kept in a hash table of FIFO
+// lists. Like the kthread wait queues the lists are protected by disabling
+// interrupts. Additionally the bucket mutex is held while checking the futex
+// value so that a wakeup cannot get lost between checking the value and adding
+// the waiter to the list.
+
+namespace {
+struct FutexWaiter {
+    FutexWaiter* prev;
+    FutexWaiter* next;
+    AddressSpace* addressSpace;
+    int* address;
+    Thread* thread;
+    bool blocked;
+};
+
+struct FutexBucket {
+    kthread_mutex_t mutex;
+    LinkedListWithEnd<FutexWaiter, &FutexWaiter::prev, &FutexWaiter::next>
+            waiters;
+};
+}
+
+static FutexBucket buckets[FUTEX_BUCKETS];
+
+static FutexBucket& getBucket(AddressSpace* addressSpace, int* address) {
+    size_t hash = (uintptr_t) address / sizeof(int) ^
+            (uintptr_t) addressSpace / PAGESIZE;
+    return buckets[hash % FUTEX_BUCKETS];
+}
+
+static int futexWait(int* address, int value, clockid_t clock,
+        const struct timespec* endTime) {
+    if (endTime && (endTime->tv_nsec < 0 ||
+            endTime->tv_nsec >= 1000000000L)) {
+        return EINVAL;
+    }
+
+    FutexWaiter waiter;
+    waiter.addressSpace = Process::current()->addressSpace;
+    waiter.address = address;
+    waiter.thread = Thread::current();
+    waiter.blocked = true;
+    FutexBucket& bucket = getBucket(waiter.addressSpace, address);
+
+    kthread_mutex_lock(&bucket.mutex);
+    if (__atomic_load_n(address, __ATOMIC_SEQ_CST) != value) {
+        kthread_mutex_unlock(&bucket.mutex);
+        return EAGAIN;
+    }
+
+    bool interrupts = Interrupts::saveAndDisable();
+    bucket.waiters.addBack(waiter);
+    kthread_mutex_unlock(&bucket.mutex);
+
+    int result = 0;
+    while (waiter.blocked) {
+        struct timespec wakeupTime;
+        if (endTime) {
+            struct timespec now;
+            Clock* clk = Clock::get(clock);
+            clk->getTime(&now);
+            if (!timespecLess(now, *endTime)) {
+                result = ETIMEDOUT;
+                break;
+            }
+            wakeupTime = clk->toMonotonic(*endTime);
+        }
+
+        if (Signal::isPending()) {
+            result = EINTR;
+            break;
+        }
+
+        Thread::block(endTime ? &wakeupTime : nullptr);
+    }
+
+    if (waiter.blocked) {
+        bucket.waiters.remove(waiter);
+    }
+    Interrupts::restore(interrupts);
+    return result;
+}
+
+static int futexWake(int* address, int count) {
+    AddressSpace* addressSpace = Process::current()->addressSpace;
+    FutexBucket& bucket = getBucket(addressSpace, address);
+
+    AutoLock lock(&bucket.mutex);
+    bool interrupts = Interrupts::saveAndDisable();
+    auto iter = bucket.waiters.begin();
+    while (count > 0 && iter != bucket.waiters.end()) {
+        FutexWaiter& waiter = *iter;
+        ++iter;
+        if (waiter.addressSpace != addressSpace || waiter.address != address) {
+            continue;
+        }
+
+        bucket.waiters.remove(waiter);
+        waiter.blocked = false;
+        waiter.thread->wakeUp();
+        count--;
+    }
+    Interrupts::restore(interrupts);
+    return 0;
+}
+
+int Syscall::futex(int* address, int op, int value,
+        const struct timespec* timeout) {
+    // Errors are returned instead of being stored in errno so that the
+    // pthread functions do not modify errno.
+    if ((uintptr_t) address % alignof(int) != 0) return EINVAL;
+
+    clockid_t clock = op & FUTEX_CLOCK_REALTIME ? CLOCK_REALTIME :
+            CLOCK_MONOTONIC;
+    switch (op & ~FUTEX_CLOCK_REALTIME) {
+    case FUTEX_WAIT: return futexWait(address, value, clock, timeout);
+    case FUTEX_WAKE: return futexWake(address, value);
+    default: return EINVAL;
+    }
+}
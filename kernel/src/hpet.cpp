@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -23,8 +23,8 @@
 #include <dennix/kernel/interrupts.h>
 #include <dennix/kernel/log.h>
 #include <dennix/kernel/panic.h>
+#include <dennix/kernel/tsc.h>
 
-#define HPET_CAP_64BIT (1 << 13)
 #define HPET_CAP_LEGACY_REPLACEMENT (1 << 15)
 
 #define HPET_CONFIG_ENABLED (1 << 0)
@@ -33,17 +33,108 @@
 #define TIMER_CONFIG_LEVEL_TRIGGERED (1 << 1)
 #define TIMER_CONFIG_ENABLED (1 << 2)
 #define TIMER_CONFIG_PERIODIC (1 << 3)
-#define TIMER_CONFIG_SUPPORTS_PERIODIC (1 << 4)
-#define TIMER_CONFIG_SUPPORTS_64BIT (1 << 5)
-#define TIMER_CONFIG_SET_ACCUMULATOR (1 << 6)
+#define TIMER_CONFIG_32BIT_MODE (1 << 8)
 #define TIMER_CONFIG_FSB (1 << 14)
 #define TIMER_CONFIG_SUPPORTS_FSB (1 << 15)
 
-static unsigned long nanoseconds;
+// The timer runs in one-shot mode. Each interrupt is programmed for the next
+// event the scheduler needs, so no interrupts occur while the system is idle
+// except at least once per MAX_INTERVAL. The main counter is only read as 32
+// bits, which wraps around after several minutes at the usual frequencies.
+static const uint64_t MAX_INTERVAL = 1000000000; // nanoseconds
+static const uint64_t MIN_INTERVAL = 5000; // nanoseconds
+static const uint64_t FEMTOSECONDS_PER_NANOSECOND = 1000000;
+
+static volatile uint32_t* mainCounter;
+static volatile uint32_t* timer0Comparator;
+static uint32_t period; // femtoseconds
+static uint32_t minTicks;
+static uint32_t lastCounter;
+static uint64_t remainder; // femtoseconds
+static bool armed;
+static uint32_t armedTarget;
 static IrqHandler handler;
 
-static void irqHandler(void*, const InterruptContext* context) {
-    Clock::onTick(context->cs != 0x8, nanoseconds);
+static void irqHandler(void*, const InterruptContext*) {
+    // The clocks are updated when the scheduler runs.
+    armed = false;
+}
+
+void Hpet::setDeadline(const struct timespec* deadline) {
+    // This function must be called with interrupts disabled.
+    if (!mainCounter) return;
+
+    uint64_t nanoseconds = MAX_INTERVAL;
+    if (deadline) {
+        struct timespec now;
+        Clock::get(CLOCK_MONOTONIC)->getTime(&now);
+        if (!timespecLess(now, *deadline)) {
+            nanoseconds = 0;
+        } else {
+            struct timespec diff = timespecMinus(*deadline, now);
+            if (diff.tv_sec == 0 && (uint64_t) diff.tv_nsec < nanoseconds) {
+                nanoseconds = diff.tv_nsec;
+            }
+        }
+    }
+
+    // The clocks were last updated at lastCounter.
+    uint64_t ticks = (nanoseconds * FEMTOSECONDS_PER_NANOSECOND + period - 1) /
+            period;
+    uint32_t target = lastCounter + ticks;
+
+    // An earlier interrupt is already pending. If that one comes too early
+    // the deadline will just be set again.
+    if (armed && (int32_t) (target - armedTarget) >= 0) return;
+
+    // The counter might pass the target before the comparator is written. In
+    // that case no interrupt would occur, so we retry with a later target.
+    uint32_t margin = minTicks;
+    while (true) {
+        uint32_t counter = *mainCounter;
+        if ((int32_t) (target - counter) < (int32_t) margin) {
+            target = counter + margin;
+        }
+        *timer0Comparator = target;
+        if ((int32_t) (target - *mainCounter) > 0) break;
+        margin *= 2;
+    }
+
+    armed = true;
+    armedTarget = target;
+}
+
+void Hpet::updateClocks(bool user) {
+    // This function must be called with interrupts disabled.
+    if (!mainCounter) return;
+
+    uint32_t counter = *mainCounter;
+    uint64_t femtoseconds = (uint64_t) (counter - lastCounter) * period +
+            remainder;
+    lastCounter = counter;
+    remainder = femtoseconds % FEMTOSECONDS_PER_NANOSECOND;
+
+    // The TSC is used instead when possible because it has a higher
+    // resolution and can also be read by userspace.
+    if (!Tsc::updateClocks(user)) {
+        Clock::onTick(user, femtoseconds / FEMTOSECONDS_PER_NANOSECOND);
+    }
+}
+
+static uint64_t measureTscFrequency() {
+    // Count the TSC ticks during 10 milliseconds.
+    uint32_t ticks = 10000000 * FEMTOSECONDS_PER_NANOSECOND / period;
+    uint32_t start = *mainCounter;
+    uint64_t tscStart = Tsc::read();
+    uint32_t end;
+    do {
+        end = *mainCounter;
+    } while (end - start < ticks);
+    uint64_t tscTicks = Tsc::read() - tscStart;
+
+    uint64_t nanoseconds = (uint64_t) (end - start) * period /
+            FEMTOSECONDS_PER_NANOSECOND;
+    return tscTicks * 1000000000 / nanoseconds;
 }
 
 void Hpet::initialize(paddr_t baseAddress) {
@@ -56,26 +147,16 @@ void Hpet::initialize(paddr_t baseAddress) {
 
     uint32_t capabilites = *(volatile uint32_t*) mapped;
     bool legacyReplacementSupported = capabilites & HPET_CAP_LEGACY_REPLACEMENT;
-    bool has64Bit = capabilites & HPET_CAP_64BIT;
 
     volatile uint32_t* timer0ConfigReg = (volatile uint32_t*) (mapped + 0x100);
     uint32_t timer0Config = *timer0ConfigReg;
     bool fsbSupported = timer0Config & TIMER_CONFIG_SUPPORTS_FSB;
 
-    uint32_t period = *(volatile uint32_t*) (mapped + 0x4);
-    uint64_t count = 1000000000000ULL / period;
-    nanoseconds = count * period / 1000000;
-    has64Bit = has64Bit && (timer0Config & TIMER_CONFIG_SUPPORTS_64BIT);
-    bool periodic = timer0Config & TIMER_CONFIG_SUPPORTS_PERIODIC;
+    period = *(volatile uint32_t*) (mapped + 0x4);
+    minTicks = MIN_INTERVAL * FEMTOSECONDS_PER_NANOSECOND / period + 1;
 
-    if (!periodic) {
-        Log::printf("HPET does not support periodic mode\n");
-        kernelSpace->unmapPhysical(mapping, mapSize);
-        return;
-    }
-
-    timer0Config |= TIMER_CONFIG_SET_ACCUMULATOR;
-    timer0Config |= TIMER_CONFIG_PERIODIC;
+    timer0Config &= ~TIMER_CONFIG_PERIODIC;
+    timer0Config |= TIMER_CONFIG_32BIT_MODE;
     timer0Config |= TIMER_CONFIG_ENABLED;
     timer0Config &= ~TIMER_CONFIG_LEVEL_TRIGGERED;
 
@@ -122,21 +203,16 @@ void Hpet::initialize(paddr_t baseAddress) {
     }
 
     Log::printf("HPET is using IRQ%d\n", irq);
-    *timer0ConfigReg = timer0Config;
-
-    volatile uint32_t* timer0ComparatorLow =
-            (volatile uint32_t*) (mapped + 0x108);
-    volatile uint32_t* timer0ComparatorHigh =
-            (volatile uint32_t*) (mapped + 0x10C);
-    *timer0ComparatorLow = count & 0xFFFFFFFF;
-    *timer0ConfigReg = timer0Config;
-    *timer0ComparatorHigh = count >> 32;
 
     volatile uint32_t* mainCounterLow = (volatile uint32_t*) (mapped + 0xF0);
     volatile uint32_t* mainCounterHigh = (volatile uint32_t*) (mapped + 0xF4);
     *mainCounterLow = 0;
     *mainCounterHigh = 0;
 
+    timer0Comparator = (volatile uint32_t*) (mapped + 0x108);
+    *timer0ConfigReg = timer0Config;
+    *timer0Comparator = 0xFFFFFFFF;
+
     handler.func = irqHandler;
     Interrupts::addIrqHandler(irq, &handler);
     Interrupts::timerIrq = irq;
@@ -144,5 +220,20 @@ void Hpet::initialize(paddr_t baseAddress) {
     generalConfig |= HPET_CONFIG_ENABLED;
     *generalConfigReg = generalConfig;
 
-    kernelSpace->unmapPhysical(mapping, mapSize);
+    // The registers stay mapped because the counter is needed for
+    // timekeeping.
+    mainCounter = mainCounterLow;
+    lastCounter = 0;
+    remainder = 0;
+
+    if (Tsc::isSupported()) {
+        Tsc::initialize(measureTscFrequency());
+    }
+
+    // Fire the first interrupt after one millisecond. Afterwards the
+    // scheduler sets the deadlines.
+    armedTarget = *mainCounter + 1000000 * FEMTOSECONDS_PER_NANOSECOND /
+            period;
+    *timer0Comparator = armedTarget;
+    armed = true;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -22,6 +22,7 @@
 #include <dennix/fcntl.h>
 #include <dennix/kernel/acpi.h>
 #include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/blockcache.h>
 #include <dennix/kernel/console.h>
 #include <dennix/kernel/devices.h>
 #include <dennix/kernel/directory.h>
@@ -35,6 +36,7 @@
 #include <dennix/kernel/process.h>
 #include <dennix/kernel/ps2.h>
 #include <dennix/kernel/rtc.h>
+#include <dennix/kernel/slab.h>
 #include <dennix/kernel/worker.h>
 
 #ifndef DENNIX_VERSION
@@ -82,6 +84,10 @@ extern "C" void kmain(uint32_t /*magic*/, paddr_t multibootAddress) {
     Log::printf("Enabling interrupts...\n");
     Interrupts::enable();
 
+#ifdef SLAB_BENCHMARK
+    benchmarkObjectCaches();
+#endif
+
     Log::printf("Scanning for PCI devices...\n");
     Pci::scanForDevices();
 
@@ -102,10 +108,9 @@ extern "C" void kmain(uint32_t /*magic*/, paddr_t multibootAddress) {
     job.context = &rootFd;
     WorkerThread::addJob(&job);
     WorkerThread::initialize();
+    BlockCacheDevice::startFlusher();
 
-    while (true) {
-        asm volatile ("hlt");
-    }
+    Thread::idle();
 }
 
 static void startInitProcess(void* param) {
@@ -1,4 +1,4 @@
-/* Copyright (c) 2017, 2019, 2020, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2017, 2019, 2020, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,95 +18,132 @@
  */
 
 #include <errno.h>
-#include <sched.h>
 #include <dennix/kernel/kthread.h>
 #include <dennix/kernel/signal.h>
+#include <dennix/kernel/thread.h>
+
+// The wait queues are protected by disabling interrupts. This allows conditions
+// to be signaled from interrupt handlers.
+
+static void wakeWaiter(kthread_wait_queue& waiters) {
+    kthread_waiter& waiter = waiters.front();
+    waiters.remove(waiter);
+    waiter.blocked = false;
+    waiter.thread->wakeUp();
+}
 
 int kthread_cond_broadcast(kthread_cond_t* cond) {
-    kthread_mutex_lock(&cond->mutex);
+    bool interrupts = Interrupts::saveAndDisable();
     while (!cond->waiters.empty()) {
-        kthread_cond_waiter& waiter = cond->waiters.front();
-        cond->waiters.remove(waiter);
-        __atomic_store_n(&waiter.blocked, false, __ATOMIC_RELEASE);
+        wakeWaiter(cond->waiters);
     }
-    kthread_mutex_unlock(&cond->mutex);
+    Interrupts::restore(interrupts);
     return 0;
 }
 
-int kthread_cond_sigclockwait(kthread_cond_t* cond, kthread_mutex_t* mutex,
-        clockid_t clock, const struct timespec* endTime) {
-    kthread_mutex_lock(&cond->mutex);
-    kthread_mutex_unlock(mutex);
-
-    kthread_cond_waiter waiter;
+static int condWait(kthread_cond_t* cond, kthread_mutex_t* mutex,
+        clockid_t clock, const struct timespec* endTime, bool interruptible) {
+    kthread_waiter waiter;
+    waiter.thread = Thread::current();
     waiter.blocked = true;
+
+    // The mutex may be null if the caller instead disabled interrupts to
+    // protect the condition.
+    bool interrupts = Interrupts::saveAndDisable();
     cond->waiters.addBack(waiter);
-    kthread_mutex_unlock(&cond->mutex);
+    if (mutex) {
+        kthread_mutex_unlock(mutex);
+    }
 
     int result = 0;
 
-    while (__atomic_load_n(&waiter.blocked, __ATOMIC_ACQUIRE)) {
+    while (waiter.blocked) {
+        struct timespec wakeupTime;
         if (endTime) {
             struct timespec now;
-            Clock::get(clock)->getTime(&now);
+            Clock* clk = Clock::get(clock);
+            clk->getTime(&now);
             if (!timespecLess(now, *endTime)) {
                 result = ETIMEDOUT;
                 break;
             }
+            wakeupTime = clk->toMonotonic(*endTime);
         }
 
-        if (Signal::isPending()) {
+        if (interruptible && Signal::isPending()) {
             result = EINTR;
             break;
         }
-        sched_yield();
-    }
 
-    if (result) {
-        kthread_mutex_lock(&cond->mutex);
+        Thread::block(endTime ? &wakeupTime : nullptr);
+    }
 
-        // Only remove the waiter from the list if we were not unblocked
-        // concurrently. In that case the waiter was already removed.
-        if (__atomic_load_n(&waiter.blocked, __ATOMIC_RELAXED)) {
-            cond->waiters.remove(waiter);
-        }
-        kthread_mutex_unlock(&cond->mutex);
+    if (waiter.blocked) {
+        cond->waiters.remove(waiter);
     }
+    Interrupts::restore(interrupts);
 
-    kthread_mutex_lock(mutex);
+    if (mutex) {
+        kthread_mutex_lock(mutex);
+    }
     return result;
 }
 
+int kthread_cond_sigclockwait(kthread_cond_t* cond, kthread_mutex_t* mutex,
+        clockid_t clock, const struct timespec* endTime) {
+    return condWait(cond, mutex, clock, endTime, true);
+}
+
 int kthread_cond_signal(kthread_cond_t* cond) {
-    kthread_mutex_lock(&cond->mutex);
+    bool interrupts = Interrupts::saveAndDisable();
     if (!cond->waiters.empty()) {
-        kthread_cond_waiter& waiter = cond->waiters.front();
-        cond->waiters.remove(waiter);
-        __atomic_store_n(&waiter.blocked, false, __ATOMIC_RELEASE);
+        wakeWaiter(cond->waiters);
     }
-    kthread_mutex_unlock(&cond->mutex);
+    Interrupts::restore(interrupts);
     return 0;
 }
 
 int kthread_cond_sigwait(kthread_cond_t* cond, kthread_mutex_t* mutex) {
-    return kthread_cond_sigclockwait(cond, mutex, CLOCK_MONOTONIC, nullptr);
+    return condWait(cond, mutex, CLOCK_MONOTONIC, nullptr, true);
+}
+
+int kthread_cond_wait(kthread_cond_t* cond, kthread_mutex_t* mutex) {
+    return condWait(cond, mutex, CLOCK_MONOTONIC, nullptr, false);
 }
 
 int kthread_mutex_lock(kthread_mutex_t* mutex) {
-    while (__atomic_test_and_set(mutex, __ATOMIC_ACQUIRE)) {
-        sched_yield();
+    if (likely(!__atomic_test_and_set(&mutex->locked, __ATOMIC_ACQUIRE))) {
+        return 0;
+    }
+
+    kthread_waiter waiter;
+    waiter.thread = Thread::current();
+
+    bool interrupts = Interrupts::saveAndDisable();
+    while (__atomic_test_and_set(&mutex->locked, __ATOMIC_ACQUIRE)) {
+        waiter.blocked = true;
+        mutex->waiters.addBack(waiter);
+        while (waiter.blocked) {
+            Thread::block();
+        }
     }
+    Interrupts::restore(interrupts);
     return 0;
 }
 
 int kthread_mutex_trylock(kthread_mutex_t* mutex) {
-    if (__atomic_test_and_set(mutex, __ATOMIC_ACQUIRE)) {
+    if (__atomic_test_and_set(&mutex->locked, __ATOMIC_ACQUIRE)) {
         return EBUSY;
     }
     return 0;
 }
 
 int kthread_mutex_unlock(kthread_mutex_t* mutex) {
-    __atomic_clear(mutex, __ATOMIC_RELEASE);
+    bool interrupts = Interrupts::saveAndDisable();
+    __atomic_clear(&mutex->locked, __ATOMIC_RELEASE);
+    if (!mutex->waiters.empty()) {
+        wakeWaiter(mutex->waiters);
+    }
+    Interrupts::restore(interrupts);
     return 0;
 }
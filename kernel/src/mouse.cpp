@@ -1,4 +1,4 @@
-/* Copyright (c) 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -50,6 +50,7 @@ void MouseDevice::addPacket(mouse_data data) {
     mouseBuffer[writeIndex] = data;
     available++;
     kthread_cond_broadcast(&readCond);
+    notifyPoll();
 }
 
 int MouseDevice::devctl(int command, void* restrict data, size_t size,
@@ -0,0 +1,403 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/namecache.cpp
+ * Cache for directory lookups.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/cache.h>
+#include <dennix/kernel/hashtable.h>
+#include <dennix/kernel/interrupts.h>
+#include <dennix/kernel/list.h>
+#include <dennix/kernel/namecache.h>
+#include <dennix/kernel/worker.h>
+
+// Longer names are not cached.
+#define MAX_NAME_LENGTH 31
+#define MAX_PAGES 256
+#define MAX_RECLAIMED_PAGES 4
+// Number of entries that are removed before their references are dropped.
+#define BATCH_SIZE 16
+
+// Entries are stored in pages of cache memory. Once no more pages can be
+// allocated the least recently used entry is reused. When memory is reclaimed
+// the page containing the least recently used entry is given back. The
+// references held by its entries cannot be dropped while the PMM is locked, so
+// this is done later by the worker thread.
+
+struct NameKey {
+    const Vnode* directory;
+    const char* name;
+    size_t length;
+    size_t hash;
+
+    bool operator==(const NameKey& other) const {
+        return directory == other.directory && length == other.length &&
+                memcmp(name, other.name, length) == 0;
+    }
+
+    size_t operator%(size_t capacity) const {
+        return hash % capacity;
+    }
+};
+
+struct NameCacheEntry {
+    // The directory is null for unused entries.
+    Vnode* directory;
+    // The vnode is null for negative entries.
+    Vnode* vnode;
+    size_t hash;
+    NameCacheEntry* nextInHashTable;
+    // Used entries are in the list of accessed entries, unused entries are in
+    // the free list.
+    NameCacheEntry* prevAccessed;
+    NameCacheEntry* nextAccessed;
+    unsigned char length;
+    char name[MAX_NAME_LENGTH];
+
+    NameKey hashKey() { return NameKey{directory, name, length, hash}; }
+};
+
+struct NameCachePage {
+    NameCachePage* prev;
+    NameCachePage* next;
+    paddr_t physicalAddress;
+};
+
+class NameCacheController : public CacheController {
+public:
+    paddr_t allocate() { return allocateCache(); }
+    void free(paddr_t address) { returnCache(address); }
+    paddr_t reclaimCache() override;
+};
+
+static const size_t entriesOffset = ALIGNUP(sizeof(NameCachePage),
+        alignof(NameCacheEntry));
+static const size_t entriesPerPage = (PAGESIZE - entriesOffset) /
+        sizeof(NameCacheEntry);
+
+static void freeReclaimedPages(void*);
+
+static NameCacheController controller;
+// The cache mutex is taken by reclaimCache while the PMM is locked, so no
+// memory must be allocated or freed and no references must be dropped while
+// holding it.
+static kthread_mutex_t cacheMutex = KTHREAD_MUTEX_INITIALIZER;
+static NameCacheEntry* entryBuffer[4096];
+static HashTable<NameCacheEntry, NameKey> cachedEntries(
+        sizeof(entryBuffer) / sizeof(entryBuffer[0]), entryBuffer);
+// Entries ordered from least recently to most recently used.
+static LinkedListWithEnd<NameCacheEntry, &NameCacheEntry::prevAccessed,
+        &NameCacheEntry::nextAccessed> accessedEntries;
+static LinkedList<NameCacheEntry, &NameCacheEntry::prevAccessed,
+        &NameCacheEntry::nextAccessed> freeEntries;
+static LinkedList<NameCachePage, &NameCachePage::prev, &NameCachePage::next>
+        pages;
+static size_t numPages;
+// Incremented whenever entries are removed.
+static unsigned long currentGeneration;
+
+static vaddr_t reclaimedPages[MAX_RECLAIMED_PAGES];
+static size_t numReclaimedPages;
+static Vnode* releasedVnodes[2 * entriesPerPage * MAX_RECLAIMED_PAGES];
+static size_t numReleasedVnodes;
+static WorkerJob workerJob = { freeReclaimedPages, nullptr, nullptr };
+
+static inline NameCacheEntry* getEntry(NameCachePage* page, size_t index) {
+    return (NameCacheEntry*) ((vaddr_t) page + entriesOffset +
+            index * sizeof(NameCacheEntry));
+}
+
+static inline NameCachePage* getPage(NameCacheEntry* entry) {
+    return (NameCachePage*) ((vaddr_t) entry & ~PAGE_MISALIGN);
+}
+
+static NameKey getKey(const Vnode* directory, const char* name,
+        size_t length) {
+    size_t hash = (uintptr_t) directory / 16;
+    for (size_t i = 0; i < length; i++) {
+        hash = hash * 31 + (unsigned char) name[i];
+    }
+    return NameKey{directory, name, length, hash};
+}
+
+static bool isCacheable(const char* name, size_t length) {
+    if (length == 0 || length > MAX_NAME_LENGTH) return false;
+    // The .. entry changes when a directory is moved, so . and .. are always
+    // looked up by the directory itself.
+    if (name[0] == '.' && (length == 1 || (length == 2 && name[1] == '.'))) {
+        return false;
+    }
+    return true;
+}
+
+static void releaseVnodes(Vnode* const* vnodes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (vnodes[i]) {
+            vnodes[i]->removeReference();
+        }
+    }
+}
+
+// Removes a used entry from the cache. The two references held by the entry
+// are stored in released and must be dropped after unlocking the mutex.
+static void removeEntry(NameCacheEntry* entry, Vnode** released) {
+    cachedEntries.remove(entry->hashKey());
+    accessedEntries.remove(*entry);
+    released[0] = entry->directory;
+    released[1] = entry->vnode;
+    entry->directory = nullptr;
+}
+
+static void addPage() {
+    paddr_t physicalAddress = controller.allocate();
+    if (!physicalAddress) return;
+    vaddr_t address = kernelSpace->mapPhysical(physicalAddress, PAGESIZE,
+            PROT_READ | PROT_WRITE);
+    if (!address) {
+        controller.free(physicalAddress);
+        return;
+    }
+
+    kthread_mutex_lock(&cacheMutex);
+    if (numPages >= MAX_PAGES) {
+        kthread_mutex_unlock(&cacheMutex);
+        kernelSpace->unmapPhysical(address, PAGESIZE);
+        controller.free(physicalAddress);
+        return;
+    }
+
+    NameCachePage* page = (NameCachePage*) address;
+    page->physicalAddress = physicalAddress;
+    pages.addFront(*page);
+    numPages++;
+    for (size_t i = 0; i < entriesPerPage; i++) {
+        NameCacheEntry* entry = getEntry(page, i);
+        entry->directory = nullptr;
+        freeEntries.addFront(*entry);
+    }
+    kthread_mutex_unlock(&cacheMutex);
+}
+
+static void freeReclaimedPages(void*) {
+    while (true) {
+        vaddr_t pagesToUnmap[MAX_RECLAIMED_PAGES];
+        Vnode* vnodes[2 * BATCH_SIZE];
+
+        kthread_mutex_lock(&cacheMutex);
+        size_t pageCount = numReclaimedPages;
+        memcpy(pagesToUnmap, reclaimedPages, pageCount * sizeof(vaddr_t));
+        numReclaimedPages = 0;
+        size_t vnodeCount = numReleasedVnodes < 2 * BATCH_SIZE ?
+                numReleasedVnodes : 2 * BATCH_SIZE;
+        numReleasedVnodes -= vnodeCount;
+        memcpy(vnodes, &releasedVnodes[numReleasedVnodes],
+                vnodeCount * sizeof(Vnode*));
+        kthread_mutex_unlock(&cacheMutex);
+
+        if (pageCount == 0 && vnodeCount == 0) return;
+        for (size_t i = 0; i < pageCount; i++) {
+            kernelSpace->unmapPhysical(pagesToUnmap[i], PAGESIZE);
+        }
+        releaseVnodes(vnodes, vnodeCount);
+    }
+}
+
+// Removes all entries for which the match function returns true. The entries
+// are removed in batches so that the references can be dropped in between.
+static void purge(bool (*match)(const NameCacheEntry*, const void*),
+        const void* context) {
+    bool done = false;
+    while (!done) {
+        Vnode* released[2 * BATCH_SIZE];
+        size_t count = 0;
+
+        kthread_mutex_lock(&cacheMutex);
+        currentGeneration++;
+        auto iter = accessedEntries.begin();
+        while (iter != accessedEntries.end() && count < 2 * BATCH_SIZE) {
+            NameCacheEntry* entry = &*iter;
+            ++iter;
+            if (match(entry, context)) {
+                removeEntry(entry, &released[count]);
+                freeEntries.addFront(*entry);
+                count += 2;
+            }
+        }
+        done = iter == accessedEntries.end();
+        kthread_mutex_unlock(&cacheMutex);
+
+        releaseVnodes(released, count);
+    }
+}
+
+void NameCache::add(Vnode* directory, const char* name, size_t length,
+        const Reference<Vnode>& vnode, unsigned long generation) {
+    if (!isCacheable(name, length)) return;
+    // The caller may still need the errno value of the lookup.
+    int savedErrno = errno;
+
+    kthread_mutex_lock(&cacheMutex);
+    bool needsPage = freeEntries.empty() && numPages < MAX_PAGES;
+    kthread_mutex_unlock(&cacheMutex);
+    if (needsPage) {
+        addPage();
+    }
+
+    NameKey key = getKey(directory, name, length);
+    Vnode* released[2] = { nullptr, nullptr };
+
+    kthread_mutex_lock(&cacheMutex);
+    if (generation == currentGeneration && !cachedEntries.get(key)) {
+        NameCacheEntry* entry = nullptr;
+        if (!freeEntries.empty()) {
+            entry = &freeEntries.front();
+            freeEntries.remove(*entry);
+        } else if (!accessedEntries.empty()) {
+            entry = &accessedEntries.front();
+            removeEntry(entry, released);
+        }
+
+        if (entry) {
+            entry->directory = directory;
+            directory->addReference();
+            entry->vnode = (Vnode*) vnode;
+            if (entry->vnode) {
+                entry->vnode->addReference();
+            }
+            entry->hash = key.hash;
+            entry->length = length;
+            memcpy(entry->name, name, length);
+            cachedEntries.add(entry);
+            accessedEntries.addBack(*entry);
+        }
+    }
+    kthread_mutex_unlock(&cacheMutex);
+
+    releaseVnodes(released, 2);
+    errno = savedErrno;
+}
+
+unsigned long NameCache::getGeneration() {
+    AutoLock lock(&cacheMutex);
+    return currentGeneration;
+}
+
+bool NameCache::lookup(const Vnode* directory, const char* name,
+        size_t length, Reference<Vnode>& result) {
+    if (!isCacheable(name, length)) return false;
+    NameKey key = getKey(directory, name, length);
+
+    AutoLock lock(&cacheMutex);
+    NameCacheEntry* entry = cachedEntries.get(key);
+    if (!entry) return false;
+
+    accessedEntries.remove(*entry);
+    accessedEntries.addBack(*entry);
+    result = entry->vnode;
+    if (!result) {
+        errno = ENOENT;
+    }
+    return true;
+}
+
+void NameCache::remove(const Vnode* directory, const char* name,
+        size_t length) {
+    Vnode* released[2] = { nullptr, nullptr };
+
+    kthread_mutex_lock(&cacheMutex);
+    currentGeneration++;
+    if (isCacheable(name, length)) {
+        NameCacheEntry* entry = cachedEntries.get(getKey(directory, name,
+                length));
+        if (entry) {
+            removeEntry(entry, released);
+            freeEntries.addFront(*entry);
+        }
+    }
+    kthread_mutex_unlock(&cacheMutex);
+
+    releaseVnodes(released, 2);
+}
+
+static bool isInDirectory(const NameCacheEntry* entry, const void* context) {
+    return entry->directory == context;
+}
+
+void NameCache::removeDirectory(const Vnode* directory) {
+    purge(isInDirectory, directory);
+}
+
+static bool isOnDevice(const NameCacheEntry* entry, const void* context) {
+    dev_t dev = *(const dev_t*) context;
+    return entry->directory->stats.st_dev == dev ||
+            (entry->vnode && entry->vnode->stats.st_dev == dev);
+}
+
+void NameCache::removeFileSystem(FileSystem* filesystem) {
+    dev_t dev;
+    {
+        Reference<Vnode> root = filesystem->getRootDir();
+        if (!root) return;
+        dev = root->stats.st_dev;
+    }
+    purge(isOnDevice, &dev);
+}
+
+paddr_t NameCacheController::reclaimCache() {
+    AutoLock lock(&cacheMutex);
+
+    if (numReclaimedPages == MAX_RECLAIMED_PAGES) return 0;
+    if (numReleasedVnodes + 2 * entriesPerPage >
+            sizeof(releasedVnodes) / sizeof(releasedVnodes[0])) {
+        return 0;
+    }
+
+    NameCachePage* page;
+    if (!accessedEntries.empty()) {
+        page = getPage(&accessedEntries.front());
+    } else if (!pages.empty()) {
+        page = &pages.front();
+    } else {
+        return 0;
+    }
+
+    for (size_t i = 0; i < entriesPerPage; i++) {
+        NameCacheEntry* entry = getEntry(page, i);
+        if (entry->directory) {
+            removeEntry(entry, &releasedVnodes[numReleasedVnodes]);
+            numReleasedVnodes += 2;
+        } else {
+            freeEntries.remove(*entry);
+        }
+    }
+    currentGeneration++;
+    pages.remove(*page);
+    numPages--;
+    paddr_t physicalAddress = page->physicalAddress;
+
+    // We cannot unmap the page yet because the PMM is locked. This will be
+    // handled by the worker thread.
+    reclaimedPages[numReclaimedPages++] = (vaddr_t) page;
+    if (numReclaimedPages == 1) {
+        Interrupts::disable();
+        WorkerThread::addJob(&workerJob);
+        Interrupts::enable();
+    }
+    return physicalAddress;
+}
@@ -0,0 +1,374 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/pagecache.cpp
+ * Page cache for file data.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/cache.h>
+#include <dennix/kernel/hashtable.h>
+#include <dennix/kernel/interrupts.h>
+#include <dennix/kernel/pagecache.h>
+#include <dennix/kernel/vnode.h>
+#include <dennix/kernel/worker.h>
+
+typedef PageCache::Page Page;
+typedef PageCache::PageKey PageKey;
+
+class PageCacheController : public CacheController {
+public:
+    paddr_t allocate() { return allocateCache(); }
+    void free(paddr_t address) { returnCache(address); }
+    paddr_t reclaimCache() override;
+};
+
+static PageCacheController controller;
+ObjectCache Page::objectCache(sizeof(Page));
+
+// The cache mutex protects the hash table, the lists of pages and the mapping
+// counts of all page caches. It is taken by reclaimCache while the PMM is
+// locked, so no memory must be allocated or freed while holding it.
+static kthread_mutex_t cacheMutex = KTHREAD_MUTEX_INITIALIZER;
+static Page* pageBuffer[10000];
+static HashTable<Page, PageKey> cachedPages(
+        sizeof(pageBuffer) / sizeof(pageBuffer[0]), pageBuffer);
+// Pages ordered from least recently to most recently used.
+static LinkedListWithEnd<Page, &Page::prevAccessed, &Page::nextAccessed>
+        accessedPages;
+using FreeList = SinglyLinkedList<Page, &Page::nextFree>;
+static FreeList freeList;
+
+static void freeUnusedPages(void*) {
+    kthread_mutex_lock(&cacheMutex);
+    FreeList list;
+    list.swap(freeList);
+    kthread_mutex_unlock(&cacheMutex);
+
+    while (!list.empty()) {
+        Page* page = &list.front();
+        kernelSpace->unmapPhysical(page->address, PAGESIZE);
+        list.removeFront();
+        delete page;
+    }
+}
+
+static WorkerJob workerJob = { freeUnusedPages, nullptr, nullptr };
+
+PageCache::PageCache(Vnode* vnode) : vnode(vnode) {
+    mappings = 0;
+    sharedWritableMappings = 0;
+    generation = 0;
+    mutex = KTHREAD_MUTEX_INITIALIZER;
+}
+
+PageCache::~PageCache() {
+    assert(mappings == 0);
+
+    kthread_mutex_lock(&cacheMutex);
+    LinkedList<Page, &Page::prevInCache, &Page::nextInCache> list;
+    list.swap(pages);
+    for (Page& page : list) {
+        cachedPages.remove(page.hashKey());
+        accessedPages.remove(page);
+    }
+    kthread_mutex_unlock(&cacheMutex);
+
+    while (!list.empty()) {
+        Page* page = &list.front();
+        list.remove(*page);
+        kernelSpace->unmapPhysical(page->address, PAGESIZE);
+        controller.free(page->physicalAddress);
+        delete page;
+    }
+}
+
+void PageCache::addMapping(bool sharedWritable) {
+    AutoLock lock(&cacheMutex);
+    mappings++;
+    if (sharedWritable) {
+        sharedWritableMappings++;
+    }
+}
+
+paddr_t PageCache::getPage(off_t offset, bool dirty) {
+    struct stat st;
+    vnode->stat(&st);
+    if (offset >= st.st_size) return 0;
+
+    AutoLock lock(&mutex);
+    Page* page = loadPage(offset / PAGESIZE);
+    if (!page) return 0;
+
+    AutoLock cacheLock(&cacheMutex);
+    if (dirty) {
+        page->dirty = true;
+    }
+    // The page does not need to stay pinned because the file is mapped.
+    page->pinCount--;
+    return page->physicalAddress;
+}
+
+PageCache::Page* PageCache::loadPage(uint64_t index) {
+    kthread_mutex_lock(&cacheMutex);
+    Page* page = cachedPages.get(PageKey{ this, index });
+    if (page) {
+        accessedPages.remove(*page);
+        accessedPages.addBack(*page);
+        page->pinCount++;
+        kthread_mutex_unlock(&cacheMutex);
+        return page;
+    }
+    kthread_mutex_unlock(&cacheMutex);
+
+    paddr_t physicalAddress = controller.allocate();
+    if (!physicalAddress) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    vaddr_t address = kernelSpace->mapPhysical(physicalAddress, PAGESIZE,
+            PROT_READ | PROT_WRITE);
+    if (!address) {
+        controller.free(physicalAddress);
+        errno = ENOMEM;
+        return nullptr;
+    }
+    page = new Page(this, index, address, physicalAddress);
+    if (!page) {
+        kernelSpace->unmapPhysical(address, PAGESIZE);
+        controller.free(physicalAddress);
+        return nullptr;
+    }
+
+    while (true) {
+        kthread_mutex_lock(&cacheMutex);
+        unsigned long oldGeneration = generation;
+        kthread_mutex_unlock(&cacheMutex);
+
+        // The part of the page after the end of the file is filled with
+        // zeros.
+        memset((void*) address, 0, PAGESIZE);
+        if (vnode->preadUncached((void*) address, PAGESIZE,
+                index * PAGESIZE) < 0) {
+            kernelSpace->unmapPhysical(address, PAGESIZE);
+            controller.free(physicalAddress);
+            delete page;
+            return nullptr;
+        }
+
+        kthread_mutex_lock(&cacheMutex);
+        // If the file was modified while we were reading it, the write did
+        // not see the page and the data might be outdated.
+        if (generation == oldGeneration) break;
+        kthread_mutex_unlock(&cacheMutex);
+    }
+
+    page->pinCount = 1;
+    cachedPages.add(page);
+    accessedPages.addBack(*page);
+    pages.addFront(*page);
+    kthread_mutex_unlock(&cacheMutex);
+    return page;
+}
+
+ssize_t PageCache::read(void* buffer, size_t size, off_t offset) {
+    struct stat st;
+    vnode->stat(&st);
+    if (offset >= st.st_size) return 0;
+    if ((off_t) size > st.st_size - offset) {
+        size = st.st_size - offset;
+    }
+
+    char* buf = (char*) buffer;
+    size_t bytesRead = 0;
+    while (bytesRead < size) {
+        uint64_t index = offset / PAGESIZE;
+
+        kthread_mutex_lock(&cacheMutex);
+        Page* page = cachedPages.get(PageKey{ this, index });
+        if (page) {
+            accessedPages.remove(*page);
+            accessedPages.addBack(*page);
+            page->pinCount++;
+        }
+        kthread_mutex_unlock(&cacheMutex);
+
+        if (!page) {
+            AutoLock lock(&mutex);
+            page = loadPage(index);
+            if (!page) {
+                if (bytesRead) return bytesRead;
+                return -1;
+            }
+        }
+
+        size_t pageOffset = offset & PAGE_MISALIGN;
+        size_t readSize = PAGESIZE - pageOffset;
+        if (readSize > size - bytesRead) readSize = size - bytesRead;
+
+        // No locks are held while copying because the buffer might be in
+        // userspace. The page is pinned so that it cannot be reclaimed.
+        memcpy(buf + bytesRead, (char*) page->address + pageOffset,
+                readSize);
+
+        kthread_mutex_lock(&cacheMutex);
+        page->pinCount--;
+        kthread_mutex_unlock(&cacheMutex);
+
+        offset += readSize;
+        bytesRead += readSize;
+    }
+
+    return bytesRead;
+}
+
+void PageCache::removeMapping(bool sharedWritable) {
+    if (sharedWritable) {
+        kthread_mutex_lock(&cacheMutex);
+        bool last = --sharedWritableMappings == 0;
+        kthread_mutex_unlock(&cacheMutex);
+
+        // Write back the changes when the last mapping that could have
+        // modified the pages goes away. After that the pages are clean.
+        if (last) {
+            sync();
+        }
+    }
+
+    AutoLock lock(&cacheMutex);
+    assert(mappings > 0);
+    mappings--;
+}
+
+int PageCache::sync() {
+    AutoLock lock(&mutex);
+
+    // Pin the cache so that the page list does not change while we are
+    // writing the pages back.
+    kthread_mutex_lock(&cacheMutex);
+    mappings++;
+    kthread_mutex_unlock(&cacheMutex);
+
+    struct stat st;
+    vnode->stat(&st);
+
+    int result = 0;
+    for (Page& page : pages) {
+        if (!page.dirty) continue;
+        // As long as the page is mapped writable it might be modified again.
+        page.dirty = sharedWritableMappings > 0;
+
+        off_t offset = page.index * PAGESIZE;
+        if (offset >= st.st_size) continue;
+        size_t size = PAGESIZE;
+        if (st.st_size - offset < PAGESIZE) {
+            size = st.st_size - offset;
+        }
+
+        if (vnode->pwriteUncached((void*) page.address, size, offset) < 0) {
+            page.dirty = true;
+            result = -1;
+        }
+    }
+
+    kthread_mutex_lock(&cacheMutex);
+    mappings--;
+    kthread_mutex_unlock(&cacheMutex);
+    return result;
+}
+
+void PageCache::truncate(off_t length) {
+    // The file contains zeros after the given length, either because it was
+    // shrunk or because it was extended with zeros.
+    AutoLock lock(&cacheMutex);
+    generation++;
+
+    for (Page& page : pages) {
+        off_t offset = page.index * PAGESIZE;
+        if (offset >= length) {
+            memset((void*) page.address, 0, PAGESIZE);
+        } else if (length - offset < PAGESIZE) {
+            size_t pageOffset = length - offset;
+            memset((char*) page.address + pageOffset, 0,
+                    PAGESIZE - pageOffset);
+        }
+    }
+}
+
+void PageCache::write(const void* buffer, size_t size, off_t offset) {
+    AutoLock lock(&cacheMutex);
+    generation++;
+
+    const char* buf = (const char*) buffer;
+    while (size > 0) {
+        size_t pageOffset = offset & PAGE_MISALIGN;
+        size_t writeSize = PAGESIZE - pageOffset;
+        if (writeSize > size) writeSize = size;
+
+        Page* page = cachedPages.get(PageKey{ this,
+                (uint64_t) offset / PAGESIZE });
+        if (page) {
+            memcpy((char*) page->address + pageOffset, buf, writeSize);
+        }
+
+        buf += writeSize;
+        offset += writeSize;
+        size -= writeSize;
+    }
+}
+
+PageCache::Page::Page(PageCache* cache, uint64_t index, vaddr_t address,
+        paddr_t physicalAddress) : cache(cache), index(index), address(address),
+        physicalAddress(physicalAddress) {
+    dirty = false;
+    pinCount = 0;
+    prevAccessed = nullptr;
+    nextAccessed = nullptr;
+    prevInCache = nullptr;
+    nextInCache = nullptr;
+}
+
+paddr_t PageCacheController::reclaimCache() {
+    AutoLock lock(&cacheMutex);
+
+    for (Page& page : accessedPages) {
+        // Pages of mapped files, pages that are currently being read and
+        // pages that have not been written back yet cannot be reclaimed.
+        if (page.cache->mappings > 0 || page.pinCount > 0 || page.dirty) {
+            continue;
+        }
+
+        accessedPages.remove(page);
+        cachedPages.remove(page.hashKey());
+        page.cache->pages.remove(page);
+
+        bool freeListWasEmpty = freeList.empty();
+        freeList.addFront(page);
+        if (freeListWasEmpty) {
+            Interrupts::disable();
+            WorkerThread::addJob(&workerJob);
+            Interrupts::enable();
+        }
+
+        // We cannot unmap the page yet because the PMM is locked. This will be
+        // handled by the worker thread.
+        return page.physicalAddress;
+    }
+
+    return 0;
+}
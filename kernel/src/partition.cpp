@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -161,6 +161,17 @@ ssize_t Partition::pwrite(const void* buffer, size_t size, off_t offset,
     return device->pwrite(buffer, size, partitionOffset + offset, flags);
 }
 
+void Partition::readahead(off_t offset, size_t size) {
+    AutoLock lock(&mutex);
+    if (offset < 0 || offset >= stats.st_size) return;
+
+    if ((off_t) size > stats.st_size || stats.st_size - (off_t) size < offset) {
+        size = stats.st_size - offset;
+    }
+
+    device->readahead(partitionOffset + offset, size);
+}
+
 int Partition::sync(int flags) {
     return device->sync(flags);
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,6 +18,8 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
+#include <string.h>
 #include <dennix/meminfo.h>
 #include <dennix/kernel/addressspace.h>
 #include <dennix/kernel/cache.h>
@@ -27,39 +29,87 @@
 #include <dennix/kernel/syscall.h>
 #include <dennix/kernel/list.h>
 
-class MemoryStack {
+static_assert(MEMINFO_ORDERS == MAX_ORDER + 1, "MEMINFO_ORDERS is incorrect");
+
+// Free memory is managed by a buddy allocator. Free memory is organized in
+// blocks of 2^order page frames that are aligned to their size. For each
+// order there is a list of free blocks.
+
+#define NO_FRAME UINT32_MAX
+
+struct Frame {
+    union {
+        // The number of additional mappings of an allocated frame. This is
+        // zero for all frames that are not shared between address spaces.
+        uint32_t references;
+        // The next free block of the same order if the frame is the first
+        // frame of a free block.
+        uint32_t nextFree;
+    };
+    uint32_t prevFree;
+    uint8_t order;
+    // Whether the frame is the first frame of a free block.
+    bool free;
+};
+
+struct Zone {
+    uint32_t freeLists[MAX_ORDER + 1];
+    size_t freeBlocks[MAX_ORDER + 1];
+    size_t freeFrames;
+};
+
+// On x86_64 memory below 4 GiB is kept in a separate zone for devices that
+// cannot access memory above that.
+#ifdef __x86_64__
+#  define ZONE_DMA32 0
+#  define ZONE_NORMAL 1
+#  define NUM_ZONES 2
+#  define DMA32_FRAMES (0x100000000 / PAGESIZE)
+#else
+#  define ZONE_DMA32 0
+#  define ZONE_NORMAL 0
+#  define NUM_ZONES 1
+#endif
+
+// Iterates over all available page frames that are not used by the kernel, by
+// modules or by the multiboot information.
+class UsableFrames {
 public:
-    MemoryStack(void* firstStackPage);
-    ~MemoryStack() = default;
-    NOT_COPYABLE(MemoryStack);
-    NOT_MOVABLE(MemoryStack);
+    UsableFrames(const multiboot_info* multiboot);
+    ~UsableFrames() = default;
+    NOT_COPYABLE(UsableFrames);
+    NOT_MOVABLE(UsableFrames);
 
-    void pushPageFrame(paddr_t physicalAddress, bool cache = false);
-    paddr_t popPageFrame(bool cache = false);
+    bool next(paddr_t& physicalAddress);
 public:
-    size_t framesOnStack;
+    paddr_t highestAddress;
+    size_t usedFrames;
 private:
-    paddr_t* stack;
-    vaddr_t lastStackPage;
+    const multiboot_info* multiboot;
+    const multiboot_tag_mmap* mmapTag;
+    vaddr_t mmap;
+    vaddr_t mmapEnd;
+    paddr_t address;
+    paddr_t entryEnd;
+    paddr_t multibootPhys;
+    paddr_t multibootEnd;
 };
 
 static SinglyLinkedList<CacheController, &CacheController::nextCache> caches;
-static char firstStackPage[PAGESIZE] ALIGNED(PAGESIZE);
 static size_t framesAvailable;
 static size_t framesReserved;
-static MemoryStack memstack(firstStackPage);
+static size_t freeFrames;
+static Frame* frames;
+static size_t numFrames;
 static size_t totalFrames;
+static Zone zones[NUM_ZONES];
 
-static kthread_mutex_t mutex = KTHREAD_MUTEX_INITIALIZER;
-
-#ifdef __x86_64__
-static char firstStackPage32[PAGESIZE] ALIGNED(PAGESIZE);
-static MemoryStack memstack32(firstStackPage32);
+// Before the frame array has been allocated, frames are allocated from a
+// range of free frames that directly follows the frame array.
+static paddr_t earlyNext;
+static paddr_t earlyEnd;
 
-#define totalFramesOnStack (memstack.framesOnStack + memstack32.framesOnStack)
-#else
-#define totalFramesOnStack (memstack.framesOnStack)
-#endif
+static kthread_mutex_t mutex = KTHREAD_MUTEX_INITIALIZER;
 
 extern "C" {
 extern symbol_t bootstrapBegin;
@@ -104,7 +154,8 @@ static inline bool isUsedByMultiboot(paddr_t physicalAddress,
     return physicalAddress >= multibootPhys && physicalAddress < multibootEnd;
 }
 
-void PhysicalMemory::initialize(const multiboot_info* multiboot) {
+UsableFrames::UsableFrames(const multiboot_info* multiboot)
+        : multiboot(multiboot) {
     uintptr_t p = (uintptr_t) multiboot + 8;
     const multiboot_tag* tag;
 
@@ -121,157 +172,334 @@ void PhysicalMemory::initialize(const multiboot_info* multiboot) {
         p = ALIGNUP(p + tag->size, 8);
     }
 
-    const multiboot_tag_mmap* mmapTag = (const multiboot_tag_mmap*) tag;
-
-    vaddr_t mmap = (vaddr_t) mmapTag->entries;
-    vaddr_t mmapEnd = mmap + (tag->size - sizeof(*mmapTag));
+    mmapTag = (const multiboot_tag_mmap*) tag;
+    mmap = (vaddr_t) mmapTag->entries;
+    mmapEnd = mmap + (tag->size - sizeof(*mmapTag));
+    address = 0;
+    entryEnd = 0;
+    highestAddress = 0;
+    usedFrames = 0;
 
-    paddr_t multibootPhys = kernelSpace->getPhysicalAddress(
+    multibootPhys = kernelSpace->getPhysicalAddress(
             (vaddr_t) multiboot & ~PAGE_MISALIGN);
-    paddr_t multibootEnd = multibootPhys + ALIGNUP(multiboot->total_size +
+    multibootEnd = multibootPhys + ALIGNUP(multiboot->total_size +
             ((vaddr_t) multiboot & PAGE_MISALIGN), PAGESIZE);
+}
 
-    while (mmap < mmapEnd) {
-        multiboot_mmap_entry* mmapEntry = (multiboot_mmap_entry*) mmap;
-
-        if (mmapEntry->type == MULTIBOOT_MEMORY_AVAILABLE &&
-                mmapEntry->addr + mmapEntry->len <= UINTPTR_MAX) {
-            paddr_t addr = (paddr_t) mmapEntry->addr;
-            for (uint64_t i = 0; i < mmapEntry->len; i += PAGESIZE) {
-                totalFrames++;
-                if (isUsedByModule(addr + i, multiboot) ||
-                        isUsedByKernel(addr + i) ||
-                        isUsedByMultiboot(addr + i, multibootPhys,
-                        multibootEnd)) {
-                    continue;
+bool UsableFrames::next(paddr_t& physicalAddress) {
+    while (true) {
+        while (address >= entryEnd) {
+            if (mmap >= mmapEnd) return false;
+
+            const multiboot_mmap_entry* mmapEntry =
+                    (const multiboot_mmap_entry*) mmap;
+            mmap += mmapTag->entry_size;
+
+            if (mmapEntry->type == MULTIBOOT_MEMORY_AVAILABLE &&
+                    mmapEntry->addr + mmapEntry->len <= UINTPTR_MAX) {
+                address = ALIGNUP((paddr_t) mmapEntry->addr, PAGESIZE);
+                entryEnd = (mmapEntry->addr + mmapEntry->len) & ~PAGE_MISALIGN;
+                if (entryEnd > highestAddress) {
+                    highestAddress = entryEnd;
                 }
-
-                pushPageFrame(addr + i);
             }
         }
 
-        mmap += mmapTag->entry_size;
+        physicalAddress = address;
+        address += PAGESIZE;
+
+        if (!isUsedByModule(physicalAddress, multiboot) &&
+                !isUsedByKernel(physicalAddress) &&
+                !isUsedByMultiboot(physicalAddress, multibootPhys,
+                multibootEnd)) {
+            return true;
+        }
+        usedFrames++;
     }
 }
 
-MemoryStack::MemoryStack(void* firstStackPage) {
-    stack = (paddr_t*) firstStackPage + 1;
-    framesOnStack = 0;
-    lastStackPage = (vaddr_t) firstStackPage;
+static inline Zone& getZone(size_t index) {
+#ifdef __x86_64__
+    if (index >= DMA32_FRAMES) return zones[ZONE_NORMAL];
+#else
+    (void) index;
+#endif
+    return zones[ZONE_DMA32];
+}
+
+static inline bool isDma32(paddr_t physicalAddress) {
+    return &getZone(physicalAddress / PAGESIZE) == &zones[ZONE_DMA32];
+}
+
+static void addFreeBlock(size_t index, unsigned int order) {
+    Zone& zone = getZone(index);
+    Frame& frame = frames[index];
+    frame.free = true;
+    frame.order = order;
+    frame.prevFree = NO_FRAME;
+    frame.nextFree = zone.freeLists[order];
+    if (frame.nextFree != NO_FRAME) {
+        frames[frame.nextFree].prevFree = index;
+    }
+    zone.freeLists[order] = index;
+    zone.freeBlocks[order]++;
 }
 
-void MemoryStack::pushPageFrame(paddr_t physicalAddress,
-        bool cache /*= false*/) {
-    if (((vaddr_t) (stack + 1) & PAGE_MISALIGN) == 0) {
-        paddr_t* stackPage = (paddr_t*) ((vaddr_t) stack & ~PAGE_MISALIGN);
+static void removeFreeBlock(size_t index) {
+    Frame& frame = frames[index];
+    Zone& zone = getZone(index);
+    if (frame.prevFree != NO_FRAME) {
+        frames[frame.prevFree].nextFree = frame.nextFree;
+    } else {
+        zone.freeLists[frame.order] = frame.nextFree;
+    }
+    if (frame.nextFree != NO_FRAME) {
+        frames[frame.nextFree].prevFree = frame.prevFree;
+    }
+    zone.freeBlocks[frame.order]--;
 
-        if (*(stackPage + 1) == 0) {
-            // We need to unlock the mutex because AddressSpace::mapPhysical
-            // might need to pop page frames from the stack.
-            kthread_mutex_unlock(&mutex);
-            vaddr_t nextStackPage = kernelSpace->mapPhysical(physicalAddress,
-                    PAGESIZE, PROT_READ | PROT_WRITE);
-            kthread_mutex_lock(&mutex);
+    frame.free = false;
+    frame.references = 0;
+    frame.prevFree = NO_FRAME;
+}
 
-            if (cache) framesAvailable--;
+static paddr_t allocateFromZone(Zone& zone, unsigned int order) {
+    unsigned int blockOrder = order;
+    while (zone.freeLists[blockOrder] == NO_FRAME) {
+        if (++blockOrder > MAX_ORDER) return 0;
+    }
 
-            if (unlikely(nextStackPage == 0)) {
-                // If we cannot save the address, we have to leak it.
-                return;
-            }
+    size_t index = zone.freeLists[blockOrder];
+    removeFreeBlock(index);
+
+    // Split the block and return the unneeded halves to the free lists.
+    while (blockOrder > order) {
+        blockOrder--;
+        addFreeBlock(index + ((size_t) 1 << blockOrder), blockOrder);
+    }
+
+    zone.freeFrames -= (size_t) 1 << order;
+    freeFrames -= (size_t) 1 << order;
+    return index * PAGESIZE;
+}
+
+static paddr_t allocateFrames(unsigned int order, bool dma32) {
+#ifdef __x86_64__
+    if (!dma32) {
+        paddr_t result = allocateFromZone(zones[ZONE_NORMAL], order);
+        if (result) return result;
+    }
+#else
+    (void) dma32;
+#endif
+    return allocateFromZone(zones[ZONE_DMA32], order);
+}
+
+static void freeFramesUnlocked(paddr_t physicalAddress, unsigned int order) {
+    size_t index = physicalAddress / PAGESIZE;
+    assert(index < numFrames);
+    assert((index & (((size_t) 1 << order) - 1)) == 0);
+
+    Zone& zone = getZone(index);
+    zone.freeFrames += (size_t) 1 << order;
+    freeFrames += (size_t) 1 << order;
+
+    // Merge the block with its buddy as long as the buddy is free.
+    while (order < MAX_ORDER) {
+        size_t buddy = index ^ ((size_t) 1 << order);
+        if (buddy >= numFrames || !frames[buddy].free ||
+                frames[buddy].order != order) {
+            break;
+        }
+        removeFreeBlock(buddy);
+        index &= ~((size_t) 1 << order);
+        order++;
+    }
+
+    addFreeBlock(index, order);
+}
+
+static paddr_t reclaimFromCaches(const CacheController* except) {
+    for (auto& cache : caches) {
+        if (&cache == except) continue;
+        paddr_t result = cache.reclaimCache();
+        if (result) return result;
+    }
+    return 0;
+}
+
+void PhysicalMemory::initialize(const multiboot_info* multiboot) {
+    paddr_t physicalAddress;
+
+    UsableFrames usable(multiboot);
+    while (usable.next(physicalAddress)) {
+        totalFrames++;
+    }
+    totalFrames += usable.usedFrames;
+
+    numFrames = usable.highestAddress / PAGESIZE;
+    if (numFrames >= NO_FRAME) {
+        PANIC("Too much physical memory.");
+    }
+    size_t framesSize = ALIGNUP(numFrames * sizeof(Frame), PAGESIZE);
+
+    // Find a contiguous range of usable frames for the frame array. The range
+    // also needs to contain the frames that are needed to map the array.
+    size_t neededFrames = framesSize / PAGESIZE * 2 + 16;
+    paddr_t rangeStart = 0;
+    paddr_t rangeEnd = 0;
+    UsableFrames usable2(multiboot);
+    while (usable2.next(physicalAddress)) {
+        if (physicalAddress != rangeEnd) {
+            rangeStart = physicalAddress;
+        }
+        rangeEnd = physicalAddress + PAGESIZE;
+        if ((rangeEnd - rangeStart) / PAGESIZE >= neededFrames) break;
+    }
+    if ((rangeEnd - rangeStart) / PAGESIZE < neededFrames) {
+        PANIC("Not enough contiguous memory for the frame array.");
+    }
+
+    earlyNext = rangeStart + framesSize;
+    earlyEnd = rangeEnd;
+    Frame* frameArray = (Frame*) kernelSpace->mapPhysical(rangeStart,
+            framesSize, PROT_READ | PROT_WRITE);
+    if (!frameArray) {
+        PANIC("Failed to allocate the frame array.");
+    }
+    memset(frameArray, 0, framesSize);
 
-            *((paddr_t*) lastStackPage + 1) = nextStackPage;
-            *(vaddr_t*) nextStackPage = lastStackPage;
-            *((paddr_t*) nextStackPage + 1) = 0;
-            lastStackPage = nextStackPage;
-            return;
-        } else {
-            stack = (paddr_t*) *(stackPage + 1) + 1;
+    for (size_t i = 0; i < NUM_ZONES; i++) {
+        for (size_t order = 0; order <= MAX_ORDER; order++) {
+            zones[i].freeLists[order] = NO_FRAME;
         }
     }
 
-    *++stack = physicalAddress;
-    framesOnStack++;
-    if (!cache) {
+    AutoLock lock(&mutex);
+    frames = frameArray;
+
+    // Add all frames to the free lists except for those that have already
+    // been allocated.
+    UsableFrames usable3(multiboot);
+    while (usable3.next(physicalAddress)) {
+        if (physicalAddress >= rangeStart && physicalAddress < earlyNext) {
+            continue;
+        }
+        freeFramesUnlocked(physicalAddress, 0);
         framesAvailable++;
     }
 }
 
+void PhysicalMemory::addFrameReference(paddr_t physicalAddress) {
+    AutoLock lock(&mutex);
+    assert(physicalAddress / PAGESIZE < numFrames);
+    frames[physicalAddress / PAGESIZE].references++;
+}
+
+bool PhysicalMemory::isFrameShared(paddr_t physicalAddress) {
+    AutoLock lock(&mutex);
+    assert(physicalAddress / PAGESIZE < numFrames);
+    return frames[physicalAddress / PAGESIZE].references > 0;
+}
+
 void PhysicalMemory::pushPageFrame(paddr_t physicalAddress) {
+    pushPageFrames(physicalAddress, 0);
+}
+
+void PhysicalMemory::pushPageFrames(paddr_t physicalAddress,
+        unsigned int order) {
     assert(physicalAddress);
     assert(PAGE_ALIGNED(physicalAddress));
     AutoLock lock(&mutex);
 
-#ifdef __x86_64__
-    if (physicalAddress <= 0xFFFFF000) {
-        memstack32.pushPageFrame(physicalAddress);
-        return;
-    }
-#endif
-    memstack.pushPageFrame(physicalAddress);
+    freeFramesUnlocked(physicalAddress, order);
+    framesAvailable += (size_t) 1 << order;
 }
 
-paddr_t MemoryStack::popPageFrame(bool cache /*= false*/) {
-    if (((vaddr_t) stack & PAGE_MISALIGN) < 2 * sizeof(paddr_t)) {
-        paddr_t* stackPage = (paddr_t*) ((vaddr_t) stack & ~PAGE_MISALIGN);
-        assert(*stackPage != 0);
-        stack = (paddr_t*) (*stackPage + PAGESIZE - sizeof(paddr_t));
-    }
+void PhysicalMemory::releaseFrame(paddr_t physicalAddress, bool reserved) {
+    assert(physicalAddress);
+    assert(PAGE_ALIGNED(physicalAddress));
+    AutoLock lock(&mutex);
 
-    framesOnStack--;
-    if (!cache) {
-        framesAvailable--;
+    assert(physicalAddress / PAGESIZE < numFrames);
+    uint32_t& references = frames[physicalAddress / PAGESIZE].references;
+    if (references > 0) {
+        // Another mapping still uses this frame. If the reference was
+        // backed by a reservation for a later copy, that is not needed
+        // anymore.
+        references--;
+        if (reserved) {
+            assert(framesReserved > 0);
+            framesReserved--;
+        }
+        return;
     }
-    return *stack--;
+
+    freeFramesUnlocked(physicalAddress, 0);
+    framesAvailable++;
 }
 
-paddr_t PhysicalMemory::popPageFrame() {
+static paddr_t popFrames(unsigned int order, bool dma32) {
     AutoLock lock(&mutex);
-    if (framesAvailable - framesReserved == 0) return 0;
+    size_t count = (size_t) 1 << order;
+
+    if (unlikely(!frames)) {
+        // The frame array is being allocated.
+        assert(count == 1);
+        if (earlyNext >= earlyEnd) return 0;
+        paddr_t result = earlyNext;
+        earlyNext += PAGESIZE;
+        return result;
+    }
 
-    if (totalFramesOnStack - framesReserved > 0) {
-        if (memstack.framesOnStack > 0) {
-            return memstack.popPageFrame();
+    while (framesAvailable - framesReserved >= count) {
+        if (freeFrames - framesReserved >= count) {
+            paddr_t result = allocateFrames(order, dma32);
+            if (result) {
+                framesAvailable -= count;
+                return result;
+            }
         }
 
-    #ifdef __x86_64__
-        return memstack32.popPageFrame();
-    #endif
-    }
+        // Reclaim memory from caches until the allocation can be satisfied.
+        paddr_t address = reclaimFromCaches(nullptr);
+        if (!address) return 0;
 
-    for (auto& cache : caches) {
-        paddr_t result = cache.reclaimCache();
-        if (result) return result;
+        if (order == 0 && (!dma32 || isDma32(address))) {
+            framesAvailable--;
+            return address;
+        }
+        freeFramesUnlocked(address, 0);
     }
 
     return 0;
 }
 
-#ifdef __x86_64__
-paddr_t PhysicalMemory::popPageFrame32() {
-    AutoLock lock(&mutex);
-    if (memstack32.framesOnStack == 0) return 0;
-    return memstack32.popPageFrame();
+paddr_t PhysicalMemory::popPageFrame() {
+    return popFrames(0, false);
 }
-#else
+
 paddr_t PhysicalMemory::popPageFrame32() {
-    return popPageFrame();
+    return popFrames(0, true);
+}
+
+paddr_t PhysicalMemory::popPageFrames(unsigned int order) {
+    return popFrames(order, false);
+}
+
+paddr_t PhysicalMemory::popPageFrames32(unsigned int order) {
+    return popFrames(order, true);
 }
-#endif
 
 paddr_t PhysicalMemory::popReserved() {
     AutoLock lock(&mutex);
     assert(framesReserved > 0);
 
     framesReserved--;
-#ifdef __x86_64__
-    if (memstack.framesOnStack > 0) {
-        return memstack.popPageFrame();
-    }
-    return memstack32.popPageFrame();
-#else
-    return memstack.popPageFrame();
-#endif
+    framesAvailable--;
+    paddr_t result = allocateFrames(0, false);
+    assert(result);
+    return result;
 }
 
 bool PhysicalMemory::reserveFrames(size_t frames) {
@@ -279,25 +507,12 @@ bool PhysicalMemory::reserveFrames(size_t frames) {
 
     if (framesAvailable - framesReserved < frames) return false;
 
-    // Make sure that reserved frames on the stack because memory used for
-    // caching can be unreclaimable for a short time frame.
-    while (totalFramesOnStack < framesReserved + frames) {
-        paddr_t address = 0;
-        for (auto& cache : caches) {
-            address = cache.reclaimCache();
-            if (address) break;
-        }
-
-        if (address) {
-#ifdef __x86_64__
-            if (address <= 0xFFFFF000) {
-                memstack32.pushPageFrame(address, true);
-            } else
-#endif
-            memstack.pushPageFrame(address, true);
-        } else {
-            return false;
-        }
+    // Make sure that reserved frames are free because memory used for caching
+    // can be unreclaimable for a short time frame.
+    while (freeFrames < framesReserved + frames) {
+        paddr_t address = reclaimFromCaches(nullptr);
+        if (!address) return false;
+        freeFramesUnlocked(address, 0);
     }
 
     framesReserved += frames;
@@ -321,33 +536,56 @@ paddr_t CacheController::allocateCache() {
         return 0;
     }
 
-    if (totalFramesOnStack - framesReserved > 0) {
-        if (memstack.framesOnStack > 0) {
-            return memstack.popPageFrame(true);
-        }
-#ifdef __x86_64__
-        return memstack32.popPageFrame(true);
-#endif
-    }
-
-    for (auto& cache : caches) {
-        if (&cache == this) continue;
-        paddr_t result = cache.reclaimCache();
-        if (result) return result;
+    // Frames used for caching are still counted as available.
+    if (freeFrames > framesReserved) {
+        return allocateFrames(0, false);
     }
 
+    paddr_t result = reclaimFromCaches(this);
+    if (result) return result;
     return reclaimCache();
 }
 
 void CacheController::returnCache(paddr_t address) {
     AutoLock lock(&mutex);
-    memstack.pushPageFrame(address, true);
+    freeFramesUnlocked(address, 0);
 }
 
-void Syscall::meminfo(struct meminfo* info) {
+void CacheController::convertToCache() {
     AutoLock lock(&mutex);
-    info->mem_total = totalFrames * PAGESIZE;
-    info->mem_free = totalFramesOnStack * PAGESIZE;
-    info->mem_available = framesAvailable * PAGESIZE;
-    info->__reserved = 0;
+    framesAvailable++;
+}
+
+bool CacheController::convertFromCache() {
+    AutoLock lock(&mutex);
+    if (framesAvailable - framesReserved == 0) return false;
+    framesAvailable--;
+    return true;
+}
+
+void Syscall::meminfo(struct meminfo* info) {
+    // Programs using this syscall only know about the fields that existed
+    // before SYSCALL_MEMINFO2 was added.
+    meminfo2(info, offsetof(struct meminfo, mem_free_blocks));
+}
+
+void Syscall::meminfo2(struct meminfo* info, size_t size) {
+    struct meminfo result;
+    kthread_mutex_lock(&mutex);
+    result.mem_total = totalFrames * PAGESIZE;
+    result.mem_free = freeFrames * PAGESIZE;
+    result.mem_available = framesAvailable * PAGESIZE;
+    result.__reserved = 0;
+
+    for (size_t order = 0; order <= MAX_ORDER; order++) {
+        result.mem_free_blocks[order] = 0;
+        for (size_t i = 0; i < NUM_ZONES; i++) {
+            result.mem_free_blocks[order] += zones[i].freeBlocks[order];
+        }
+    }
+    kthread_mutex_unlock(&mutex);
+
+    // Newer fields are only written if the caller's struct contains them.
+    if (size > sizeof(result)) size = sizeof(result);
+    memcpy(info, &result, size);
 }
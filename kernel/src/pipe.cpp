@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2019, 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2018, 2019, 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -97,6 +97,7 @@ PipeVnode::ReadEnd::~ReadEnd() {
     AutoLock lock(&pipe->mutex);
     pipe->readEnd = nullptr;
     kthread_cond_broadcast(&pipe->writeCond);
+    notifyPoll();
 }
 
 short PipeVnode::WriteEnd::poll() {
@@ -111,6 +112,7 @@ PipeVnode::WriteEnd::~WriteEnd() {
     AutoLock lock(&pipe->mutex);
     pipe->writeEnd = nullptr;
     kthread_cond_broadcast(&pipe->readCond);
+    notifyPoll();
 }
 
 short PipeVnode::poll() {
@@ -144,6 +146,7 @@ ssize_t PipeVnode::read(void* buffer, size_t size, int flags) {
 
     size_t bytesRead = circularBuffer.read(buffer, size);
     kthread_cond_broadcast(&writeCond);
+    notifyPoll();
     updateTimestamps(true, false, false);
     return bytesRead;
 }
@@ -201,6 +204,7 @@ ssize_t PipeVnode::write(const void* buffer, size_t size, int flags) {
 
         written += circularBuffer.write(buf + written, size - written);
         kthread_cond_broadcast(&readCond);
+        notifyPoll();
     }
 
     updateTimestamps(false, true, true);
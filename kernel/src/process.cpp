@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -19,7 +19,6 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <sched.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <dennix/fcntl.h>
@@ -31,6 +30,7 @@
 #include <dennix/kernel/process.h>
 #include <dennix/kernel/registers.h>
 #include <dennix/kernel/signal.h>
+#include <dennix/kernel/tsc.h>
 #include <dennix/kernel/util.h>
 #include <dennix/kernel/worker.h>
 
@@ -62,6 +62,7 @@ static void terminateProcess(void* process) {
 
 Process::Process() {
     addressSpace = nullptr;
+    niceness = 0;
     pid = -1;
     terminationStatus = {};
 
@@ -85,8 +86,10 @@ Process::Process() {
     terminationJob.func = terminateProcess;
     terminationJob.context = this;
     threadsMutex = KTHREAD_MUTEX_INITIALIZER;
+    threadsCond = KTHREAD_COND_INITIALIZER;
 
     childrenMutex = KTHREAD_MUTEX_INITIALIZER;
+    childrenCond = KTHREAD_COND_INITIALIZER;
     prevChild = nullptr;
     nextChild = nullptr;
 
@@ -214,17 +217,62 @@ uintptr_t Process::loadELF(const Reference<Vnode>& vnode,
         vaddr_t loadAddressAligned = 0;
         ptrdiff_t offset = 0;
         size_t size = 0;
+        off_t fileOffset = programHeader.p_offset;
+        size_t fileSize = programHeader.p_filesz;
         if (programHeader.p_type == PT_LOAD) {
             loadAddressAligned = programHeader.p_vaddr & ~PAGE_MISALIGN;
             offset = programHeader.p_vaddr - loadAddressAligned;
 
-            size = ALIGNUP(programHeader.p_memsz + offset, PAGESIZE);
+            size = ALIGNUP(programHeader.p_filesz + offset, PAGESIZE);
+            size_t memorySize = ALIGNUP(programHeader.p_memsz + offset,
+                    PAGESIZE);
 
-            if (!newAddressSpace->mapMemory(loadAddressAligned, size,
-                    protection)) {
+            if (programHeader.p_offset + programHeader.p_filesz >
+                    (uint64_t) vnode->stat().st_size) {
+                errno = ENOEXEC;
+                return 0;
+            }
+
+            // Whole pages of the file are mapped from the page cache and are
+            // loaded when they are accessed. Read-only pages are shared by
+            // all processes running the program and writable pages are
+            // copied on write. A page that also contains .bss is loaded now
+            // because the part after the file contents needs to be zeroed.
+            size_t mappedSize = size;
+            if (programHeader.p_memsz > programHeader.p_filesz) {
+                mappedSize = (programHeader.p_filesz + offset) &
+                        ~PAGE_MISALIGN;
+            }
+            if ((programHeader.p_offset - offset) & PAGE_MISALIGN) {
+                // The file offset is not aligned like the address.
+                mappedSize = 0;
+            }
+
+            if (mappedSize > 0 && !newAddressSpace->mapFile(
+                    loadAddressAligned, mappedSize, protection, false, vnode,
+                    programHeader.p_offset - offset)) {
                 errno = ENOMEM;
                 return 0;
             }
+
+            // Pages that are entirely .bss are allocated on demand.
+            if ((size > mappedSize && !newAddressSpace->mapMemory(
+                    loadAddressAligned + mappedSize, size - mappedSize,
+                    protection)) || (memorySize > size &&
+                    !newAddressSpace->mapMemory(loadAddressAligned + size,
+                    memorySize - size, protection | SEG_LAZY))) {
+                errno = ENOMEM;
+                return 0;
+            }
+            if (size == mappedSize) continue;
+
+            if (mappedSize > 0) {
+                fileOffset += mappedSize - offset;
+                fileSize -= mappedSize - offset;
+                loadAddressAligned += mappedSize;
+                size -= mappedSize;
+                offset = 0;
+            }
         } else if (programHeader.p_type == PT_TLS) {
             size = ALIGNUP(programHeader.p_memsz, PAGESIZE);
             loadAddressAligned = newAddressSpace->mapMemory(size, protection);
@@ -243,14 +291,14 @@ uintptr_t Process::loadELF(const Reference<Vnode>& vnode,
             errno = ENOMEM;
             return 0;
         }
-        memset((void*) (dest + offset), 0, programHeader.p_memsz);
-        readSize = vnode->pread((void*) (dest + offset), programHeader.p_filesz,
-                programHeader.p_offset, 0);
+        memset((void*) dest, 0, size);
+        readSize = vnode->pread((void*) (dest + offset), fileSize, fileOffset,
+                0);
         if (readSize < 0) {
             kernelSpace->unmapPhysical(dest, size);
             return 0;
         }
-        if ((uint64_t) readSize != programHeader.p_filesz) {
+        if ((size_t) readSize != fileSize) {
             kernelSpace->unmapPhysical(dest, size);
             errno = ENOEXEC;
             return 0;
@@ -294,7 +342,7 @@ uintptr_t Process::loadELF(const Reference<Vnode>& vnode,
     }
 
     userStack = newAddressSpace->mapMemory(USER_STACK_SIZE,
-            PROT_READ | PROT_WRITE);
+            PROT_READ | PROT_WRITE | SEG_LAZY);
     if (!userStack) {
         kernelSpace->unmapPhysical(dest, tlsCopySize);
         errno = ENOMEM;
@@ -347,18 +395,31 @@ unsigned int Process::alarm(unsigned int seconds) {
     }
 
     Interrupts::enable();
+
+    // Wake up all threads so that blocked threads notice the new alarm.
+    AutoLock lock(&threadsMutex);
+    for (auto thread : threads) {
+        thread->wakeUp();
+    }
+
     return remaining;
 }
 
 int Process::close(int fd) {
-    AutoLock lock(&fdMutex);
+    kthread_mutex_lock(&fdMutex);
     if (fd < 0 || fd >= fdTable.allocatedSize || !fdTable[fd]) {
+        kthread_mutex_unlock(&fdMutex);
         errno = EBADF;
         return -1;
     }
 
+    Reference<Vnode> vnode = fdTable[fd].descr->vnode;
     fdTable[fd] = { nullptr, 0 };
-    return 0;
+    kthread_mutex_unlock(&fdMutex);
+
+    // Closing the last file descriptor for an open file description might
+    // write back data of the file, so errors are checked afterwards.
+    return vnode->checkWriteBackError();
 }
 
 int Process::dup3(int fd1, int fd2, int flags) {
@@ -420,6 +481,19 @@ int Process::execute(Reference<Vnode>& vnode, char* const argv[],
     memcpy((void*) sigreturnMapped, &beginSigreturn, sigreturnSize);
     kernelSpace->unmapPhysical(sigreturnMapped, PAGESIZE);
 
+    // The time page is shared by all processes. Like page cache frames it is
+    // not owned by the address space.
+    vaddr_t timePage = 0;
+    if (Tsc::timePage) {
+        timePage = newAddressSpace->mapPhysical(Tsc::timePage, PAGESIZE,
+                PROT_READ | PROT_CACHE_FRAME);
+        if (!timePage) {
+            delete newAddressSpace;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
     vaddr_t newKernelStack = kernelSpace->mapMemory(PAGESIZE,
             PROT_READ | PROT_WRITE);
     if (!newKernelStack) {
@@ -443,10 +517,11 @@ int Process::execute(Reference<Vnode>& vnode, char* const argv[],
     }
 
 #ifdef __i386__
-    // Pass argc, argv and envp to the process.
+    // Pass argc, argv, envp and the time page to the process.
     newInterruptContext->eax = argc;
     newInterruptContext->ebx = (uint32_t) newArgv;
     newInterruptContext->ecx = (uint32_t) newEnvp;
+    newInterruptContext->edx = (uint32_t) timePage;
     newInterruptContext->eip = (uint32_t) entry;
     newInterruptContext->cs = 0x1B;
     newInterruptContext->eflags = 0x200; // Interrupt enable
@@ -456,6 +531,7 @@ int Process::execute(Reference<Vnode>& vnode, char* const argv[],
     newInterruptContext->rdi = argc;
     newInterruptContext->rsi = (vaddr_t) newArgv;
     newInterruptContext->rdx = (vaddr_t) newEnvp;
+    newInterruptContext->rcx = timePage;
     newInterruptContext->rip = entry;
     newInterruptContext->cs = 0x1B;
     newInterruptContext->rflags = 0x200; // Interrupt enable
@@ -475,14 +551,13 @@ int Process::execute(Reference<Vnode>& vnode, char* const argv[],
     for (auto thread : threads) {
         if (thread != Thread::current()) {
             thread->forceKill = true;
+            thread->wakeUp();
         }
     }
 
     while (!threads.empty() &&
             !Util::containsOnly(threads, Thread::current())) {
-        kthread_mutex_unlock(&threadsMutex);
-        sched_yield();
-        kthread_mutex_lock(&threadsMutex);
+        kthread_cond_wait(&threadsCond, &threadsMutex);
     }
     kthread_mutex_unlock(&threadsMutex);
 
@@ -549,13 +624,12 @@ void Process::exitThread(const struct exit_thread* data) {
         for (auto thread : threads) {
             if (thread != Thread::current()) {
                 thread->forceKill = true;
+                thread->wakeUp();
             }
         }
 
         while (!Util::containsOnly(threads, Thread::current())) {
-            kthread_mutex_unlock(&threadsMutex);
-            sched_yield();
-            kthread_mutex_lock(&threadsMutex);
+            kthread_cond_wait(&threadsCond, &threadsMutex);
         }
     }
 
@@ -730,6 +804,7 @@ Process* Process::regfork(int flags, regfork_t* registers) {
     memcpy(process->sigactions, sigactions, sizeof(sigactions));
     kthread_mutex_unlock(&signalMutex);
 
+    process->niceness = niceness;
     process->sigreturn = sigreturn;
     kthread_mutex_lock(&fileMaskMutex);
     process->fileMask = fileMask;
@@ -879,7 +954,20 @@ void Process::terminate() {
     }
 
     delete addressSpace;
+
+    // The parent only changes when the parent itself terminates. This happens
+    // on the worker thread, which is also where exited processes are
+    // terminated. Processes whose creation failed in regfork are terminated by
+    // their parent instead and are not in its list of children yet. So the
+    // parent cannot change here.
+    kthread_mutex_lock(&parentMutex);
+    Process* parentProcess = parent;
+    kthread_mutex_unlock(&parentMutex);
+
+    // The parent might delete this process as soon as terminated is set.
+    AutoLock lock(&parentProcess->childrenMutex);
     terminated = true;
+    kthread_cond_broadcast(&parentProcess->childrenCond);
 }
 
 void Process::terminateBySignal(siginfo_t siginfo) {
@@ -889,13 +977,12 @@ void Process::terminateBySignal(siginfo_t siginfo) {
     for (auto thread : threads) {
         if (thread != Thread::current()) {
             thread->forceKill = true;
+            thread->wakeUp();
         }
     }
 
     while (!Util::containsOnly(threads, Thread::current())) {
-        kthread_mutex_unlock(&threadsMutex);
-        sched_yield();
-        kthread_mutex_lock(&threadsMutex);
+        kthread_cond_wait(&threadsCond, &threadsMutex);
     }
 
     terminationStatus.si_signo = SIGCHLD;
@@ -920,9 +1007,9 @@ mode_t Process::umask(const mode_t* newMask /*= nullptr*/) {
 Process* Process::waitpid(pid_t pid, int flags) {
     ChildrenList::iterator process;
 
+    kthread_mutex_lock(&childrenMutex);
     if (pid == -1) {
         while (true) {
-            kthread_mutex_lock(&childrenMutex);
             if (children.empty()) {
                 kthread_mutex_unlock(&childrenMutex);
                 errno = ECHILD;
@@ -931,43 +1018,43 @@ Process* Process::waitpid(pid_t pid, int flags) {
 
             process = Util::findIf(children.begin(), children.end(),
                     [](Process& proc) { return proc.terminated; });
-
-            kthread_mutex_unlock(&childrenMutex);
             if (process != children.end()) break;
+
             if (flags & WNOHANG) {
+                kthread_mutex_unlock(&childrenMutex);
                 return nullptr;
             }
 
-            sched_yield();
-
-            if (Signal::isPending()) {
+            if (kthread_cond_sigwait(&childrenCond, &childrenMutex) == EINTR) {
+                kthread_mutex_unlock(&childrenMutex);
                 errno = EINTR;
                 return nullptr;
             }
         }
     } else {
-        kthread_mutex_lock(&childrenMutex);
         process = Util::findIf(children.begin(), children.end(),
                 [pid](Process& proc) { return proc.pid == pid; });
-        kthread_mutex_unlock(&childrenMutex);
 
         if (process == children.end()) {
+            kthread_mutex_unlock(&childrenMutex);
             errno = ECHILD;
             return nullptr;
         }
 
         while (!process->terminated) {
             if (flags & WNOHANG) {
+                kthread_mutex_unlock(&childrenMutex);
                 return nullptr;
             }
 
-            sched_yield();
-            if (Signal::isPending()) {
+            if (kthread_cond_sigwait(&childrenCond, &childrenMutex) == EINTR) {
+                kthread_mutex_unlock(&childrenMutex);
                 errno = EINTR;
                 return nullptr;
             }
         }
     }
+    kthread_mutex_unlock(&childrenMutex);
 
     childrenSystemCpuClock.add(&process->systemCpuClock);
     childrenSystemCpuClock.add(&process->childrenSystemCpuClock);
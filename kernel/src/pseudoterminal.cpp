@@ -1,4 +1,4 @@
-/* Copyright (c) 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -228,6 +228,7 @@ void PseudoTerminal::output(const char* buffer, size_t size) {
             bytesAvailable++;
         }
         kthread_cond_broadcast(&controllerReadCond);
+        notifyPoll();
     }
 }
 
@@ -278,6 +279,7 @@ ssize_t PseudoTerminal::readController(void* buffer, size_t size, int flags) {
     }
 
     kthread_cond_broadcast(&outputCond);
+    notifyPoll();
     updateTimestamps(true, false, false);
     return bytesRead;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2017, 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2017, 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -54,6 +54,8 @@ extern "C" {
 volatile unsigned long signalPending = 0;
 }
 
+ObjectCache PendingSignal::objectCache(sizeof(PendingSignal));
+
 static inline bool isMoreImportantSignalThan(int signal1, int signal2) {
     if (signal1 == SIGKILL) return true;
     if (signal2 == SIGKILL) return false;
@@ -271,6 +273,8 @@ void Thread::raiseSignalUnlocked(siginfo_t siginfo) {
     }
 
     kthread_cond_broadcast(&signalCond);
+    // Wake up the thread so that it can notice the signal.
+    wakeUp();
 }
 
 void Thread::updatePendingSignals() {
@@ -0,0 +1,243 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/slab.cpp
+ * Slab allocator for fixed-size objects.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/clock.h>
+#include <dennix/kernel/interrupts.h>
+#include <dennix/kernel/log.h>
+#include <dennix/kernel/physicalmemory.h>
+#include <dennix/kernel/slab.h>
+
+#define OBJECT_ALIGNMENT 16
+
+// The slab header is stored at the beginning of the page, so the slab of an
+// object can be found by rounding down the address of the object. Free objects
+// are linked together through their first word.
+
+// The mutex is only taken with trylock by reclaimCache because the PMM is
+// locked at that time, so the PMM may be called while holding the mutex.
+
+ObjectCache::ObjectCache(size_t objectSize) {
+    mutex = KTHREAD_MUTEX_INITIALIZER;
+    this->objectSize = ALIGNUP(objectSize, OBJECT_ALIGNMENT);
+    size_t headerSize = ALIGNUP(sizeof(Slab), OBJECT_ALIGNMENT);
+    assert(this->objectSize <= PAGESIZE - headerSize);
+    objectsPerSlab = (PAGESIZE - headerSize) / this->objectSize;
+    numEmptySlabs = 0;
+    numReclaimedSlabs = 0;
+    workerJob.func = unmapReclaimedSlabs;
+    workerJob.context = this;
+}
+
+void* ObjectCache::allocate() {
+    AutoLock lock(&mutex);
+
+    if (partialSlabs.empty()) {
+        Slab* slab;
+        if (!emptySlabs.empty()) {
+            if (!convertFromCache()) return nullptr;
+            slab = &emptySlabs.front();
+            emptySlabs.remove(*slab);
+            numEmptySlabs--;
+        } else {
+            slab = allocateSlab();
+            if (!slab) return nullptr;
+        }
+        partialSlabs.addFront(*slab);
+    }
+
+    Slab* slab = &partialSlabs.front();
+    void* object = slab->freeList;
+    slab->freeList = *(void**) object;
+    slab->usedObjects++;
+    if (slab->usedObjects == objectsPerSlab) {
+        partialSlabs.remove(*slab);
+    }
+    return object;
+}
+
+ObjectCache::Slab* ObjectCache::allocateSlab() {
+    paddr_t physicalAddress = PhysicalMemory::popPageFrame();
+    if (!physicalAddress) return nullptr;
+    vaddr_t address = kernelSpace->mapPhysical(physicalAddress, PAGESIZE,
+            PROT_READ | PROT_WRITE);
+    if (!address) {
+        PhysicalMemory::pushPageFrame(physicalAddress);
+        return nullptr;
+    }
+
+    Slab* slab = (Slab*) address;
+    slab->usedObjects = 0;
+    slab->freeList = nullptr;
+    vaddr_t object = address + ALIGNUP(sizeof(Slab), OBJECT_ALIGNMENT);
+    for (size_t i = 0; i < objectsPerSlab; i++) {
+        *(void**) object = slab->freeList;
+        slab->freeList = (void*) object;
+        object += objectSize;
+    }
+    return slab;
+}
+
+void ObjectCache::free(void* object) {
+    if (!object) return;
+
+    AutoLock lock(&mutex);
+    Slab* slab = (Slab*) ((vaddr_t) object & ~PAGE_MISALIGN);
+    assert(slab->usedObjects > 0);
+
+    if (slab->usedObjects == objectsPerSlab) {
+        partialSlabs.addFront(*slab);
+    }
+    *(void**) object = slab->freeList;
+    slab->freeList = object;
+    slab->usedObjects--;
+
+    if (slab->usedObjects == 0) {
+        partialSlabs.remove(*slab);
+        if (numEmptySlabs < MAX_EMPTY_SLABS) {
+            emptySlabs.addFront(*slab);
+            numEmptySlabs++;
+            convertToCache();
+        } else {
+            freeSlab(slab);
+        }
+    }
+}
+
+void ObjectCache::freeSlab(Slab* slab) {
+    paddr_t physicalAddress = kernelSpace->getPhysicalAddress((vaddr_t) slab);
+    kernelSpace->unmapPhysical((vaddr_t) slab, PAGESIZE);
+    PhysicalMemory::pushPageFrame(physicalAddress);
+}
+
+paddr_t ObjectCache::reclaimCache() {
+    if (kthread_mutex_trylock(&mutex) != 0) return 0;
+
+    if (emptySlabs.empty() || numReclaimedSlabs == MAX_EMPTY_SLABS) {
+        kthread_mutex_unlock(&mutex);
+        return 0;
+    }
+
+    Slab* slab = &emptySlabs.front();
+    emptySlabs.remove(*slab);
+    numEmptySlabs--;
+
+    // We cannot unmap the slab yet because the PMM is locked. This will be
+    // handled by the worker thread.
+    reclaimedSlabs[numReclaimedSlabs++] = (vaddr_t) slab;
+    if (numReclaimedSlabs == 1) {
+        Interrupts::disable();
+        WorkerThread::addJob(&workerJob);
+        Interrupts::enable();
+    }
+
+    paddr_t physicalAddress = kernelSpace->getPhysicalAddress((vaddr_t) slab);
+    kthread_mutex_unlock(&mutex);
+    return physicalAddress;
+}
+
+void ObjectCache::unmapReclaimedSlabs(void* cache) {
+    ObjectCache* self = (ObjectCache*) cache;
+
+    kthread_mutex_lock(&self->mutex);
+    vaddr_t slabs[MAX_EMPTY_SLABS];
+    size_t numSlabs = self->numReclaimedSlabs;
+    for (size_t i = 0; i < numSlabs; i++) {
+        slabs[i] = self->reclaimedSlabs[i];
+    }
+    self->numReclaimedSlabs = 0;
+    kthread_mutex_unlock(&self->mutex);
+
+    for (size_t i = 0; i < numSlabs; i++) {
+        kernelSpace->unmapPhysical(slabs[i], PAGESIZE);
+    }
+}
+
+#ifdef SLAB_BENCHMARK
+// Compares the latency of the object caches with the kernel heap. The heap is
+// fragmented first so that malloc has to search through some chunks like it
+// has to on a running system. Build with -DSLAB_BENCHMARK to enable this.
+
+#define BENCHMARK_BATCH 64
+#define BENCHMARK_ROUNDS 10000
+
+static ObjectCache cache32(32);
+static ObjectCache cache128(128);
+static ObjectCache cache512(512);
+
+static unsigned long long getNanoseconds() {
+    struct timespec now;
+    Clock::get(CLOCK_MONOTONIC)->getTime(&now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static unsigned long long benchmarkHeap(size_t size) {
+    void* objects[BENCHMARK_BATCH];
+    unsigned long long start = getNanoseconds();
+    for (size_t i = 0; i < BENCHMARK_ROUNDS; i++) {
+        for (size_t j = 0; j < BENCHMARK_BATCH; j++) {
+            objects[j] = malloc(size);
+        }
+        for (size_t j = 0; j < BENCHMARK_BATCH; j++) {
+            ::free(objects[j]);
+        }
+    }
+    return getNanoseconds() - start;
+}
+
+static unsigned long long benchmarkCache(ObjectCache& cache) {
+    void* objects[BENCHMARK_BATCH];
+    unsigned long long start = getNanoseconds();
+    for (size_t i = 0; i < BENCHMARK_ROUNDS; i++) {
+        for (size_t j = 0; j < BENCHMARK_BATCH; j++) {
+            objects[j] = cache.allocate();
+        }
+        for (size_t j = 0; j < BENCHMARK_BATCH; j++) {
+            cache.free(objects[j]);
+        }
+    }
+    return getNanoseconds() - start;
+}
+
+void benchmarkObjectCaches() {
+    static void* fragments[1024];
+    for (size_t i = 0; i < 1024; i++) {
+        fragments[i] = malloc(16 + i % 7 * 48);
+    }
+    for (size_t i = 0; i < 1024; i += 2) {
+        ::free(fragments[i]);
+    }
+
+    const size_t sizes[] = { 32, 128, 512 };
+    ObjectCache* caches[] = { &cache32, &cache128, &cache512 };
+    const unsigned long long operations = BENCHMARK_ROUNDS * BENCHMARK_BATCH;
+    for (size_t i = 0; i < 3; i++) {
+        unsigned long long heap = benchmarkHeap(sizes[i]);
+        unsigned long long slab = benchmarkCache(*caches[i]);
+        Log::printf("Allocating %zu bytes: heap %llu ns, slab %llu ns\n",
+                sizes[i], heap / operations, slab / operations);
+    }
+
+    for (size_t i = 1; i < 1024; i += 2) {
+        ::free(fragments[i]);
+    }
+}
+#endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2020, 2021, 2023 Dennis Wölfing
+/* Copyright (c) 2020, 2021, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -61,6 +61,7 @@ StreamSocket::~StreamSocket() {
             peer->peer = nullptr;
             kthread_cond_broadcast(&peer->receiveCond);
             kthread_cond_broadcast(&peer->sendCond);
+            notifyPoll();
         }
         kthread_mutex_unlock(&connectionMutex->mutex);
         delete receiveBuffer;
@@ -68,6 +69,7 @@ StreamSocket::~StreamSocket() {
 
     while (firstConnection) {
         kthread_cond_broadcast(&firstConnection->connectCond);
+        notifyPoll();
         Reference<StreamSocket> connection = firstConnection;
         firstConnection = firstConnection->nextConnection;
         connection->nextConnection = nullptr;
@@ -113,6 +115,7 @@ Reference<Vnode> StreamSocket::accept(struct sockaddr* address,
         kthread_mutex_lock(&incoming->socketMutex);
         incoming->isConnecting = false;
         kthread_cond_broadcast(&incoming->connectCond);
+        notifyPoll();
         kthread_mutex_unlock(&incoming->socketMutex);
         return nullptr;
     }
@@ -126,6 +129,7 @@ Reference<Vnode> StreamSocket::accept(struct sockaddr* address,
     incoming->circularBuffer.initialize(buffer, BUFFER_SIZE);
     struct sockaddr_un peerAddr = incoming->boundAddress;
     kthread_cond_broadcast(&incoming->connectCond);
+    notifyPoll();
     kthread_mutex_unlock(&incoming->socketMutex);
 
     if (address) {
@@ -153,6 +157,7 @@ bool StreamSocket::addConnection(const Reference<StreamSocket>& socket) {
     lastConnection = socket;
 
     kthread_cond_signal(&acceptCond);
+    notifyPoll();
     return true;
 }
 
@@ -398,6 +403,7 @@ ssize_t StreamSocket::read(void* buffer, size_t size, int flags) {
 
     if (peer) {
         kthread_cond_broadcast(&peer->sendCond);
+        notifyPoll();
     }
     updateTimestamps(true, false, false);
     return bytesRead;
@@ -458,6 +464,7 @@ ssize_t StreamSocket::write(const void* buffer, size_t size, int flags) {
 
         written += peer->circularBuffer.write(buf + written, size - written);
         kthread_cond_broadcast(&peer->receiveCond);
+        notifyPoll();
     }
 
     updateTimestampsLocked(false, true, true);
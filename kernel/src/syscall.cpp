@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -102,6 +102,12 @@ static const void* syscallList[NUM_SYSCALLS] = {
     /*[SYSCALL_FCHOWN] =*/ (void*) Syscall::fchown,
     /*[SYSCALL_SETSID] =*/ (void*) Syscall::setsid,
     /*[SYSCALL_GETPPID] =*/ (void*) Syscall::getppid,
+    /*[SYSCALL_GETPRIORITY] =*/ (void*) Syscall::getpriority,
+    /*[SYSCALL_SETPRIORITY] =*/ (void*) Syscall::setpriority,
+    /*[SYSCALL_MSYNC] =*/ (void*) Syscall::msync,
+    /*[SYSCALL_FUTEX] =*/ (void*) Syscall::futex,
+    /*[SYSCALL_FALLOCATE] =*/ (void*) Syscall::fallocate,
+    /*[SYSCALL_MEMINFO2] =*/ (void*) Syscall::meminfo2,
 };
 
 static Reference<FileDescription> getRootFd(int fd, const char* path) {
@@ -168,12 +174,15 @@ int Syscall::clock_gettime(clockid_t clockid, struct timespec* result) {
     Clock* clock = Clock::get(clockid);
     if (!clock) return -1;
 
-    return clock->getTime(result);
+    return clock->getPreciseTime(result);
 }
 
 int Syscall::clock_nanosleep(clockid_t clockid, int flags,
         const struct timespec* requested, struct timespec* remaining) {
-    if (clockid == CLOCK_PROCESS_CPUTIME_ID) return errno = EINVAL;
+    if (clockid == CLOCK_PROCESS_CPUTIME_ID ||
+            clockid == CLOCK_THREAD_CPUTIME_ID) {
+        return errno = EINVAL;
+    }
 
     if (clockid == CLOCK_REALTIME && !(flags & TIMER_ABSTIME)) {
         clockid = CLOCK_MONOTONIC;
@@ -237,6 +246,21 @@ NORETURN void Syscall::exit_thread(const struct exit_thread* data) {
     Process::current()->exitThread(&copy);
 }
 
+int Syscall::fallocate(int fd, off_t offset, off_t length) {
+    if (offset < 0 || length <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Reference<FileDescription> descr = Process::current()->getFd(fd);
+    if (!descr) return -1;
+    if (!(descr->fcntl(F_GETFL, 0) & O_WRONLY)) {
+        errno = EBADF;
+        return -1;
+    }
+    return descr->vnode->fallocate(offset, length);
+}
+
 int Syscall::fchdir(int fd) {
     Reference<FileDescription> descr = Process::current()->getFd(fd);
     if (!descr) return -1;
@@ -401,6 +425,17 @@ pid_t Syscall::getpgid(pid_t pid) {
     return process->pgid;
 }
 
+int Syscall::getpriority(int which, id_t who) {
+    if (which != PRIO_PROCESS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Process* process = who == 0 ? Process::current() : Process::get(who);
+    if (!process) return -1;
+    return process->niceness;
+}
+
 int Syscall::getrusagens(int who, struct rusagens* usage) {
     if (who == RUSAGE_SELF) {
         Process::current()->systemCpuClock.getTime(&usage->ru_stime);
@@ -467,21 +502,44 @@ int Syscall::mkdirat(int fd, const char* path, mode_t mode) {
 }
 
 static void* mmapImplementation(void* /*addr*/, size_t size,
-        int protection, int flags, int /*fd*/, off_t /*offset*/) {
-    if (size == 0 || !(flags & MAP_PRIVATE)) {
+        int protection, int flags, int fd, off_t offset) {
+    bool shared = flags & MAP_SHARED;
+    if (size == 0 || !(flags & (MAP_PRIVATE | MAP_SHARED)) ||
+            (shared && flags & MAP_PRIVATE)) {
         errno = EINVAL;
         return MAP_FAILED;
     }
 
+    AddressSpace* addressSpace = Process::current()->addressSpace;
+    protection &= _PROT_FLAGS;
+
     if (flags & MAP_ANONYMOUS) {
-        AddressSpace* addressSpace = Process::current()->addressSpace;
+        if (shared) {
+            errno = ENOTSUP;
+            return MAP_FAILED;
+        }
+
+        if (!(flags & MAP_POPULATE)) protection |= SEG_LAZY;
         return (void*) addressSpace->mapMemory(ALIGNUP(size, PAGESIZE),
-                protection & _PROT_FLAGS);
+                protection);
+    }
+
+    if (offset < 0 || !PAGE_ALIGNED(offset)) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    Reference<FileDescription> descr = Process::current()->getFd(fd);
+    if (!descr) return MAP_FAILED;
+    int fileFlags = descr->fcntl(F_GETFL, 0);
+    if (!(fileFlags & O_RDONLY) || (shared && protection & PROT_WRITE &&
+            !(fileFlags & O_WRONLY))) {
+        errno = EACCES;
+        return MAP_FAILED;
     }
 
-    // TODO: Implement other flags than MAP_ANONYMOUS
-    errno = ENOTSUP;
-    return MAP_FAILED;
+    return (void*) addressSpace->mapFile(0, ALIGNUP(size, PAGESIZE),
+            protection, shared, descr->vnode, offset);
 }
 
 void* Syscall::mmap(__mmapRequest* request) {
@@ -526,6 +584,20 @@ int Syscall::mount(const char* filename, const char* mountPath,
     return result;
 }
 
+int Syscall::msync(void* addr, size_t size, int flags) {
+    if (!PAGE_ALIGNED((vaddr_t) addr) ||
+            flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE) ||
+            (flags & MS_ASYNC && flags & MS_SYNC)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Mapped pages are always up to date with the file, so there is nothing
+    // to invalidate. Asynchronous writeback is done synchronously.
+    AddressSpace* addressSpace = Process::current()->addressSpace;
+    return addressSpace->syncMemory((vaddr_t) addr, ALIGNUP(size, PAGESIZE));
+}
+
 int Syscall::munmap(void* addr, size_t size) {
     if (size == 0 || !PAGE_ALIGNED((vaddr_t) addr)) {
         errno = EINVAL;
@@ -604,6 +676,7 @@ int Syscall::ppoll(struct pollfd fds[], nfds_t nfds,
 
     int events = 0;
     while (true) {
+        unsigned long pollGeneration = getPollGeneration();
         for (nfds_t i = 0; i < nfds; i++) {
             int fd = fds[i].fd;
             if (fd < 0) {
@@ -646,7 +719,7 @@ int Syscall::ppoll(struct pollfd fds[], nfds_t nfds,
             return -1;
         }
 
-        sched_yield();
+        waitForPoll(pollGeneration, timeout ? &endTime : nullptr);
     }
 }
 
@@ -739,6 +812,27 @@ int Syscall::setpgid(pid_t pid, pid_t pgid) {
     return process->setpgid(pgid);
 }
 
+int Syscall::setpriority(int which, id_t who, int value) {
+    if (which != PRIO_PROCESS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Process* process = who == 0 ? Process::current() : Process::get(who);
+    if (!process) return -1;
+
+    if (value < -NZERO) {
+        value = -NZERO;
+    } else if (value > NZERO - 1) {
+        value = NZERO - 1;
+    }
+
+    // The new priority is used the next time a thread of the process is
+    // queued by the scheduler.
+    process->niceness = value;
+    return 0;
+}
+
 pid_t Syscall::setsid() {
     return Process::current()->setsid();
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -72,6 +72,7 @@ void Terminal::handleCharacter(char c) {
         } else {
             numEof++;
             kthread_cond_broadcast(&readCond);
+            notifyPoll();
         }
     } else if (termio.c_lflag & ICANON && c == termio.c_cc[VERASE]) {
         if (backspace() && (termio.c_lflag & ECHOE)) {
@@ -127,6 +128,7 @@ void Terminal::hangup() {
 
     hungup = true;
     kthread_cond_broadcast(&readCond);
+    notifyPoll();
 }
 
 int Terminal::devctl(int command, void* restrict data, size_t size,
@@ -429,6 +431,7 @@ bool Terminal::backspace() {
     } while (continuationByte && lineIndex != writeIndex);
 
     kthread_cond_broadcast(&writeCond);
+    notifyPoll();
     return true;
 }
 
@@ -439,6 +442,7 @@ bool Terminal::canWriteBuffer() {
 void Terminal::endLine() {
     lineIndex = writeIndex;
     kthread_cond_broadcast(&readCond);
+    notifyPoll();
 }
 
 bool Terminal::hasIncompleteLine() {
@@ -449,6 +453,7 @@ char Terminal::readBuffer() {
     char result = circularBuffer[readIndex];
     readIndex = (readIndex + 1) % TERMINAL_BUFFER_SIZE;
     kthread_cond_broadcast(&writeCond);
+    notifyPoll();
     return result;
 }
 
@@ -457,6 +462,7 @@ void Terminal::resetBuffer() {
     lineIndex = 0;
     writeIndex = 0;
     kthread_cond_broadcast(&writeCond);
+    notifyPoll();
 }
 
 void Terminal::writeBuffer(char c) {
@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2019, 2020, 2021, 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2018, 2019, 2020, 2021, 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -21,13 +21,44 @@
 #include <errno.h>
 #include <sched.h>
 #include <string.h>
+#include <dennix/limits.h>
+#include <dennix/kernel/hpet.h>
+#include <dennix/kernel/panic.h>
 #include <dennix/kernel/process.h>
 #include <dennix/kernel/registers.h>
+#include <dennix/kernel/vnode.h>
 #include <dennix/kernel/worker.h>
 
+// Runnable threads are kept in run queues ordered by priority. Priorities
+// range from 0 (highest) to NUM_PRIORITIES - 1 (lowest) and are derived from
+// the nice value of the process. Threads that block before their timeslice
+// runs out get a priority bonus so that interactive threads are preferred over
+// CPU bound ones. Threads whose timeslice has run out are moved to the expired
+// queue and only run again after all threads in the active queue have used up
+// their timeslices, so that low priority threads cannot starve.
+static const int NUM_PRIORITIES = 2 * NZERO;
+static const int INTERACTIVE_BONUS = 5;
+static const unsigned long TIMESLICE_PER_PRIORITY = 500000; // nanoseconds
+// While a thread is running the timer interrupt needs to occur regularly so
+// that timeslices can end. When the system is idle the timer only fires when
+// the next sleeping thread needs to be woken up.
+static const struct timespec TICK = { 0, 1000000 };
+
+struct RunQueue {
+    Thread::RunList queues[NUM_PRIORITIES];
+    uint64_t bitmap;
+};
+
 Thread* Thread::_current;
 Thread* Thread::idleThread;
-static ThreadList threadList;
+ObjectCache Thread::objectCache(sizeof(Thread));
+static RunQueue runQueues[2];
+static RunQueue* activeQueue = &runQueues[0];
+static RunQueue* expiredQueue = &runQueues[1];
+// Blocked threads that will be woken up at a given time, sorted by wakeupTime.
+static ThreadList sleepingThreads;
+// Whether the idle thread has finished initializing the system.
+static bool idling;
 
 __fpu_t initFpu;
 
@@ -35,26 +66,47 @@ static int bootErrno;
 extern "C" { int* __errno_location = &bootErrno; }
 
 Thread::Thread(Process* process) {
+    blocked = false;
+    bounceBuffer = 0;
     contextChanged = false;
     forceKill = false;
+    interactive = false;
     interruptContext = nullptr;
     kernelStack = 0;
     next = nullptr;
     pendingSignals = nullptr;
     prev = nullptr;
+    priority = 0;
     this->process = process;
     returnSignalMask = 0;
+    runQueue = nullptr;
     signalMask = 0;
     signalMutex = KTHREAD_MUTEX_INITIALIZER;
     signalCond = KTHREAD_COND_INITIALIZER;
     tid = -1;
+    timesliceEnd.tv_sec = 0;
+    timesliceEnd.tv_nsec = 0;
     tlsBase = 0;
+    wakeupTime.tv_sec = 0;
+    wakeupTime.tv_nsec = -1;
 }
 
 Thread::~Thread() {
     if (kernelStack != 0) {
         kernelSpace->unmapMemory(kernelStack, PAGESIZE);
     }
+    if (bounceBuffer != 0) {
+        kernelSpace->unmapMemory(bounceBuffer, BOUNCE_BUFFER_SIZE);
+    }
+}
+
+void* Thread::getBounceBuffer() {
+    // The buffer is only used by the thread itself, so no locking is needed.
+    if (!bounceBuffer) {
+        bounceBuffer = kernelSpace->mapMemory(BOUNCE_BUFFER_SIZE,
+                PROT_READ | PROT_WRITE);
+    }
+    return (void*) bounceBuffer;
 }
 
 void Thread::initializeIdleThread() {
@@ -68,17 +120,132 @@ void Thread::initializeIdleThread() {
     _current = idleThread;
 }
 
+void Thread::startKernelThread(void (*func)(void)) {
+    Thread* thread = xnew Thread(idleThread->process);
+    vaddr_t stack = kernelSpace->mapMemory(PAGESIZE, PROT_READ | PROT_WRITE);
+    if (!stack) PANIC("Failed to allocate stack for kernel thread");
+    InterruptContext* context = (InterruptContext*)
+            (stack + PAGESIZE - sizeof(InterruptContext));
+    *context = {};
+
+#ifdef __i386__
+    context->eip = (vaddr_t) func;
+    context->cs = 0x8;
+    context->eflags = 0x200;
+    context->esp = stack + PAGESIZE - sizeof(void*);
+    context->ss = 0x10;
+#elif defined(__x86_64__)
+    context->rip = (vaddr_t) func;
+    context->cs = 0x8;
+    context->rflags = 0x200;
+    context->rsp = stack + PAGESIZE - sizeof(void*);
+    context->ss = 0x10;
+#else
+#  error "InterruptContext in kernel thread is uninitialized."
+#endif
+
+    thread->updateContext(stack, context, &initFpu);
+    addThread(thread);
+}
+
+void Thread::newTimeslice() {
+    // Threads with a higher static priority get longer timeslices.
+    struct timespec timeslice;
+    timeslice.tv_sec = 0;
+    timeslice.tv_nsec = (NZERO - process->niceness) * TIMESLICE_PER_PRIORITY;
+    cpuClock.getTime(&timesliceEnd);
+    timesliceEnd = timespecPlus(timesliceEnd, timeslice);
+}
+
 void Thread::addThread(Thread* thread) {
     Interrupts::disable();
-    threadList.addFront(*thread);
+    thread->newTimeslice();
+    enqueue(thread, activeQueue);
     Interrupts::enable();
 }
 
+void Thread::block(const struct timespec* wakeupTime /*= nullptr*/) {
+    // This function must be called with interrupts disabled. The thread will
+    // not be scheduled again until wakeUp is called or the wakeup time is
+    // reached. Callers must be prepared to handle spurious wakeups.
+
+    if (_current == idleThread) {
+        // The idle thread must always be runnable. Instead of blocking we just
+        // wait for the next interrupt.
+        if (wakeupTime) {
+            Hpet::setDeadline(wakeupTime);
+        }
+        asm volatile ("sti; hlt; cli");
+        return;
+    }
+
+    _current->blocked = true;
+    if (wakeupTime) {
+        _current->wakeupTime = *wakeupTime;
+    } else {
+        _current->wakeupTime.tv_nsec = -1;
+    }
+
+    // Make sure that the thread is woken up when an alarm expires.
+    if (_current->process->alarmTime.tv_nsec != -1) {
+        struct timespec alarmTime = Clock::get(CLOCK_REALTIME)->toMonotonic(
+                _current->process->alarmTime);
+        if (_current->wakeupTime.tv_nsec == -1 ||
+                timespecLess(alarmTime, _current->wakeupTime)) {
+            _current->wakeupTime = alarmTime;
+        }
+    }
+
+    sched_yield();
+}
+
+void Thread::dequeue(Thread* thread) {
+    RunList& queue = thread->runQueue->queues[thread->priority];
+    queue.remove(*thread);
+    if (queue.empty()) {
+        thread->runQueue->bitmap &= ~(1ULL << thread->priority);
+    }
+    thread->runQueue = nullptr;
+}
+
+void Thread::enqueue(Thread* thread, RunQueue* queue) {
+    int priority = thread->process->niceness + NZERO;
+    if (thread->interactive) {
+        priority -= INTERACTIVE_BONUS;
+    }
+    if (priority < 0) priority = 0;
+    if (priority >= NUM_PRIORITIES) priority = NUM_PRIORITIES - 1;
+
+    thread->priority = priority;
+    thread->runQueue = queue;
+    queue->queues[priority].addBack(*thread);
+    queue->bitmap |= 1ULL << priority;
+}
+
 void Thread::removeThread(Thread* thread) {
-    threadList.remove(*thread);
+    dequeue(thread);
+}
+
+void Thread::addSleepingThread(Thread* thread) {
+    if (sleepingThreads.empty() || timespecLess(thread->wakeupTime,
+            sleepingThreads.front().wakeupTime)) {
+        sleepingThreads.addFront(*thread);
+        return;
+    }
+
+    Thread* prev = &sleepingThreads.front();
+    for (Thread* t = prev->next; t; t = t->next) {
+        if (timespecLess(thread->wakeupTime, t->wakeupTime)) break;
+        prev = t;
+    }
+    sleepingThreads.addAfter(ThreadList::iterator(prev), *thread);
 }
 
-InterruptContext* Thread::schedule(InterruptContext* context) {
+InterruptContext* Thread::schedule(InterruptContext* context,
+        bool preempted /*= false*/) {
+    // Account the time since the last update to the thread that was running.
+    Hpet::updateClocks(context->cs != 0x8);
+
     if (likely(!_current->contextChanged)) {
         _current->interruptContext = context;
         Registers::saveFpu(&_current->fpuEnv);
@@ -87,16 +254,56 @@ InterruptContext* Thread::schedule(InterruptContext* context) {
         _current->contextChanged = false;
     }
 
-    if (_current->next) {
-        _current = _current->next;
-    } else {
-        if (!threadList.empty()) {
-            _current = &threadList.front();
-        } else {
-            _current = idleThread;
+    if (_current->blocked) {
+        dequeue(_current);
+        _current->interactive = true;
+        if (_current->wakeupTime.tv_nsec != -1) {
+            addSleepingThread(_current);
+        }
+    } else if (_current->runQueue) {
+        struct timespec now;
+        _current->cpuClock.getTime(&now);
+        if (!timespecLess(now, _current->timesliceEnd)) {
+            // The thread has used up its timeslice.
+            dequeue(_current);
+            _current->interactive = false;
+            _current->newTimeslice();
+            enqueue(_current, expiredQueue);
+        } else if (!preempted) {
+            // The thread yielded, so let other threads run first. Threads
+            // that yield are usually waiting for another thread and therefore
+            // lose their priority bonus.
+            dequeue(_current);
+            _current->interactive = false;
+            enqueue(_current, activeQueue);
         }
     }
 
+    if (!sleepingThreads.empty()) {
+        struct timespec now;
+        Clock::get(CLOCK_MONOTONIC)->getTime(&now);
+        while (!sleepingThreads.empty() &&
+                !timespecLess(now, sleepingThreads.front().wakeupTime)) {
+            sleepingThreads.front().wakeUp();
+        }
+    }
+
+    if (!activeQueue->bitmap && expiredQueue->bitmap) {
+        RunQueue* queue = activeQueue;
+        activeQueue = expiredQueue;
+        expiredQueue = queue;
+    }
+
+    if (activeQueue->bitmap) {
+        // A thread that was preempted before its timeslice ran out is still at
+        // the front of its queue and will continue to run unless a thread with
+        // a higher priority has become runnable.
+        int priority = __builtin_ctzll(activeQueue->bitmap);
+        _current = &activeQueue->queues[priority].front();
+    } else {
+        _current = idleThread;
+    }
+
     setKernelStack(_current->kernelStack + PAGESIZE);
     Registers::restoreFpu(&_current->fpuEnv);
     setTlsBase(_current->tlsBase);
@@ -105,9 +312,44 @@ InterruptContext* Thread::schedule(InterruptContext* context) {
     _current->process->addressSpace->activate();
     _current->checkSigalarm(true);
     _current->updatePendingSignals();
+
+    const struct timespec* deadline = nullptr;
+    struct timespec tick;
+    if (_current != idleThread || !idling) {
+        Clock::get(CLOCK_MONOTONIC)->getTime(&tick);
+        tick = timespecPlus(tick, TICK);
+        deadline = &tick;
+    }
+    if (!sleepingThreads.empty() && (!deadline ||
+            timespecLess(sleepingThreads.front().wakeupTime, *deadline))) {
+        deadline = &sleepingThreads.front().wakeupTime;
+    }
+    Hpet::setDeadline(deadline);
+
     return _current->interruptContext;
 }
 
+NORETURN void Thread::idle() {
+    // This is called by the idle thread once the system has been initialized.
+    idling = true;
+    while (true) {
+        asm volatile ("hlt");
+    }
+}
+
+void Thread::wakeUp() {
+    bool interrupts = Interrupts::saveAndDisable();
+    if (blocked) {
+        blocked = false;
+        if (wakeupTime.tv_nsec != -1) {
+            sleepingThreads.remove(*this);
+            wakeupTime.tv_nsec = -1;
+        }
+        enqueue(this, activeQueue);
+    }
+    Interrupts::restore(interrupts);
+}
+
 static void deleteThread(void* thread) {
     delete (Thread*) thread;
 }
@@ -117,6 +359,7 @@ NORETURN void Thread::terminate(bool alsoTerminateProcess) {
 
     kthread_mutex_lock(&process->threadsMutex);
     process->threads[tid] = nullptr;
+    kthread_cond_broadcast(&process->threadsCond);
     kthread_mutex_unlock(&process->threadsMutex);
 
     WorkerJob job;
@@ -0,0 +1,131 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* kernel/src/tsc.cpp
+ * Time Stamp Counter.
+ */
+
+#include <string.h>
+#include <dennix/timepage.h>
+#include <dennix/kernel/addressspace.h>
+#include <dennix/kernel/clock.h>
+#include <dennix/kernel/log.h>
+#include <dennix/kernel/panic.h>
+#include <dennix/kernel/physicalmemory.h>
+#include <dennix/kernel/tsc.h>
+
+// When the TSC is used, all clock updates are computed from TSC differences
+// the same way libc does it with the time page. This way clock_gettime in
+// userspace returns the same times as the kernel and never goes backwards.
+
+paddr_t Tsc::timePage;
+static volatile __timepage* page;
+static uint64_t frequency;
+
+static uint64_t toNanoseconds(uint64_t delta, uint64_t& fraction) {
+    uint64_t nanoseconds = 0;
+    if (unlikely(delta >= frequency)) {
+        nanoseconds = delta / frequency * 1000000000;
+        delta %= frequency;
+    }
+    uint64_t scaled = delta * page->tscMultiplier + page->tscFraction;
+    fraction = scaled & 0xFFFFFFFF;
+    return nanoseconds + (scaled >> 32);
+}
+
+uint64_t Tsc::getElapsed() {
+    if (!page) return 0;
+    uint64_t fraction;
+    return toNanoseconds(read() - page->tscBase, fraction);
+}
+
+void Tsc::initialize(uint64_t tscFrequency) {
+    // Frequencies this low are most likely measurement errors.
+    if (tscFrequency < 1000000) return;
+    frequency = tscFrequency;
+
+    timePage = PhysicalMemory::popPageFrame();
+    if (!timePage) PANIC("Failed to allocate the time page");
+    page = (volatile __timepage*) kernelSpace->mapPhysical(timePage,
+            PAGESIZE, PROT_READ | PROT_WRITE);
+    if (!page) PANIC("Failed to map the time page");
+    memset((void*) page, 0, PAGESIZE);
+
+    page->tscMultiplier = (1000000000ULL << 32) / frequency;
+    page->tscMaxDelta = frequency;
+    page->tscBase = read();
+    updateTimePage();
+    page->tscEnabled = 1;
+
+    Log::printf("TSC frequency is %llu kHz\n",
+            (unsigned long long) frequency / 1000);
+}
+
+bool Tsc::isSupported() {
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t eax = 1;
+    uint32_t ecx;
+    uint32_t edx;
+    asm("cpuid" : "+a"(eax), "=c"(ecx), "=d"(edx) :: "ebx");
+    if (!(edx & (1 << 4))) return false;
+    // Hypervisors usually provide a TSC with a constant rate even when they do
+    // not report it as invariant.
+    if (ecx & (1U << 31)) return true;
+
+    eax = 0x80000000;
+    asm("cpuid" : "+a"(eax) :: "ebx", "ecx", "edx");
+    if (eax < 0x80000007) return false;
+    eax = 0x80000007;
+    asm("cpuid" : "+a"(eax), "=d"(edx) :: "ebx", "ecx");
+    return edx & (1 << 8);
+#else
+    return false;
+#endif
+}
+
+bool Tsc::updateClocks(bool user) {
+    // This function must be called with interrupts disabled.
+    if (!page) return false;
+
+    uint64_t tsc = read();
+    uint64_t fraction;
+    uint64_t nanoseconds = toNanoseconds(tsc - page->tscBase, fraction);
+    while (nanoseconds > 1000000000) {
+        Clock::onTick(user, 1000000000);
+        nanoseconds -= 1000000000;
+    }
+    Clock::onTick(user, nanoseconds);
+
+    page->sequence++;
+    asm volatile ("" ::: "memory");
+    page->tscBase = tsc;
+    page->tscFraction = fraction;
+    Clock::get(CLOCK_MONOTONIC)->getTime((struct timespec*) &page->monotonic);
+    Clock::get(CLOCK_REALTIME)->getTime((struct timespec*) &page->realtime);
+    asm volatile ("" ::: "memory");
+    page->sequence++;
+    return true;
+}
+
+void Tsc::updateTimePage() {
+    if (!page) return;
+
+    page->sequence++;
+    asm volatile ("" ::: "memory");
+    Clock::get(CLOCK_MONOTONIC)->getTime((struct timespec*) &page->monotonic);
+    Clock::get(CLOCK_REALTIME)->getTime((struct timespec*) &page->realtime);
+    asm volatile ("" ::: "memory");
+    page->sequence++;
+}
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -24,9 +24,13 @@
 #include <sys/stat.h>
 #include <dennix/conf.h>
 #include <dennix/kernel/clock.h>
+#include <dennix/kernel/pagecache.h>
 #include <dennix/kernel/process.h>
 #include <dennix/kernel/vnode.h>
 
+static kthread_cond_t pollCond = KTHREAD_COND_INITIALIZER;
+static unsigned long pollGeneration;
+
 Vnode::Vnode(mode_t mode, dev_t dev) {
     stats.st_dev = dev;
     stats.st_ino = (uintptr_t) this;
@@ -40,10 +44,35 @@ Vnode::Vnode(mode_t mode, dev_t dev) {
     stats.st_blksize = 0x1000;
 
     mutex = KTHREAD_MUTEX_INITIALIZER;
+    pageCache = nullptr;
+    writeMutex = KTHREAD_MUTEX_INITIALIZER;
 }
 
 Vnode::~Vnode() {
     assert(stats.st_nlink == 0);
+    delete pageCache;
+}
+
+unsigned long getPollGeneration() {
+    return __atomic_load_n(&pollGeneration, __ATOMIC_RELAXED);
+}
+
+void notifyPoll() {
+    bool interrupts = Interrupts::saveAndDisable();
+    pollGeneration++;
+    kthread_cond_broadcast(&pollCond);
+    Interrupts::restore(interrupts);
+}
+
+int waitForPoll(unsigned long generation, const struct timespec* endTime) {
+    int result = 0;
+    Interrupts::disable();
+    if (generation == pollGeneration) {
+        result = kthread_cond_sigclockwait(&pollCond, nullptr, CLOCK_MONOTONIC,
+                endTime);
+    }
+    Interrupts::enable();
+    return result;
 }
 
 static Reference<Vnode> resolvePathExceptLastComponent(
@@ -207,6 +236,10 @@ int Vnode::bind(const struct sockaddr* /*address*/, socklen_t /*length*/,
     return -1;
 }
 
+int Vnode::checkWriteBackError() {
+    return 0;
+}
+
 int Vnode::chmod(mode_t mode) {
     AutoLock lock(&mutex);
     stats.st_mode = (stats.st_mode & ~07777) | (mode & 07777);
@@ -241,6 +274,11 @@ int Vnode::devctl(int /*command*/, void* restrict /*data*/, size_t /*size*/,
     return ENOTTY;
 }
 
+int Vnode::fallocate(off_t /*offset*/, off_t /*length*/) {
+    errno = isSeekable() ? ENODEV : ESPIPE;
+    return -1;
+}
+
 int Vnode::ftruncate(off_t /*length*/) {
     errno = EBADF;
     return -1;
@@ -267,6 +305,19 @@ char* Vnode::getLinkTarget() {
     return nullptr;
 }
 
+PageCache* Vnode::getPageCache() {
+    if (!S_ISREG(stats.st_mode)) {
+        errno = ENODEV;
+        return nullptr;
+    }
+
+    AutoLock lock(&mutex);
+    if (!pageCache) {
+        pageCache = new PageCache(this);
+    }
+    return pageCache;
+}
+
 int Vnode::isatty() {
     errno = ENOTTY;
     return 0;
@@ -301,6 +352,10 @@ int Vnode::mount(FileSystem* /*filesystem*/) {
     return -1;
 }
 
+void Vnode::onClose(int /*flags*/) {
+    // Most vnodes do not need to know when a file is closed.
+}
+
 void Vnode::onLink() {
     updateTimestamps(false, true, false);
     stats.st_nlink++;
@@ -337,17 +392,33 @@ ssize_t Vnode::pread(void* /*buffer*/, size_t /*size*/, off_t /*offset*/,
     return -1;
 }
 
+// Reads file data without going through the page cache. This is used to fill
+// the page cache and must be overridden by vnodes whose pread uses it.
+ssize_t Vnode::preadUncached(void* buffer, size_t size, off_t offset) {
+    return pread(buffer, size, offset, 0);
+}
+
 ssize_t Vnode::pwrite(const void* /*buffer*/, size_t /*size*/,
         off_t /*offset*/, int /*flags*/) {
     errno = ESPIPE;
     return -1;
 }
 
+// Writes file data without updating the page cache. This is used to write back
+// the page cache and must be overridden by vnodes whose pwrite updates it.
+ssize_t Vnode::pwriteUncached(const void* buffer, size_t size, off_t offset) {
+    return pwrite(buffer, size, offset, 0);
+}
+
 ssize_t Vnode::read(void* /*buffer*/, size_t /*size*/, int /*flags*/) {
     errno = EBADF;
     return -1;
 }
 
+void Vnode::readahead(off_t /*offset*/, size_t /*size*/) {
+    // Reading ahead is optional, so by default nothing is done.
+}
+
 ssize_t Vnode::readlink(char* /*buffer*/, size_t /*size*/) {
     errno = EINVAL;
     return -1;
@@ -382,6 +453,9 @@ int Vnode::symlink(const char* /*linkTarget*/, const char* /*name*/) {
 }
 
 int Vnode::sync(int /*flags*/) {
+    if (pageCache) {
+        return pageCache->sync();
+    }
     return 0;
 }
 
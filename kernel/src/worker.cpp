@@ -1,4 +1,4 @@
-/* Copyright (c) 2021 Dennis Wölfing
+/* Copyright (c) 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,26 +17,23 @@
  * Kernel worker thread.
  */
 
-#include <sched.h>
-#include <dennix/kernel/addressspace.h>
-#include <dennix/kernel/panic.h>
 #include <dennix/kernel/thread.h>
 #include <dennix/kernel/worker.h>
 
 static WorkerJob* firstJob;
 static WorkerJob* lastJob;
+static kthread_cond_t jobCond = KTHREAD_COND_INITIALIZER;
 
 static NORETURN void worker(void) {
     while (true) {
         Interrupts::disable();
+        while (!firstJob) {
+            kthread_cond_wait(&jobCond, nullptr);
+        }
         WorkerJob* job = firstJob;
         firstJob = nullptr;
         Interrupts::enable();
 
-        if (!job) {
-            sched_yield();
-        }
-
         while (job) {
             WorkerJob* next = job->next;
             job->func(job->context);
@@ -56,32 +53,9 @@ void WorkerThread::addJob(WorkerJob* job) {
         lastJob->next = job;
         lastJob = job;
     }
+    kthread_cond_signal(&jobCond);
 }
 
 void WorkerThread::initialize() {
-    Thread* thread = xnew Thread(Thread::idleThread->process);
-    vaddr_t stack = kernelSpace->mapMemory(PAGESIZE, PROT_READ | PROT_WRITE);
-    if (!stack) PANIC("Failed to allocate stack for worker thread");
-    InterruptContext* context = (InterruptContext*)
-            (stack + PAGESIZE - sizeof(InterruptContext));
-    *context = {};
-
-#ifdef __i386__
-    context->eip = (vaddr_t) worker;
-    context->cs = 0x8;
-    context->eflags = 0x200;
-    context->esp = stack + PAGESIZE - sizeof(void*);
-    context->ss = 0x10;
-#elif defined(__x86_64__)
-    context->rip = (vaddr_t) worker;
-    context->cs = 0x8;
-    context->rflags = 0x200;
-    context->rsp = stack + PAGESIZE - sizeof(void*);
-    context->ss = 0x10;
-#else
-#  error "InterruptContext in WorkerThread is uninitialized."
-#endif
-
-    thread->updateContext(stack, context, &initFpu);
-    Thread::addThread(thread);
+    Thread::startKernelThread(worker);
 }
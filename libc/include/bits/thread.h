@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -29,26 +29,26 @@ typedef int __thread_attr_t;
 struct __cond_waiter {
     struct __cond_waiter* __prev;
     struct __cond_waiter* __next;
-    char __blocked;
+    int __blocked;
 };
 
 typedef struct {
     struct __cond_waiter* __first;
     struct __cond_waiter* __last;
     __clockid_t __clock;
-    char __state;
+    int __state;
 } __cond_t;
 
 typedef int __key_t;
 
 typedef struct {
     char __type;
-    char __state;
+    int __state;
     __pid_t __owner;
     __SIZE_TYPE__ __count;
 } __mutex_t;
 
-typedef unsigned char __once_t;
+typedef int __once_t;
 
 #define _MUTEX_NORMAL 0
 #define _MUTEX_RECURSIVE 1
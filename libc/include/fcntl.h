@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2018, 2019, 2020, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2018, 2019, 2020, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -38,6 +38,7 @@ int creat(const char*, mode_t);
 int fcntl(int, int, ...);
 int open(const char*, int, ...);
 int openat(int, const char*, int, ...);
+int posix_fallocate(int, off_t, off_t);
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2017 Dennis Wölfing
+/* Copyright (c) 2017, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -21,12 +21,24 @@
 #define _SCHED_H
 
 #include <sys/cdefs.h>
+#define __need_pid_t
+#include <bits/types.h>
 #include <dennix/timespec.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define SCHED_OTHER 0
+
+struct sched_param {
+    int sched_priority;
+};
+
+int sched_get_priority_max(int);
+int sched_get_priority_min(int);
+int sched_getparam(pid_t, struct sched_param*);
+int sched_setparam(pid_t, const struct sched_param*);
 int sched_yield(void);
 
 #ifdef __cplusplus
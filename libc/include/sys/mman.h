@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 void* mmap(void*, size_t, int, int, int, off_t);
+int msync(void*, size_t, int);
 int munmap(void*, size_t);
 
 #ifdef __cplusplus
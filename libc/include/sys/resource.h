@@ -1,4 +1,4 @@
-/* Copyright (c) 2020 Dennis Wölfing
+/* Copyright (c) 2020, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -59,8 +59,10 @@ struct rusage {
     struct timeval ru_stime;
 };
 
+int getpriority(int, id_t);
 int getrlimit(int, struct rlimit*);
 int getrusage(int, struct rusage*);
+int setpriority(int, id_t, int);
 int setrlimit(int, const struct rlimit*);
 
 #if __USE_DENNIX
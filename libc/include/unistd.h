@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2024 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2018, 2019, 2020, 2021, 2022, 2024, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -268,6 +268,7 @@ int lchown(const char*, uid_t, gid_t);
 int link(const char*, const char*);
 int linkat(int, const char*, int, const char*, int);
 off_t lseek(int, off_t, int);
+int nice(int);
 long pathconf(const char*, int);
 int pipe(int[2]);
 ssize_t read(int, void*, size_t);
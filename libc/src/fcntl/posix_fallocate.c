@@ -0,0 +1,35 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/src/fcntl/posix_fallocate.c
+ * Allocate file space. (POSIX2008)
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+DEFINE_SYSCALL(SYSCALL_FALLOCATE, int, sys_fallocate, (int, off_t, off_t));
+
+int posix_fallocate(int fd, off_t offset, off_t length) {
+    // Errors are returned instead of being stored in errno.
+    int oldErrno = errno;
+    if (sys_fallocate(fd, offset, length) < 0) {
+        int result = errno;
+        errno = oldErrno;
+        return result;
+    }
+    return 0;
+}
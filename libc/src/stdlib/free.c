@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,41 +17,48 @@
  * Memory deallocation.
  */
 
-#include <assert.h>
+#include <stdint.h>
 #include "malloc.h"
 
 void free(void* addr) {
     if (addr == NULL) return;
-    __lockHeap();
-
-    Chunk* chunk = (Chunk*) addr - 1;
-
-    assert(chunk->magic == MAGIC_USED_CHUNK);
 
-    chunk->magic = MAGIC_FREE_CHUNK;
-
-    // Unify the chunk with its neighbors if they are free too
-    if (chunk->prev && chunk->prev->magic == MAGIC_FREE_CHUNK) {
-        chunk = __unifyChunks(chunk->prev, chunk);
+    size_t* header = (size_t*) ((uintptr_t) addr & ~(PAGESIZE - 1));
+    if (*header == MAGIC_LARGE) {
+        __freeLarge((LargeHeader*) header);
+        return;
+    } else if (*header != MAGIC_RUN) {
+        // This was not allocated by malloc or the heap has been corrupted.
+        abort();
     }
 
-    if (chunk->next->magic == MAGIC_FREE_CHUNK) {
-        chunk = __unifyChunks(chunk, chunk->next);
+    Run* run = (Run*) header;
+    void** object = addr;
+#ifdef MALLOC_DEBUG
+    if (object[1] == (void*) MAGIC_FREE_OBJECT) {
+        __checkDoubleFree(run, object);
     }
+    object[1] = (void*) MAGIC_FREE_OBJECT;
+#endif
 
-    if (chunk->prev == NULL && chunk->next->magic == MAGIC_END_CHUNK) {
-        // The whole big chunk is free, so we can unmap it
-        Chunk* bigChunk = chunk - 1;
-        assert(bigChunk->magic == MAGIC_BIG_CHUNK);
+#if __is_dennix_libc
+    ThreadCache* cache = __getThreadCache();
+    if (cache) {
+        size_t sizeClass = run->sizeClass;
+        object[0] = cache->objects[sizeClass];
+        cache->objects[sizeClass] = object;
+        cache->numObjects[sizeClass]++;
 
-        if (bigChunk->prev) {
-            bigChunk->prev->next = bigChunk->next;
-        }
-        if (bigChunk->next) {
-            bigChunk->next->prev = bigChunk->prev;
+        size_t maxObjects = THREAD_CACHE_BYTES / __getClassSize(sizeClass);
+        if (cache->numObjects[sizeClass] > maxObjects) {
+            __flushThreadCache(cache, sizeClass,
+                    cache->numObjects[sizeClass] / 2);
         }
-        unmapMemory(bigChunk, bigChunk->size);
+        return;
     }
+#endif
 
+    __lockHeap();
+    __freeObject(run, object);
     __unlockHeap();
 }
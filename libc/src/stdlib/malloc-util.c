@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -22,78 +22,312 @@
 #include <assert.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <string.h>
 #include "malloc.h"
+#if __is_dennix_libc
+#  include "../thread/thread.h"
+#endif
+
+// Pages are mapped in batches and pages of empty runs are kept for reuse.
+#define PAGES_PER_BATCH 16
+#define MAX_FREE_PAGES 64
+// Freed large allocations of up to this many pages are kept for reuse, up to
+// MAX_FREE_PAGES pages in total. Large allocations of a single page use the
+// same pages as runs.
+#define MAX_CACHED_LARGE_PAGES 8
 
-static Chunk emptyBigChunk[2] = {
-    {MAGIC_BIG_CHUNK, sizeof(emptyBigChunk), NULL, NULL},
-    {MAGIC_END_CHUNK, 0, NULL, NULL}
-};
+Run* __partialRuns[NUM_SIZE_CLASSES];
+static void* cachedLarge[MAX_CACHED_LARGE_PAGES + 1];
+static void* freePages;
+static size_t numCachedLargePages;
+static size_t numFreePages;
 
-Chunk* __firstBigChunk = emptyBigChunk;
+static void* mapPages(size_t size) {
+    void* result = mapMemory(size);
+#if __is_dennix_libc
+    if (result == MAP_FAILED) return NULL;
+#endif
+    return result;
+}
 
-Chunk* __allocateBigChunk(Chunk* lastBigChunk, size_t size) {
-    assert(lastBigChunk->magic == MAGIC_BIG_CHUNK);
+// These functions need to be called with the heap locked.
+static void* allocatePage(void) {
+    if (!freePages) {
+        char* pages = mapPages(PAGES_PER_BATCH * PAGESIZE);
+        if (!pages) return NULL;
+        for (size_t i = 0; i < PAGES_PER_BATCH; i++) {
+            *(void**) (pages + i * PAGESIZE) = freePages;
+            freePages = pages + i * PAGESIZE;
+        }
+        numFreePages += PAGES_PER_BATCH;
+    }
 
-    size += 3 * sizeof(Chunk);
-    size = alignUp(size, PAGESIZE);
+    void* page = freePages;
+    freePages = *(void**) page;
+    numFreePages--;
+    return page;
+}
 
-    if (size < 4 * PAGESIZE) {
-        size = 4 * PAGESIZE;
+static void freePage(void* page) {
+    if (numFreePages >= MAX_FREE_PAGES) {
+        unmapMemory(page, PAGESIZE);
+        return;
     }
 
-    Chunk* bigChunk = mapMemory(size);
+    *(void**) page = freePages;
+    freePages = page;
+    numFreePages++;
+}
+
+void* __allocateObject(size_t sizeClass) {
+    Run* run = __partialRuns[sizeClass];
+    if (!run) {
+        run = __allocateRun(sizeClass);
+        if (!run) return NULL;
+    }
+
+    void** object = run->freeList;
+#ifdef MALLOC_DEBUG
+    if (object[1] != (void*) MAGIC_FREE_OBJECT) {
+        // A freed object has been modified.
+        abort();
+    }
+#endif
+    run->freeList = object[0];
+    run->usedObjects++;
+    if (!run->freeList) {
+        // The run is full.
+        __removeRun(run);
+    }
+    return object;
+}
+
+void* __allocateLarge(size_t size) {
+    size_t mapSize = alignUp(size + LARGE_HEADER_SIZE, PAGESIZE);
+    if (mapSize < size) return NULL;
+    size_t numPages = mapSize / PAGESIZE;
 
-    if (!bigChunk) return NULL;
+    LargeHeader* header = NULL;
+    if (numPages <= MAX_CACHED_LARGE_PAGES) {
+        __lockHeap();
+        if (numPages == 1) {
+            header = allocatePage();
+        } else if (cachedLarge[numPages]) {
+            header = cachedLarge[numPages];
+            cachedLarge[numPages] = *(void**) header;
+            numCachedLargePages -= numPages;
+        }
+        __unlockHeap();
+    }
 
-    Chunk* chunk = bigChunk + 1;
-    Chunk* endChunk = (Chunk*) ((uintptr_t) bigChunk + size - sizeof(Chunk));
+    if (!header && numPages != 1) {
+        header = mapPages(mapSize);
+    }
+    if (!header) return NULL;
 
-    bigChunk->magic = MAGIC_BIG_CHUNK;
-    bigChunk->size = size;
-    bigChunk->prev = lastBigChunk;
-    bigChunk->next = NULL;
+    header->magic = MAGIC_LARGE;
+    header->size = mapSize;
+    return (void*) ((uintptr_t) header + LARGE_HEADER_SIZE);
+}
 
-    lastBigChunk->next = bigChunk;
+Run* __allocateRun(size_t sizeClass) {
+    Run* run = allocatePage();
+    if (!run) return NULL;
 
-    chunk->magic = MAGIC_FREE_CHUNK;
-    chunk->size = size - 3 * sizeof(Chunk);
-    chunk->prev = NULL;
-    chunk->next = endChunk;
+    size_t classSize = __getClassSize(sizeClass);
+    run->magic = MAGIC_RUN;
+    run->sizeClass = sizeClass;
+    run->usedObjects = 0;
+    run->freeList = NULL;
+    run->prev = NULL;
+    run->next = __partialRuns[sizeClass];
+    if (run->next) {
+        run->next->prev = run;
+    }
+    __partialRuns[sizeClass] = run;
 
-    endChunk->magic = MAGIC_END_CHUNK;
-    endChunk->size = 0;
-    endChunk->prev = chunk;
-    endChunk->next = NULL;
+    uintptr_t object = (uintptr_t) run + PAGESIZE - classSize;
+    while (object >= (uintptr_t) run + RUN_HEADER_SIZE) {
+        void** link = (void**) object;
+        link[0] = run->freeList;
+#ifdef MALLOC_DEBUG
+        link[1] = (void*) MAGIC_FREE_OBJECT;
+#endif
+        run->freeList = link;
+        object -= classSize;
+    }
 
-    return bigChunk;
+    return run;
 }
 
-void __splitChunk(Chunk* chunk, size_t size) {
-    assert(chunk->magic == MAGIC_FREE_CHUNK);
+#ifdef MALLOC_DEBUG
+void __checkDoubleFree(Run* run, void* object) {
+    __lockHeap();
+    for (void** freeObject = run->freeList; freeObject;
+            freeObject = *freeObject) {
+        if (freeObject == object) abort();
+    }
+    __unlockHeap();
 
-    Chunk* newChunk = (Chunk*) ((uintptr_t) chunk + sizeof(Chunk) + size);
-    newChunk->magic = MAGIC_FREE_CHUNK;
-    newChunk->size = chunk->size - sizeof(Chunk) - size;
-    newChunk->prev = chunk;
-    newChunk->next = chunk->next;
+#if __is_dennix_libc
+    ThreadCache* cache = __thread_self()->mallocCache;
+    if (cache) {
+        for (void** freeObject = cache->objects[run->sizeClass]; freeObject;
+                freeObject = *freeObject) {
+            if (freeObject == object) abort();
+        }
+    }
+#endif
+}
+#endif
 
-    chunk->size = size;
-    chunk->next->prev = newChunk;
-    chunk->next = newChunk;
+void __freeObject(Run* run, void* object) {
+    if (!run->freeList) {
+        // The run was full, so it needs to be added to the list again.
+        run->next = __partialRuns[run->sizeClass];
+        if (run->next) {
+            run->next->prev = run;
+        }
+        __partialRuns[run->sizeClass] = run;
+    }
+    *(void**) object = run->freeList;
+    run->freeList = object;
+    run->usedObjects--;
+
+    // Keep the run if it is the only one of its size class so that repeated
+    // allocations and frees do not need to set up a new run every time.
+    if (run->usedObjects == 0 && (run->prev || run->next)) {
+        __removeRun(run);
+        __freeRun(run);
+    }
 }
 
-Chunk* __unifyChunks(Chunk* first, Chunk* second) {
-    assert(first->magic == MAGIC_FREE_CHUNK);
-    assert(second->magic == MAGIC_FREE_CHUNK);
+void __freeLarge(LargeHeader* header) {
+    size_t numPages = header->size / PAGESIZE;
+    header->magic = 0;
+
+    if (numPages <= MAX_CACHED_LARGE_PAGES) {
+        __lockHeap();
+        if (numPages == 1) {
+            freePage(header);
+            __unlockHeap();
+            return;
+        }
 
-    first->next = second->next;
-    first->size += sizeof(Chunk) + second->size;
-    second->next->prev = first;
+        if (numCachedLargePages + numPages <= MAX_FREE_PAGES) {
+            *(void**) header = cachedLarge[numPages];
+            cachedLarge[numPages] = header;
+            numCachedLargePages += numPages;
+            __unlockHeap();
+            return;
+        }
+        __unlockHeap();
+    }
+
+    unmapMemory(header, header->size);
+}
+
+void __freeRun(Run* run) {
+    assert(run->usedObjects == 0);
+    run->magic = 0;
+    freePage(run);
+}
+
+size_t __getSizeClass(size_t size) {
+    assert(size > 0 && size <= MAX_SMALL_SIZE);
+
+    // Sizes up to 128 bytes are rounded to multiples of 16. Larger sizes are
+    // split into four size classes per power of two.
+    if (size <= 128) return (size - 1) / 16;
+    size_t shift = sizeof(long) * CHAR_BIT - 1 - __builtin_clzl(size - 1);
+    return 8 + (shift - 7) * 4 + (((size - 1) >> (shift - 2)) & 3);
+}
+
+size_t __getClassSize(size_t sizeClass) {
+    if (sizeClass < 8) return (sizeClass + 1) * 16;
+    size_t group = (sizeClass - 8) / 4;
+    size_t step = 32 << group;
+    return (128 << group) + ((sizeClass - 8) % 4 + 1) * step;
+}
+
+void __removeRun(Run* run) {
+    if (run->prev) {
+        run->prev->next = run->next;
+    } else {
+        __partialRuns[run->sizeClass] = run->next;
+    }
+    if (run->next) {
+        run->next->prev = run->prev;
+    }
+    run->prev = NULL;
+    run->next = NULL;
+}
+
+#if __is_dennix_libc
+void __flushThreadCache(ThreadCache* cache, size_t sizeClass, size_t count) {
+    __lockHeap();
+    for (size_t i = 0; i < count; i++) {
+        void** object = cache->objects[sizeClass];
+        cache->objects[sizeClass] = object[0];
+        Run* run = (Run*) ((uintptr_t) object & ~(PAGESIZE - 1));
+        __freeObject(run, object);
+    }
+    __unlockHeap();
+    cache->numObjects[sizeClass] -= count;
+}
+
+ThreadCache* __getThreadCache(void) {
+    __thread_t self = __thread_self();
+    if (self->mallocCache) return self->mallocCache;
+
+    __lockHeap();
+    ThreadCache* cache = __allocateObject(__getSizeClass(sizeof(ThreadCache)));
+    __unlockHeap();
+    if (!cache) return NULL;
+    memset(cache, 0, sizeof(ThreadCache));
+    self->mallocCache = cache;
+    return cache;
+}
+
+void __mallocThreadExit(void) {
+    __thread_t self = __thread_self();
+    ThreadCache* cache = self->mallocCache;
+    if (!cache) return;
+
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        __flushThreadCache(cache, i, cache->numObjects[i]);
+    }
+    self->mallocCache = NULL;
+#ifdef MALLOC_DEBUG
+    ((void**) cache)[1] = (void*) MAGIC_FREE_OBJECT;
+#endif
+
+    __lockHeap();
+    Run* run = (Run*) ((uintptr_t) cache & ~(PAGESIZE - 1));
+    __freeObject(run, cache);
+    __unlockHeap();
+}
+
+bool __refillThreadCache(ThreadCache* cache, size_t sizeClass) {
+    // Fill half of the cache so that the next frees do not immediately need
+    // to flush it again.
+    size_t count = THREAD_CACHE_BYTES / 2 / __getClassSize(sizeClass);
+    if (count == 0) count = 1;
+
+    __lockHeap();
+    size_t i;
+    for (i = 0; i < count; i++) {
+        void** object = __allocateObject(sizeClass);
+        if (!object) break;
+        object[0] = cache->objects[sizeClass];
+        cache->objects[sizeClass] = object;
+    }
+    __unlockHeap();
 
-    return first;
+    cache->numObjects[sizeClass] += i;
+    return i > 0;
 }
 
-#ifdef __is_dennix_libc
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void __lockHeap(void) {
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2017, 2019 Dennis Wölfing
+/* Copyright (c) 2016, 2017, 2019, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,57 +18,51 @@
  */
 
 #include <errno.h>
-#include <stdalign.h>
-#include <stddef.h>
+#include <stdint.h>
 #include "malloc.h"
 
 void* malloc(size_t size) {
     if (size == 0) size = 1;
 
-    size = alignUp(size, 16);
+    if (size > MAX_SMALL_SIZE) {
+        void* result = __allocateLarge(size);
+        if (!result) {
+            errno = ENOMEM;
+        }
+        return result;
+    }
 
-    __lockHeap();
+    size_t sizeClass = __getSizeClass(size);
+    void** object;
 
-    Chunk* currentBigChunk = __firstBigChunk;
-    Chunk* currentChunk = currentBigChunk + 1;
+#if __is_dennix_libc
+    ThreadCache* cache = __getThreadCache();
+    if (cache) {
+        if (!cache->objects[sizeClass] &&
+                !__refillThreadCache(cache, sizeClass)) {
+            errno = ENOMEM;
+            return NULL;
+        }
 
-    while (1) {
-        switch (currentChunk->magic) {
-        case MAGIC_FREE_CHUNK:
-            if (currentChunk->size >= size) {
-                // We found a chunk!
-                if (currentChunk->size > size + sizeof(Chunk)) {
-                    // Split the chunk
-                    __splitChunk(currentChunk, size);
-                }
-                currentChunk->magic = MAGIC_USED_CHUNK;
-                __unlockHeap();
-                return (void*) (currentChunk + 1);
-            } else {
-                currentChunk = currentChunk->next;
-            }
-            break;
-        case MAGIC_USED_CHUNK:
-            currentChunk = currentChunk->next;
-            break;
-        case MAGIC_END_CHUNK:
-            if (currentBigChunk->next) {
-                currentBigChunk = currentBigChunk->next;
-                currentChunk = currentBigChunk + 1;
-            } else {
-                currentBigChunk = __allocateBigChunk(currentBigChunk, size);
-                currentChunk = currentBigChunk + 1;
-                if (!currentBigChunk) {
-                    __unlockHeap();
-                    errno = ENOMEM;
-                    return NULL;
-                }
-            }
-            break;
-        default:
-            // This shouldn't happen!
-            __unlockHeap();
+        object = cache->objects[sizeClass];
+#  ifdef MALLOC_DEBUG
+        if (object[1] != (void*) MAGIC_FREE_OBJECT) {
+            // A freed object has been modified.
             abort();
         }
+#  endif
+        cache->objects[sizeClass] = object[0];
+        cache->numObjects[sizeClass]--;
+        return object;
+    }
+#endif
+
+    __lockHeap();
+    object = __allocateObject(sizeClass);
+    __unlockHeap();
+
+    if (!object) {
+        errno = ENOMEM;
     }
+    return object;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019, 2022 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -21,6 +21,7 @@
 #define MALLOC_H
 
 #include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #if __is_dennix_libc
@@ -38,25 +39,78 @@ extern void __unmapMemory(void*, size_t);
 #  define unmapMemory(addr, size) __unmapMemory(addr, size)
 #endif
 
-typedef struct Chunk {
+// Small allocations are rounded up to one of a few size classes. Objects of
+// the same size class are allocated from runs. A run is a page that starts
+// with a run header followed by objects. Free objects are kept in a list.
+// Large allocations start with a header at the beginning of the first page. So
+// the header belonging to an allocation can always be found at the beginning
+// of its page. Large allocations of a single page use the same pages as runs
+// and freed ones of a few pages are cached so that they do not need to be
+// mapped again.
+
+typedef struct Run {
+    size_t magic;
+    size_t sizeClass;
+    size_t usedObjects;
+    void* freeList;
+    struct Run* prev;
+    struct Run* next;
+} Run;
+
+typedef struct {
     size_t magic;
     size_t size;
-    struct Chunk* prev;
-    struct Chunk* next;
-} Chunk;
+} LargeHeader;
 
-#define MAGIC_BIG_CHUNK 0xC001C0DE
-#define MAGIC_FREE_CHUNK 0xBEEFBEEF
-#define MAGIC_USED_CHUNK 0xDEADBEEF
-#define MAGIC_END_CHUNK 0xDEADDEAD
+#define MAGIC_RUN 0xC001C0DE
+#define MAGIC_LARGE 0xDEADBEEF
+#define MAGIC_FREE_OBJECT 0xBEEFBEEF
 
 #define alignUp(val, alignment) ((((val) - 1) & ~((alignment) - 1)) + (alignment))
 
-extern Chunk* __firstBigChunk;
+#define RUN_HEADER_SIZE alignUp(sizeof(Run), 16)
+#define LARGE_HEADER_SIZE 16
+#define NUM_SIZE_CLASSES 20
+#define MAX_SMALL_SIZE 1024
+
+// Build with -DMALLOC_DEBUG to detect double frees and writes to freed small
+// objects. Freed objects are then marked with MAGIC_FREE_OBJECT.
+
+#if __is_dennix_libc
+// Each thread caches some free objects of each size class so that most
+// allocations and frees do not need to lock the heap. Objects are moved
+// between the cache and the heap in batches. An object freed by another
+// thread than the one that allocated it goes into the cache of the freeing
+// thread and will eventually be returned to its run.
+typedef struct {
+    void* objects[NUM_SIZE_CLASSES];
+    size_t numObjects[NUM_SIZE_CLASSES];
+} ThreadCache;
+
+// The number of bytes that may be cached per size class and thread.
+#define THREAD_CACHE_BYTES 4096
+
+void __flushThreadCache(ThreadCache* cache, size_t sizeClass, size_t count);
+ThreadCache* __getThreadCache(void);
+bool __refillThreadCache(ThreadCache* cache, size_t sizeClass);
+#endif
+
+extern Run* __partialRuns[NUM_SIZE_CLASSES];
+
+// These functions need to be called with the heap locked.
+void* __allocateObject(size_t sizeClass);
+Run* __allocateRun(size_t sizeClass);
+void __freeObject(Run* run, void* object);
+void __freeRun(Run* run);
+void __removeRun(Run* run);
 
-Chunk* __allocateBigChunk(Chunk* lastBigChunk, size_t size);
-void __splitChunk(Chunk* chunk, size_t size);
-Chunk* __unifyChunks(Chunk* first, Chunk* second);
+void* __allocateLarge(size_t size);
+#ifdef MALLOC_DEBUG
+void __checkDoubleFree(Run* run, void* object);
+#endif
+void __freeLarge(LargeHeader* header);
+size_t __getClassSize(size_t sizeClass);
+size_t __getSizeClass(size_t size);
 
 void __lockHeap(void);
 void __unlockHeap(void);
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019, 2020 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2020, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,70 +17,44 @@
  * Changes the size of an allocation.
  */
 
-#include <assert.h>
-#include <stdalign.h>
-#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/types.h>
 #include "malloc.h"
 
-static void changeChunkSize(Chunk* chunk, ssize_t sizeDiff) {
-    Chunk* next = chunk->next;
-
-    Chunk* newNextChunk = (Chunk*) ((uintptr_t) next + sizeDiff);
-    memmove(newNextChunk, next, sizeof(Chunk));
-    chunk->next = newNextChunk;
-
-    chunk->size += sizeDiff;
-    newNextChunk->size -= sizeDiff;
-
-    if (newNextChunk->next) {
-        newNextChunk->next->prev = newNextChunk;
-    }
-}
-
 void* realloc(void* addr, size_t size) {
     if (addr == NULL) return malloc(size);
-
-    __lockHeap();
-
-    Chunk* chunk = (Chunk*) addr - 1;
-    assert(chunk->magic == MAGIC_USED_CHUNK);
-
     if (size == 0) size = 1;
-    size = alignUp(size, 16);
 
-    ssize_t sizeDiff = size - chunk->size;
-
-    Chunk* next = chunk->next;
-
-    if (sizeDiff == 0) {
-        __unlockHeap();
-        return addr;
-    }
-
-    if (next->magic == MAGIC_FREE_CHUNK) {
-        // The next chunk is free so we can move its chunk header freely
-        if ((sizeDiff > 0 && next->size > sizeDiff + sizeof(Chunk)) ||
-                sizeDiff < 0) {
-            changeChunkSize(chunk, sizeDiff);
-
-            __unlockHeap();
+    size_t* header = (size_t*) ((uintptr_t) addr & ~(PAGESIZE - 1));
+    size_t oldSize;
+    if (*header == MAGIC_LARGE) {
+        LargeHeader* large = (LargeHeader*) header;
+        oldSize = large->size - LARGE_HEADER_SIZE;
+
+        if (size > MAX_SMALL_SIZE && size <= oldSize) {
+            // Unmap pages that are no longer needed.
+            size_t newMapSize = alignUp(size + LARGE_HEADER_SIZE, PAGESIZE);
+            if (newMapSize < large->size) {
+                unmapMemory((char*) large + newMapSize,
+                        large->size - newMapSize);
+                large->size = newMapSize;
+            }
             return addr;
         }
+    } else if (*header == MAGIC_RUN) {
+        Run* run = (Run*) header;
+        oldSize = __getClassSize(run->sizeClass);
+        if (size <= MAX_SMALL_SIZE &&
+                __getSizeClass(size) == run->sizeClass) {
+            return addr;
+        }
+    } else {
+        abort();
     }
 
-    // TODO: If we could not resize the next chunk we could also try to split
-    // or unify chunks to avoid copying.
-
-    __unlockHeap();
-
-    // Create a new chunk and copy the contents to it
     void* newAddress = malloc(size);
     if (!newAddress) return NULL;
-    size_t copySize = sizeDiff < 0 ? size : chunk->size;
-    memcpy(newAddress, addr, copySize);
+    memcpy(newAddress, addr, size < oldSize ? size : oldSize);
     free(addr);
     return newAddress;
 }
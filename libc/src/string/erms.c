@@ -0,0 +1,44 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/src/string/erms.c
+ * Detect enhanced rep movsb/stosb.
+ */
+
+#include "mem.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+// The result is cached. Racing threads will compute the same value, so no
+// synchronization is needed.
+static int erms = -1;
+
+bool __haveErms(void) {
+    if (__builtin_expect(erms < 0, 0)) {
+        unsigned int eax = 0;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        __asm__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx) :: "edx");
+        if (eax < 7) {
+            erms = 0;
+        } else {
+            eax = 7;
+            ecx = 0;
+            __asm__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx) :: "edx");
+            erms = !!(ebx & (1 << 9));
+        }
+    }
+    return erms;
+}
+#endif
@@ -0,0 +1,145 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/src/string/mem.h
+ * Internal definitions for the memory and string functions.
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// All supported architectures allow unaligned memory accesses, so the memory
+// functions work on whole words even if the pointers are misaligned.
+typedef size_t __attribute__((__may_alias__, __aligned__(1))) Word;
+typedef size_t __attribute__((__may_alias__)) AlignedWord;
+#define WORD_SIZE sizeof(size_t)
+
+// The string functions do not know the size of the string in advance. They
+// only read aligned words and vectors, which cannot cross a page boundary, so
+// they never fault by reading beyond the end of the string.
+
+#define ONES ((size_t) -1 / UCHAR_MAX)
+#define HIGHS (ONES * (UCHAR_MAX / 2 + 1))
+
+// Returns the word with every byte set to c.
+static inline size_t repeatByte(unsigned char c) {
+    return ONES * c;
+}
+
+// Returns a nonzero value if one of the bytes in the word is zero. The highest
+// bit of the first zero byte is set. Higher bytes may also be marked if they
+// are 0x01 and follow a zero byte.
+static inline size_t findZeroByte(size_t word) {
+    return (word - ONES) & ~word & HIGHS;
+}
+
+// Returns the index of the first byte marked by findZeroByte. This assumes a
+// little endian architecture.
+static inline size_t firstMarkedByte(size_t marks) {
+    return __builtin_ctzl(marks) / CHAR_BIT;
+}
+
+// A set of bytes as a bitmap. Functions like strspn use this so that each byte
+// of the string needs only a single lookup.
+#define BYTE_SET_WORD_BITS (CHAR_BIT * sizeof(size_t))
+typedef struct {
+    size_t bits[(UCHAR_MAX + 1) / BYTE_SET_WORD_BITS];
+} ByteSet;
+
+static inline void byteSetAdd(ByteSet* set, unsigned char c) {
+    set->bits[c / BYTE_SET_WORD_BITS] |= (size_t) 1 << c % BYTE_SET_WORD_BITS;
+}
+
+static inline bool byteSetContains(const ByteSet* set, unsigned char c) {
+    return set->bits[c / BYTE_SET_WORD_BITS] >> c % BYTE_SET_WORD_BITS & 1;
+}
+
+static inline void byteSetInit(ByteSet* set, const char* characters) {
+    *set = (ByteSet) {{0}};
+    while (*characters) {
+        byteSetAdd(set, *characters++);
+    }
+}
+
+#ifdef __SSE2__
+// SSE2 is always available on x86_64 but the kernel does not save the SSE
+// registers, so this is only used in userspace.
+typedef unsigned char Vector
+        __attribute__((__vector_size__(16), __may_alias__, __aligned__(1)));
+typedef unsigned char AlignedVector
+        __attribute__((__vector_size__(16), __may_alias__));
+typedef char CharVector __attribute__((__vector_size__(16)));
+#  define VECTOR_SIZE 16
+
+// Returns a mask that has bit i set if byte i of the vector is equal to c.
+static inline unsigned int findByteInVector(AlignedVector vector,
+        unsigned char c) {
+    return __builtin_ia32_pmovmskb128((CharVector) (vector ==
+            (AlignedVector) {} + c));
+}
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+// Sizes from which the string instructions are used. With ERMS (enhanced
+// rep movsb/stosb) rep movsb and rep stosb are faster than any loop for large
+// sizes. Without ERMS, rep movs and rep stos of whole words are still faster
+// than a loop. The instructions have a startup cost, so small sizes are
+// handled by loops.
+#  ifdef __SSE2__
+#    define ERMS_THRESHOLD 2048
+#  else
+#    define ERMS_THRESHOLD 128
+#  endif
+#  define REP_THRESHOLD 128
+
+bool __haveErms(void);
+
+static inline void repMovsb(void* dest, const void* src, size_t size) {
+    __asm__ __volatile__ ("rep movsb" : "+D"(dest), "+S"(src), "+c"(size)
+            :: "memory");
+}
+
+static inline void repMovsWords(void* dest, const void* src, size_t words) {
+#  ifdef __x86_64__
+    __asm__ __volatile__ ("rep movsq" : "+D"(dest), "+S"(src), "+c"(words)
+            :: "memory");
+#  else
+    __asm__ __volatile__ ("rep movsl" : "+D"(dest), "+S"(src), "+c"(words)
+            :: "memory");
+#  endif
+}
+
+static inline void repStosb(void* dest, unsigned char value, size_t size) {
+    __asm__ __volatile__ ("rep stosb" : "+D"(dest), "+c"(size) : "a"(value)
+            : "memory");
+}
+
+static inline void repStosWords(void* dest, size_t value, size_t words) {
+#  ifdef __x86_64__
+    __asm__ __volatile__ ("rep stosq" : "+D"(dest), "+c"(words) : "a"(value)
+            : "memory");
+#  else
+    __asm__ __volatile__ ("rep stosl" : "+D"(dest), "+c"(words) : "a"(value)
+            : "memory");
+#  endif
+}
+#endif
+
+#endif
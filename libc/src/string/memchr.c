@@ -1,4 +1,4 @@
-/* Copyright (c) 2018 Dennis Wölfing
+/* Copyright (c) 2018, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,13 +18,51 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 void* memchr(const void* s, int c, size_t size) {
     const unsigned char* p = s;
-    for (size_t i = 0; i < size; i++) {
-        if (p[i] == (unsigned char) c) {
-            return (void*) &p[i];
+    unsigned char uc = (unsigned char) c;
+
+#ifdef __SSE2__
+    if (size == 0) return NULL;
+
+    size_t misalign = (uintptr_t) p & (VECTOR_SIZE - 1);
+    p -= misalign;
+    // The number of bytes from p to the end of the buffer.
+    size_t remaining = size > SIZE_MAX - misalign ? SIZE_MAX : size + misalign;
+    unsigned int mask = findByteInVector(*(const AlignedVector*) p, uc) >>
+            misalign << misalign;
+
+    while (true) {
+        if (mask) {
+            size_t i = __builtin_ctz(mask);
+            return i < remaining ? (void*) (p + i) : NULL;
         }
+        if (remaining <= VECTOR_SIZE) return NULL;
+        p += VECTOR_SIZE;
+        remaining -= VECTOR_SIZE;
+        mask = findByteInVector(*(const AlignedVector*) p, uc);
+    }
+#else
+    while (size && (uintptr_t) p & (WORD_SIZE - 1)) {
+        if (*p == uc) return (void*) p;
+        p++;
+        size--;
+    }
+
+    size_t pattern = repeatByte(uc);
+    while (size >= WORD_SIZE) {
+        size_t marks = findZeroByte(*(const AlignedWord*) p ^ pattern);
+        if (marks) return (void*) (p + firstMarkedByte(marks));
+        p += WORD_SIZE;
+        size -= WORD_SIZE;
+    }
+
+    while (size--) {
+        if (*p == uc) return (void*) p;
+        p++;
     }
     return NULL;
+#endif
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,12 +18,27 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 int memcmp(const void* p1, const void* p2, size_t size) {
     const unsigned char* a = p1;
     const unsigned char* b = p2;
+    size_t i = 0;
 
-    for (size_t i = 0; i < size; i++) {
+    // Skip over equal parts quickly and then find the differing byte.
+#ifdef __SSE2__
+    for (; i + VECTOR_SIZE <= size; i += VECTOR_SIZE) {
+        CharVector equal = (CharVector) (*(const Vector*) (a + i) ==
+                *(const Vector*) (b + i));
+        if (__builtin_ia32_pmovmskb128(equal) != 0xFFFF) break;
+    }
+#endif
+
+    for (; i + WORD_SIZE <= size; i += WORD_SIZE) {
+        if (*(const Word*) (a + i) != *(const Word*) (b + i)) break;
+    }
+
+    for (; i < size; i++) {
         if (a[i] < b[i]) {
             return -1;
         } else if (a[i] > b[i]) {
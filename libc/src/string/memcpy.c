@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,13 +18,57 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 void* memcpy(void* restrict dest, const void* restrict src, size_t size) {
     unsigned char* d = dest;
     const unsigned char* s = src;
 
-    for (size_t i = 0; i < size; i++) {
-        d[i] = s[i];
+#ifdef ERMS_THRESHOLD
+    if (size >= ERMS_THRESHOLD && __haveErms()) {
+        repMovsb(d, s, size);
+        return dest;
+    }
+#endif
+
+#ifdef __SSE2__
+    if (size >= VECTOR_SIZE) {
+        // Copy the first vector unaligned and continue at the next aligned
+        // address of the destination. The last vector is also copied unaligned
+        // and may overlap with the previous one.
+        *(Vector*) d = *(const Vector*) s;
+        size_t i = VECTOR_SIZE - ((uintptr_t) d & (VECTOR_SIZE - 1));
+        for (; i + VECTOR_SIZE <= size; i += VECTOR_SIZE) {
+            *(AlignedVector*) (d + i) = *(const Vector*) (s + i);
+        }
+        *(Vector*) (d + size - VECTOR_SIZE) =
+                *(const Vector*) (s + size - VECTOR_SIZE);
+        return dest;
+    }
+#elif defined(REP_THRESHOLD)
+    if (size >= REP_THRESHOLD) {
+        // Align the destination because misaligned stores are slow.
+        *(Word*) d = *(const Word*) s;
+        size_t offset = WORD_SIZE - ((uintptr_t) d & (WORD_SIZE - 1));
+        d += offset;
+        s += offset;
+        size -= offset;
+        repMovsWords(d, s, size / WORD_SIZE);
+        d += size & ~(WORD_SIZE - 1);
+        s += size & ~(WORD_SIZE - 1);
+        size &= WORD_SIZE - 1;
+    }
+#endif
+
+    while (size >= WORD_SIZE) {
+        *(Word*) d = *(const Word*) s;
+        d += WORD_SIZE;
+        s += WORD_SIZE;
+        size -= WORD_SIZE;
+    }
+
+    while (size--) {
+        *d++ = *s++;
     }
 
     return dest;
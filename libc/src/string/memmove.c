@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,18 +18,37 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 void* memmove(void* dest, const void* src, size_t size) {
     unsigned char* d = dest;
     const unsigned char* s = src;
 
-    if (src > dest) {
-        for (size_t i = 0; i < size; i++) {
-            d[i] = s[i];
+    // Buffers that do not overlap can be copied with the faster memcpy.
+    if ((uintptr_t) d - (uintptr_t) s >= size &&
+            (uintptr_t) s - (uintptr_t) d >= size) {
+        return memcpy(dest, src, size);
+    }
+
+    // Each word is read completely before it is written, so copying whole
+    // words in the right direction is correct for any overlap.
+    if (s > d) {
+        while (size >= WORD_SIZE) {
+            *(Word*) d = *(const Word*) s;
+            d += WORD_SIZE;
+            s += WORD_SIZE;
+            size -= WORD_SIZE;
+        }
+        while (size--) {
+            *d++ = *s++;
         }
     } else {
-        for (size_t i = size; i > 0; i--) {
-            d[i - 1] = s[i - 1];
+        while (size >= WORD_SIZE) {
+            size -= WORD_SIZE;
+            *(Word*) (d + size) = *(const Word*) (s + size);
+        }
+        while (size--) {
+            d[size] = s[size];
         }
     }
 
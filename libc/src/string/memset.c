@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,12 +18,52 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 void* memset(void* dest, int value, size_t size) {
     unsigned char* p = dest;
+    unsigned char c = (unsigned char) value;
 
-    for (size_t i = 0; i < size; i++) {
-        p[i] = (unsigned char) value;
+#ifdef ERMS_THRESHOLD
+    if (size >= ERMS_THRESHOLD && __haveErms()) {
+        repStosb(p, c, size);
+        return dest;
+    }
+#endif
+
+    size_t word = repeatByte(c);
+
+#ifdef __SSE2__
+    if (size >= VECTOR_SIZE) {
+        AlignedVector vector = (AlignedVector) {} + c;
+        *(Vector*) p = vector;
+        size_t i = VECTOR_SIZE - ((uintptr_t) p & (VECTOR_SIZE - 1));
+        for (; i + VECTOR_SIZE <= size; i += VECTOR_SIZE) {
+            *(AlignedVector*) (p + i) = vector;
+        }
+        *(Vector*) (p + size - VECTOR_SIZE) = vector;
+        return dest;
+    }
+#elif defined(REP_THRESHOLD)
+    if (size >= REP_THRESHOLD) {
+        *(Word*) p = word;
+        size_t offset = WORD_SIZE - ((uintptr_t) p & (WORD_SIZE - 1));
+        p += offset;
+        size -= offset;
+        repStosWords(p, word, size / WORD_SIZE);
+        p += size & ~(WORD_SIZE - 1);
+        size &= WORD_SIZE - 1;
+    }
+#endif
+
+    while (size >= WORD_SIZE) {
+        *(Word*) p = word;
+        p += WORD_SIZE;
+        size -= WORD_SIZE;
+    }
+
+    while (size--) {
+        *p++ = c;
     }
 
     return dest;
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,13 +18,44 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 char* strchr(const char* s, int c) {
-    do {
-        if (*s == (char) c) {
-            return (char*) s;
+    unsigned char uc = (unsigned char) c;
+
+    // Find the first byte that is either c or the terminating null byte.
+#ifdef __SSE2__
+    size_t misalign = (uintptr_t) s & (VECTOR_SIZE - 1);
+    const char* p = s - misalign;
+    AlignedVector vector = *(const AlignedVector*) p;
+    unsigned int mask = (findByteInVector(vector, uc) |
+            findByteInVector(vector, 0)) >> misalign << misalign;
+
+    while (!mask) {
+        p += VECTOR_SIZE;
+        vector = *(const AlignedVector*) p;
+        mask = findByteInVector(vector, uc) | findByteInVector(vector, 0);
+    }
+    p += __builtin_ctz(mask);
+#else
+    const char* p = s;
+    while ((uintptr_t) p & (WORD_SIZE - 1)) {
+        if (*p == (char) uc || !*p) {
+            return *p == (char) uc ? (char*) p : NULL;
         }
-    } while (*s++);
+        p++;
+    }
+
+    size_t pattern = repeatByte(uc);
+    size_t marks;
+    while (true) {
+        size_t word = *(const AlignedWord*) p;
+        marks = findZeroByte(word) | findZeroByte(word ^ pattern);
+        if (marks) break;
+        p += WORD_SIZE;
+    }
+    p += firstMarkedByte(marks);
+#endif
 
-    return NULL;
+    return *p == (char) uc ? (char*) p : NULL;
 }
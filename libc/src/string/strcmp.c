@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,21 +18,55 @@
  */
 
 #include <string.h>
+#include "mem.h"
+
+#ifdef __SSE2__
+#  define CHUNK_SIZE VECTOR_SIZE
+#else
+#  define CHUNK_SIZE WORD_SIZE
+#endif
 
 int strcmp(const char* str1, const char* str2) {
     const unsigned char* s1 = (const unsigned char*) str1;
     const unsigned char* s2 = (const unsigned char*) str2;
 
-    while (*s1 || *s2) {
-        if (*s1 < *s2) {
-            return -1;
-        } else if (*s1 > *s2) {
-            return 1;
+    // Compare bytewise until s1 is aligned. After that whole chunks are
+    // compared with aligned reads from s1 and unaligned reads from s2 as long
+    // as the unaligned read does not cross a page boundary.
+    size_t bytes = -(uintptr_t) s1 & (CHUNK_SIZE - 1);
+
+    while (true) {
+        for (; bytes > 0; bytes--) {
+            if (*s1 != *s2 || !*s1) {
+                return *s1 < *s2 ? -1 : *s1 > *s2;
+            }
+            s1++;
+            s2++;
         }
 
-        s1++;
-        s2++;
-    }
+        if (((uintptr_t) s2 & (PAGESIZE - 1)) > PAGESIZE - CHUNK_SIZE) {
+            bytes = CHUNK_SIZE;
+            continue;
+        }
 
-    return 0;
+#ifdef __SSE2__
+        AlignedVector a = *(const AlignedVector*) s1;
+        AlignedVector b = *(const Vector*) s2;
+        unsigned int mask = (findByteInVector((AlignedVector) (a == b), 0) |
+                findByteInVector(a, 0));
+        if (mask) {
+            size_t i = __builtin_ctz(mask);
+            return s1[i] < s2[i] ? -1 : s1[i] > s2[i];
+        }
+#else
+        size_t a = *(const AlignedWord*) s1;
+        size_t b = *(const Word*) s2;
+        if (a != b || findZeroByte(a)) {
+            bytes = CHUNK_SIZE;
+            continue;
+        }
+#endif
+        s1 += CHUNK_SIZE;
+        s2 += CHUNK_SIZE;
+    }
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,19 +18,24 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 size_t strcspn(const char* string, const char* characters) {
-    size_t result = 0;
+    const unsigned char* s = (const unsigned char*) string;
 
-    while (string[result]) {
-        for (size_t i = 0; characters[i]; i++) {
-            if (string[result] == characters[i]) {
-                return result;
-            }
-        }
+    if (!characters[0]) return strlen(string);
+    if (!characters[1]) {
+        const char* p = strchr(string, characters[0]);
+        return p ? (size_t) (p - string) : strlen(string);
+    }
 
+    // Adding the null byte to the set stops the loop at the end of the string.
+    ByteSet set;
+    byteSetInit(&set, characters);
+    byteSetAdd(&set, '\0');
+    size_t result = 0;
+    while (!byteSetContains(&set, s[result])) {
         result++;
     }
-
     return result;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, Dennis Wölfing
+/* Copyright (c) 2016, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -18,11 +18,33 @@
  */
 
 #include <string.h>
+#include "mem.h"
 
 size_t strlen(const char* s) {
-    size_t result = 0;
-    while (*s++) {
-        result++;
+#ifdef __SSE2__
+    // Bytes before the beginning of the string are shifted out of the mask.
+    size_t misalign = (uintptr_t) s & (VECTOR_SIZE - 1);
+    const char* p = s - misalign;
+    unsigned int mask = findByteInVector(*(const AlignedVector*) p, 0) >>
+            misalign;
+    if (mask) return __builtin_ctz(mask);
+
+    while (true) {
+        p += VECTOR_SIZE;
+        mask = findByteInVector(*(const AlignedVector*) p, 0);
+        if (mask) return p + __builtin_ctz(mask) - s;
+    }
+#else
+    const char* p = s;
+    while ((uintptr_t) p & (WORD_SIZE - 1)) {
+        if (!*p) return p - s;
+        p++;
+    }
+
+    size_t marks;
+    while (!(marks = findZeroByte(*(const AlignedWord*) p))) {
+        p += WORD_SIZE;
     }
-    return result;
+    return p + firstMarkedByte(marks) - s;
+#endif
 }
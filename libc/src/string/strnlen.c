@@ -1,4 +1,4 @@
-/* Copyright (c) 2017 Dennis Wölfing
+/* Copyright (c) 2017, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -20,9 +20,6 @@
 #include <string.h>
 
 size_t strnlen(const char* s, size_t maxlen) {
-    size_t length = 0;
-    while (length < maxlen && s[length] != '\0') {
-        length++;
-    }
-    return length;
+    const char* end = memchr(s, '\0', maxlen);
+    return end ? (size_t) (end - s) : maxlen;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2018 Dennis Wölfing
+/* Copyright (c) 2018, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -20,15 +20,6 @@
 #include <string.h>
 
 char* strpbrk(const char* s1, const char* s2) {
-    while (*s1) {
-        for (size_t i = 0; s2[i]; i++) {
-            if (*s1 == s2[i]) {
-                return (char*) s1;
-            }
-        }
-
-        s1++;
-    }
-
-    return NULL;
+    s1 += strcspn(s1, s2);
+    return *s1 ? (char*) s1 : NULL;
 }
@@ -1,4 +1,4 @@
-/* Copyright (c) 2016, 2019 Dennis Wölfing
+/* Copyright (c) 2016, 2019, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,22 +17,27 @@
  * Calculates the length of a substring.
  */
 
-#include <stdbool.h>
 #include <string.h>
+#include "mem.h"
 
 size_t strspn(const char* string, const char* characters) {
-    size_t result = 0;
+    const unsigned char* s = (const unsigned char*) string;
 
-    while (true) {
-        bool found = false;
-        for (size_t i = 0; characters[i]; i++) {
-            if (string[result] == characters[i]) {
-                found = true;
-                break;
-            }
+    if (!characters[0]) return 0;
+    if (!characters[1]) {
+        size_t result = 0;
+        while (s[result] == (unsigned char) characters[0]) {
+            result++;
         }
-        if (!found) return result;
+        return result;
+    }
 
+    // The null byte is not in the set, so this stops at the end of the string.
+    ByteSet set;
+    byteSetInit(&set, characters);
+    size_t result = 0;
+    while (byteSetContains(&set, s[result])) {
         result++;
     }
+    return result;
 }
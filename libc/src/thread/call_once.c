@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,22 +17,33 @@
  * One-time initialization. (C11, called from POSIX2008)
  */
 
-#define sched_yield __sched_yield
 #include "thread.h"
 #include <stdbool.h>
 
 void __call_once(__once_t* once, void (*func)(void)) {
-    if (__atomic_load_n(once, __ATOMIC_ACQUIRE) < 2) {
-        unsigned char expected = 0;
-        if (__atomic_compare_exchange_n(once, &expected, 1, false,
-                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
-            func();
-            __atomic_store_n(once, 2, __ATOMIC_RELEASE);
-        } else {
-            while (__atomic_load_n(once, __ATOMIC_ACQUIRE) == 1) {
-                sched_yield();
-            }
+    int state = __atomic_load_n(once, __ATOMIC_ACQUIRE);
+    if (state == ONCE_DONE) return;
+
+    if (state == ONCE_INITIAL && __atomic_compare_exchange_n(once, &state,
+            ONCE_RUNNING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        func();
+        if (__atomic_exchange_n(once, ONCE_DONE, __ATOMIC_RELEASE) ==
+                ONCE_WAITING) {
+            __futex_wake(once, INT_MAX);
+        }
+        return;
+    }
+
+    // Another thread is running the function. Mark that there are waiters so
+    // that the thread wakes us when it is done.
+    while (state != ONCE_DONE) {
+        if (state == ONCE_RUNNING && !__atomic_compare_exchange_n(once,
+                &state, ONCE_WAITING, false, __ATOMIC_ACQUIRE,
+                __ATOMIC_ACQUIRE)) {
+            continue;
         }
+        __futex_wait(once, ONCE_WAITING, CLOCK_MONOTONIC, NULL);
+        state = __atomic_load_n(once, __ATOMIC_ACQUIRE);
     }
 }
 __weak_alias(__call_once, call_once);
@@ -0,0 +1,63 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/src/thread/futex.c
+ * Futexes.
+ */
+
+#include "thread.h"
+#include <stdbool.h>
+#include <dennix/futex.h>
+#include <sys/syscall.h>
+
+DEFINE_SYSCALL(SYSCALL_FUTEX, int, sys_futex,
+        (int*, int, int, const struct timespec*));
+
+int __futex_wait(int* address, int value, clockid_t clock,
+        const struct timespec* abstime) {
+    int op = FUTEX_WAIT;
+    if (abstime && clock == CLOCK_REALTIME) {
+        op |= FUTEX_CLOCK_REALTIME;
+    }
+    return sys_futex(address, op, value, abstime);
+}
+
+void __futex_wake(int* address, int count) {
+    sys_futex(address, FUTEX_WAKE, count, NULL);
+}
+
+// A lock that is UNLOCKED, LOCKED or CONTENDED. Threads that find the lock
+// locked mark it as contended and sleep, so only unlocking a contended lock
+// needs a system call.
+int __futex_lock(int* lock, clockid_t clock, const struct timespec* abstime) {
+    int expected = UNLOCKED;
+    if (__atomic_compare_exchange_n(lock, &expected, LOCKED, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    while (__atomic_exchange_n(lock, CONTENDED, __ATOMIC_ACQUIRE) != UNLOCKED) {
+        if (__futex_wait(lock, CONTENDED, clock, abstime) == ETIMEDOUT) {
+            return ETIMEDOUT;
+        }
+    }
+    return 0;
+}
+
+void __futex_unlock(int* lock) {
+    if (__atomic_exchange_n(lock, UNLOCKED, __ATOMIC_RELEASE) == CONTENDED) {
+        __futex_wake(lock, 1);
+    }
+}
@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,22 +17,21 @@
  * Broadcast a condition variable. (POSIX2008, called from C11)
  */
 
-#define sched_yield __sched_yield
 #include "thread.h"
 
 int __cond_broadcast(__cond_t* cond) {
-    while (__atomic_test_and_set(&cond->__state, __ATOMIC_ACQUIRE)) {
-        sched_yield();
-    }
+    __futex_lock(&cond->__state, CLOCK_MONOTONIC, NULL);
 
+    // Waiters are woken in the order in which they started waiting.
     while (cond->__first) {
         struct __cond_waiter* waiter = cond->__first;
         cond->__first = waiter->__next;
         __atomic_store_n(&waiter->__blocked, 0, __ATOMIC_RELEASE);
+        __futex_wake(&waiter->__blocked, 1);
     }
     cond->__last = NULL;
 
-    __atomic_clear(&cond->__state, __ATOMIC_RELEASE);
+    __futex_unlock(&cond->__state);
     return 0;
 }
 __weak_alias(__cond_broadcast, pthread_cond_broadcast);
@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,16 +17,7 @@
  * Wait on a condition variable for a given time. (called from C11)
  */
 
-#define clock_gettime __clock_gettime
-#define sched_yield __sched_yield
 #include "thread.h"
-#include <stdbool.h>
-
-static bool timespecLess(struct timespec ts1, struct timespec ts2) {
-    if (ts1.tv_sec < ts2.tv_sec) return true;
-    if (ts1.tv_sec > ts2.tv_sec) return false;
-    return ts1.tv_nsec < ts2.tv_nsec;
-}
 
 int __cond_clockwait(__cond_t* restrict cond, __mutex_t* restrict mutex,
         clockid_t clock, const struct timespec* restrict abstime) {
@@ -39,9 +30,7 @@ int __cond_clockwait(__cond_t* restrict cond, __mutex_t* restrict mutex,
         }
     }
 
-    while (__atomic_test_and_set(&cond->__state, __ATOMIC_ACQUIRE)) {
-        sched_yield();
-    }
+    __futex_lock(&cond->__state, CLOCK_MONOTONIC, NULL);
 
     __mutex_unlock(mutex);
 
@@ -56,27 +45,20 @@ int __cond_clockwait(__cond_t* restrict cond, __mutex_t* restrict mutex,
     }
     cond->__last = &waiter;
 
-    __atomic_clear(&cond->__state, __ATOMIC_RELEASE);
+    __futex_unlock(&cond->__state);
 
+    // Each waiter sleeps on its own futex so that signals wake the waiters in
+    // FIFO order.
     int result = 0;
     while (__atomic_load_n(&waiter.__blocked, __ATOMIC_ACQUIRE)) {
-        if (abstime) {
-            struct timespec now;
-            clock_gettime(clock, &now);
-
-            if (!timespecLess(now, *abstime)) {
-                result = ETIMEDOUT;
-                break;
-            }
+        if (__futex_wait(&waiter.__blocked, 1, clock, abstime) == ETIMEDOUT) {
+            result = ETIMEDOUT;
+            break;
         }
-
-        sched_yield();
     }
 
     if (result) {
-        while (__atomic_test_and_set(&cond->__state, __ATOMIC_ACQUIRE)) {
-            sched_yield();
-        }
+        __futex_lock(&cond->__state, CLOCK_MONOTONIC, NULL);
 
         // Only remove the waiter from the list if we were not unblocked
         // concurrently. In that case the waiter was already removed.
@@ -91,9 +73,11 @@ int __cond_clockwait(__cond_t* restrict cond, __mutex_t* restrict mutex,
             } else {
                 cond->__last = waiter.__prev;
             }
+        } else {
+            result = 0;
         }
 
-        __atomic_clear(&cond->__state, __ATOMIC_RELEASE);
+        __futex_unlock(&cond->__state);
     }
 
     __mutex_lock(mutex);
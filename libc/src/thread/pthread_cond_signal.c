@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,18 +17,18 @@
  * Signal a condition variable. (POSIX2008, called from C11)
  */
 
-#define sched_yield __sched_yield
 #include "thread.h"
 
 int __cond_signal(__cond_t* cond) {
-    while (__atomic_test_and_set(&cond->__state, __ATOMIC_ACQUIRE)) {
-        sched_yield();
-    }
+    __futex_lock(&cond->__state, CLOCK_MONOTONIC, NULL);
 
     if (cond->__first) {
         struct __cond_waiter* waiter = cond->__first;
         cond->__first = waiter->__next;
+        // The waiter may return as soon as __blocked is cleared. Waking a
+        // futex whose memory is no longer used is harmless.
         __atomic_store_n(&waiter->__blocked, 0, __ATOMIC_RELEASE);
+        __futex_wake(&waiter->__blocked, 1);
     }
     if (cond->__first) {
         cond->__first->__prev = NULL;
@@ -36,7 +36,7 @@ int __cond_signal(__cond_t* cond) {
         cond->__last = NULL;
     }
 
-    __atomic_clear(&cond->__state, __ATOMIC_RELEASE);
+    __futex_unlock(&cond->__state);
     return 0;
 }
 __weak_alias(__cond_signal, pthread_cond_signal);
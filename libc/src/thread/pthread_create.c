@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -116,6 +116,7 @@ int __thread_create(__thread_t* restrict thread,
     thr->mappingSize = mappingSize;
     thr->state = PREPARING;
     memset(thr->keyValues, 0, sizeof(thr->keyValues));
+    thr->mallocCache = NULL;
 
     regfork_t registers;
     prepareRegisters(&registers, wrapper, func, arg, stack, STACK_SIZE, thr);
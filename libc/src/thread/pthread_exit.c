@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -31,6 +31,9 @@ DEFINE_SYSCALL(SYSCALL_EXIT_THREAD, __noreturn void, exit_thread,
 __attribute__((weak))
 void __key_run_destructors(void) {}
 
+__attribute__((weak))
+void __mallocThreadExit(void) {}
+
 __noreturn void __thread_exit(union ThreadResult result) {
     __thread_t self = __thread_self();
 
@@ -47,6 +50,7 @@ __noreturn void __thread_exit(union ThreadResult result) {
     }
     __mutex_unlock(&__threadListMutex);
 
+    __mallocThreadExit();
     self->result = result;
 
     struct exit_thread data = {0};
@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,33 +17,30 @@
  * Try to lock a mutex within a given time. (called from C11)
  */
 
-#define clock_gettime __clock_gettime
-#define sched_yield __sched_yield
 #include "thread.h"
-#include <stdbool.h>
-
-static bool timespecLess(struct timespec ts1, struct timespec ts2) {
-    if (ts1.tv_sec < ts2.tv_sec) return true;
-    if (ts1.tv_sec > ts2.tv_sec) return false;
-    return ts1.tv_nsec < ts2.tv_nsec;
-}
 
 int __mutex_clocklock(__mutex_t* restrict mutex, clockid_t clock,
         const struct timespec* restrict abstime) {
-    while (true) {
-        int result = __mutex_trylock(mutex);
-        if (result != EBUSY) return result;
+    int result = __mutex_trylock(mutex);
+    if (result != EBUSY) return result;
 
-        if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000) {
+    if (abstime) {
+        if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) {
             return EINVAL;
         }
-        struct timespec now;
-        if (clock_gettime(clock, &now) != 0) return EINVAL;
-        if (!timespecLess(now, *abstime)) {
-            return ETIMEDOUT;
+        if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000) {
+            return EINVAL;
         }
+    }
+
+    result = __futex_lock(&mutex->__state, clock, abstime);
+    if (result) return result;
 
-        sched_yield();
+    if (mutex->__type == _MUTEX_RECURSIVE) {
+        __atomic_store_n(&mutex->__owner, __thread_self()->uthread.tid,
+                __ATOMIC_RELAXED);
+        mutex->__count = 1;
     }
+    return 0;
 }
 __weak_alias(__mutex_clocklock, pthread_mutex_clocklock);
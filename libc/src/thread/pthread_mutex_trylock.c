@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,51 +17,35 @@
  * Try to lock a mutex. (POSIX2008, called from C89)
  */
 
-#define sched_yield __sched_yield
 #include "thread.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 int __mutex_trylock(__mutex_t* mutex) {
-    if (mutex->__type == _MUTEX_NORMAL) {
-        if (__atomic_test_and_set(&mutex->__state, __ATOMIC_ACQUIRE)) {
-            return EBUSY;
-        }
-        return 0;
-    } else if (mutex->__type == _MUTEX_RECURSIVE) {
+    if (mutex->__type == _MUTEX_RECURSIVE) {
+        // Only this thread can have stored its own tid as the owner, so the
+        // owner can be checked without holding the lock.
         pid_t tid = __thread_self()->uthread.tid;
-
-        while (true) {
-            int expected = UNLOCKED;
-            if (__atomic_compare_exchange_n(&mutex->__state, &expected, BUSY,
-                    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
-                mutex->__owner = tid;
-                mutex->__count = 1;
-                __atomic_store_n(&mutex->__state, LOCKED, __ATOMIC_RELEASE);
-                return 0;
-            }
-
-            expected = LOCKED;
-            if (__atomic_compare_exchange_n(&mutex->__state, &expected, BUSY,
-                    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
-                if (mutex->__owner == tid) {
-                    if (mutex->__count == SIZE_MAX) {
-                        __atomic_store_n(&mutex->__state, LOCKED,
-                                __ATOMIC_RELAXED);
-                        return EAGAIN;
-                    }
-                    mutex->__count++;
-                    __atomic_store_n(&mutex->__state, LOCKED, __ATOMIC_RELEASE);
-                    return 0;
-                }
-                __atomic_store_n(&mutex->__state, LOCKED, __ATOMIC_RELAXED);
-                return EBUSY;
-            }
-
-            sched_yield();
+        if (__atomic_load_n(&mutex->__owner, __ATOMIC_RELAXED) == tid) {
+            if (mutex->__count == SIZE_MAX) return EAGAIN;
+            mutex->__count++;
+            return 0;
         }
+    } else if (mutex->__type != _MUTEX_NORMAL) {
+        return EINVAL;
     }
 
-    return EINVAL;
+    int expected = UNLOCKED;
+    if (!__atomic_compare_exchange_n(&mutex->__state, &expected, LOCKED,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return EBUSY;
+    }
+
+    if (mutex->__type == _MUTEX_RECURSIVE) {
+        __atomic_store_n(&mutex->__owner, __thread_self()->uthread.tid,
+                __ATOMIC_RELAXED);
+        mutex->__count = 1;
+    }
+    return 0;
 }
 __weak_alias(__mutex_trylock, pthread_mutex_trylock);
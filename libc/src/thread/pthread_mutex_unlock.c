@@ -1,4 +1,4 @@
-/* Copyright (c) 2022 Dennis Wölfing
+/* Copyright (c) 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,42 +17,24 @@
  * Unlock a mutex. (POSIX2008, called from C89)
  */
 
-#define sched_yield __sched_yield
 #include "thread.h"
 #include <errno.h>
-#include <stdbool.h>
 
 int __mutex_unlock(__mutex_t* mutex) {
-    if (mutex->__type == _MUTEX_NORMAL) {
-        __atomic_clear(&mutex->__state, __ATOMIC_RELEASE);
-        return 0;
-    } else if (mutex->__type == _MUTEX_RECURSIVE) {
-        int expected = LOCKED;
-        while (!__atomic_compare_exchange_n(&mutex->__state, &expected, BUSY,
-                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
-            if (expected == UNLOCKED) {
-                return EPERM;
-            }
-            sched_yield();
-            expected = LOCKED;
-        }
-
+    if (mutex->__type == _MUTEX_RECURSIVE) {
         pid_t tid = __thread_self()->uthread.tid;
-        if (mutex->__owner != tid) {
-            __atomic_store_n(&mutex->__state, LOCKED, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&mutex->__owner, __ATOMIC_RELAXED) != tid) {
             return EPERM;
         }
 
         mutex->__count--;
-        if (mutex->__count == 0) {
-            mutex->__owner = -1;
-            __atomic_store_n(&mutex->__state, UNLOCKED, __ATOMIC_RELEASE);
-            return 0;
-        }
-        __atomic_store_n(&mutex->__state, LOCKED, __ATOMIC_RELEASE);
-        return 0;
+        if (mutex->__count > 0) return 0;
+        __atomic_store_n(&mutex->__owner, -1, __ATOMIC_RELAXED);
+    } else if (mutex->__type != _MUTEX_NORMAL) {
+        return EINVAL;
     }
 
-    return EINVAL;
+    __futex_unlock(&mutex->__state);
+    return 0;
 }
 __weak_alias(__mutex_unlock, pthread_mutex_unlock);
@@ -1,4 +1,4 @@
-/* Copyright (c) 2022, 2023 Dennis Wölfing
+/* Copyright (c) 2022, 2023, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -40,6 +40,7 @@ struct __threadStruct {
     union ThreadResult result;
     size_t mappingSize;
     char state;
+    void* mallocCache;
     void* keyValues[PTHREAD_KEYS_MAX];
 };
 
@@ -54,7 +55,14 @@ _Static_assert(alignof(struct __threadStruct) == alignof(struct uthread),
 // Mutex states
 #define UNLOCKED 0
 #define LOCKED 1
-#define BUSY 2
+// The mutex is locked and other threads might be waiting for it.
+#define CONTENDED 2
+
+// Once states
+#define ONCE_INITIAL 0
+#define ONCE_RUNNING 1
+#define ONCE_WAITING 2
+#define ONCE_DONE 3
 
 // Thread states
 #define PREPARING 0
@@ -78,10 +86,16 @@ int __cond_broadcast(__cond_t* cond);
 int __cond_clockwait(__cond_t* restrict cond, __mutex_t* restrict mutex,
         clockid_t clock, const struct timespec* restrict abstime);
 int __cond_signal(__cond_t* cond);
+int __futex_lock(int* lock, clockid_t clock, const struct timespec* abstime);
+void __futex_unlock(int* lock);
+int __futex_wait(int* address, int value, clockid_t clock,
+        const struct timespec* abstime);
+void __futex_wake(int* address, int count);
 int __key_create(__key_t* key, void (*destructor)(void*));
 int __key_delete(__key_t key);
 void* __key_getspecific(__key_t key);
 void __key_run_destructors(void);
+void __mallocThreadExit(void);
 int __key_setspecific(__key_t key, const void* value);
 int __mutex_clocklock(__mutex_t* restrict mutex, clockid_t clock,
         const struct timespec* restrict abstime);
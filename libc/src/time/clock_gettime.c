@@ -1,4 +1,4 @@
-/* Copyright (c) 2018, 2022 Dennis Wölfing
+/* Copyright (c) 2018, 2022, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -17,9 +17,75 @@
  * Gets the current time. (POSIX2008, called from C89)
  */
 
+#include <stdbool.h>
 #include <time.h>
+#include <dennix/timepage.h>
 #include <sys/syscall.h>
 
-DEFINE_SYSCALL_GLOBAL(SYSCALL_CLOCK_GETTIME, int, __clock_gettime,
+DEFINE_SYSCALL(SYSCALL_CLOCK_GETTIME, int, sys_clock_gettime,
         (clockid_t, struct timespec*));
-DEFINE_SYSCALL_WEAK_ALIAS(__clock_gettime, clock_gettime);
+
+// The kernel passes the address of the time page to _start.
+const volatile struct __timepage* __timePage;
+
+static inline unsigned long long readTsc(void) {
+    unsigned int low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a"(low), "=d"(high));
+    return (unsigned long long) high << 32 | low;
+}
+
+static bool readTimePage(clockid_t clock, struct timespec* ts) {
+    const volatile struct __timepage* page = __timePage;
+    if (!page || !page->tscEnabled) return false;
+
+    struct timespec base;
+    unsigned long long delta;
+    unsigned long long multiplier;
+    unsigned long long fraction;
+    unsigned long long maxDelta;
+
+    while (true) {
+        unsigned int sequence = __atomic_load_n(&page->sequence,
+                __ATOMIC_ACQUIRE);
+        if (sequence & 1) continue;
+
+        if (clock == CLOCK_MONOTONIC) {
+            base = page->monotonic;
+        } else {
+            base = page->realtime;
+        }
+        multiplier = page->tscMultiplier;
+        fraction = page->tscFraction;
+        maxDelta = page->tscMaxDelta;
+        delta = readTsc() - page->tscBase;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == sequence) {
+            break;
+        }
+    }
+
+    // If the page has not been updated for a long time, the kernel needs to
+    // update the clocks first.
+    if (delta >= maxDelta) return false;
+
+    // The delta is less than the TSC frequency, so this is at most about one
+    // second.
+    long nanoseconds = (delta * multiplier + fraction) >> 32;
+    ts->tv_sec = base.tv_sec;
+    ts->tv_nsec = base.tv_nsec + nanoseconds;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+    return true;
+}
+
+int __clock_gettime(clockid_t clock, struct timespec* ts) {
+    if ((clock == CLOCK_MONOTONIC || clock == CLOCK_REALTIME) &&
+            readTimePage(clock, ts)) {
+        return 0;
+    }
+    return sys_clock_gettime(clock, ts);
+}
+__weak_alias(__clock_gettime, clock_gettime);
@@ -0,0 +1,30 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/src/unistd/nice.c
+ * Change the nice value. (POSIX2008, XSI)
+ */
+
+#define getpriority __getpriority
+#define setpriority __setpriority
+#include <sys/resource.h>
+#include <unistd.h>
+
+int nice(int increment) {
+    // Getting the nice value of the current process cannot fail.
+    int value = getpriority(PRIO_PROCESS, 0);
+    if (setpriority(PRIO_PROCESS, 0, value + increment) < 0) return -1;
+    return getpriority(PRIO_PROCESS, 0);
+}
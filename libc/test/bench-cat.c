@@ -0,0 +1,66 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-cat.c
+ * Measures the throughput of reading a file sequentially.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// The file is read like cat(1) does it. Only the first run after booting
+// reads the file from the disk, later runs measure reading from the cache.
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        errx(1, "usage: %s FILE [BUFFER-SIZE]", argv[0]);
+    }
+    size_t bufferSize = argc >= 3 ? strtoul(argv[2], NULL, 10) : 4096;
+    if (bufferSize == 0) errx(1, "invalid buffer size");
+
+    char* buffer = malloc(bufferSize);
+    if (!buffer) err(1, "malloc");
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) err(1, "'%s'", argv[1]);
+
+    long long start = getTime();
+    long long total = 0;
+    while (1) {
+        ssize_t bytesRead = read(fd, buffer, bufferSize);
+        if (bytesRead < 0) err(1, "read");
+        if (bytesRead == 0) break;
+        total += bytesRead;
+    }
+    long long duration = getTime() - start;
+    if (duration == 0) duration = 1;
+
+    printf("read %lld bytes in %lld us\n", total, duration / 1000);
+    printf("throughput: %lld KiB/s\n",
+            total / 1024 * 1000000000LL / duration);
+
+    close(fd);
+    free(buffer);
+}
@@ -0,0 +1,59 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-clock.c
+ * Measures the cost and resolution of clock_gettime.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+
+static long long toNanoseconds(const struct timespec* ts) {
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void benchmark(const char* name, clockid_t clock) {
+    struct timespec start;
+    struct timespec now;
+    if (clock_gettime(clock, &start) < 0) err(1, "clock_gettime");
+
+    long long previous = toNanoseconds(&start);
+    long long smallestStep = -1;
+    for (int i = 0; i < ITERATIONS; i++) {
+        clock_gettime(clock, &now);
+        long long time = toNanoseconds(&now);
+        if (time < previous) {
+            errx(1, "%s clock went backwards by %lld ns", name,
+                    previous - time);
+        }
+        if (time != previous && (smallestStep < 0 ||
+                time - previous < smallestStep)) {
+            smallestStep = time - previous;
+        }
+        previous = time;
+    }
+
+    long long duration = previous - toNanoseconds(&start);
+    printf("%s: %lld ns per call, smallest step %lld ns\n", name,
+            duration / ITERATIONS, smallestStep);
+}
+
+int main(void) {
+    benchmark("CLOCK_MONOTONIC", CLOCK_MONOTONIC);
+    benchmark("CLOCK_REALTIME", CLOCK_REALTIME);
+}
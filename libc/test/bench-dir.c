@@ -0,0 +1,83 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-dir.c
+ * Measures creating, looking up and removing many files in a directory.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// The directory is created by the benchmark and removed again at the end.
+// Lookups of files in a large directory are dominated by the time it takes to
+// find the directory entry.
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void report(const char* operation, long count, long long duration) {
+    if (duration == 0) duration = 1;
+    printf("%s %ld files in %lld ms (%lld ns per file)\n", operation, count,
+            duration / 1000000, duration / count);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        errx(1, "usage: %s DIRECTORY [COUNT]", argv[0]);
+    }
+    long count = argc >= 3 ? strtol(argv[2], NULL, 10) : 100000;
+    if (count <= 0) errx(1, "invalid count");
+
+    if (mkdir(argv[1], 0755) < 0) err(1, "mkdir: '%s'", argv[1]);
+    int dirFd = open(argv[1], O_SEARCH | O_DIRECTORY);
+    if (dirFd < 0) err(1, "'%s'", argv[1]);
+
+    char name[32];
+    long long start = getTime();
+    for (long i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "file%ld", i);
+        int fd = openat(dirFd, name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) err(1, "cannot create '%s'", name);
+        close(fd);
+    }
+    report("created", count, getTime() - start);
+
+    // Look up the files in a different order than they were created in.
+    start = getTime();
+    for (long i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "file%ld", (i * 7919) % count);
+        struct stat st;
+        if (fstatat(dirFd, name, &st, 0) < 0) err(1, "stat: '%s'", name);
+    }
+    report("looked up", count, getTime() - start);
+
+    start = getTime();
+    for (long i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "file%ld", i);
+        if (unlinkat(dirFd, name, 0) < 0) err(1, "unlink: '%s'", name);
+    }
+    report("removed", count, getTime() - start);
+
+    close(dirFd);
+    if (rmdir(argv[1]) < 0) err(1, "rmdir: '%s'", argv[1]);
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-latency.c
+ * Measures input-to-render latency while CPU bound processes are running.
+ */
+
+#include <err.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// A process writes timestamps into a pipe in regular intervals, simulating
+// input events. Another process waits for these events and measures the time
+// until it gets to run, which is the minimum latency for reacting to input.
+// Meanwhile some processes keep the cpu busy.
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void cpuLoad(void) {
+    volatile unsigned long counter = 0;
+    while (1) {
+        counter++;
+    }
+}
+
+static void render(int fd, int events) {
+    long long total = 0;
+    long long min = -1;
+    long long max = 0;
+
+    for (int i = 0; i < events; i++) {
+        long long timestamp;
+        if (read(fd, &timestamp, sizeof(timestamp)) != sizeof(timestamp)) {
+            err(1, "read");
+        }
+        long long latency = getTime() - timestamp;
+        total += latency;
+        if (min < 0 || latency < min) min = latency;
+        if (latency > max) max = latency;
+    }
+
+    printf("events: %d\n", events);
+    printf("min latency: %lld us\n", min / 1000);
+    printf("avg latency: %lld us\n", total / events / 1000);
+    printf("max latency: %lld us\n", max / 1000);
+}
+
+int main(int argc, char* argv[]) {
+    int loadProcesses = argc >= 2 ? atoi(argv[1]) : 2;
+    int events = argc >= 3 ? atoi(argv[2]) : 200;
+    if (loadProcesses < 0 || events <= 0) {
+        errx(1, "usage: %s [LOAD-PROCESSES [EVENTS]]", argv[0]);
+    }
+
+    pid_t* load = malloc(loadProcesses * sizeof(pid_t));
+    if (!load) err(1, "malloc");
+
+    for (int i = 0; i < loadProcesses; i++) {
+        load[i] = fork();
+        if (load[i] < 0) err(1, "fork");
+        if (load[i] == 0) {
+            cpuLoad();
+        }
+    }
+
+    int fds[2];
+    if (pipe(fds) < 0) err(1, "pipe");
+
+    pid_t renderer = fork();
+    if (renderer < 0) err(1, "fork");
+    if (renderer == 0) {
+        close(fds[1]);
+        render(fds[0], events);
+        exit(0);
+    }
+    close(fds[0]);
+
+    for (int i = 0; i < events; i++) {
+        // Wait 10 ms between events.
+        struct timespec interval = { 0, 10000000 };
+        nanosleep(&interval, NULL);
+
+        long long timestamp = getTime();
+        if (write(fds[1], &timestamp, sizeof(timestamp)) < 0) {
+            err(1, "write");
+        }
+    }
+
+    waitpid(renderer, NULL, 0);
+
+    for (int i = 0; i < loadProcesses; i++) {
+        kill(load[i], SIGKILL);
+        waitpid(load[i], NULL, 0);
+    }
+    free(load);
+}
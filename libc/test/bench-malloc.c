@@ -0,0 +1,166 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-malloc.c
+ * Measures the performance of malloc and free.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SLOTS 1024
+
+static void* slots[SLOTS];
+static unsigned long seed = 1;
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// A simple deterministic generator so that every run does the same work.
+static unsigned long nextRandom(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static void freeAll(void) {
+    for (size_t i = 0; i < SLOTS; i++) {
+        free(slots[i]);
+        slots[i] = NULL;
+    }
+}
+
+// Allocates and frees objects of the same size in batches.
+static void batch(size_t size, long iterations) {
+    for (long i = 0; i < iterations; i += SLOTS) {
+        for (size_t j = 0; j < SLOTS; j++) {
+            slots[j] = malloc(size);
+            if (!slots[j]) err(1, "malloc");
+        }
+        freeAll();
+    }
+}
+
+// Replaces random objects with objects of random sizes up to maxSize. This
+// fragments the heap like long running programs do.
+static void mixed(size_t maxSize, long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        size_t slot = nextRandom() % SLOTS;
+        free(slots[slot]);
+        slots[slot] = malloc(nextRandom() % maxSize + 1);
+        if (!slots[slot]) err(1, "malloc");
+    }
+    freeAll();
+}
+
+// Grows objects with realloc like a string buffer.
+static void grow(long iterations) {
+    for (long i = 0; i < iterations; i += 64) {
+        char* buffer = NULL;
+        for (size_t size = 16; size <= 16 * 64; size += 16) {
+            buffer = realloc(buffer, size);
+            if (!buffer) err(1, "realloc");
+            buffer[size - 1] = 0;
+        }
+        free(buffer);
+    }
+}
+
+// Allocates and frees small objects in a thread. Every thread uses its own
+// objects, so the threads only compete for the allocator.
+static void* threadMain(void* arg) {
+    long iterations = *(long*) arg;
+    void* objects[64] = {0};
+    for (long i = 0; i < iterations; i++) {
+        size_t slot = i * 7 % 64;
+        free(objects[slot]);
+        objects[slot] = malloc(i % 256 + 1);
+        if (!objects[slot]) err(1, "malloc");
+    }
+    for (size_t i = 0; i < 64; i++) {
+        free(objects[i]);
+    }
+    return NULL;
+}
+
+static void threads(long numThreads, long iterations) {
+    pthread_t thread[numThreads];
+    for (long i = 0; i < numThreads; i++) {
+        errno = pthread_create(&thread[i], NULL, threadMain, &iterations);
+        if (errno) err(1, "pthread_create");
+    }
+    for (long i = 0; i < numThreads; i++) {
+        pthread_join(thread[i], NULL);
+    }
+}
+
+// With multiple threads the time is the wall time per operation of a single
+// thread, so it stays the same if the allocator scales perfectly.
+static void report(const char* name, long long start, long iterations) {
+    long long duration = getTime() - start;
+    printf("%-24s %8lld ns/op\n", name, duration / iterations);
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc >= 2 ? atol(argv[1]) : 100000;
+    long numThreads = argc >= 3 ? atol(argv[2]) : 4;
+    if (iterations <= 0 || numThreads <= 0) {
+        errx(1, "usage: %s [ITERATIONS [THREADS]]", argv[0]);
+    }
+
+    long long start = getTime();
+    batch(16, iterations);
+    report("small (16 bytes)", start, iterations);
+
+    start = getTime();
+    batch(200, iterations);
+    report("small (200 bytes)", start, iterations);
+
+    start = getTime();
+    batch(1000, iterations);
+    report("small (1000 bytes)", start, iterations);
+
+    start = getTime();
+    batch(64 * 1024, iterations / 16);
+    report("large (64 KiB)", start, iterations / 16);
+
+    start = getTime();
+    mixed(512, iterations);
+    report("mixed small", start, iterations);
+
+    start = getTime();
+    mixed(16 * 1024, iterations / 4);
+    report("mixed small and large", start, iterations / 4);
+
+    start = getTime();
+    grow(iterations);
+    report("realloc growth", start, iterations);
+
+    start = getTime();
+    threads(1, iterations);
+    report("1 thread", start, iterations);
+
+    start = getTime();
+    threads(numThreads, iterations);
+    char name[32];
+    snprintf(name, sizeof(name), "%ld threads", numThreads);
+    report(name, start, iterations);
+}
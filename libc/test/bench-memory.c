@@ -0,0 +1,84 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-memory.c
+ * Measures the throughput of memcpy, memmove, memset and memcmp.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SIZE (1024 * 1024)
+// Every measurement processes about this many bytes.
+#define BYTES_PER_SIZE (256 * 1024 * 1024LL)
+
+static unsigned char* buffer1;
+static unsigned char* buffer2;
+static volatile int sink;
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// The buffers are offset by a few bytes to also measure misaligned accesses.
+static long long measure(int function, size_t size, size_t misalign) {
+    long iterations = BYTES_PER_SIZE / size;
+    unsigned char* a = buffer1 + misalign;
+    unsigned char* b = buffer2;
+
+    long long start = getTime();
+    for (long i = 0; i < iterations; i++) {
+        switch (function) {
+        case 0: memcpy(a, b, size); break;
+        case 1: memmove(a + 1, a, size); break;
+        case 2: memset(a, i, size); break;
+        case 3: sink = memcmp(a, a + MAX_SIZE + 32, size); break;
+        }
+    }
+    long long duration = getTime() - start;
+    if (duration == 0) duration = 1;
+    return iterations * (long long) size * 1000000000LL / 1024 / 1024 /
+            duration;
+}
+
+int main(int argc, char* argv[]) {
+    size_t misalign = argc >= 2 ? strtoul(argv[1], NULL, 10) % 64 : 0;
+
+    // memcmp compares two equal halves of buffer1 so that it has to look at
+    // all bytes.
+    buffer1 = malloc(2 * MAX_SIZE + 128);
+    buffer2 = malloc(MAX_SIZE + 64);
+    if (!buffer1 || !buffer2) err(1, "malloc");
+    memset(buffer1, 'a', 2 * MAX_SIZE + 128);
+    memset(buffer2, 'b', MAX_SIZE + 64);
+
+    printf("%8s %10s %10s %10s %10s (MiB/s)\n", "size", "memcpy", "memmove",
+            "memset", "memcmp");
+    for (size_t size = 8; size <= MAX_SIZE; size *= 2) {
+        printf("%8zu", size);
+        for (int function = 0; function < 4; function++) {
+            printf(" %10lld", measure(function, size, misalign));
+        }
+        printf("\n");
+    }
+
+    free(buffer1);
+    free(buffer2);
+}
@@ -0,0 +1,166 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/bench-string.c
+ * Compares the string functions with simple byte-by-byte implementations.
+ */
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LENGTH (64 * 1024)
+// Every measurement processes about this many bytes.
+#define BYTES_PER_LENGTH (64 * 1024 * 1024LL)
+
+static char* string1;
+static char* string2;
+static volatile size_t sink;
+
+// These are the byte-by-byte implementations that libc used before.
+
+static size_t scalarStrlen(const char* s) {
+    size_t result = 0;
+    while (*s++) {
+        result++;
+    }
+    return result;
+}
+
+static char* scalarStrchr(const char* s, int c) {
+    do {
+        if (*s == (char) c) {
+            return (char*) s;
+        }
+    } while (*s++);
+
+    return NULL;
+}
+
+static void* scalarMemchr(const void* s, int c, size_t size) {
+    const unsigned char* p = s;
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] == (unsigned char) c) {
+            return (void*) &p[i];
+        }
+    }
+    return NULL;
+}
+
+static int scalarStrcmp(const char* str1, const char* str2) {
+    const unsigned char* s1 = (const unsigned char*) str1;
+    const unsigned char* s2 = (const unsigned char*) str2;
+
+    while (*s1 || *s2) {
+        if (*s1 < *s2) {
+            return -1;
+        } else if (*s1 > *s2) {
+            return 1;
+        }
+
+        s1++;
+        s2++;
+    }
+
+    return 0;
+}
+
+static size_t scalarStrspn(const char* string, const char* characters) {
+    size_t result = 0;
+
+    while (true) {
+        bool found = false;
+        for (size_t i = 0; characters[i]; i++) {
+            if (string[result] == characters[i]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) return result;
+
+        result++;
+    }
+}
+
+static long long getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static size_t run(int function, bool scalar, size_t length) {
+    const char* s = string1 + MAX_LENGTH - length;
+    const char* s2 = string2 + MAX_LENGTH - length;
+
+    switch (function) {
+    case 0: return scalar ? scalarStrlen(s) : strlen(s);
+    case 1: return (size_t) (scalar ? scalarStrchr(s, 'x') : strchr(s, 'x'));
+    case 2: return (size_t) (scalar ? scalarMemchr(s, 'x', length) :
+            memchr(s, 'x', length));
+    case 3: return scalar ? scalarStrcmp(s, s2) : strcmp(s, s2);
+    default: return scalar ? scalarStrspn(s, " \tab") : strspn(s, " \tab");
+    }
+}
+
+// Returns the throughput in MiB/s.
+static long long measure(int function, bool scalar, size_t length) {
+    long iterations = BYTES_PER_LENGTH / length;
+    long long start = getTime();
+    for (long i = 0; i < iterations; i++) {
+        sink = run(function, scalar, length);
+    }
+    long long duration = getTime() - start;
+    if (duration == 0) duration = 1;
+    return iterations * (long long) length * 1000000000LL / 1024 / 1024 /
+            duration;
+}
+
+int main(int argc, char* argv[]) {
+    // The strings are misaligned by default so that the alignment handling is
+    // included in the measurement.
+    size_t misalign = argc >= 2 ? strtoul(argv[1], NULL, 10) % 64 : 3;
+
+    // The strings consist of characters that are found by strspn but not by
+    // strchr and memchr. string2 is offset against string1 so that strcmp
+    // compares differently aligned strings.
+    string1 = malloc(MAX_LENGTH + 64);
+    string2 = malloc(MAX_LENGTH + 64);
+    if (!string1 || !string2) err(1, "malloc");
+    string1 += misalign;
+    string2 += 64 - misalign;
+    for (size_t i = 0; i < MAX_LENGTH; i++) {
+        string1[i] = string2[i] = "ab \t"[i % 4];
+    }
+    string1[MAX_LENGTH] = string2[MAX_LENGTH] = '\0';
+
+    const char* names[] = { "strlen", "strchr", "memchr", "strcmp", "strspn" };
+    printf("%8s", "length");
+    for (int function = 0; function < 5; function++) {
+        printf(" %15s", names[function]);
+    }
+    printf(" (MiB/s, old/new)\n");
+
+    for (size_t length = 16; length <= MAX_LENGTH; length *= 4) {
+        printf("%8zu", length);
+        for (int function = 0; function < 5; function++) {
+            printf(" %7lld/%7lld", measure(function, true, length),
+                    measure(function, false, length));
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/test-fallocate.c
+ * Tests posix_fallocate.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The test creates a temporary file in the current directory. It should be
+// run on a writable filesystem.
+
+static off_t getSize(int fd) {
+    struct stat st;
+    assert(fstat(fd, &st) == 0);
+    return st.st_size;
+}
+
+int main(void) {
+    char path[] = "test-fallocate-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    int readOnlyFd = open(path, O_RDONLY);
+    assert(readOnlyFd >= 0);
+    unlink(path);
+
+    // Extending the file fills it with zeros.
+    assert(write(fd, "abc", 3) == 3);
+    assert(posix_fallocate(fd, 1, 100000) == 0);
+    assert(getSize(fd) == 100001);
+
+    char buffer[4096];
+    assert(pread(fd, buffer, 3, 0) == 3);
+    assert(buffer[0] == 'a' && buffer[1] == 'b' && buffer[2] == 'c');
+    for (off_t offset = 3; offset < 100001; offset += sizeof(buffer)) {
+        ssize_t size = pread(fd, buffer, sizeof(buffer), offset);
+        assert(size > 0);
+        for (ssize_t i = 0; i < size; i++) {
+            assert(buffer[i] == 0);
+        }
+    }
+
+    // Allocating space inside of the file does not change it.
+    assert(posix_fallocate(fd, 0, 10) == 0);
+    assert(getSize(fd) == 100001);
+
+    // Writes to the allocated space do not change the size.
+    assert(pwrite(fd, "x", 1, 50000) == 1);
+    assert(getSize(fd) == 100001);
+
+    errno = 0;
+    assert(posix_fallocate(fd, 0, 0) == EINVAL);
+    assert(posix_fallocate(fd, -1, 10) == EINVAL);
+    assert(errno == 0);
+
+    // The file must be open for writing.
+    assert(posix_fallocate(readOnlyFd, 0, 200000) == EBADF);
+    assert(getSize(readOnlyFd) == 100001);
+    close(readOnlyFd);
+    close(fd);
+    assert(posix_fallocate(fd, 0, 10) == EBADF);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(posix_fallocate(fds[1], 0, 10) == ESPIPE);
+    close(fds[0]);
+    close(fds[1]);
+}
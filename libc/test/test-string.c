@@ -0,0 +1,163 @@
+/* Copyright (c) 2026 Dennis Wölfing
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* libc/test/test-string.c
+ * Tests the string functions against simple reference implementations.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// The optimized functions work on aligned words and vectors, so all
+// combinations of alignments and lengths up to a few vectors are tested.
+#define MAX_LENGTH 80
+#define MAX_ALIGN 32
+
+static char buffer1[MAX_LENGTH + MAX_ALIGN + 64];
+static char buffer2[MAX_LENGTH + MAX_ALIGN + 64];
+static int status = 0;
+
+static size_t referenceStrlen(const char* s) {
+    size_t length = 0;
+    while (s[length]) length++;
+    return length;
+}
+
+static char* referenceStrchr(const char* s, int c) {
+    for (;; s++) {
+        if (*s == (char) c) return (char*) s;
+        if (!*s) return NULL;
+    }
+}
+
+static void* referenceMemchr(const void* s, int c, size_t size) {
+    const unsigned char* p = s;
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] == (unsigned char) c) return (void*) (p + i);
+    }
+    return NULL;
+}
+
+static int referenceStrcmp(const char* s1, const char* s2) {
+    const unsigned char* a = (const unsigned char*) s1;
+    const unsigned char* b = (const unsigned char*) s2;
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a < *b ? -1 : *a > *b;
+}
+
+static size_t referenceStrspn(const char* s, const char* characters,
+        bool complement) {
+    size_t result = 0;
+    while (s[result] &&
+            (referenceStrchr(characters, s[result]) != NULL) != complement) {
+        result++;
+    }
+    return result;
+}
+
+static int sign(int value) {
+    return value < 0 ? -1 : value > 0;
+}
+
+static void fail(const char* function, size_t align, size_t length) {
+    printf("%s failed with alignment %zu and length %zu\n", function, align,
+            length);
+    status = 1;
+}
+
+// Fills the buffer with a string of the given length. Bytes with the high bit
+// set and bytes like 0x01 and 0x80 that could confuse the zero byte detection
+// are included.
+static char* makeString(char* buffer, size_t align, size_t length) {
+    static const char bytes[] = "ab\x01\x80\xff\x7f" "c";
+    memset(buffer, 'x', sizeof(buffer1));
+    char* s = buffer + align;
+    for (size_t i = 0; i < length; i++) {
+        s[i] = bytes[i % (sizeof(bytes) - 1)];
+    }
+    s[length] = '\0';
+    return s;
+}
+
+static void testString(size_t align, size_t length) {
+    char* s = makeString(buffer1, align, length);
+
+    if (strlen(s) != referenceStrlen(s)) fail("strlen", align, length);
+    if (strnlen(s, length / 2) != length / 2) fail("strnlen", align, length);
+
+    const int characters[] = { 'a', 'c', 0x80, 0xff, 0x01, '\0', 'x', 'y' };
+    for (size_t i = 0; i < sizeof(characters) / sizeof(int); i++) {
+        int c = characters[i];
+        if (strchr(s, c) != referenceStrchr(s, c)) {
+            fail("strchr", align, length);
+        }
+        if (memchr(s, c, length) != referenceMemchr(s, c, length)) {
+            fail("memchr", align, length);
+        }
+    }
+
+    const char* sets[] = { "", "a", "ab", "ba\x01", "\x80\xff", "abc\x01\x7f" };
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+        if (strspn(s, sets[i]) != referenceStrspn(s, sets[i], false)) {
+            fail("strspn", align, length);
+        }
+        if (strcspn(s, sets[i]) != referenceStrspn(s, sets[i], true)) {
+            fail("strcspn", align, length);
+        }
+    }
+
+    // Compare with a copy at every other alignment and with copies that differ
+    // in a single byte.
+    for (size_t align2 = 0; align2 < MAX_ALIGN; align2++) {
+        char* s2 = makeString(buffer2, align2, length);
+        if (strcmp(s, s2) != 0) fail("strcmp", align, length);
+
+        for (size_t i = 0; i < length; i += 7) {
+            s2[i] = (char) 0x90;
+            if (sign(strcmp(s, s2)) != referenceStrcmp(s, s2) ||
+                    sign(strcmp(s2, s)) != referenceStrcmp(s2, s)) {
+                fail("strcmp", align, length);
+            }
+            s2[i] = '\0';
+            if (sign(strcmp(s, s2)) != referenceStrcmp(s, s2) ||
+                    sign(strcmp(s2, s)) != referenceStrcmp(s2, s)) {
+                fail("strcmp", align, length);
+            }
+            s2[i] = s[i];
+        }
+    }
+}
+
+int main(void) {
+    for (size_t align = 0; align < MAX_ALIGN; align++) {
+        for (size_t length = 0; length <= MAX_LENGTH; length++) {
+            testString(align, length);
+        }
+    }
+
+    // memchr must stop at the end of the buffer even if the byte follows.
+    char* s = makeString(buffer1, 3, 40);
+    if (memchr(s, 'x', 40) || memchr(s, '\0', 40)) {
+        fail("memchr", 3, 40);
+    }
+    if (memchr(s, '\0', SIZE_MAX) != s + 40) fail("memchr", 3, 40);
+
+    return status;
+}
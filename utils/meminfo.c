@@ -1,4 +1,4 @@
-/* Copyright (c) 2020, 2021 Dennis Wölfing
+/* Copyright (c) 2020, 2021, 2026 Dennis Wölfing
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -29,4 +29,10 @@ int main(void) {
             "free:      %9zu KiB\ncached:    %9zu KiB\n",
             info.mem_total / 1024, used / 1024, info.mem_available / 1024,
             info.mem_free / 1024, cached / 1024);
+
+    printf("\nfree blocks:\n");
+    for (size_t i = 0; i < MEMINFO_ORDERS; i++) {
+        printf("%7zu KiB: %9zu\n", ((size_t) 4 << i),
+                info.mem_free_blocks[i]);
+    }
 }